@@ -0,0 +1,52 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+//
+// per-frame stage timings collected during timedemo runs
+//
+
+typedef enum {
+    BENCH_FRAME,        // entire frame
+    BENCH_PARSE,        // demo message parsing
+    BENCH_ENTITIES,     // CL_AddEntities, includes particles
+    BENCH_PARTICLES,    // CL_AddParticles
+    BENCH_REFRESH,      // renderer CPU side entity preparation
+    BENCH_SOUND,        // sound spatialization and mixing
+    BENCH_CLIENTS,      // MVD spectator updates
+
+    BENCH_NUM_STAGES
+} benchstage_t;
+
+extern bool bench_running;
+
+void Bench_Init(void);
+void Bench_Start(const char *name);
+void Bench_Stop(void);
+void Bench_Begin(benchstage_t stage);
+void Bench_End(benchstage_t stage);
+void Bench_EndFrame(void);
+
+#define BENCH_BEGIN(stage) \
+    do { if (bench_running) Bench_Begin(stage); } while (0)
+#define BENCH_END(stage) \
+    do { if (bench_running) Bench_End(stage); } while (0)
+
+#endif // BENCH_H
@@ -147,7 +147,6 @@ typedef struct {
     int                 contents;
     int                 numsides;
     mbrushside_t        *firstbrushside;
-    int                 checkcount;        // to avoid repeated testings
 } mbrush_t;
 
 typedef struct {
@@ -280,6 +279,7 @@ typedef struct bsp_s {
 
 	byte            *pvs_matrix;
 	byte            *pvs2_matrix;
+	byte            *phs_matrix;    // NULL if over map_phs_budget
 	bool            pvs_patched;
 
     bool            extended;
@@ -32,6 +32,26 @@ typedef struct {
     bool        *portalopen;
 } cm_t;
 
+#define TRACE_CHECK_SLOTS   256     // must be power of two
+
+// trace state, traces using different contexts may run concurrently
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      offsets[8];
+    vec3_t      extents;
+    trace_t     *trace;
+    int         contents;
+    bool        ispoint;        // optimized case
+
+    // brushes already checked during current trace
+    unsigned    checkcount;
+    int         numchecked;
+    struct {
+        const mbrush_t  *brush;
+        unsigned        checkcount;
+    } checked[TRACE_CHECK_SLOTS];
+} trace_ctx_t;
+
 void        CM_Init(void);
 
 void        CM_FreeMap(cm_t *cm);
@@ -59,6 +79,15 @@ void        CM_BoxTrace(trace_t *trace,
                         const vec3_t start, const vec3_t end,
                         const vec3_t mins, const vec3_t maxs,
                         mnode_t *headnode, int brushmask);
+void        CM_BoxTraceCtx(trace_ctx_t *ctx, trace_t *trace,
+                           const vec3_t start, const vec3_t end,
+                           const vec3_t mins, const vec3_t maxs,
+                           mnode_t *headnode, int brushmask);
+void        CM_TransformedBoxTraceCtx(trace_ctx_t *ctx, trace_t *trace,
+                                      const vec3_t start, const vec3_t end,
+                                      const vec3_t mins, const vec3_t maxs,
+                                      mnode_t *headnode, int brushmask,
+                                      const vec3_t origin, const vec3_t angles);
 void        CM_TransformedBoxTrace(trace_t *trace,
                                    const vec3_t start, const vec3_t end,
                                    const vec3_t mins, const vec3_t maxs,
@@ -72,7 +101,11 @@ int         CM_BoxLeafs(cm_t *cm, const vec3_t mins, const vec3_t maxs,
                         mleaf_t **list, int listsize, mnode_t **topnode);
 mleaf_t     *CM_PointLeaf(cm_t *cm, const vec3_t p);
 
+#define MAX_FAT_CLUSTERS    64
+
 byte        *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis);
+int         CM_FatClusters(cm_t *cm, const vec3_t org, int *clusters);
+byte        *CM_ClustersPVS(cm_t *cm, byte *mask, const int *clusters, int count, int vis);
 
 void        CM_SetAreaPortalState(cm_t *cm, int portalnum, bool open);
 bool        CM_AreasConnected(cm_t *cm, int area1, int area2);
@@ -81,6 +114,7 @@ int         CM_WriteAreaBits(cm_t *cm, byte *buffer, int area);
 int         CM_WritePortalBits(cm_t *cm, byte *buffer);
 void        CM_SetPortalStates(cm_t *cm, byte *buffer, int bytes);
 bool        CM_HeadnodeVisible(mnode_t *headnode, byte *visbits);
+void        CM_HeadnodeClusters(mnode_t *headnode, byte *bits);
 
 void        CM_WritePortalState(cm_t *cm, qhandle_t f);
 void        CM_ReadPortalState(cm_t *cm, qhandle_t f);
@@ -0,0 +1,58 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEMOINDEX_H
+#define DEMOINDEX_H
+
+#include "common/zone.h"
+
+//
+// demo seek snapshots, kept sorted by frame number and optionally
+// persisted in a `<demo>.idx' sidecar file next to the demo
+//
+
+typedef struct {
+    int         framenum;
+    int64_t     filepos;
+    size_t      msglen;
+    byte        data[1];
+} demosnap_t;
+
+typedef struct {
+    demosnap_t  **snaps;
+    int         numsnaps;
+    int         maxsnaps;
+    uint32_t    key;        // identifies demo contents, 0 if not persistent
+    bool        dirty;      // has snapshots not yet in the sidecar
+    memtag_t    tag;
+    char        path[MAX_OSPATH];
+} demoindex_t;
+
+void        DemoIndex_Init(demoindex_t *index, memtag_t tag);
+void        DemoIndex_Clear(demoindex_t *index);
+demosnap_t  *DemoIndex_Add(demoindex_t *index, int framenum, int64_t filepos,
+                           const void *data, size_t len);
+demosnap_t  *DemoIndex_Find(const demoindex_t *index, int framenum);
+int         DemoIndex_LastFrame(const demoindex_t *index);
+
+uint32_t    DemoIndex_Key(const char (*configstrings)[MAX_QPATH], int count,
+                          int64_t offset, int64_t size);
+int         DemoIndex_Load(demoindex_t *index, const char *demoname, uint32_t key);
+int         DemoIndex_Save(demoindex_t *index);
+
+#endif // DEMOINDEX_H
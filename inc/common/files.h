@@ -75,6 +75,8 @@ typedef struct file_info_s {
 #define FS_FLAG_TEXT            0x00000400  // open in text mode if from disk
 #define FS_FLAG_DEFLATE         0x00000800  // if compressed in .pkz, read raw deflate data, fail otherwise
 #define FS_FLAG_LOADFILE        0x00001000  // open non-unique handle, must be closed very quickly
+#define FS_FLAG_ASYNC           0x00002000  // write from background thread, FS_Write only buffers data
+#define FS_FLAG_MAPPED          0x00004000  // FS_LoadFile may return read-only, not NUL terminated view into mapped pack
 
 //
 // Limit the maximum file size FS_LoadFile can handle, as a protection from
@@ -91,7 +93,19 @@ typedef struct file_info_s {
 #define FS_LoadFile(path, buf)  FS_LoadFileEx(path, buf, 0, TAG_FILESYSTEM)
 #define FS_LoadFileFlags(path, buf, flags)  \
                                 FS_LoadFileEx(path, buf, (flags), TAG_FILESYSTEM)
-#define FS_FreeFile(buf)        Z_Free(buf)
+
+// counters of FS_LoadFile work, for measuring load times
+typedef struct {
+    unsigned    files;          // files loaded
+    unsigned    mapped;         // files returned as views into mapped packs
+    unsigned    prefetched;     // files read ahead by FS_Prefetch
+    uint64_t    bytes_copied;
+    uint64_t    bytes_mapped;
+    unsigned    reads;          // calls to read file data
+    unsigned    seeks;
+} fs_loadstats_t;
+
+extern fs_loadstats_t   fs_loadstats;
 
 // just regular malloc for now
 #define FS_AllocTempMem(size)   FS_Malloc(size)
@@ -108,9 +122,7 @@ void    FS_Init(void);
 void    FS_Shutdown(void);
 void    FS_Restart(bool total);
 
-#if USE_CLIENT
 int FS_RenameFile(const char *from, const char *to);
-#endif
 
 int FS_CreatePath(char *path);
 
@@ -127,9 +139,13 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
     FS_FileExistsEx(path, 0)
 
 int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag);
+void FS_FreeFile(void *buf);
 // a NULL buffer will just return the file length without loading
 // length < 0 indicates error
 
+void FS_Prefetch(const char **paths, int count);
+void FS_EndPrefetch(void);
+
 int FS_WriteFile(const char *path, const void *data, size_t len);
 
 bool FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
@@ -145,6 +161,17 @@ int FS_ReadLine(qhandle_t f, char *buffer, size_t size);
 
 int FS_Flush(qhandle_t f);
 
+// statistics of file opened with FS_FLAG_ASYNC
+typedef struct {
+    int64_t     queued;     // accepted by FS_Write, not yet written
+    int64_t     written;
+    int64_t     dropped;    // discarded after write error
+    unsigned    stalls;     // times FS_Write waited for writer thread
+    unsigned    stall_msec;
+} fs_asyncstats_t;
+
+bool FS_AsyncStats(qhandle_t f, fs_asyncstats_t *stats);
+
 int64_t FS_Tell(qhandle_t f);
 int FS_Seek(qhandle_t f, int64_t offset, int whence);
 
@@ -40,6 +40,7 @@ typedef struct {
     uint16_t    frame;
     uint8_t     sound;
     uint8_t     event;
+    int16_t     velocity[3];    // origin change per frame, for bit packed deltas
 } entity_packed_t;
 
 typedef struct {
@@ -76,13 +77,16 @@ typedef enum {
     MSG_ES_UMASK        = (1 << 4),
     MSG_ES_BEAMORIGIN   = (1 << 5),
     MSG_ES_SHORTANGLES  = (1 << 6),
-    MSG_ES_REMOVE       = (1 << 7)
+    MSG_ES_REMOVE       = (1 << 7),
+    MSG_ES_BITPACKED    = (1 << 8)
 } msgEsFlags_t;
 
-extern sizebuf_t    msg_write;
+// each thread writes into its own buffer, worker threads
+// must point their msg_write at private storage before use
+extern q_thread_local sizebuf_t msg_write;
 extern byte         msg_write_buffer[MAX_MSGLEN];
 
-extern sizebuf_t    msg_read;
+extern q_thread_local sizebuf_t msg_read;
 extern byte         msg_read_buffer[MAX_MSGLEN];
 
 extern const entity_packed_t    nullEntityState;
@@ -105,8 +109,13 @@ int     MSG_WriteDeltaUsercmd(const usercmd_t *from, const usercmd_t *cmd, int v
 int     MSG_WriteDeltaUsercmd_Enhanced(const usercmd_t *from, const usercmd_t *cmd, int version);
 #endif
 void    MSG_WriteDir(const vec3_t vector);
+size_t  MSG_BuildZDictionary(byte *dict, const byte *strings, size_t stringslen,
+                             const byte *bases, size_t baseslen);
 void    MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, bool short_angles);
 void    MSG_WriteDeltaEntity(const entity_packed_t *from, const entity_packed_t *to, msgEsFlags_t flags);
+void    MSG_BeginPackedEntities(void);
+void    MSG_WritePackedEntity(const entity_packed_t *from, entity_packed_t *to, msgEsFlags_t flags, int dt);
+void    MSG_EndPackedEntities(void);
 void    MSG_PackPlayer(player_packed_t *out, const player_state_t *in);
 void    MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player_packed_t *to);
 int     MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t *from, player_packed_t *to, msgPsFlags_t flags);
@@ -142,6 +151,11 @@ void    MSG_ReadDeltaUsercmd_Hacked(const usercmd_t *from, usercmd_t *to);
 void    MSG_ReadDeltaUsercmd_Enhanced(const usercmd_t *from, usercmd_t *to, int version);
 int     MSG_ParseEntityBits(int *bits);
 void    MSG_ParseDeltaEntity(const entity_state_t *from, entity_state_t *to, int number, int bits, msgEsFlags_t flags);
+void    MSG_BeginParsingPackedEntities(void);
+int     MSG_ParsePackedEntityBits(int *bits);
+void    MSG_ParsePackedEntity(const entity_state_t *from, entity_state_t *to,
+                              const int16_t *fromvel, int16_t *tovel,
+                              int number, int bits, msgEsFlags_t flags, int dt);
 #if USE_CLIENT
 void    MSG_ParseDeltaPlayerstate_Default(const player_state_t *from, player_state_t *to, int flags);
 void    MSG_ParseDeltaPlayerstate_Enhanced(const player_state_t *from, player_state_t *to, int flags, int extraflags);
@@ -205,6 +205,7 @@ void        NET_UpdateStats(void);
 
 bool        NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
+void        NET_BatchPackets(netsrc_t sock, bool enable);
 bool        NET_SendPacket(netsrc_t sock, const void *data,
                            size_t len, const netadr_t *to);
 
@@ -236,5 +237,6 @@ extern cvar_t       *net_ip;
 extern cvar_t       *net_port;
 
 extern netadr_t     net_from;
+extern unsigned     net_time;   // arrival time of net_from packet
 
 #endif // NET_H
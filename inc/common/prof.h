@@ -0,0 +1,49 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PROF_H
+#define PROF_H
+
+//
+// CPU profiler zones, recorded into per-thread ring buffers and exported
+// in Chrome trace format. Every PROF_BEGIN must be matched by PROF_END on
+// each return path. Name must be a string literal.
+//
+
+#if USE_PROFILER
+
+extern int prof_enabled;
+
+void Prof_Init(void);
+void Prof_Begin(const char *name);
+void Prof_End(void);
+
+#define PROF_BEGIN(name) \
+    do { if (prof_enabled) Prof_Begin(name); } while (0)
+#define PROF_END() \
+    do { if (prof_enabled) Prof_End(); } while (0)
+
+#else
+
+#define Prof_Init()         (void)0
+#define PROF_BEGIN(name)    (void)0
+#define PROF_END()          (void)0
+
+#endif // !USE_PROFILER
+
+#endif // PROF_H
@@ -47,7 +47,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define PROTOCOL_VERSION_Q2PRO_SERVER_STATE     1019    // r1302
 #define PROTOCOL_VERSION_Q2PRO_EXTENDED_LAYOUT  1020    // r1354
 #define PROTOCOL_VERSION_Q2PRO_ZLIB_DOWNLOADS   1021    // r1358
-#define PROTOCOL_VERSION_Q2PRO_CURRENT          1021    // r1358
+#define PROTOCOL_VERSION_Q2PRO_ZLIB_DICT        1022
+#define PROTOCOL_VERSION_Q2PRO_PACKED_ENTITIES  1023
+#define PROTOCOL_VERSION_Q2PRO_CURRENT          1023
 
 #define PROTOCOL_VERSION_MVD_MINIMUM            2009    // r168
 #define PROTOCOL_VERSION_MVD_CURRENT            2010    // r177
@@ -78,6 +80,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SVCMD_BITS              5
 #define SVCMD_MASK              ((1 << SVCMD_BITS) - 1)
 
+// svc_zpacket extra bit: deflated with preset dictionary built from the
+// last svc_gamestate, see MSG_BuildZDictionary()
+#define ZPACKET_DICT            (1 << SVCMD_BITS)
+
+#define ZDICT_SIZE              0x8000  // deflate window size
+
 #define FRAMENUM_BITS           27
 #define FRAMENUM_MASK           ((1 << FRAMENUM_BITS) - 1)
 
@@ -124,6 +124,30 @@ int IMG_GetDimensions(const char* name, int* width, int* height);
 void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
                          byte *out, int outwidth, int outheight);
 void IMG_MipMap(byte *out, byte *in, int width, int height);
+void IMG_MipMapSRGB(byte *out, byte *in, int width, int height);
+
+void IMG_FilterFloat(float *out, const float *in, int count,
+                     const float *kernel, int size, int stride);
+void IMG_AverageFloat(float *out, const float *a, const float *b, int count);
+
+// sRGB <-> linear conversion tables, filled by IMG_Init
+#define IMG_LINEAR_STEPS    4096
+
+extern float    img_srgb_to_linear[256];
+extern float    img_srgb_thresholds[256];   // smallest linear value of each sRGB value
+extern byte     img_linear_to_srgb[IMG_LINEAR_STEPS];
+
+// exact, but without powf
+static inline byte IMG_EncodeSRGB(float x)
+{
+    int i, b = 0;
+
+    for (i = 128; i; i >>= 1)
+        if (x >= img_srgb_thresholds[b + i])
+            b += i;
+
+    return b;
+}
 
 // these are implemented in src/refresh/[gl,sw]/images.c
 extern void (*IMG_Unload)(image_t *image);
@@ -24,6 +24,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // flags used in hello packet
 #define GTF_DEFLATE     1
 #define GTF_STRINGCMDS  2
+#define GTF_SUBSCRIBE   4   // stream start carries a subscription
+
+// subscriptions used in stream start packet
+typedef enum {
+    GTV_SUB_ALL,        // full stream
+    GTV_SUB_PLAYER,     // byte: player number to follow
+    GTV_SUB_ORIGIN      // 3 shorts: fixed view origin, 1/8 units
+} gtv_subscription_t;
 
 typedef enum {
     GTS_HELLO,
@@ -54,6 +54,7 @@ typedef enum {
 #define GMF_VARIABLE_FPS            0x00000800
 #define GMF_EXTRA_USERINFO          0x00001000
 #define GMF_IPV6_ADDRESS_AWARE      0x00002000
+#define GMF_TRACE_MANY              0x00004000  // sv_features only, game_import_t has trace_many
 
 //===============================================================
 
@@ -107,6 +108,16 @@ struct edict_s {
 
 //===============================================================
 
+// single ray of a trace_many batch
+typedef struct {
+    vec3_t      start;
+    vec3_t      mins, maxs;     // relative, may be all zero
+    vec3_t      end;
+    edict_t     *passent;
+    int         contentmask;
+    trace_t     trace;          // filled in by trace_many
+} tracebatch_t;
+
 //
 // functions provided by the main engine
 //
@@ -183,6 +194,12 @@ typedef struct {
     void (*AddCommandString)(const char *text);
 
     void (*DebugGraph)(float value, int color);
+
+    // same as calling trace for each ray, but nearby rays share area
+    // queries and large batches may be spread over multiple threads.
+    // Past the end of original imports, only present if sv_features
+    // has GMF_TRACE_MANY set.
+    void (*trace_many)(tracebatch_t *batch, int count);
 } game_import_t;
 
 //
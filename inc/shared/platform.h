@@ -134,6 +134,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_unused            __attribute__((unused))
 
+#define q_thread_local      __thread
+
+// atomic operations on ints, with acquire/release semantics
+#define q_atomic_load(p)            __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define q_atomic_store(p, v)        __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define q_atomic_add(p, v)          __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+#define q_atomic_cas(p, o, n) \
+    __atomic_compare_exchange_n(p, &(int){ o }, n, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
 #else /* __GNUC__ */
 
 #define q_printf(f, a)
@@ -157,4 +166,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_unused
 
+#define q_thread_local      __declspec(thread)
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define q_atomic_load(p)            _InterlockedOr((volatile long *)(p), 0)
+#define q_atomic_store(p, v)        (void)_InterlockedExchange((volatile long *)(p), v)
+#define q_atomic_add(p, v)          _InterlockedExchangeAdd((volatile long *)(p), v)
+#define q_atomic_cas(p, o, n) \
+    (_InterlockedCompareExchange((volatile long *)(p), n, o) == (o))
+#endif
+
 #endif /* !__GNUC__ */
@@ -35,6 +35,7 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned Sys_Milliseconds(void);
+uint64_t Sys_Microseconds(void);
 void     Sys_Sleep(int msec);
 
 void    Sys_Init(void);
@@ -67,7 +68,8 @@ void    Sys_DebugBreak(void);
 bool Sys_GetAntiCheatAPI(void);
 #endif
 
-#if USE_CLIENT
+// work_cb runs on worker thread, done_cb on main thread once it's done.
+// number of threads taking async work is set by `sys_workers' cvar.
 typedef struct asyncwork_s {
     void (*work_cb)(void *);
     void (*done_cb)(void *);
@@ -76,7 +78,16 @@ typedef struct asyncwork_s {
 } asyncwork_t;
 
 void Sys_QueueAsyncWork(asyncwork_t *work);
-#endif
+
+#define MAX_WORKER_THREADS  32
+
+// runs func(arg, index, slot) for each index in [0, count) on up to
+// `threads' worker threads and blocks until all of them are done.
+// indices are handed out in increasing order. `slot' is unique among
+// concurrently running callbacks and is always less than `threads'.
+typedef void (*parallelfunc_t)(void *arg, int index, int slot);
+
+void Sys_ParallelFor(int threads, int count, parallelfunc_t func, void *arg);
 
 extern cvar_t   *sys_basedir;
 extern cvar_t   *sys_libdir;
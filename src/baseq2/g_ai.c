@@ -258,6 +258,39 @@ int range(edict_t *self, edict_t *other)
     return RANGE_FAR;
 }
 
+/*
+=============
+visible_many
+
+sets results[i] if others[i] is visible to self, tracing all of them
+in a single batch
+=============
+*/
+void visible_many(edict_t *self, edict_t **others, int count, bool *results)
+{
+    tracebatch_t    batch[MAX_VISIBLE_BATCH];
+    int             i, j, n;
+
+    for (i = 0; i < count; i += n) {
+        n = min(count - i, MAX_VISIBLE_BATCH);
+        for (j = 0; j < n; j++) {
+            VectorCopy(self->s.origin, batch[j].start);
+            batch[j].start[2] += self->viewheight;
+            VectorCopy(others[i + j]->s.origin, batch[j].end);
+            batch[j].end[2] += others[i + j]->viewheight;
+            VectorClear(batch[j].mins);
+            VectorClear(batch[j].maxs);
+            batch[j].passent = self;
+            batch[j].contentmask = MASK_OPAQUE;
+        }
+
+        G_TraceMany(batch, n);
+
+        for (j = 0; j < n; j++)
+            results[i + j] = batch[j].trace.fraction == 1.0f;
+    }
+}
+
 /*
 =============
 visible
@@ -830,6 +863,8 @@ void ai_run(edict_t *self, float dist)
     vec3_t      v_forward, v_right;
     float       left, center, right;
     vec3_t      left_target, right_target;
+    tracebatch_t batch[2];
+    int         i;
 
     // if we're going to a combat point, just proceed
     if (self->monsterinfo.aiflags & AI_COMBAT_POINT) {
@@ -951,13 +986,21 @@ void ai_run(edict_t *self, float dist)
 
             VectorSet(v, d2, -16, 0);
             G_ProjectSource(self->s.origin, v, v_forward, v_right, left_target);
-            tr = gi.trace(self->s.origin, self->mins, self->maxs, left_target, self, MASK_PLAYERSOLID);
-            left = tr.fraction;
-
             VectorSet(v, d2, 16, 0);
             G_ProjectSource(self->s.origin, v, v_forward, v_right, right_target);
-            tr = gi.trace(self->s.origin, self->mins, self->maxs, right_target, self, MASK_PLAYERSOLID);
-            right = tr.fraction;
+
+            for (i = 0; i < 2; i++) {
+                VectorCopy(self->s.origin, batch[i].start);
+                VectorCopy(self->mins, batch[i].mins);
+                VectorCopy(self->maxs, batch[i].maxs);
+                batch[i].passent = self;
+                batch[i].contentmask = MASK_PLAYERSOLID;
+            }
+            VectorCopy(left_target, batch[0].end);
+            VectorCopy(right_target, batch[1].end);
+            G_TraceMany(batch, 2);
+            left = batch[0].trace.fraction;
+            right = batch[1].trace.fraction;
 
             center = (d1 * center) / d2;
             if (left >= center && left > right) {
@@ -634,6 +634,8 @@ void    G_FreeEdict(edict_t *e);
 void    G_TouchTriggers(edict_t *ent);
 void    G_TouchSolids(edict_t *ent);
 
+void    G_TraceMany(tracebatch_t *batch, int count);
+
 char    *G_CopyString(char *in);
 
 float   *tv(float x, float y, float z);
@@ -715,6 +717,8 @@ int range(edict_t *self, edict_t *other);
 void FoundTarget(edict_t *self);
 bool infront(edict_t *self, edict_t *other);
 bool visible(edict_t *self, edict_t *other);
+#define MAX_VISIBLE_BATCH   32  // sight checks per trace_many call
+void visible_many(edict_t *self, edict_t **others, int count, bool *results);
 bool FacingIdeal(edict_t *self);
 
 //
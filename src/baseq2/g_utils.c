@@ -410,6 +410,28 @@ void G_FreeEdict(edict_t *ed)
 }
 
 
+/*
+============
+G_TraceMany
+
+Uses engine batch tracing when available, one trace at a time otherwise.
+============
+*/
+void G_TraceMany(tracebatch_t *batch, int count)
+{
+    int i;
+
+    if (sv_features && (sv_features->integer & GMF_TRACE_MANY)) {
+        gi.trace_many(batch, count);
+        return;
+    }
+
+    for (i = 0; i < count; i++, batch++)
+        batch->trace = gi.trace(batch->start, batch->mins, batch->maxs,
+                                batch->end, batch->passent, batch->contentmask);
+}
+
+
 /*
 ============
 G_TouchTriggers
@@ -45,29 +45,48 @@ edict_t *medic_FindDeadMonster(edict_t *self)
 {
     edict_t *ent = NULL;
     edict_t *best = NULL;
+    edict_t *list[MAX_VISIBLE_BATCH];
+    bool    vis[MAX_VISIBLE_BATCH];
+    bool    more = true;
+    int     i, count;
+
+    // gather candidates first so that sight checks go in batches
+    while (more) {
+        count = 0;
+        while (count < MAX_VISIBLE_BATCH) {
+            ent = findradius(ent, self->s.origin, 1024);
+            if (!ent) {
+                more = false;
+                break;
+            }
+            if (ent == self)
+                continue;
+            if (!(ent->svflags & SVF_MONSTER))
+                continue;
+            if (ent->monsterinfo.aiflags & AI_GOOD_GUY)
+                continue;
+            if (ent->owner)
+                continue;
+            if (ent->health > 0)
+                continue;
+            if (ent->nextthink)
+                continue;
+            list[count++] = ent;
+        }
 
-    while ((ent = findradius(ent, self->s.origin, 1024)) != NULL) {
-        if (ent == self)
-            continue;
-        if (!(ent->svflags & SVF_MONSTER))
-            continue;
-        if (ent->monsterinfo.aiflags & AI_GOOD_GUY)
-            continue;
-        if (ent->owner)
-            continue;
-        if (ent->health > 0)
-            continue;
-        if (ent->nextthink)
-            continue;
-        if (!visible(self, ent))
-            continue;
-        if (!best) {
-            best = ent;
-            continue;
+        visible_many(self, list, count, vis);
+
+        for (i = 0; i < count; i++) {
+            if (!vis[i])
+                continue;
+            if (!best) {
+                best = list[i];
+                continue;
+            }
+            if (list[i]->max_health <= best->max_health)
+                continue;
+            best = list[i];
         }
-        if (ent->max_health <= best->max_health)
-            continue;
-        best = ent;
     }
 
     return best;
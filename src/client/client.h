@@ -21,11 +21,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "shared/list.h"
 
+#include "common/bench.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
 #include "common/common.h"
 #include "common/cvar.h"
+#include "common/demoindex.h"
 #include "common/field.h"
 #include "common/files.h"
 #include "common/pmove.h"
@@ -203,6 +205,7 @@ typedef struct client_state_s {
     entity_state_t  baselines[MAX_EDICTS];
 
     entity_state_t  entityStates[MAX_PARSE_ENTITIES];
+    int16_t         entityVelocities[MAX_PARSE_ENTITIES][3];    // for MSG_ES_BITPACKED
     int             numEntityStates;
 
     msgEsFlags_t    esFlags;
@@ -416,6 +419,8 @@ typedef struct client_static_s {
 
 #if USE_ZLIB
     z_stream    z;
+    byte        zdict[ZDICT_SIZE];  // preset dictionary from last gamestate
+    size_t      zdict_len;
 #endif
 
     int         quakePort;          // a 16 bit value that allows quake servers
@@ -466,7 +471,8 @@ typedef struct client_static_s {
         int64_t     file_offset;
         int         file_percent;
         sizebuf_t   buffer;
-        list_t      snapshots;
+        demoindex_t snapshots;
+        char        name[MAX_OSPATH];   // path of demo being played back
         bool        paused;
         bool        seeking;
         bool        eof;
@@ -526,6 +532,7 @@ extern cvar_t    *cl_kickangles;
 extern cvar_t    *cl_rollhack;
 extern cvar_t    *cl_noglow;
 extern cvar_t    *cl_nolerp;
+extern cvar_t    *cl_loadstats;
 
 #if USE_DEBUG
 #define SHOWNET(level, ...) \
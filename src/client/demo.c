@@ -27,6 +27,7 @@ static byte     demo_buffer[MAX_PACKETLEN];
 static cvar_t   *cl_demosnaps;
 static cvar_t   *cl_demomsglen;
 static cvar_t   *cl_demowait;
+static cvar_t   *cl_demoindex;
 
 // =========================================================================
 
@@ -322,7 +323,7 @@ static void CL_Record_f(void)
     entity_packed_t pack;
     char            *s;
     qhandle_t       f;
-    unsigned        mode = FS_MODE_WRITE;
+    unsigned        mode = FS_MODE_WRITE | FS_FLAG_ASYNC;
     size_t          size = Cvar_ClampInteger(
                                cl_demomsglen,
                                MIN_PACKETLEN,
@@ -714,6 +715,7 @@ static void CL_PlayDemo_f(void)
     CL_Disconnect(ERR_RECONNECT);
 
     cls.demo.playback = f;
+    Q_strlcpy(cls.demo.name, name, sizeof(cls.demo.name));
     cls.state = ca_connected;
     Q_strlcpy(cls.servername, COM_SkipPath(name), sizeof(cls.servername));
     cls.serverAddress.type = NA_LOOPBACK;
@@ -738,14 +740,6 @@ static void CL_Demo_c(genctx_t *ctx, int argnum)
     }
 }
 
-typedef struct {
-    list_t entry;
-    int framenum;
-    int64_t filepos;
-    size_t msglen;
-    byte data[1];
-} demosnap_t;
-
 /*
 ====================
 CL_EmitDemoSnapshot
@@ -756,7 +750,6 @@ state, configstrings and layouts at the given server frame.
 */
 void CL_EmitDemoSnapshot(void)
 {
-    demosnap_t *snap;
     int64_t pos;
     char *from, *to;
     size_t len;
@@ -815,12 +808,8 @@ void CL_EmitDemoSnapshot(void)
     MSG_WriteByte(svc_layout);
     MSG_WriteString(cl.layout);
 
-    snap = Z_Malloc(sizeof(*snap) + msg_write.cursize - 1);
-    snap->framenum = cls.demo.frames_read;
-    snap->filepos = pos;
-    snap->msglen = msg_write.cursize;
-    memcpy(snap->data, msg_write.data, msg_write.cursize);
-    List_Append(&cls.demo.snapshots, &snap->entry);
+    DemoIndex_Add(&cls.demo.snapshots, cls.demo.frames_read, pos,
+                  msg_write.data, msg_write.cursize);
 
     Com_DPrintf("[%d] snaplen %zu\n", cls.demo.frames_read, msg_write.cursize);
 
@@ -829,22 +818,44 @@ void CL_EmitDemoSnapshot(void)
     cls.demo.last_snapshot = cls.demo.frames_read;
 }
 
-static demosnap_t *find_snapshot(int framenum)
+/*
+====================
+load_demo_index
+
+Loads snapshots saved by previous playback of the same demo from the
+`<demo>.idx' sidecar, so that seeking doesn't need to parse the whole demo
+first. Only the first map of the demo is indexed, since snapshots are
+relative to base configstrings.
+====================
+*/
+static void load_demo_index(void)
 {
-    demosnap_t *snap, *prev;
+    demoindex_t *index = &cls.demo.snapshots;
+    uint32_t key;
+    int ret;
 
-    if (LIST_EMPTY(&cls.demo.snapshots))
-        return NULL;
+    if (index->key || index->numsnaps) {
+        // next map in the same demo
+        DemoIndex_Save(index);
+        index->key = 0;
+        return;
+    }
+
+    if (cl_demosnaps->integer <= 0 || !cl_demoindex->integer)
+        return;
 
-    prev = LIST_FIRST(demosnap_t, &cls.demo.snapshots, entry);
+    if (!cls.demo.file_size || !cls.demo.name[0])
+        return;
 
-    LIST_FOR_EACH(demosnap_t, snap, &cls.demo.snapshots, entry) {
-        if (snap->framenum > framenum)
-            break;
-        prev = snap;
+    key = DemoIndex_Key(cl.baseconfigstrings, MAX_CONFIGSTRINGS,
+                        cls.demo.file_offset, cls.demo.file_size);
+    ret = DemoIndex_Load(index, cls.demo.name, key);
+    if (ret > 0) {
+        // snapshots past this frame are emitted as usual
+        cls.demo.last_snapshot = DemoIndex_LastFrame(index);
+    } else if (ret < 0 && ret != Q_ERR(ENOENT)) {
+        Com_WPrintf("Couldn't load %s: %s\n", index->path, Q_ErrorString(ret));
     }
-
-    return prev;
 }
 
 /*
@@ -881,60 +892,36 @@ void CL_FirstDemoFrame(void)
 
         cls.demo.time_frames = 0;
         cls.demo.time_start = Sys_Milliseconds();
+
+        Bench_Start(cls.servername);
     }
 
     // force initial snapshot
     cls.demo.last_snapshot = INT_MIN;
+
+    load_demo_index();
 }
 
-static void CL_Seek_f(void)
+/*
+====================
+seek_demo
+
+Seeks to the given demo frame. If `to_end' is set, stops at the end of
+demo file instead of finishing the demo.
+====================
+*/
+static void seek_demo(int dest, bool to_end)
 {
     demosnap_t *snap;
-    int i, j, ret, index, frames, dest, prev;
+    int i, j, ret, index, frames, prev;
     char *from, *to;
 
-    if (Cmd_Argc() < 2) {
-        Com_Printf("Usage: %s [+-]<timespec>\n", Cmd_Argv(0));
-        return;
-    }
-
-#if USE_MVD_CLIENT
-    if (sv_running->integer == ss_broadcast) {
-        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
-        return;
-    }
-#endif
-
-    if (!cls.demo.playback) {
-        Com_Printf("Not playing a demo.\n");
-        return;
-    }
-
-    to = Cmd_Argv(1);
-
-    if (*to == '-' || *to == '+') {
-        // relative to current frame
-        if (!Com_ParseTimespec(to + 1, &frames)) {
-            Com_Printf("Invalid relative timespec.\n");
-            return;
-        }
-        if (*to == '-')
-            frames = -frames;
-        dest = cls.demo.frames_read + frames;
-    } else {
-        // relative to first frame
-        if (!Com_ParseTimespec(to, &dest)) {
-            Com_Printf("Invalid absolute timespec.\n");
-            return;
-        }
-        frames = dest - cls.demo.frames_read;
-    }
-
+    frames = dest - cls.demo.frames_read;
     if (!frames)
         // already there
         return;
 
-    if (frames > 0 && cls.demo.eof && cl_demowait->integer)
+    if (frames > 0 && cls.demo.eof && (cl_demowait->integer || to_end))
         // already at end
         return;
 
@@ -954,7 +941,11 @@ static void CL_Seek_f(void)
 
     // seek to the previous most recent snapshot
     if (frames < 0 || cls.demo.last_snapshot > cls.demo.frames_read) {
-        snap = find_snapshot(dest);
+        snap = DemoIndex_Find(&cls.demo.snapshots, dest);
+
+        // don't go back when seeking forward past the last snapshot
+        if (snap && frames > 0 && snap->framenum <= cls.demo.frames_read)
+            snap = NULL;
 
         if (snap) {
             Com_DPrintf("found snap at %d\n", snap->framenum);
@@ -994,7 +985,7 @@ static void CL_Seek_f(void)
     // skip forward to destination frame
     while (cls.demo.frames_read < dest) {
         ret = read_next_message(cls.demo.playback);
-        if (ret == 0 && cl_demowait->integer) {
+        if (ret == 0 && (cl_demowait->integer || to_end)) {
             cls.demo.eof = true;
             break;
         }
@@ -1048,6 +1039,88 @@ done:
     cls.demo.seeking = false;
 }
 
+static void CL_Seek_f(void)
+{
+    int frames, dest;
+    char *to;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s [+-]<timespec>\n", Cmd_Argv(0));
+        return;
+    }
+
+#if USE_MVD_CLIENT
+    if (sv_running->integer == ss_broadcast) {
+        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
+        return;
+    }
+#endif
+
+    if (!cls.demo.playback) {
+        Com_Printf("Not playing a demo.\n");
+        return;
+    }
+
+    to = Cmd_Argv(1);
+
+    if (*to == '-' || *to == '+') {
+        // relative to current frame
+        if (!Com_ParseTimespec(to + 1, &frames)) {
+            Com_Printf("Invalid relative timespec.\n");
+            return;
+        }
+        if (*to == '-')
+            frames = -frames;
+        dest = cls.demo.frames_read + frames;
+    } else {
+        // relative to first frame
+        if (!Com_ParseTimespec(to, &dest)) {
+            Com_Printf("Invalid absolute timespec.\n");
+            return;
+        }
+    }
+
+    seek_demo(dest, false);
+}
+
+/*
+====================
+CL_IndexDemo_f
+
+Builds snapshots for the whole demo by skipping to the end and back, then
+saves them into the `<demo>.idx' sidecar.
+====================
+*/
+static void CL_IndexDemo_f(void)
+{
+    demoindex_t *index = &cls.demo.snapshots;
+    int framenum, ret;
+
+    if (!cls.demo.playback || cls.state != ca_active) {
+        Com_Printf("Not playing a demo.\n");
+        return;
+    }
+
+    if (!index->key) {
+        Com_Printf("Demo index is not available, check cl_demosnaps and cl_demoindex.\n");
+        return;
+    }
+
+    framenum = cls.demo.frames_read;
+    seek_demo(INT_MAX, true);
+    if (!cls.demo.playback)
+        return;
+    seek_demo(framenum, false);
+
+    ret = DemoIndex_Save(index);
+    if (ret < 0) {
+        Com_EPrintf("Couldn't write %s: %s\n", index->path, Q_ErrorString(ret));
+        return;
+    }
+
+    Com_Printf("Indexed %d snapshots in %s\n", index->numsnaps, index->path);
+}
+
 static void parse_info_string(demoInfo_t *info, int clientNum, int index, const char *string)
 {
     size_t len;
@@ -1165,8 +1238,6 @@ fail:
 
 void CL_CleanupDemos(void)
 {
-    demosnap_t *snap, *next;
-    size_t total;
 
     if (cls.demo.recording) {
         CL_Stop_f();
@@ -1175,6 +1246,8 @@ void CL_CleanupDemos(void)
     if (cls.demo.playback) {
         FS_CloseFile(cls.demo.playback);
 
+        Bench_Stop();
+
         if (com_timedemo->integer && cls.demo.time_frames) {
             unsigned msec = Sys_Milliseconds();
 
@@ -1202,18 +1275,12 @@ void CL_CleanupDemos(void)
         }
     }
 
-    total = 0;
-    LIST_FOR_EACH_SAFE(demosnap_t, snap, next, &cls.demo.snapshots, entry) {
-        total += snap->msglen;
-        Z_Free(snap);
-    }
-
-    if (total)
-        Com_DPrintf("Freed %zu bytes of snaps\n", total);
+    DemoIndex_Save(&cls.demo.snapshots);
+    DemoIndex_Clear(&cls.demo.snapshots);
 
     memset(&cls.demo, 0, sizeof(cls.demo));
 
-    List_Init(&cls.demo.snapshots);
+    DemoIndex_Init(&cls.demo.snapshots, TAG_GENERAL);
 }
 
 /*
@@ -1233,7 +1300,9 @@ void CL_DemoFrame(int msec)
     }
 
     if (com_timedemo->integer) {
+        BENCH_BEGIN(BENCH_PARSE);
         parse_next_message(0);
+        BENCH_END(BENCH_PARSE);
         cl.time = cl.servertime;
         cls.demo.time_frames++;
         return;
@@ -1262,6 +1331,7 @@ static const cmdreg_t c_demo[] = {
     { "stop", CL_Stop_f },
     { "suspend", CL_Suspend_f },
     { "seek", CL_Seek_f },
+    { "demoindex", CL_IndexDemo_f },
 
     { NULL }
 };
@@ -1276,9 +1346,10 @@ void CL_InitDemos(void)
     cl_demosnaps = Cvar_Get("cl_demosnaps", "10", 0);
     cl_demomsglen = Cvar_Get("cl_demomsglen", va("%d", MAX_PACKETLEN_WRITABLE_DEFAULT), 0);
     cl_demowait = Cvar_Get("cl_demowait", "0", 0);
+    cl_demoindex = Cvar_Get("cl_demoindex", "1", 0);
 
     Cmd_Register(c_demo);
-    List_Init(&cls.demo.snapshots);
+    DemoIndex_Init(&cls.demo.snapshots, TAG_GENERAL);
 }
 
 
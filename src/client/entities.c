@@ -1412,7 +1412,9 @@ void CL_AddEntities(void)
     CL_FinishViewValues();
     CL_AddPacketEntities();
     CL_AddTEnts();
+    BENCH_BEGIN(BENCH_PARTICLES);
     CL_AddParticles();
+    BENCH_END(BENCH_PARTICLES);
     CL_AddDLights();
     CL_AddLightStyles();
 	CL_AddTestModel();
@@ -37,6 +37,7 @@ cvar_t  *cl_kickangles;
 cvar_t  *cl_rollhack;
 cvar_t  *cl_noglow;
 cvar_t  *cl_nolerp;
+cvar_t  *cl_loadstats;
 
 #if USE_DEBUG
 cvar_t  *cl_shownet;
@@ -776,6 +777,10 @@ void CL_Disconnect(error_type_t type)
         cls.netchan = NULL;
     }
 
+#if USE_ZLIB
+    cls.zdict_len = 0;
+#endif
+
     // stop playback and/or recording
     CL_CleanupDemos();
 
@@ -2729,6 +2734,7 @@ static void CL_InitLocal(void)
     cl_rollhack = Cvar_Get("cl_rollhack", "1", 0);
     cl_noglow = Cvar_Get("cl_noglow", "0", 0);
     cl_nolerp = Cvar_Get("cl_nolerp", "0", 0);
+    cl_loadstats = Cvar_Get("cl_loadstats", "0", 0);
 
     // hack for timedemo
     com_timedemo->changed = cl_sync_changed;
@@ -3211,6 +3217,8 @@ unsigned CL_Frame(unsigned msec, int waterLevel)
         break;
     }
 
+    BENCH_BEGIN(BENCH_FRAME);
+
     Com_DDDDPrintf("main_extra=%d ref_frame=%d ref_extra=%d "
                    "phys_frame=%d phys_extra=%d\n",
                    main_extra, ref_frame, ref_extra,
@@ -3286,7 +3294,9 @@ unsigned CL_Frame(unsigned msec, int waterLevel)
         R_FRAMES++;
 
         // update audio after the 3D view was drawn
+        BENCH_BEGIN(BENCH_SOUND);
         S_Update();
+        BENCH_END(BENCH_SOUND);
         SCR_RunCinematic();
     } else if (sync_mode == SYNC_SLEEP_10) {
         // force audio and effects update if not rendering
@@ -3304,6 +3314,9 @@ unsigned CL_Frame(unsigned msec, int waterLevel)
 
     cls.framecount++;
 
+    BENCH_END(BENCH_FRAME);
+    Bench_EndFrame();
+
     main_extra = 0;
     return 0;
 }
@@ -30,9 +30,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 static inline void CL_ParseDeltaEntity(server_frame_t  *frame,
                                        int             newnum,
                                        entity_state_t  *old,
-                                       int             bits)
+                                       int             bits,
+                                       int             dt)
 {
     entity_state_t    *state;
+    int16_t           *vel;
 
     // suck up to MAX_EDICTS for servers that don't cap at MAX_PACKET_ENTITIES
     if (frame->numEntities >= MAX_EDICTS) {
@@ -40,6 +42,7 @@ static inline void CL_ParseDeltaEntity(server_frame_t  *frame,
     }
 
     state = &cl.entityStates[cl.numEntityStates & PARSE_ENTITIES_MASK];
+    vel = cl.entityVelocities[cl.numEntityStates & PARSE_ENTITIES_MASK];
     cl.numEntityStates++;
     frame->numEntities++;
 
@@ -50,7 +53,13 @@ static inline void CL_ParseDeltaEntity(server_frame_t  *frame,
     }
 #endif
 
-    MSG_ParseDeltaEntity(old, state, newnum, bits, cl.esFlags);
+    if (cl.esFlags & MSG_ES_BITPACKED) {
+        // zero dt means delta from baseline, which has no velocity
+        MSG_ParsePackedEntity(old, state, dt ? cl.entityVelocities[old - cl.entityStates] : NULL,
+                              vel, newnum, bits, cl.esFlags, dt);
+    } else {
+        MSG_ParseDeltaEntity(old, state, newnum, bits, cl.esFlags);
+    }
 
     // shuffle previous origin to old
     if (!(bits & U_OLDORIGIN) && !(state->renderfx & RF_BEAM))
@@ -64,10 +73,14 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
     int            bits;
     entity_state_t    *oldstate;
     int            oldindex, oldnum;
-    int i;
+    int i, dt;
 
     frame->firstEntity = cl.numEntityStates;
     frame->numEntities = 0;
+    dt = oldframe ? frame->number - oldframe->number : 0;
+
+    if (cl.esFlags & MSG_ES_BITPACKED)
+        MSG_BeginParsingPackedEntities();
 
     // delta from the entities present in oldframe
     oldindex = 0;
@@ -85,7 +98,10 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
     }
 
     while (1) {
-        newnum = MSG_ParseEntityBits(&bits);
+        if (cl.esFlags & MSG_ES_BITPACKED)
+            newnum = MSG_ParsePackedEntityBits(&bits);
+        else
+            newnum = MSG_ParseEntityBits(&bits);
         if (newnum < 0 || newnum >= MAX_EDICTS) {
             Com_Error(ERR_DROP, "%s: bad number: %d", __func__, newnum);
         }
@@ -101,7 +117,7 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
         while (oldnum < newnum) {
             // one or more entities from the old packet are unchanged
             SHOWNET(3, "   unchanged: %i\n", oldnum);
-            CL_ParseDeltaEntity(frame, oldnum, oldstate, 0);
+            CL_ParseDeltaEntity(frame, oldnum, oldstate, 0, dt);
 
             oldindex++;
 
@@ -139,7 +155,7 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
         if (oldnum == newnum) {
             // delta from previous state
             SHOWNET(2, "   delta: %i ", newnum);
-            CL_ParseDeltaEntity(frame, newnum, oldstate, bits);
+            CL_ParseDeltaEntity(frame, newnum, oldstate, bits, dt);
             if (!bits) {
                 SHOWNET(2, "\n");
             }
@@ -159,7 +175,7 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
         if (oldnum > newnum) {
             // delta from baseline
             SHOWNET(2, "   baseline: %i ", newnum);
-            CL_ParseDeltaEntity(frame, newnum, &cl.baselines[newnum], bits);
+            CL_ParseDeltaEntity(frame, newnum, &cl.baselines[newnum], bits, 0);
             if (!bits) {
                 SHOWNET(2, "\n");
             }
@@ -172,7 +188,7 @@ static void CL_ParsePacketEntities(server_frame_t *oldframe,
     while (oldnum != 99999) {
         // one or more entities from the old packet are unchanged
         SHOWNET(3, "   unchanged: %i\n", oldnum);
-        CL_ParseDeltaEntity(frame, oldnum, oldstate, 0);
+        CL_ParseDeltaEntity(frame, oldnum, oldstate, 0, dt);
 
         oldindex++;
 
@@ -458,7 +474,9 @@ static void CL_ParseBaseline(int index, int bits)
 static void CL_ParseGamestate(void)
 {
     int        index, bits;
+    size_t     strings, bases;
 
+    strings = msg_read.readcount;
     while (msg_read.readcount < msg_read.cursize) {
         index = MSG_ReadShort();
         if (index == MAX_CONFIGSTRINGS) {
@@ -467,6 +485,7 @@ static void CL_ParseGamestate(void)
         CL_ParseConfigstring(index);
     }
 
+    bases = msg_read.readcount;
     while (msg_read.readcount < msg_read.cursize) {
         index = MSG_ParseEntityBits(&bits);
         if (!index) {
@@ -474,6 +493,17 @@ static void CL_ParseGamestate(void)
         }
         CL_ParseBaseline(index, bits);
     }
+
+#if USE_ZLIB
+    // build the same preset dictionary server will use for svc_zpacket
+    if (cls.serverProtocol == PROTOCOL_VERSION_Q2PRO &&
+        cls.protocolVersion >= PROTOCOL_VERSION_Q2PRO_ZLIB_DICT &&
+        msg_read.readcount <= msg_read.cursize) {
+        cls.zdict_len = MSG_BuildZDictionary(cls.zdict,
+                                             msg_read.data + strings, bases - strings,
+                                             msg_read.data + bases, msg_read.readcount - bases);
+    }
+#endif
 }
 
 static void CL_ParseServerData(void)
@@ -608,6 +638,9 @@ static void CL_ParseServerData(void)
         if (cls.protocolVersion >= PROTOCOL_VERSION_Q2PRO_SHORT_ANGLES) {
             cl.esFlags |= MSG_ES_SHORTANGLES;
         }
+        if (cls.protocolVersion >= PROTOCOL_VERSION_Q2PRO_PACKED_ENTITIES) {
+            cl.esFlags |= MSG_ES_BITPACKED;
+        }
         if (cls.protocolVersion >= PROTOCOL_VERSION_Q2PRO_WATERJUMP_HACK) {
             i = MSG_ReadByte();
             if (i) {
@@ -1076,7 +1109,7 @@ static void CL_ParseDownload(int cmd)
     CL_HandleDownload(data, size, percent, decompressed_size);
 }
 
-static void CL_ParseZPacket(void)
+static void CL_ParseZPacket(int extrabits)
 {
 #if USE_ZLIB
     sizebuf_t   temp;
@@ -1100,6 +1133,13 @@ static void CL_ParseZPacket(void)
 
     inflateReset(&cls.z);
 
+    if (extrabits & (ZPACKET_DICT >> SVCMD_BITS)) {
+        if (!cls.zdict_len) {
+            Com_Error(ERR_DROP, "%s: no preset dictionary", __func__);
+        }
+        inflateSetDictionary(&cls.z, cls.zdict, cls.zdict_len);
+    }
+
     cls.z.next_in = msg_read.data + msg_read.readcount;
     cls.z.avail_in = (uInt)inlen;
     cls.z.next_out = buffer;
@@ -1292,7 +1332,7 @@ badbyte:
             if (cls.serverProtocol < PROTOCOL_VERSION_R1Q2) {
                 goto badbyte;
             }
-            CL_ParseZPacket();
+            CL_ParseZPacket(extrabits);
             continue;
 
         case svc_zdownload:
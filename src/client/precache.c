@@ -195,6 +195,185 @@ void CL_LoadClientinfo(clientinfo_t *ci, const char *s)
     }
 }
 
+/*
+=================
+Asset prefetching
+
+Builds a list of files that registration is about to load and lets
+FS_Prefetch read and inflate them on worker threads. Images are looked up
+in the same order as the image loader does, and only the file it is going
+to load is listed.
+=================
+*/
+
+typedef struct {
+    char        (*names)[MAX_QPATH];
+    int         count, size;
+} prefetchlist_t;
+
+static q_printf(2, 3)
+void add_prefetch(prefetchlist_t *list, const char *fmt, ...)
+{
+    va_list argptr;
+    size_t len;
+
+    if (list->count == list->size) {
+        list->size = max(list->size * 2, 256);
+        list->names = Z_Realloc(list->names, list->size * sizeof(list->names[0]));
+    }
+
+    va_start(argptr, fmt);
+    len = Q_vsnprintf(list->names[list->count], MAX_QPATH, fmt, argptr);
+    va_end(argptr);
+
+    if (len < MAX_QPATH)
+        list->count++;
+}
+
+static bool add_prefetch_file(prefetchlist_t *list, const char *base, const char *ext)
+{
+    char path[MAX_QPATH];
+
+    if (Q_concat(path, sizeof(path), base, ".", ext) >= sizeof(path))
+        return false;
+    if (!FS_FileExists(path))
+        return false;
+
+    add_prefetch(list, "%s", path);
+    return true;
+}
+
+// same search order as try_other_formats() in refresh/images.c:
+// `first' extension, then r_texture_formats, then 8-bit `last' one
+static bool add_prefetch_formats(prefetchlist_t *list, const char *base,
+                                 const char *first, const char *last)
+{
+    const char *s, *ext;
+
+    if (first && add_prefetch_file(list, base, first))
+        return true;
+
+    for (s = Cvar_VariableString("r_texture_formats"); *s; s++) {
+        switch (Q_tolower(*s)) {
+            case 't': ext = "tga"; break;
+            case 'j': ext = "jpg"; break;
+            case 'p': ext = "png"; break;
+            default: continue;
+        }
+        if (add_prefetch_file(list, base, ext))
+            return true;
+    }
+
+    return last && add_prefetch_file(list, base, last);
+}
+
+// adds the file IMG_Find is going to load image from, if any. `ext' is the
+// original extension and `fallback' 8-bit format for this image type.
+static void add_prefetch_image(prefetchlist_t *list, const char *base,
+                               const char *ext, const char *fallback)
+{
+    char path[MAX_QPATH];
+    bool overrides = Cvar_VariableInteger("r_override_textures");
+
+    if (cls.ref_type == REF_TYPE_GL && strcmp(fallback, "pcx") &&
+        !Cvar_VariableInteger("gl_use_hd_assets"))
+        overrides = false;
+
+    if (!overrides) {
+        add_prefetch_formats(list, base, ext, strcmp(ext, fallback) ? fallback : NULL);
+        return;
+    }
+
+    // overrides ignore the original extension
+    Q_concat(path, sizeof(path), "overrides/", COM_SkipPath(base));
+    if (!add_prefetch_formats(list, path, NULL, fallback))
+        add_prefetch_formats(list, base, NULL, fallback);
+}
+
+static void prefetch_list(prefetchlist_t *list)
+{
+    const char **paths;
+    int i;
+
+    if (list->count) {
+        paths = Z_Malloc(list->count * sizeof(paths[0]));
+        for (i = 0; i < list->count; i++)
+            paths[i] = list->names[i];
+        FS_Prefetch(paths, list->count);
+        Z_Free(paths);
+    }
+
+    Z_Free(list->names);
+}
+
+static void CL_PrefetchAssets(void)
+{
+    prefetchlist_t list = { 0 };
+    char base[MAX_QPATH];
+    size_t len;
+    char *name;
+    int i;
+
+    // world textures with default normal and emissive maps,
+    // duplicates are skipped by FS_Prefetch
+    for (i = 0; i < cl.bsp->numtexinfo; i++) {
+        name = cl.bsp->texinfo[i].name;
+        Q_concat(base, sizeof(base), "textures/", name);
+        add_prefetch_image(&list, base, "wal", "wal");
+        if (cls.ref_type == REF_TYPE_VKPT) {
+            Q_concat(base, sizeof(base), "textures/", name, "_n");
+            add_prefetch_image(&list, base, "tga", "wal");
+            Q_concat(base, sizeof(base), "textures/", name, "_light");
+            add_prefetch_image(&list, base, "tga", "wal");
+        }
+    }
+
+    for (i = 2; i < MAX_MODELS; i++) {
+        name = cl.configstrings[CS_MODELS + i];
+        if (!name[0])
+            break;
+        if (name[0] == '#' || name[0] == '*')
+            continue;
+        len = strlen(name);
+        if (len > 4 && !Q_stricmp(name + len - 4, ".md2"))
+            add_prefetch(&list, "%.*s.md3", (int)(len - 4), name);
+        add_prefetch(&list, "%s", name);
+    }
+
+    for (i = 1; i < MAX_IMAGES; i++) {
+        name = cl.configstrings[CS_IMAGES + i];
+        if (!name[0])
+            break;
+        if (name[0] == '/' || name[0] == '\\' || strchr(name, '.'))
+            continue;
+        Q_concat(base, sizeof(base), "pics/", name);
+        add_prefetch_image(&list, base, "pcx", "pcx");
+    }
+
+    prefetch_list(&list);
+}
+
+static void CL_PrefetchSounds(void)
+{
+    prefetchlist_t list = { 0 };
+    char *name;
+    int i;
+
+    for (i = 1; i < MAX_SOUNDS; i++) {
+        name = cl.configstrings[CS_SOUNDS + i];
+        if (!name[0])
+            break;
+        if (name[0] == '*')
+            continue;
+        if (name[0] == '#')
+            add_prefetch(&list, "%s", name + 1);
+        else
+            add_prefetch(&list, "sound/%s", name);
+    }
+
+    prefetch_list(&list);
+}
+
 /*
 =================
 CL_RegisterSounds
@@ -205,6 +384,8 @@ void CL_RegisterSounds(void)
     int i;
     char    *s;
 
+    CL_PrefetchSounds();
+
     S_BeginRegistration();
     CL_RegisterTEntSounds();
     for (i = 1; i < MAX_SOUNDS; i++) {
@@ -214,6 +395,8 @@ void CL_RegisterSounds(void)
         cl.sound_precache[i] = S_RegisterSound(s);
     }
     S_EndRegistration();
+
+    FS_EndPrefetch();
 }
 
 /*
@@ -328,12 +511,20 @@ void CL_PrepRefresh(void)
 {
     int         i;
     char        *name;
+    fs_loadstats_t  stats;
+    unsigned    start;
 
     if (!cls.ref_initialized)
         return;
     if (!cl.mapname[0])
         return;     // no map loaded
 
+    stats = fs_loadstats;
+    start = Sys_Milliseconds();
+
+    if (cl.bsp)
+        CL_PrefetchAssets();
+
     // register models, pics, and skins
     R_BeginRegistration(cl.mapname);
 
@@ -398,6 +589,18 @@ void CL_PrepRefresh(void)
     // the renderer can now free unneeded stuff
     R_EndRegistration();
 
+    FS_EndPrefetch();
+
+    if (cl_loadstats->integer)
+        Com_Printf("Loaded %s in %u ms: %u files (%u mapped, %u prefetched), "
+                   "%.1f MB copied, %.1f MB mapped, %u reads, %u seeks\n", cl.mapname,
+                   Sys_Milliseconds() - start,
+                   fs_loadstats.files - stats.files, fs_loadstats.mapped - stats.mapped,
+                   fs_loadstats.prefetched - stats.prefetched,
+                   (fs_loadstats.bytes_copied - stats.bytes_copied) / 1e6,
+                   (fs_loadstats.bytes_mapped - stats.bytes_mapped) / 1e6,
+                   fs_loadstats.reads - stats.reads, fs_loadstats.seeks - stats.seeks);
+
     // clear any lines of console text
     Con_ClearNotify_f();
 
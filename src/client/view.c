@@ -502,7 +502,9 @@ void V_RenderView(int waterLevel)
         // build a refresh entity list and calc cl.sim*
         // this also calls CL_CalcViewValues which loads
         // v_forward, etc.
+        BENCH_BEGIN(BENCH_ENTITIES);
         CL_AddEntities();
+        BENCH_END(BENCH_ENTITIES);
 
 #if USE_DEBUG
         if (cl_testparticles->integer)
@@ -0,0 +1,405 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// bench.c -- timedemo benchmark harness
+//
+// Collects microsecond timings of individual frame stages while a timedemo
+// is running, prints percentiles when it finishes, optionally writes them
+// into CSV/JSON reports and compares them against a baseline report.
+//
+
+#include "shared/shared.h"
+#include "common/bench.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/cvar.h"
+#include "common/files.h"
+#include "common/zone.h"
+#include "system/system.h"
+
+#define BENCH_DIR           "benchmarks/"
+#define BENCH_NUM_PCT       3
+#define BENCH_MIN_DELTA     5   // ignore regressions smaller than this (usec)
+
+typedef struct {
+    bool        valid;
+    double      mean;
+    unsigned    min, max;
+    unsigned    pct[BENCH_NUM_PCT];
+} benchstat_t;
+
+static const char *const bench_stage_names[BENCH_NUM_STAGES] = {
+    "frame", "parse", "entities", "particles", "refresh", "sound", "clients"
+};
+
+static const char *const bench_pct_names[BENCH_NUM_PCT] = {
+    "p50", "p95", "p99"
+};
+
+static const int bench_pct_values[BENCH_NUM_PCT] = {
+    50, 95, 99
+};
+
+static cvar_t   *timedemo_report;
+static cvar_t   *timedemo_baseline;
+static cvar_t   *timedemo_tolerance;
+
+bool bench_running;
+
+static struct {
+    char        name[MAX_QPATH];
+    uint64_t    start;
+    uint64_t    begin[BENCH_NUM_STAGES];
+    uint32_t    cur[BENCH_NUM_STAGES];
+    unsigned    used;       // bitmask of stages ever timed
+    uint32_t    (*frames)[BENCH_NUM_STAGES];
+    int         numframes;
+    int         maxframes;
+} bench;
+
+/*
+==============================================================================
+
+COLLECTION
+
+==============================================================================
+*/
+
+void Bench_Start(const char *name)
+{
+    Z_Free(bench.frames);
+    memset(&bench, 0, sizeof(bench));
+
+    Q_strlcpy(bench.name, COM_SkipPath(name), sizeof(bench.name));
+    COM_StripExtension(bench.name, bench.name, sizeof(bench.name));
+
+    bench.start = Sys_Microseconds();
+    bench_running = true;
+}
+
+void Bench_Begin(benchstage_t stage)
+{
+    bench.begin[stage] = Sys_Microseconds();
+}
+
+void Bench_End(benchstage_t stage)
+{
+    bench.cur[stage] += Sys_Microseconds() - bench.begin[stage];
+    bench.used |= (1U << stage);
+}
+
+void Bench_EndFrame(void)
+{
+    if (!bench_running)
+        return;
+
+    if (bench.numframes == bench.maxframes) {
+        bench.maxframes = max(bench.maxframes * 2, 1024);
+        bench.frames = Z_Realloc(bench.frames, bench.maxframes * sizeof(bench.frames[0]));
+    }
+
+    memcpy(bench.frames[bench.numframes++], bench.cur, sizeof(bench.cur));
+    memset(bench.cur, 0, sizeof(bench.cur));
+}
+
+/*
+==============================================================================
+
+STATISTICS
+
+==============================================================================
+*/
+
+static int uintcmp(const void *p1, const void *p2)
+{
+    uint32_t a = *(const uint32_t *)p1;
+    uint32_t b = *(const uint32_t *)p2;
+
+    return (a > b) - (a < b);
+}
+
+// nearest rank percentiles
+static void calc_stats(benchstat_t *stats)
+{
+    uint32_t *samples;
+    uint64_t total;
+    int i, j, n = bench.numframes;
+
+    memset(stats, 0, sizeof(stats[0]) * BENCH_NUM_STAGES);
+    if (!n)
+        return;
+
+    samples = Z_Malloc(n * sizeof(samples[0]));
+
+    for (i = 0; i < BENCH_NUM_STAGES; i++) {
+        if (!(bench.used & (1U << i)))
+            continue;
+
+        total = 0;
+        for (j = 0; j < n; j++) {
+            samples[j] = bench.frames[j][i];
+            total += samples[j];
+        }
+        qsort(samples, n, sizeof(samples[0]), uintcmp);
+
+        stats[i].valid = true;
+        stats[i].mean = (double)total / n;
+        stats[i].min = samples[0];
+        stats[i].max = samples[n - 1];
+        for (j = 0; j < BENCH_NUM_PCT; j++)
+            stats[i].pct[j] = samples[max((n * bench_pct_values[j] + 99) / 100, 1) - 1];
+    }
+
+    Z_Free(samples);
+}
+
+static void print_stats(const benchstat_t *stats)
+{
+    int i;
+
+    Com_Printf("stage        mean    min    p50    p95    p99    max (usec)\n"
+               "---------- ------ ------ ------ ------ ------ ------\n");
+    for (i = 0; i < BENCH_NUM_STAGES; i++) {
+        if (!stats[i].valid)
+            continue;
+        Com_Printf("%-10s %6.0f %6u %6u %6u %6u %6u\n", bench_stage_names[i],
+                   stats[i].mean, stats[i].min, stats[i].pct[0],
+                   stats[i].pct[1], stats[i].pct[2], stats[i].max);
+    }
+}
+
+/*
+==============================================================================
+
+REPORTS
+
+==============================================================================
+*/
+
+static bool report_path(char *buffer, size_t size, const char *name, const char *ext)
+{
+    if (Q_concat(buffer, size, BENCH_DIR, name, ext) >= size) {
+        Com_EPrintf("Oversize benchmark report name\n");
+        return false;
+    }
+    return true;
+}
+
+static void write_csv(const char *name)
+{
+    char path[MAX_OSPATH];
+    qhandle_t f;
+    int i, j;
+
+    if (!report_path(path, sizeof(path), name, ".csv"))
+        return;
+
+    FS_OpenFile(path, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for writing\n", path);
+        return;
+    }
+
+    FS_FPrintf(f, "index");
+    for (i = 0; i < BENCH_NUM_STAGES; i++)
+        if (bench.used & (1U << i))
+            FS_FPrintf(f, ",%s", bench_stage_names[i]);
+    FS_FPrintf(f, "\n");
+
+    for (j = 0; j < bench.numframes; j++) {
+        FS_FPrintf(f, "%d", j);
+        for (i = 0; i < BENCH_NUM_STAGES; i++)
+            if (bench.used & (1U << i))
+                FS_FPrintf(f, ",%u", bench.frames[j][i]);
+        FS_FPrintf(f, "\n");
+    }
+
+    FS_CloseFile(f);
+}
+
+static void write_json(const char *name, const benchstat_t *stats, double seconds)
+{
+    char path[MAX_OSPATH];
+    const char *sep = "";
+    qhandle_t f;
+    int i, j;
+
+    if (!report_path(path, sizeof(path), name, ".json"))
+        return;
+
+    FS_OpenFile(path, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for writing\n", path);
+        return;
+    }
+
+    FS_FPrintf(f, "{\n  \"name\": \"%s\",\n  \"frames\": %d,\n"
+               "  \"seconds\": %.3f,\n  \"fps\": %.1f,\n  \"stages\": {",
+               bench.name, bench.numframes, seconds,
+               seconds > 0 ? bench.numframes / seconds : 0.0);
+
+    for (i = 0; i < BENCH_NUM_STAGES; i++) {
+        if (!stats[i].valid)
+            continue;
+        FS_FPrintf(f, "%s\n    \"%s\": { \"mean\": %.1f, \"min\": %u",
+                   sep, bench_stage_names[i], stats[i].mean, stats[i].min);
+        for (j = 0; j < BENCH_NUM_PCT; j++)
+            FS_FPrintf(f, ", \"%s\": %u", bench_pct_names[j], stats[i].pct[j]);
+        FS_FPrintf(f, ", \"max\": %u }", stats[i].max);
+        sep = ",";
+    }
+
+    FS_FPrintf(f, "\n  }\n}\n");
+    FS_CloseFile(f);
+
+    Com_Printf("Wrote %s\n", path);
+}
+
+// reads back percentiles from JSON written by write_json()
+static bool load_json(const char *name, benchstat_t *stats)
+{
+    char path[MAX_OSPATH], key[MAX_QPATH];
+    char *data, *obj, *end, *p;
+    int i, j, ret;
+
+    memset(stats, 0, sizeof(stats[0]) * BENCH_NUM_STAGES);
+
+    if (!report_path(path, sizeof(path), name, ".json"))
+        return false;
+
+    ret = FS_LoadFile(path, (void **)&data);
+    if (!data) {
+        Com_EPrintf("Couldn't load %s: %s\n", path, Q_ErrorString(ret));
+        return false;
+    }
+
+    for (i = 0; i < BENCH_NUM_STAGES; i++) {
+        Q_snprintf(key, sizeof(key), "\"%s\":", bench_stage_names[i]);
+        obj = strstr(data, key);
+        if (!obj)
+            continue;
+        end = strchr(obj, '}');
+        if (!end)
+            continue;
+
+        for (j = 0; j < BENCH_NUM_PCT; j++) {
+            Q_snprintf(key, sizeof(key), "\"%s\":", bench_pct_names[j]);
+            p = strstr(obj, key);
+            if (!p || p > end)
+                break;
+            stats[i].pct[j] = strtoul(p + strlen(key), NULL, 10);
+        }
+
+        stats[i].valid = j == BENCH_NUM_PCT;
+    }
+
+    FS_FreeFile(data);
+    return true;
+}
+
+// returns number of regressed percentiles
+static int compare_stats(const benchstat_t *cur, const benchstat_t *base)
+{
+    float tolerance = Cvar_ClampValue(timedemo_tolerance, 0, 1000);
+    int i, j, regressed = 0;
+    unsigned a, b;
+    bool bad;
+
+    Com_Printf("stage          p50 delta      p95 delta      p99 delta\n"
+               "---------- ------ ------- ------ ------- ------ -------\n");
+    for (i = 0; i < BENCH_NUM_STAGES; i++) {
+        if (!cur[i].valid || !base[i].valid)
+            continue;
+
+        Com_Printf("%-10s", bench_stage_names[i]);
+        for (j = 0; j < BENCH_NUM_PCT; j++) {
+            a = cur[i].pct[j];
+            b = base[i].pct[j];
+            bad = a > b + BENCH_MIN_DELTA && a > b * (1 + tolerance * 0.01f);
+            Com_Printf(" %6u %+6.1f%%%s", a, b ? (a - (double)b) * 100 / b : 0.0,
+                       bad ? "!" : "");
+            regressed += bad;
+        }
+        Com_Printf("\n");
+    }
+
+    if (regressed)
+        Com_WPrintf("REGRESSION: %d percentiles exceed baseline by more than %g%%\n",
+                    regressed, tolerance);
+    else
+        Com_Printf("No regressions against baseline\n");
+
+    return regressed;
+}
+
+void Bench_Stop(void)
+{
+    benchstat_t stats[BENCH_NUM_STAGES], base[BENCH_NUM_STAGES];
+    double seconds;
+
+    if (!bench_running)
+        return;
+
+    bench_running = false;
+    seconds = (Sys_Microseconds() - bench.start) * 1e-6;
+
+    if (!bench.numframes)
+        return;
+
+    calc_stats(stats);
+
+    Com_Printf("%d frames, %.3f seconds, %.1f fps\n", bench.numframes, seconds,
+               seconds > 0 ? bench.numframes / seconds : 0.0);
+    print_stats(stats);
+
+    if (timedemo_report->string[0]) {
+        write_csv(timedemo_report->string);
+        write_json(timedemo_report->string, stats, seconds);
+    }
+
+    if (timedemo_baseline->string[0] &&
+        load_json(timedemo_baseline->string, base))
+        compare_stats(stats, base);
+
+    Z_Free(bench.frames);
+    bench.frames = NULL;
+    bench.numframes = bench.maxframes = 0;
+}
+
+static void Bench_Compare_f(void)
+{
+    benchstat_t cur[BENCH_NUM_STAGES], base[BENCH_NUM_STAGES];
+
+    if (Cmd_Argc() != 3) {
+        Com_Printf("Usage: %s <report> <baseline>\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (load_json(Cmd_Argv(1), cur) && load_json(Cmd_Argv(2), base))
+        compare_stats(cur, base);
+}
+
+void Bench_Init(void)
+{
+    timedemo_report = Cvar_Get("timedemo_report", "", 0);
+    timedemo_baseline = Cvar_Get("timedemo_baseline", "", 0);
+    timedemo_tolerance = Cvar_Get("timedemo_tolerance", "10", 0);
+
+    Cmd_AddCommand("benchcompare", Bench_Compare_f);
+}
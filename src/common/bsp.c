@@ -30,11 +30,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/math.h"
 #include "common/utils.h"
 #include "common/mdfour.h"
+#include "common/prof.h"
 #include "system/hunk.h"
 
 extern mtexinfo_t nulltexinfo;
 
 static cvar_t *map_visibility_patch;
+static cvar_t *map_phs_budget;
 
 /*
 ===============================================================================
@@ -281,7 +283,6 @@ LOAD(Brushes)
         out->firstbrushside = bsp->brushsides + firstside;
         out->numsides = numsides;
         out->contents = LittleLong(in->contents);
-        out->checkcount = 0;
     }
 
     return Q_ERR_SUCCESS;
@@ -1311,12 +1312,13 @@ void BSP_Free(bsp_t *bsp)
     }
     Q_assert(bsp->refcount > 0);
     if (--bsp->refcount == 0) {
-		if (bsp->pvs2_matrix)
-		{
-			// free the PVS2 matrix separately - it's not part of the hunk
-			Z_Free(bsp->pvs2_matrix);
-			bsp->pvs2_matrix = NULL;
-		}
+		// free the vis matrices separately - they are not part of the hunk
+		Z_Free(bsp->pvs_matrix);
+		Z_Free(bsp->pvs2_matrix);
+		Z_Free(bsp->phs_matrix);
+		bsp->pvs_matrix = NULL;
+		bsp->pvs2_matrix = NULL;
+		bsp->phs_matrix = NULL;
 
         Hunk_Free(&bsp->hunk);
         List_Remove(&bsp->entry);
@@ -1450,6 +1452,112 @@ bool BSP_SavePatchedPVS(bsp_t *bsp)
 		return false;
 }
 
+#define PHS_IDENT   MakeLittleLong('P', 'H', 'S', '1')
+
+typedef struct {
+	uint32_t	ident;
+	uint32_t	checksum;
+	uint32_t	numclusters;
+	uint32_t	rowsize;
+	uint32_t	patched;
+} dphsheader_t;
+
+// Converts `maps/<name>.bsp` into `maps/pvs/<name>.phs`
+static bool BSP_GetPHSFileName(const char* map_path, char phs_path[MAX_QPATH])
+{
+	if (!BSP_GetPatchedPVSFileName(map_path, phs_path))
+		return false;
+
+	strcpy(phs_path + strlen(phs_path) - 4, ".phs");
+	return true;
+}
+
+static void BSP_PHSHeader(bsp_t *bsp, dphsheader_t *header)
+{
+	header->ident = LittleLong(PHS_IDENT);
+	header->checksum = LittleLong(bsp->checksum);
+	header->numclusters = LittleLong(bsp->vis->numclusters);
+	header->rowsize = LittleLong(bsp->visrowsize);
+	header->patched = LittleLong(!!map_visibility_patch->integer);
+}
+
+// Loads the PHS matrix from a file called `maps/pvs/<mapname>.phs` if it matches the map
+static bool BSP_LoadPHSMatrix(bsp_t *bsp, const char *phs_path, size_t matrix_size)
+{
+	dphsheader_t header;
+	byte *filebuf;
+	int filelen;
+
+	filelen = FS_LoadFile(phs_path, (void **)&filebuf);
+	if (!filebuf)
+		return false;
+
+	BSP_PHSHeader(bsp, &header);
+	if (filelen != sizeof(header) + matrix_size || memcmp(filebuf, &header, sizeof(header)))
+	{
+		FS_FreeFile(filebuf);
+		return false;
+	}
+
+	bsp->phs_matrix = Z_Malloc(matrix_size);
+	memcpy(bsp->phs_matrix, filebuf + sizeof(header), matrix_size);
+
+	FS_FreeFile(filebuf);
+	return true;
+}
+
+static void BSP_SavePHSMatrix(bsp_t *bsp, const char *phs_path, size_t matrix_size)
+{
+	dphsheader_t header;
+	byte *filebuf;
+
+	BSP_PHSHeader(bsp, &header);
+
+	filebuf = Z_Malloc(sizeof(header) + matrix_size);
+	memcpy(filebuf, &header, sizeof(header));
+	memcpy(filebuf + sizeof(header), bsp->phs_matrix, matrix_size);
+
+	if (FS_WriteFile(phs_path, filebuf, sizeof(header) + matrix_size) < 0)
+		Com_DPrintf("Couldn't write %s\n", phs_path);
+
+	Z_Free(filebuf);
+}
+
+// Decompresses the PHS into a matrix like the PVS, unless it exceeds map_phs_budget.
+// The matrix is cached in `maps/pvs/<mapname>.phs` for later loads of the same map.
+static void BSP_BuildPhsMatrix(bsp_t *bsp)
+{
+	char phs_path[MAX_QPATH];
+	bool have_path;
+
+	if (!bsp->vis)
+		return;
+
+	size_t matrix_size = bsp->visrowsize * bsp->vis->numclusters;
+	if (matrix_size > (size_t)Cvar_ClampInteger(map_phs_budget, 0, 4096) << 20)
+	{
+		Com_DPrintf("%s: PHS matrix of %zu bytes exceeds map_phs_budget\n", bsp->name, matrix_size);
+		return;
+	}
+
+	have_path = BSP_GetPHSFileName(bsp->name, phs_path);
+	if (have_path && BSP_LoadPHSMatrix(bsp, phs_path, matrix_size))
+		return;
+
+	// as with the PVS, don't set it in the BSP structure until it's built
+	byte* phs_matrix = Z_Malloc(matrix_size);
+
+	for (int cluster = 0; cluster < bsp->vis->numclusters; cluster++)
+	{
+		BSP_ClusterVis(bsp, phs_matrix + bsp->visrowsize * cluster, cluster, DVIS_PHS);
+	}
+
+	bsp->phs_matrix = phs_matrix;
+
+	if (have_path)
+		BSP_SavePHSMatrix(bsp, phs_path, matrix_size);
+}
+
 #if USE_REF
 static bool BSP_FindBspxLump(dheader_t* header, size_t file_size, const char* name, const void** pLump, size_t* pLumpSize)
 {
@@ -1545,14 +1653,7 @@ static void BSP_LoadBspxNormals(bsp_t* bsp, const void* data, size_t data_size)
 }
 #endif
 
-/*
-==================
-BSP_Load
-
-Loads in the map and all submodels
-==================
-*/
-int BSP_Load(const char *name, bsp_t **bsp_p)
+static int load_bsp(const char *name, bsp_t **bsp_p)
 {
     bsp_t           *bsp;
     byte            *buf;
@@ -1582,7 +1683,7 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
     //
     // load the file
     //
-    filelen = FS_LoadFile(name, (void **)&buf);
+    filelen = FS_LoadFileFlags(name, (void **)&buf, FS_FLAG_MAPPED);
     if (!buf) {
         return filelen;
     }
@@ -1678,6 +1779,8 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
 		bsp->pvs_patched = true;
 	}
 
+	BSP_BuildPhsMatrix(bsp);
+
 #if USE_REF
     if (normal_lump_size)
 	{
@@ -1702,6 +1805,24 @@ fail2:
     return ret;
 }
 
+/*
+==================
+BSP_Load
+
+Loads in the map and all submodels
+==================
+*/
+int BSP_Load(const char *name, bsp_t **bsp_p)
+{
+    int ret;
+
+    PROF_BEGIN("BSP_Load");
+    ret = load_bsp(name, bsp_p);
+    PROF_END();
+
+    return ret;
+}
+
 /*
 ===============================================================================
 
@@ -1857,6 +1978,12 @@ byte *BSP_ClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis)
 		return mask;
 	}
 
+	if (vis == DVIS_PHS && bsp->phs_matrix)
+	{
+		memcpy(mask, bsp->phs_matrix + bsp->visrowsize * cluster, bsp->visrowsize);
+		return mask;
+	}
+
     // decompress vis
     in_end = (byte *)bsp->vis + bsp->numvisibility;
     in = (byte *)bsp->vis + bsp->vis->bitofs[cluster][vis];
@@ -1963,6 +2090,7 @@ mmodel_t *BSP_InlineModel(bsp_t *bsp, const char *name)
 void BSP_Init(void)
 {
     map_visibility_patch = Cvar_Get("map_visibility_patch", "1", 0);
+    map_phs_budget = Cvar_Get("map_phs_budget", "16", 0);
 
     Cmd_AddCommand("bsplist", BSP_List_f);
 
@@ -24,15 +24,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/math.h"
+#include "common/prof.h"
 #include "common/zone.h"
 #include "system/hunk.h"
+#include "system/system.h"
 
 mtexinfo_t nulltexinfo;
 
 static mleaf_t      nullleaf;
 
 static int          floodvalid;
-static int          checkcount;
 
 static cvar_t       *map_noareas;
 static cvar_t       *map_allsolid_bug;
@@ -107,14 +108,16 @@ mleaf_t *CM_LeafNum(cm_t *cm, int number)
 
 //=======================================================================
 
-static cplane_t box_planes[12];
-static mnode_t  box_nodes[6];
-static mnode_t  *box_headnode;
-static mbrush_t box_brush;
-static mbrush_t *box_leafbrush;
-static mbrushside_t box_brushsides[6];
-static mleaf_t  box_leaf;
-static mleaf_t  box_emptyleaf;
+// box hull is per thread, so that entities can be clipped against from
+// multiple threads at once
+static q_thread_local cplane_t box_planes[12];
+static q_thread_local mnode_t  box_nodes[6];
+static q_thread_local mnode_t  *box_headnode;
+static q_thread_local mbrush_t box_brush;
+static q_thread_local mbrush_t *box_leafbrush;
+static q_thread_local mbrushside_t box_brushsides[6];
+static q_thread_local mleaf_t  box_leaf;
+static q_thread_local mleaf_t  box_emptyleaf;
 
 /*
 ===================
@@ -183,6 +186,9 @@ BSP trees instead of being compared directly.
 */
 mnode_t *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs)
 {
+    if (!box_headnode)
+        CM_InitBoxHull();
+
     box_planes[0].dist = maxs[0];
     box_planes[1].dist = -maxs[0];
     box_planes[2].dist = mins[0];
@@ -214,33 +220,35 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int          leaf_count, leaf_maxcount;
-static mleaf_t      **leaf_list;
-static const vec_t  *leaf_mins, *leaf_maxs;
-static mnode_t      *leaf_topnode;
-
-static void CM_BoxLeafs_r(mnode_t *node)
+typedef struct {
+    int             count, maxcount;
+    mleaf_t         **list;
+    const vec_t     *mins, *maxs;
+    mnode_t         *topnode;
+} boxleafs_t;
+
+static void CM_BoxLeafs_r(boxleafs_t *bl, mnode_t *node)
 {
     int     s;
 
     while (node->plane) {
-        s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        s = BoxOnPlaneSideFast(bl->mins, bl->maxs, node->plane);
         if (s == 1) {
             node = node->children[0];
         } else if (s == 2) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!bl->topnode) {
+                bl->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(bl, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (mleaf_t *)node;
+    if (bl->count < bl->maxcount) {
+        bl->list[bl->count++] = (mleaf_t *)node;
     }
 }
 
@@ -248,20 +256,22 @@ static int CM_BoxLeafs_headnode(const vec3_t mins, const vec3_t maxs,
                                 mleaf_t **list, int listsize,
                                 mnode_t *headnode, mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
+    boxleafs_t  bl;
+
+    bl.list = list;
+    bl.count = 0;
+    bl.maxcount = listsize;
+    bl.mins = mins;
+    bl.maxs = maxs;
 
-    leaf_topnode = NULL;
+    bl.topnode = NULL;
 
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&bl, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = bl.topnode;
 
-    return leaf_count;
+    return bl.count;
 }
 
 int CM_BoxLeafs(cm_t *cm, const vec3_t mins, const vec3_t maxs,
@@ -324,20 +334,16 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    0.03125f
 
-static vec3_t   trace_start, trace_end;
-static vec3_t   trace_offsets[8];
-static vec3_t   trace_extents;
-
-static trace_t  *trace_trace;
-static int      trace_contents;
-static bool     trace_ispoint;      // optimized case
+// used by CM_BoxTrace and friends
+static q_thread_local trace_ctx_t   cm_trace_ctx;
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace, mbrush_t *brush)
+static void CM_ClipBoxToBrush(const trace_ctx_t *ctx, const vec3_t p1, const vec3_t p2,
+                              trace_t *trace, mbrush_t *brush)
 {
     int         i;
     cplane_t    *plane, *clipplane;
@@ -364,10 +370,10 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         plane = side->plane;
 
         // FIXME: special case for axial
-        if (!trace_ispoint) {
+        if (!ctx->ispoint) {
             // general box case
             // push the plane out apropriately for mins/maxs
-            dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+            dist = DotProduct(ctx->offsets[plane->signbits], plane->normal);
             dist = plane->dist - dist;
         } else {
             // special point case
@@ -436,7 +442,8 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
 CM_TestBoxInBrush
 ================
 */
-static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
+static void CM_TestBoxInBrush(const trace_ctx_t *ctx, const vec3_t p1,
+                              trace_t *trace, mbrush_t *brush)
 {
     int         i;
     cplane_t    *plane;
@@ -454,7 +461,7 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
         // FIXME: special case for axial
         // general box case
         // push the plane out apropriately for mins/maxs
-        dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+        dist = DotProduct(ctx->offsets[plane->signbits], plane->normal);
         dist = plane->dist - dist;
 
         d1 = DotProduct(p1, plane->normal) - dist;
@@ -470,30 +477,56 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, mbrush_t *brush)
     trace->contents = brush->contents;
 }
 
+/*
+================
+CM_BrushChecked
+
+Returns true if brush was already checked during current trace in another
+leaf. Checking brush again doesn't change the result, so if there are too
+many brushes to remember, they are simply checked again.
+================
+*/
+static bool CM_BrushChecked(trace_ctx_t *ctx, const mbrush_t *brush)
+{
+    unsigned i = (unsigned)((uintptr_t)brush / sizeof(*brush)) * 2654435761U;
+
+    if (ctx->numchecked >= TRACE_CHECK_SLOTS * 3 / 4)
+        return false;
+
+    for (i &= TRACE_CHECK_SLOTS - 1; ; i = (i + 1) & (TRACE_CHECK_SLOTS - 1)) {
+        if (ctx->checked[i].checkcount != ctx->checkcount) {
+            ctx->checked[i].checkcount = ctx->checkcount;
+            ctx->checked[i].brush = brush;
+            ctx->numchecked++;
+            return false;
+        }
+        if (ctx->checked[i].brush == brush)
+            return true;
+    }
+}
+
 /*
 ================
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(mleaf_t *leaf)
+static void CM_TraceToLeaf(trace_ctx_t *ctx, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & ctx->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
-            continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
-
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & ctx->contents))
             continue;
-        CM_ClipBoxToBrush(trace_start, trace_end, trace_trace, b);
-        if (!trace_trace->fraction)
+        if (CM_BrushChecked(ctx, b))
+            continue;   // already checked this brush in another leaf
+        CM_ClipBoxToBrush(ctx, ctx->start, ctx->end, ctx->trace, b);
+        if (!ctx->trace->fraction)
             return;
     }
 }
@@ -503,25 +536,23 @@ static void CM_TraceToLeaf(mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(mleaf_t *leaf)
+static void CM_TestInLeaf(trace_ctx_t *ctx, mleaf_t *leaf)
 {
     int         k;
     mbrush_t    *b, **leafbrush;
 
-    if (!(leaf->contents & trace_contents))
+    if (!(leaf->contents & ctx->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
-            continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
-
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & ctx->contents))
             continue;
-        CM_TestBoxInBrush(trace_start, trace_trace, b);
-        if (!trace_trace->fraction)
+        if (CM_BrushChecked(ctx, b))
+            continue;   // already checked this brush in another leaf
+        CM_TestBoxInBrush(ctx, ctx->start, ctx->trace, b);
+        if (!ctx->trace->fraction)
             return;
     }
 }
@@ -532,7 +563,8 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+static void CM_RecursiveHullCheck(trace_ctx_t *ctx, mnode_t *node, float p1f, float p2f,
+                                  const vec3_t p1, const vec3_t p2)
 {
     cplane_t    *plane;
     float       t1, t2, offset;
@@ -542,14 +574,14 @@ static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, const vec
     int         side;
     float       midf;
 
-    if (trace_trace->fraction <= p1f)
+    if (ctx->trace->fraction <= p1f)
         return;     // already hit something nearer
 
 recheck:
     // if plane is NULL, we are in a leaf node
     plane = node->plane;
     if (!plane) {
-        CM_TraceToLeaf((mleaf_t *)node);
+        CM_TraceToLeaf(ctx, (mleaf_t *)node);
         return;
     }
 
@@ -560,16 +592,16 @@ recheck:
     if (plane->type < 3) {
         t1 = p1[plane->type] - plane->dist;
         t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+        offset = ctx->extents[plane->type];
     } else {
         t1 = PlaneDiff(p1, plane);
         t2 = PlaneDiff(p2, plane);
-        if (trace_ispoint)
+        if (ctx->ispoint)
             offset = 0;
         else
-            offset = fabsf(trace_extents[0] * plane->normal[0]) +
-                     fabsf(trace_extents[1] * plane->normal[1]) +
-                     fabsf(trace_extents[2] * plane->normal[2]);
+            offset = fabsf(ctx->extents[0] * plane->normal[0]) +
+                     fabsf(ctx->extents[1] * plane->normal[1]) +
+                     fabsf(ctx->extents[2] * plane->normal[2]);
     }
 
     // see which sides we need to consider
@@ -603,48 +635,57 @@ recheck:
     midf = p1f + (p2f - p1f) * clamp(frac, 0, 1);
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(ctx, node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     midf = p1f + (p2f - p1f) * clamp(frac2, 0, 1);
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(ctx, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
 //======================================================================
 
 /*
 ==================
-CM_BoxTrace
+CM_BoxTraceCtx
+
+Same as CM_BoxTrace, but keeps all state in the given context. Traces
+using different contexts may run concurrently. Context must be zero
+initialized before first use.
 ==================
 */
-void CM_BoxTrace(trace_t *trace,
-                 const vec3_t start, const vec3_t end,
-                 const vec3_t mins, const vec3_t maxs,
-                 mnode_t *headnode, int brushmask)
+static void box_trace(trace_ctx_t *ctx, trace_t *trace,
+                      const vec3_t start, const vec3_t end,
+                      const vec3_t mins, const vec3_t maxs,
+                      mnode_t *headnode, int brushmask)
 {
     const vec_t *bounds[2] = { mins, maxs };
     int i, j;
 
-    checkcount++;       // for multi-check avoidance
+    // for multi-check avoidance
+    if (!++ctx->checkcount) {
+        memset(ctx->checked, 0, sizeof(ctx->checked));
+        ctx->checkcount = 1;
+    }
+    ctx->numchecked = 0;
 
     // fill in a default trace
-    trace_trace = trace;
-    memset(trace_trace, 0, sizeof(*trace_trace));
-    trace_trace->fraction = 1;
-    trace_trace->surface = &(nulltexinfo.c);
+    ctx->trace = trace;
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->surface = &(nulltexinfo.c);
 
     if (!headnode) {
         return;
     }
 
-    trace_contents = brushmask;
-    VectorCopy(start, trace_start);
-    VectorCopy(end, trace_end);
+    ctx->contents = brushmask;
+    VectorCopy(start, ctx->start);
+    VectorCopy(end, ctx->end);
     for (i = 0; i < 8; i++)
         for (j = 0; j < 3; j++)
-            trace_offsets[i][j] = bounds[i >> j & 1][j];
+            ctx->offsets[i][j] = bounds[i >> j & 1][j];
 
     //
     // check for position test special case
@@ -663,11 +704,11 @@ void CM_BoxTrace(trace_t *trace,
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, q_countof(leafs), headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
-            if (trace_trace->allsolid)
+            CM_TestInLeaf(ctx, leafs[i]);
+            if (trace->allsolid)
                 break;
         }
-        VectorCopy(start, trace_trace->endpos);
+        VectorCopy(start, trace->endpos);
         return;
     }
 
@@ -675,39 +716,62 @@ void CM_BoxTrace(trace_t *trace,
     // check for point special case
     //
     if (VectorEmpty(mins) && VectorEmpty(maxs)) {
-        trace_ispoint = true;
-        VectorClear(trace_extents);
+        ctx->ispoint = true;
+        VectorClear(ctx->extents);
     } else {
-        trace_ispoint = false;
-        trace_extents[0] = max(-mins[0], maxs[0]);
-        trace_extents[1] = max(-mins[1], maxs[1]);
-        trace_extents[2] = max(-mins[2], maxs[2]);
+        ctx->ispoint = false;
+        ctx->extents[0] = max(-mins[0], maxs[0]);
+        ctx->extents[1] = max(-mins[1], maxs[1]);
+        ctx->extents[2] = max(-mins[2], maxs[2]);
     }
 
     //
     // general sweeping through world
     //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+    CM_RecursiveHullCheck(ctx, headnode, 0, 1, start, end);
 
-    if (trace_trace->fraction == 1)
-        VectorCopy(end, trace_trace->endpos);
+    if (trace->fraction == 1)
+        VectorCopy(end, trace->endpos);
     else
-        LerpVector(start, end, trace_trace->fraction, trace_trace->endpos);
+        LerpVector(start, end, trace->fraction, trace->endpos);
+}
+
+void CM_BoxTraceCtx(trace_ctx_t *ctx, trace_t *trace,
+                    const vec3_t start, const vec3_t end,
+                    const vec3_t mins, const vec3_t maxs,
+                    mnode_t *headnode, int brushmask)
+{
+    PROF_BEGIN("CM_BoxTrace");
+    box_trace(ctx, trace, start, end, mins, maxs, headnode, brushmask);
+    PROF_END();
+}
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+void CM_BoxTrace(trace_t *trace,
+                 const vec3_t start, const vec3_t end,
+                 const vec3_t mins, const vec3_t maxs,
+                 mnode_t *headnode, int brushmask)
+{
+    CM_BoxTraceCtx(&cm_trace_ctx, trace, start, end, mins, maxs, headnode, brushmask);
 }
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_TransformedBoxTraceCtx
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
 ==================
 */
-void CM_TransformedBoxTrace(trace_t *trace,
-                            const vec3_t start, const vec3_t end,
-                            const vec3_t mins, const vec3_t maxs,
-                            mnode_t *headnode, int brushmask,
-                            const vec3_t origin, const vec3_t angles)
+void CM_TransformedBoxTraceCtx(trace_ctx_t *ctx, trace_t *trace,
+                               const vec3_t start, const vec3_t end,
+                               const vec3_t mins, const vec3_t maxs,
+                               mnode_t *headnode, int brushmask,
+                               const vec3_t origin, const vec3_t angles)
 {
     vec3_t      start_l, end_l;
     vec3_t      axis[3];
@@ -726,7 +790,7 @@ void CM_TransformedBoxTrace(trace_t *trace,
     }
 
     // sweep the box through the model
-    CM_BoxTrace(trace, start_l, end_l, mins, maxs, headnode, brushmask);
+    CM_BoxTraceCtx(ctx, trace, start_l, end_l, mins, maxs, headnode, brushmask);
 
     // rotate plane normal into the worlds frame of reference
     if (rotated && trace->fraction != 1.0f) {
@@ -739,6 +803,16 @@ void CM_TransformedBoxTrace(trace_t *trace,
     LerpVector(start, end, trace->fraction, trace->endpos);
 }
 
+void CM_TransformedBoxTrace(trace_t *trace,
+                            const vec3_t start, const vec3_t end,
+                            const vec3_t mins, const vec3_t maxs,
+                            mnode_t *headnode, int brushmask,
+                            const vec3_t origin, const vec3_t angles)
+{
+    CM_TransformedBoxTraceCtx(&cm_trace_ctx, trace, start, end, mins, maxs,
+                              headnode, brushmask, origin, angles);
+}
+
 void CM_ClipEntity(trace_t *dst, const trace_t *src, struct edict_s *ent)
 {
     dst->allsolid |= src->allsolid;
@@ -957,29 +1031,40 @@ bool CM_HeadnodeVisible(mnode_t *node, byte *visbits)
 }
 
 /*
-============
-CM_FatPVS
+=============
+CM_HeadnodeClusters
 
-The client will interpolate the view position,
-so we can't use a single PVS point
-===========
+Sets bits of all clusters of leafs under headnode
+=============
 */
-byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis)
+void CM_HeadnodeClusters(mnode_t *node, byte *bits)
 {
-    byte    temp[VIS_MAX_BYTES];
-    mleaf_t *leafs[64];
-    int     clusters[64];
-    int     i, j, count, longs;
-    size_t  *src, *dst;
-    vec3_t  mins, maxs;
+    mleaf_t *leaf;
 
-    if (!cm->cache) {   // map not loaded
-        return memset(mask, 0, VIS_MAX_BYTES);
-    }
-    if (!cm->cache->vis) {
-        return memset(mask, 0xff, VIS_MAX_BYTES);
+    while (node->plane) {
+        CM_HeadnodeClusters(node->children[0], bits);
+        node = node->children[1];
     }
 
+    leaf = (mleaf_t *)node;
+    if (leaf->cluster != -1)
+        Q_SetBit(bits, leaf->cluster);
+}
+
+/*
+============
+CM_FatClusters
+
+Finds distinct clusters touched by the box around view position,
+returned in ascending order. List must hold MAX_FAT_CLUSTERS entries.
+============
+*/
+int CM_FatClusters(cm_t *cm, const vec3_t org, int *clusters)
+{
+    mleaf_t *leafs[MAX_FAT_CLUSTERS];
+    int     i, j, k, count, cluster;
+    vec3_t  mins, maxs;
+
     for (i = 0; i < 3; i++) {
         mins[i] = org[i] - 8;
         maxs[i] = org[i] + 8;
@@ -989,9 +1074,39 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis)
     if (count < 1)
         Com_Error(ERR_DROP, "CM_FatPVS: leaf count < 1");
 
-    // convert leafs to clusters
-    for (i = 0; i < count; i++) {
-        clusters[i] = leafs[i]->cluster;
+    // convert leafs to sorted clusters
+    for (i = j = 0; i < count; i++) {
+        cluster = leafs[i]->cluster;
+        for (k = j; k > 0 && clusters[k - 1] > cluster; k--)
+            ;
+        if (k > 0 && clusters[k - 1] == cluster)
+            continue;   // already have the cluster we want
+        memmove(clusters + k + 1, clusters + k, (j - k) * sizeof(clusters[0]));
+        clusters[k] = cluster;
+        j++;
+    }
+
+    return j;
+}
+
+/*
+============
+CM_ClustersPVS
+
+Combines visibility of distinct clusters
+============
+*/
+byte *CM_ClustersPVS(cm_t *cm, byte *mask, const int *clusters, int count, int vis)
+{
+    byte    temp[VIS_MAX_BYTES];
+    int     i, j, longs;
+    size_t  *src, *dst;
+
+    if (!cm->cache) {   // map not loaded
+        return memset(mask, 0, VIS_MAX_BYTES);
+    }
+    if (!cm->cache->vis) {
+        return memset(mask, 0xff, VIS_MAX_BYTES);
     }
 
     BSP_ClusterVis(cm->cache, mask, clusters[0], vis);
@@ -999,23 +1114,166 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis)
 
     // or in all the other leaf bits
     for (i = 1; i < count; i++) {
-        for (j = 0; j < i; j++) {
-            if (clusters[i] == clusters[j]) {
-                goto nextleaf; // already have the cluster we want
-            }
-        }
         src = (size_t *)BSP_ClusterVis(cm->cache, temp, clusters[i], vis);
         dst = (size_t *)mask;
         for (j = 0; j < longs; j++) {
             *dst++ |= *src++;
         }
-
-nextleaf:;
     }
 
     return mask;
 }
 
+/*
+============
+CM_FatPVS
+
+The client will interpolate the view position,
+so we can't use a single PVS point
+===========
+*/
+byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org, int vis)
+{
+    int     clusters[MAX_FAT_CLUSTERS];
+    int     count;
+
+    if (!cm->cache) {   // map not loaded
+        return memset(mask, 0, VIS_MAX_BYTES);
+    }
+    if (!cm->cache->vis) {
+        return memset(mask, 0xff, VIS_MAX_BYTES);
+    }
+
+    count = CM_FatClusters(cm, org, clusters);
+    return CM_ClustersPVS(cm, mask, clusters, count, vis);
+}
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    int         brushmask;
+} tracework_t;
+
+typedef struct {
+    mnode_t     *headnode;
+    tracework_t *work;
+    trace_t     *results;
+    trace_ctx_t *ctx;       // [MAX_WORKER_THREADS]
+    int         batch;
+    int         count;
+} tracetest_t;
+
+static void trace_batch(void *arg, int index, int slot)
+{
+    tracetest_t *t = arg;
+    int i, end = min((index + 1) * t->batch, t->count);
+
+    for (i = index * t->batch; i < end; i++) {
+        tracework_t *w = &t->work[i];
+        CM_BoxTraceCtx(&t->ctx[slot], &t->results[i], w->start, w->end,
+                       w->mins, w->maxs, t->headnode, w->brushmask);
+    }
+}
+
+static bool trace_equal(const trace_t *a, const trace_t *b)
+{
+    return a->allsolid == b->allsolid && a->startsolid == b->startsolid &&
+        a->fraction == b->fraction && VectorCompare(a->endpos, b->endpos) &&
+        VectorCompare(a->plane.normal, b->plane.normal) &&
+        a->plane.dist == b->plane.dist && a->surface == b->surface &&
+        a->contents == b->contents;
+}
+
+/*
+=============
+CM_TraceTest_f
+
+Traces random boxes through the map from multiple threads
+and checks that results match serial traces.
+=============
+*/
+static void CM_TraceTest_f(void)
+{
+    char name[MAX_QPATH];
+    cm_t cm;
+    tracetest_t t;
+    trace_t *serial;
+    int i, j, ret, threads, errors;
+    unsigned start, time_serial, time_parallel;
+    mmodel_t *world;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [threads] [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    threads = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 4;
+    clamp(threads, 1, MAX_WORKER_THREADS);
+    t.count = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 100000;
+    clamp(t.count, 1, 10000000);
+
+    Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp");
+    memset(&cm, 0, sizeof(cm));
+    ret = CM_LoadMap(&cm, name);
+    if (ret) {
+        Com_EPrintf("Couldn't load %s: %s\n", name, Q_ErrorString(ret));
+        return;
+    }
+
+    world = &cm.cache->models[0];
+    t.headnode = world->headnode;
+    t.batch = 256;
+    t.work = Z_Malloc(sizeof(t.work[0]) * t.count);
+    t.results = Z_Malloc(sizeof(t.results[0]) * t.count);
+    t.ctx = Z_Mallocz(sizeof(t.ctx[0]) * MAX_WORKER_THREADS);
+    serial = Z_Malloc(sizeof(serial[0]) * t.count);
+
+    Q_srand(1);
+    for (i = 0; i < t.count; i++) {
+        tracework_t *w = &t.work[i];
+        for (j = 0; j < 3; j++) {
+            w->start[j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+            w->end[j] = w->start[j] + crand() * 512;
+        }
+        if (i & 1) {
+            VectorSet(w->mins, -16, -16, -24);
+            VectorSet(w->maxs, 16, 16, 32);
+        } else {
+            VectorClear(w->mins);
+            VectorClear(w->maxs);
+        }
+        if (!(i & 7))
+            VectorCopy(w->start, w->end);
+        w->brushmask = (i & 2) ? MASK_SHOT : MASK_PLAYERSOLID;
+    }
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < t.count; i++) {
+        tracework_t *w = &t.work[i];
+        CM_BoxTrace(&serial[i], w->start, w->end, w->mins, w->maxs,
+                    t.headnode, w->brushmask);
+    }
+    time_serial = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    Sys_ParallelFor(threads, (t.count + t.batch - 1) / t.batch, trace_batch, &t);
+    time_parallel = Sys_Milliseconds() - start;
+
+    errors = 0;
+    for (i = 0; i < t.count; i++)
+        if (!trace_equal(&serial[i], &t.results[i]))
+            errors++;
+
+    Com_Printf("%d traces: %u msec serial, %u msec on %d threads, %d mismatches\n",
+               t.count, time_serial, time_parallel, threads, errors);
+
+    Z_Free(serial);
+    Z_Free(t.ctx);
+    Z_Free(t.results);
+    Z_Free(t.work);
+    CM_FreeMap(&cm);
+}
+
 /*
 =============
 CM_Init
@@ -1029,5 +1287,7 @@ void CM_Init(void)
 
     map_noareas = Cvar_Get("map_noareas", "0", 0);
     map_allsolid_bug = Cvar_Get("map_allsolid_bug", "1", 0);
+
+    Cmd_AddCommand("tracetest", CM_TraceTest_f);
 }
 
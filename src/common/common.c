@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 
+#include "common/bench.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
@@ -38,6 +39,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/net.h"
 #include "common/net/chan.h"
 #include "common/pmove.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/tests.h"
@@ -65,6 +67,8 @@ static bool     com_errorEntered;
 static char     com_errorMsg[MAXERRORMSG]; // from Com_Printf/Com_Error
 
 static int      com_printEntered;
+static int      com_printLock;      // serializes output from worker threads
+static q_thread_local int com_printDepth;
 
 static qhandle_t    com_logFile;
 static bool         com_logNewline;
@@ -410,9 +414,15 @@ void Com_LPrintf(print_type_t type, const char *fmt, ...)
     char        msg[MAXPRINTMSG];
     size_t      len;
 
+    // worker threads may print concurrently
+    if (!com_printDepth++) {
+        while (!q_atomic_cas(&com_printLock, 0, 1))
+            ;
+    }
+
     // may be entered recursively only once
     if (com_printEntered >= 2) {
-        return;
+        goto unlock;
     }
 
     com_printEntered++;
@@ -481,6 +491,11 @@ void Com_LPrintf(print_type_t type, const char *fmt, ...)
     }
 
     com_printEntered--;
+
+unlock:
+    if (!--com_printDepth) {
+        q_atomic_store(&com_printLock, 0);
+    }
 }
 
 
@@ -533,6 +548,8 @@ void Com_Error(error_type_t code, const char *fmt, ...)
 
     // reset Com_Printf recursion level
     com_printEntered = 0;
+    com_printDepth = 0;
+    q_atomic_store(&com_printLock, 0);
 
     if (code == ERR_DISCONNECT || code == ERR_RECONNECT) {
         Com_WPrintf("%s\n", com_errorMsg);
@@ -999,6 +1016,8 @@ void Qcommon_Init(int argc, char **argv)
     SV_Init();
     CL_Init();
     TST_Init();
+    Bench_Init();
+    Prof_Init();
 
     Sys_RunConsole();
 
@@ -0,0 +1,307 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// demoindex.c -- seek snapshots shared by client demos and MVD channels
+//
+
+#include "shared/shared.h"
+#include "common/common.h"
+#include "common/demoindex.h"
+#include "common/error.h"
+#include "common/files.h"
+#include "common/intreadwrite.h"
+#include "common/mdfour.h"
+#include "common/protocol.h"
+#include "common/zone.h"
+
+/*
+Sidecar file layout, all values are little endian:
+
+uint32_t    ident       DEMOINDEX_IDENT
+uint32_t    key         DemoIndex_Key() of the demo
+uint32_t    numsnaps
+
+then for each snapshot, sorted by frame number:
+
+int32_t     framenum
+uint32_t    msglen
+int64_t     filepos
+byte        data[msglen]
+*/
+
+#define DEMOINDEX_IDENT     MakeLittleLong('D','I','X','1')
+#define DEMOINDEX_HEADER    12
+#define DEMOINDEX_ENTRY     16
+
+void DemoIndex_Init(demoindex_t *index, memtag_t tag)
+{
+    memset(index, 0, sizeof(*index));
+    index->tag = tag;
+}
+
+static void free_snaps(demoindex_t *index)
+{
+    int i;
+
+    for (i = 0; i < index->numsnaps; i++)
+        Z_Free(index->snaps[i]);
+
+    Z_Free(index->snaps);
+    index->snaps = NULL;
+    index->numsnaps = index->maxsnaps = 0;
+    index->dirty = false;
+}
+
+// frees all snapshots and forgets the sidecar file
+void DemoIndex_Clear(demoindex_t *index)
+{
+    free_snaps(index);
+    DemoIndex_Init(index, index->tag);
+}
+
+// returns index of the first snapshot with frame number > framenum
+static int upper_bound(const demoindex_t *index, int framenum)
+{
+    int lo = 0, hi = index->numsnaps;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (index->snaps[mid]->framenum > framenum)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo;
+}
+
+demosnap_t *DemoIndex_Add(demoindex_t *index, int framenum, int64_t filepos,
+                          const void *data, size_t len)
+{
+    demosnap_t *snap;
+    int pos;
+
+    pos = upper_bound(index, framenum);
+    if (pos > 0 && index->snaps[pos - 1]->framenum == framenum)
+        return index->snaps[pos - 1];
+
+    if (index->numsnaps == index->maxsnaps) {
+        index->maxsnaps = max(index->maxsnaps * 2, 64);
+        if (index->snaps)
+            index->snaps = Z_Realloc(index->snaps, index->maxsnaps * sizeof(snap));
+        else
+            index->snaps = Z_TagMalloc(index->maxsnaps * sizeof(snap), index->tag);
+    }
+
+    snap = Z_TagMalloc(sizeof(*snap) + len - 1, index->tag);
+    snap->framenum = framenum;
+    snap->filepos = filepos;
+    snap->msglen = len;
+    memcpy(snap->data, data, len);
+
+    memmove(index->snaps + pos + 1, index->snaps + pos,
+            (index->numsnaps - pos) * sizeof(snap));
+    index->snaps[pos] = snap;
+    index->numsnaps++;
+    index->dirty = true;
+
+    return snap;
+}
+
+// returns the most recent snapshot at or before framenum. if all snapshots
+// are past framenum, returns the first one, matching the old list scan.
+demosnap_t *DemoIndex_Find(const demoindex_t *index, int framenum)
+{
+    int pos;
+
+    if (!index->numsnaps)
+        return NULL;
+
+    pos = upper_bound(index, framenum);
+    return index->snaps[pos ? pos - 1 : 0];
+}
+
+int DemoIndex_LastFrame(const demoindex_t *index)
+{
+    if (!index->numsnaps)
+        return INT_MIN;
+
+    return index->snaps[index->numsnaps - 1]->framenum;
+}
+
+/*
+==============
+DemoIndex_Key
+
+Snapshots are only valid for the exact demo they were built from. Identify
+it by the configstrings snapshots are delta compressed against, offset of
+the first frame and the remaining file size.
+==============
+*/
+uint32_t DemoIndex_Key(const char (*configstrings)[MAX_QPATH], int count,
+                       int64_t offset, int64_t size)
+{
+    struct mdfour md;
+    byte buf[16];
+    uint32_t key;
+    int i;
+
+    mdfour_begin(&md);
+    for (i = 0; i < count; i++)
+        mdfour_update(&md, (const byte *)configstrings[i],
+                      Q_strnlen(configstrings[i], MAX_QPATH) + 1);
+    WL64(buf, offset);
+    WL64(buf + 8, size);
+    mdfour_update(&md, buf, 16);
+    mdfour_result(&md, buf);
+
+    key = RL32(buf) ^ RL32(buf + 4) ^ RL32(buf + 8) ^ RL32(buf + 12);
+    return key ? key : 1;
+}
+
+static int parse_index(demoindex_t *index, const byte *data, size_t len, uint32_t key)
+{
+    const byte *end = data + len;
+    int i, numsnaps, framenum, lastframe;
+    uint32_t msglen;
+    int64_t filepos;
+
+    if (len < DEMOINDEX_HEADER)
+        return Q_ERR_FILE_TOO_SMALL;
+    if (RL32(data) != DEMOINDEX_IDENT)
+        return Q_ERR_UNKNOWN_FORMAT;
+    if (RL32(data + 4) != key)
+        return Q_ERR_INVALID_FORMAT;
+
+    numsnaps = RL32(data + 8);
+    if (numsnaps < 0)
+        return Q_ERR_TOO_MANY;
+
+    data += DEMOINDEX_HEADER;
+    lastframe = INT_MIN;
+    for (i = 0; i < numsnaps; i++) {
+        if (end - data < DEMOINDEX_ENTRY)
+            return Q_ERR_UNEXPECTED_EOF;
+
+        framenum = RL32(data);
+        msglen = RL32(data + 4);
+        filepos = RL64(data + 8);
+        data += DEMOINDEX_ENTRY;
+
+        if (framenum <= lastframe || filepos < 0)
+            return Q_ERR_INVALID_FORMAT;
+        if (!msglen || msglen > MAX_MSGLEN)
+            return Q_ERR_INVALID_FORMAT;
+        if (end - data < msglen)
+            return Q_ERR_UNEXPECTED_EOF;
+
+        DemoIndex_Add(index, framenum, filepos, data, msglen);
+        data += msglen;
+        lastframe = framenum;
+    }
+
+    return Q_ERR_SUCCESS;
+}
+
+/*
+==============
+DemoIndex_Load
+
+Replaces snapshots with contents of `<demoname>.idx' if it was built for
+the same demo. Index remembers the sidecar path and key in any case, so
+that DemoIndex_Save() can (re)create it later.
+==============
+*/
+int DemoIndex_Load(demoindex_t *index, const char *demoname, uint32_t key)
+{
+    void *data;
+    int ret;
+
+    DemoIndex_Clear(index);
+
+    if (Q_concat(index->path, sizeof(index->path), demoname, ".idx") >= sizeof(index->path))
+        return Q_ERR(ENAMETOOLONG);
+
+    index->key = key;
+
+    ret = FS_LoadFile(index->path, &data);
+    if (!data)
+        return ret;
+
+    ret = parse_index(index, data, ret, key);
+    FS_FreeFile(data);
+
+    if (ret) {
+        free_snaps(index);
+        return ret;
+    }
+
+    index->dirty = false;
+    Com_DPrintf("Loaded %d snaps from %s\n", index->numsnaps, index->path);
+    return index->numsnaps;
+}
+
+/*
+==============
+DemoIndex_Save
+
+Writes the sidecar file if there are snapshots it doesn't have yet.
+==============
+*/
+int DemoIndex_Save(demoindex_t *index)
+{
+    demosnap_t *snap;
+    size_t len;
+    byte *data, *p;
+    int i, ret;
+
+    if (!index->key || !index->dirty)
+        return Q_ERR_SUCCESS;
+
+    len = DEMOINDEX_HEADER;
+    for (i = 0; i < index->numsnaps; i++)
+        len += DEMOINDEX_ENTRY + index->snaps[i]->msglen;
+
+    p = data = FS_AllocTempMem(len);
+    WL32(p, DEMOINDEX_IDENT);
+    WL32(p + 4, index->key);
+    WL32(p + 8, index->numsnaps);
+    p += DEMOINDEX_HEADER;
+
+    for (i = 0; i < index->numsnaps; i++) {
+        snap = index->snaps[i];
+        WL32(p, snap->framenum);
+        WL32(p + 4, snap->msglen);
+        WL64(p + 8, snap->filepos);
+        memcpy(p + DEMOINDEX_ENTRY, snap->data, snap->msglen);
+        p += DEMOINDEX_ENTRY + snap->msglen;
+    }
+
+    ret = FS_WriteFile(index->path, data, len);
+    FS_FreeTempMem(data);
+
+    if (ret < 0) {
+        Com_DPrintf("Couldn't write %s: %s\n", index->path, Q_ErrorString(ret));
+        return ret;
+    }
+
+    index->dirty = false;
+    Com_DPrintf("Saved %d snaps to %s\n", index->numsnaps, index->path);
+    return Q_ERR_SUCCESS;
+}
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/error.h"
 #include "common/files.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/intreadwrite.h"
 #include "system/system.h"
@@ -35,14 +36,25 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/stat.h>
 #ifndef _WIN32
     #include <unistd.h>
+    #include <sys/mman.h>
 #else
     #define stat _stat
+    #include <windows.h>
+    #include <io.h>
 #endif
 
 #if USE_ZLIB
 #include <zlib.h>
 #endif
 
+// files opened with FS_FLAG_ASYNC are written by a background thread
+#ifndef _WIN32
+#include <pthread.h>
+#define USE_ASYNC_WRITE     1
+#else
+#define USE_ASYNC_WRITE     0
+#endif
+
 /*
 =============================================================================
 
@@ -138,6 +150,9 @@ typedef struct {
     filetype_t  type;       // FS_PAK or FS_ZIP
     unsigned    refcount;   // for tracking pack users
     FILE        *fp;
+    byte        *map;       // read-only mapping of the whole pack, or NULL
+    size_t      map_size;
+    list_t      map_entry;  // in fs_mapped_packs
     unsigned    num_files;
     unsigned    hash_size;
     packfile_t  *files;
@@ -165,6 +180,9 @@ typedef struct {
     int         error;      // stream error indicator from read/write operation
     int64_t     position;   // reading position for FS_PAK/FS_ZIP
     int64_t     length;     // total cached file length
+#if USE_ASYNC_WRITE
+    struct asyncfile_s *async;  // non-NULL if opened with FS_FLAG_ASYNC
+#endif
 } file_t;
 
 typedef struct {
@@ -190,6 +208,11 @@ static int          fs_num_files;
 
 static bool         fs_non_uniq_open;
 
+// packs with active mappings, for finding owner of mapped FS_LoadFile buffer
+static LIST_DECL(fs_mapped_packs);
+
+fs_loadstats_t      fs_loadstats;
+
 #if USE_DEBUG
 static int          fs_count_read;
 static int          fs_count_open;
@@ -214,6 +237,8 @@ cvar_t              *fs_game;
 
 cvar_t              *fs_shareware;
 
+static cvar_t       *fs_mmap;
+
 #if USE_ZLIB
 // local stream used for all file loads
 static zipstream_t  fs_zipstream;
@@ -229,6 +254,17 @@ static int seek_zip_file(file_t *file, int64_t offset, int whence);
 static pack_t *pack_get(pack_t *pack);
 static void pack_put(pack_t *pack);
 
+#if USE_ASYNC_WRITE
+static void open_async(file_t *file, int64_t pos);
+static void close_async(file_t *file);
+static void drain_async(file_t *file);
+static int write_async(file_t *file, const void *buf, size_t len);
+static int64_t tell_async(file_t *file);
+static void shutdown_async(void);
+#else
+#define shutdown_async() (void)0
+#endif
+
 /*
 
 All of Quake's data access is through a hierchal file system,
@@ -510,6 +546,11 @@ int64_t FS_Tell(qhandle_t f)
     if (!file)
         return Q_ERR(EBADF);
 
+#if USE_ASYNC_WRITE
+    if (file->async)
+        return tell_async(file);
+#endif
+
     switch (file->type) {
     case FS_REAL:
         ret = os_ftell(file->fp);
@@ -672,6 +713,11 @@ int FS_CloseFile(qhandle_t f)
     if (!file)
         return Q_ERR(EBADF);
 
+#if USE_ASYNC_WRITE
+    if (file->async)
+        close_async(file);
+#endif
+
     ret = file->error;
     switch (file->type) {
     case FS_REAL:
@@ -966,8 +1012,10 @@ static int check_header_coherency(FILE *fp, packfile_t *entry)
     if (entry->compmtd != 0 && entry->compmtd != Z_DEFLATED)
         return Q_ERR_BAD_COMPRESSION;
 
+    fs_loadstats.seeks++;
     if (os_fseek(fp, entry->filepos, SEEK_SET))
         return Q_ERRNO;
+    fs_loadstats.reads++;
     if (!fread(header, sizeof(header), 1, fp))
         return FS_ERR_READ(fp);
 
@@ -1076,6 +1124,7 @@ static int read_zip_file(file_t *file, void *buf, size_t len)
 
             // fill in the temp buffer
             block = min(s->rest_in, ZIP_BUFSIZE);
+            fs_loadstats.reads++;
             result = fread(s->buffer, 1, block, file->fp);
             if (result != block) {
                 file->error = FS_ERR_READ(file->fp);
@@ -1154,6 +1203,31 @@ static int seek_zip_file(file_t *file, int64_t offset, int whence)
 #define entry_compmtd(entry)  0
 #endif
 
+// returns stored entry data within pack mapping, or NULL if entry
+// has to be read the regular way
+// loaders cast views to on-disk structures, misaligned entries are copied
+#define MAPPED_ALIGN    8
+
+static const byte *entry_view(const pack_t *pack, const packfile_t *entry)
+{
+    if (!pack->map || !fs_mmap->integer)
+        return NULL;
+    if (entry_compmtd(entry))
+        return NULL;
+#if USE_ZLIB
+    if (!entry->coherent)
+        return NULL;
+#endif
+    if (entry->filelen <= 0 || entry->filepos < 0)
+        return NULL;
+    if (entry->filepos & (MAPPED_ALIGN - 1))
+        return NULL;
+    if (entry->filelen > pack->map_size || entry->filepos > pack->map_size - entry->filelen)
+        return NULL;
+
+    return pack->map + entry->filepos;
+}
+
 // open a new file on the pakfile
 static int64_t open_from_pack(file_t *file, pack_t *pack, packfile_t *entry)
 {
@@ -1189,9 +1263,14 @@ static int64_t open_from_pack(file_t *file, pack_t *pack, packfile_t *entry)
         goto fail2;
     }
 
-    if (os_fseek(fp, entry->filepos, SEEK_SET)) {
-        ret = Q_ERRNO;
-        goto fail2;
+    // mapped loads don't need file position
+    if ((file->mode & (FS_FLAG_MAPPED | FS_FLAG_LOADFILE)) != (FS_FLAG_MAPPED | FS_FLAG_LOADFILE) ||
+        !entry_view(pack, entry)) {
+        fs_loadstats.seeks++;
+        if (os_fseek(fp, entry->filepos, SEEK_SET)) {
+            ret = Q_ERRNO;
+            goto fail2;
+        }
     }
 
     file->type = pack->type;
@@ -1525,6 +1604,7 @@ static int read_pak_file(file_t *file, void *buf, size_t len)
         return 0;
     }
 
+    fs_loadstats.reads++;
     result = fread(buf, 1, len, file->fp);
     if (result != len) {
         file->error = FS_ERR_READ(file->fp);
@@ -1541,6 +1621,7 @@ static int read_phys_file(file_t *file, void *buf, size_t len)
 {
     size_t result;
 
+    fs_loadstats.reads++;
     result = fread(buf, 1, len, file->fp);
     if (result != len && ferror(file->fp)) {
         file->error = Q_ERR_FAILURE;
@@ -1587,6 +1668,7 @@ int FS_Read(void *buf, size_t len, qhandle_t f)
         return read_pak_file(file, buf, len);
 #if USE_ZLIB
     case FS_GZ:
+        fs_loadstats.reads++;
         ret = gzread(file->zfp, buf, len);
         if (ret < 0) {
             return Q_ERR_LIBRARY_ERROR;
@@ -1648,6 +1730,14 @@ int FS_Flush(qhandle_t f)
     if ((file->mode & FS_MODE_MASK) == FS_MODE_READ)
         return Q_ERR(EBADF);
 
+#if USE_ASYNC_WRITE
+    if (file->async) {
+        drain_async(file);
+        if (file->error)
+            return file->error;
+    }
+#endif
+
     switch (file->type) {
     case FS_REAL:
         if (fflush(file->fp))
@@ -1666,6 +1756,27 @@ int FS_Flush(qhandle_t f)
     return ret;
 }
 
+// doesn't touch file->error, may be called from async writer thread
+static int write_file_data(file_t *file, const void *buf, size_t len)
+{
+    switch (file->type) {
+    case FS_REAL:
+        if (fwrite(buf, 1, len, file->fp) != len)
+            return Q_ERR_FAILURE;
+        break;
+#if USE_ZLIB
+    case FS_GZ:
+        if (gzwrite(file->zfp, buf, len) != len)
+            return Q_ERR_LIBRARY_ERROR;
+        break;
+#endif
+    default:
+        Q_assert(!"bad file type");
+    }
+
+    return Q_ERR_SUCCESS;
+}
+
 /*
 =================
 FS_Write
@@ -1691,28 +1802,297 @@ int FS_Write(const void *buf, size_t len, qhandle_t f)
     if (len == 0)
         return 0;
 
-    switch (file->type) {
-    case FS_REAL:
-        if (fwrite(buf, 1, len, file->fp) != len) {
-            file->error = Q_ERR_FAILURE;
-            return file->error;
+#if USE_ASYNC_WRITE
+    if (file->async)
+        return write_async(file, buf, len);
+#endif
+
+    file->error = write_file_data(file, buf, len);
+    if (file->error)
+        return file->error;
+
+    return len;
+}
+
+/*
+=============================================================================
+
+ASYNC WRITER
+
+Files opened with FS_FLAG_ASYNC have two buffers. FS_Write only appends to
+one of them, while background thread writes out the other one. Buffers are
+swapped when full or once a second. If the thread falls behind, FS_Write has
+to wait for it, which is counted as a stall. After a write error, remaining
+queued data is dropped and the error is returned by the next FS_Write call.
+
+=============================================================================
+*/
+
+#if USE_ASYNC_WRITE
+
+#define ASYNC_BUFSIZE       0x40000     // 256 KiB per buffer
+#define ASYNC_FLUSH_MSEC    1000
+
+typedef struct asyncfile_s {
+    struct asyncfile_s *next;   // in writer queue
+    file_t      *file;
+    byte        *data[2];
+    size_t      len[2];
+    int         cur;            // buffer being filled by FS_Write
+    bool        busy;           // other buffer is owned by writer thread
+    int         error;          // set by writer thread
+    unsigned    swap_time;
+    int64_t     pos;            // logical file position
+    int64_t     accepted;
+    int64_t     written;
+    int64_t     dropped;
+    unsigned    stalls;
+    unsigned    stall_msec;
+} asyncfile_t;
+
+static struct {
+    bool            initialized;
+    bool            terminate;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake_cond;
+    pthread_cond_t  done_cond;
+    asyncfile_t     *head, **tail;
+} fs_async;
+
+static void *async_func(void *arg)
+{
+    asyncfile_t *a;
+    const byte *data;
+    size_t len;
+    int ret;
+
+    pthread_mutex_lock(&fs_async.lock);
+    while (1) {
+        while (!fs_async.head && !fs_async.terminate)
+            pthread_cond_wait(&fs_async.wake_cond, &fs_async.lock);
+
+        a = fs_async.head;
+        if (!a)
+            break;
+        fs_async.head = a->next;
+        if (!fs_async.head)
+            fs_async.tail = &fs_async.head;
+
+        data = a->data[a->cur ^ 1];
+        len = a->len[a->cur ^ 1];
+        ret = a->error;
+
+        pthread_mutex_unlock(&fs_async.lock);
+        if (!ret)
+            ret = write_file_data(a->file, data, len);
+        pthread_mutex_lock(&fs_async.lock);
+
+        if (ret) {
+            a->error = ret;
+            a->dropped += len;
+        } else {
+            a->written += len;
         }
-        break;
-#if USE_ZLIB
-    case FS_GZ:
-        if (gzwrite(file->zfp, buf, len) != len) {
-            file->error = Q_ERR_LIBRARY_ERROR;
-            return file->error;
+        a->busy = false;
+        pthread_cond_broadcast(&fs_async.done_cond);
+    }
+    pthread_mutex_unlock(&fs_async.lock);
+
+    return NULL;
+}
+
+static bool init_async(void)
+{
+    if (fs_async.initialized)
+        return true;
+
+    pthread_mutex_init(&fs_async.lock, NULL);
+    pthread_cond_init(&fs_async.wake_cond, NULL);
+    pthread_cond_init(&fs_async.done_cond, NULL);
+    fs_async.head = NULL;
+    fs_async.tail = &fs_async.head;
+    fs_async.terminate = false;
+
+    if (pthread_create(&fs_async.thread, NULL, async_func, NULL)) {
+        Com_EPrintf("Couldn't create async writer thread\n");
+        pthread_mutex_destroy(&fs_async.lock);
+        pthread_cond_destroy(&fs_async.wake_cond);
+        pthread_cond_destroy(&fs_async.done_cond);
+        return false;
+    }
+
+    fs_async.initialized = true;
+    return true;
+}
+
+static void shutdown_async(void)
+{
+    if (!fs_async.initialized)
+        return;
+
+    pthread_mutex_lock(&fs_async.lock);
+    fs_async.terminate = true;
+    pthread_cond_signal(&fs_async.wake_cond);
+    pthread_mutex_unlock(&fs_async.lock);
+
+    pthread_join(fs_async.thread, NULL);
+
+    pthread_mutex_destroy(&fs_async.lock);
+    pthread_cond_destroy(&fs_async.wake_cond);
+    pthread_cond_destroy(&fs_async.done_cond);
+    fs_async.initialized = false;
+}
+
+// falls back to synchronous writes if thread can't be started
+static void open_async(file_t *file, int64_t pos)
+{
+    asyncfile_t *a;
+
+    if (!init_async())
+        return;
+
+    a = FS_Mallocz(sizeof(*a));
+    a->file = file;
+    a->data[0] = FS_Malloc(ASYNC_BUFSIZE);
+    a->data[1] = FS_Malloc(ASYNC_BUFSIZE);
+    a->swap_time = Sys_Milliseconds();
+    a->pos = pos;
+    file->async = a;
+}
+
+// waits for writer thread to finish with the other buffer, then hands
+// it the current one. must be called with lock held.
+static void swap_async(file_t *file, bool stall)
+{
+    asyncfile_t *a = file->async;
+    unsigned start;
+
+    if (a->busy) {
+        start = Sys_Milliseconds();
+        while (a->busy)
+            pthread_cond_wait(&fs_async.done_cond, &fs_async.lock);
+        if (stall) {
+            a->stalls++;
+            a->stall_msec += Sys_Milliseconds() - start;
         }
-        break;
-#endif
-    default:
-        Q_assert(!"bad file type");
+    }
+
+    if (a->error)
+        file->error = a->error;
+
+    if (a->len[a->cur]) {
+        a->busy = true;
+        a->next = NULL;
+        *fs_async.tail = a;
+        fs_async.tail = &a->next;
+        pthread_cond_signal(&fs_async.wake_cond);
+
+        a->cur ^= 1;
+        a->len[a->cur] = 0;
+    }
+
+    a->swap_time = Sys_Milliseconds();
+}
+
+// writes out all queued data
+static void drain_async(file_t *file)
+{
+    asyncfile_t *a = file->async;
+
+    pthread_mutex_lock(&fs_async.lock);
+    swap_async(file, false);
+    while (a->busy)
+        pthread_cond_wait(&fs_async.done_cond, &fs_async.lock);
+    if (a->error)
+        file->error = a->error;
+    pthread_mutex_unlock(&fs_async.lock);
+}
+
+static void close_async(file_t *file)
+{
+    asyncfile_t *a = file->async;
+
+    drain_async(file);
+
+    Z_Free(a->data[0]);
+    Z_Free(a->data[1]);
+    Z_Free(a);
+    file->async = NULL;
+}
+
+static int write_async(file_t *file, const void *buf, size_t len)
+{
+    asyncfile_t *a = file->async;
+    const byte *data = buf;
+    size_t n, left = len;
+
+    while (left) {
+        n = min(left, ASYNC_BUFSIZE - a->len[a->cur]);
+        if (!n) {
+            pthread_mutex_lock(&fs_async.lock);
+            swap_async(file, true);
+            pthread_mutex_unlock(&fs_async.lock);
+            if (file->error)
+                return file->error;
+            continue;
+        }
+        memcpy(a->data[a->cur] + a->len[a->cur], data, n);
+        a->len[a->cur] += n;
+        data += n;
+        left -= n;
+    }
+
+    a->pos += len;
+    a->accepted += len;
+
+    // don't keep data in memory for too long
+    if (Sys_Milliseconds() - a->swap_time >= ASYNC_FLUSH_MSEC) {
+        pthread_mutex_lock(&fs_async.lock);
+        swap_async(file, true);
+        pthread_mutex_unlock(&fs_async.lock);
     }
 
     return len;
 }
 
+static int64_t tell_async(file_t *file)
+{
+    return file->async->pos;
+}
+
+#endif // USE_ASYNC_WRITE
+
+/*
+=================
+FS_AsyncStats
+
+Returns false if the file is written synchronously.
+=================
+*/
+bool FS_AsyncStats(qhandle_t f, fs_asyncstats_t *stats)
+{
+#if USE_ASYNC_WRITE
+    file_t *file = file_for_handle(f);
+    asyncfile_t *a;
+
+    if (!file || !file->async)
+        return false;
+
+    a = file->async;
+    pthread_mutex_lock(&fs_async.lock);
+    stats->queued = a->accepted - a->written - a->dropped;
+    stats->written = a->written;
+    stats->dropped = a->dropped;
+    pthread_mutex_unlock(&fs_async.lock);
+    stats->stalls = a->stalls;
+    stats->stall_msec = a->stall_msec;
+    return true;
+#else
+    return false;
+#endif
+}
+
 /*
 ============
 FS_OpenFile
@@ -1745,6 +2125,11 @@ int64_t FS_OpenFile(const char *name, qhandle_t *f, unsigned mode)
         ret = expand_open_file_read(file, name);
     } else {
         ret = open_file_write(file, name);
+#if USE_ASYNC_WRITE
+        if (ret >= 0 && (mode & FS_FLAG_ASYNC)) {
+            open_async(file, ret);
+        }
+#endif
     }
 
     if (ret >= 0) {
@@ -1870,6 +2255,306 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
     return easy_open_write(buf, size, mode, dir, name, ext);
 }
 
+/*
+================================================================================
+
+PREFETCH
+
+================================================================================
+*/
+
+#define PREFETCH_HASH       1024
+#define PREFETCH_MAX_BYTES  (256 << 20)
+
+typedef enum {
+    PF_SKIP,        // load the regular way
+    PF_MISSING,     // not found in any search path
+    PF_LOADED       // file data is in buffer
+} pfstate_t;
+
+typedef struct {
+    char        *name;      // normalized
+    unsigned    hash_next;  // index + 1 of next entry in bucket
+    pfstate_t   state;
+    FILE        *fp;        // loose file opened by main thread
+    pack_t      *pack;
+    packfile_t  *entry;
+    int64_t     len;
+    byte        *buf;
+    int         ret;
+    unsigned    reads;
+    unsigned    seeks;
+} prefetch_t;
+
+static struct {
+    prefetch_t  *files;
+    unsigned    count, size;
+    int64_t     bytes;
+    unsigned    hash[PREFETCH_HASH];
+} fs_pf;
+
+static cvar_t   *fs_prefetch;
+
+static prefetch_t *find_prefetched(const char *path)
+{
+    char normalized[MAX_OSPATH];
+    prefetch_t *p;
+    unsigned i;
+
+    if (FS_NormalizePathBuffer(normalized, path, sizeof(normalized)) >= sizeof(normalized))
+        return NULL;
+
+    i = fs_pf.hash[FS_HashPath(normalized, PREFETCH_HASH)];
+    for (; i; i = p->hash_next) {
+        p = &fs_pf.files[i - 1];
+        if (!FS_pathcmp(p->name, normalized))
+            return p;
+    }
+
+    return NULL;
+}
+
+static prefetch_t *add_prefetched(const char *normalized)
+{
+    prefetch_t *p;
+    unsigned hash;
+
+    if (fs_pf.count == fs_pf.size) {
+        fs_pf.size = max(fs_pf.size * 2, 256);
+        fs_pf.files = Z_Realloc(fs_pf.files, fs_pf.size * sizeof(fs_pf.files[0]));
+    }
+
+    hash = FS_HashPath(normalized, PREFETCH_HASH);
+    p = &fs_pf.files[fs_pf.count++];
+    memset(p, 0, sizeof(*p));
+    p->name = FS_CopyString(normalized);
+    p->hash_next = fs_pf.hash[hash];
+    fs_pf.hash[hash] = fs_pf.count;
+    return p;
+}
+
+// finds the file on main thread, leaving only reading to the worker
+static void open_prefetched(prefetch_t *p)
+{
+    file_t *file;
+    qhandle_t f;
+    int64_t len;
+
+    file = alloc_handle(&f);
+    if (!file)
+        return;
+
+    file->mode = FS_MODE_READ | FS_FLAG_LOADFILE | FS_FLAG_MAPPED;
+    len = expand_open_file_read(file, p->name);
+    if (len == Q_ERR(ENOENT)) {
+        p->state = PF_MISSING;
+        return;
+    }
+    if (len < 0)
+        return;
+
+    if (file->type == FS_REAL) {
+        p->fp = file->fp;
+    } else {
+        // non-unique pack handle, nothing to close
+        fs_non_uniq_open = false;
+        p->pack = file->pack;
+        p->entry = file->entry;
+    }
+    memset(file, 0, sizeof(*file));
+
+    // stored entries in mapped packs are loaded in place anyway
+    if (p->pack && entry_view(p->pack, p->entry))
+        return;
+
+    if (len > MAX_LOADFILE || fs_pf.bytes + len > PREFETCH_MAX_BYTES) {
+        if (p->fp) {
+            fclose(p->fp);
+            p->fp = NULL;
+        }
+        return;
+    }
+
+    // Z_Malloc is not thread safe
+    p->buf = FS_Malloc(len + 1);
+    p->buf[len] = 0;
+    p->len = len;
+    p->state = PF_LOADED;
+    fs_pf.bytes += len;
+}
+
+#if USE_ZLIB
+static int inflate_prefetched(prefetch_t *p, const byte *src, int64_t srclen)
+{
+    z_stream z;
+    int ret;
+
+    if (srclen > UINT_MAX)
+        return Q_ERR(EFBIG);
+
+    // default allocators are thread safe
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+        return Q_ERR_INFLATE_FAILED;
+
+    z.next_in = (Bytef *)src;
+    z.avail_in = (uInt)srclen;
+    z.next_out = p->buf;
+    z.avail_out = (uInt)p->len;
+
+    ret = inflate(&z, Z_FINISH);
+    inflateEnd(&z);
+
+    if (ret != Z_STREAM_END && ret != Z_OK && ret != Z_BUF_ERROR)
+        return Q_ERR_INFLATE_FAILED;
+    if (z.total_out != p->len)
+        return Q_ERR_UNEXPECTED_EOF;
+
+    return Q_ERR_SUCCESS;
+}
+#endif
+
+// runs on worker thread, must only touch its own prefetch_t
+static int read_prefetched(prefetch_t *p)
+{
+    const pack_t *pack = p->pack;
+    const packfile_t *entry = p->entry;
+    int64_t srclen = p->len;
+    const byte *src = NULL;
+    byte *dst, *tmp = NULL;
+    FILE *fp = p->fp;
+    int ret = Q_ERR_SUCCESS;
+
+    p->fp = NULL;
+
+    if (pack) {
+#if USE_ZLIB
+        if (entry->compmtd)
+            srclen = entry->complen;
+#endif
+        if (pack->map && srclen <= pack->map_size && entry->filepos <= pack->map_size - srclen) {
+            src = pack->map + entry->filepos;
+        } else {
+            // shared pack handle can't be used here
+            fp = fopen(pack->filename, "rb");
+            if (!fp)
+                return Q_ERRNO;
+            p->seeks++;
+            if (os_fseek(fp, entry->filepos, SEEK_SET)) {
+                ret = Q_ERRNO;
+                goto done;
+            }
+        }
+    }
+
+    if (!src) {
+        if (entry && entry_compmtd(entry)) {
+            dst = tmp = malloc(srclen);
+            if (!tmp) {
+                ret = Q_ERR(ENOMEM);
+                goto done;
+            }
+        } else {
+            dst = p->buf;
+        }
+        p->reads++;
+        if (fread(dst, 1, srclen, fp) != srclen) {
+            ret = FS_ERR_READ(fp);
+            goto done;
+        }
+        src = dst;
+    }
+
+#if USE_ZLIB
+    if (entry && entry->compmtd)
+        ret = inflate_prefetched(p, src, srclen);
+    else
+#endif
+    if (src != p->buf)
+        memcpy(p->buf, src, p->len);
+
+done:
+    if (fp)
+        fclose(fp);
+    free(tmp);
+    return ret;
+}
+
+static void prefetch_job(void *arg, int index, int slot)
+{
+    prefetch_t *p = (prefetch_t *)arg + index;
+
+    if (p->state == PF_LOADED)
+        p->ret = read_prefetched(p);
+}
+
+/*
+============
+FS_Prefetch
+
+Finds the given files and reads them in parallel on worker threads,
+inflating compressed pack entries. Subsequent FS_LoadFile calls without
+path restrictions get prefetched buffers until FS_EndPrefetch. Missing
+files are remembered too, which makes probing for alternative image
+formats cheap.
+============
+*/
+void FS_Prefetch(const char **paths, int count)
+{
+    char normalized[MAX_OSPATH];
+    prefetch_t *p;
+    unsigned i, start;
+
+    if (!fs_searchpaths || fs_prefetch->integer <= 0)
+        return;
+
+    start = fs_pf.count;
+    for (i = 0; i < count; i++) {
+        if (FS_NormalizePathBuffer(normalized, paths[i], sizeof(normalized)) >= sizeof(normalized))
+            continue;
+        if (!normalized[0] || find_prefetched(normalized))
+            continue;
+        open_prefetched(add_prefetched(normalized));
+    }
+
+    if (fs_pf.count == start)
+        return;
+
+    Sys_ParallelFor(fs_prefetch->integer, fs_pf.count - start, prefetch_job, fs_pf.files + start);
+
+    for (i = start; i < fs_pf.count; i++) {
+        p = &fs_pf.files[i];
+        fs_loadstats.reads += p->reads;
+        fs_loadstats.seeks += p->seeks;
+        if (p->state == PF_LOADED && p->ret) {
+            Com_WPrintf("Couldn't prefetch %s: %s\n", p->name, Q_ErrorString(p->ret));
+            Z_Free(p->buf);
+            p->buf = NULL;
+            p->state = PF_SKIP;
+        }
+    }
+}
+
+/*
+============
+FS_EndPrefetch
+
+Frees prefetched files that were not loaded.
+============
+*/
+void FS_EndPrefetch(void)
+{
+    unsigned i;
+
+    for (i = 0; i < fs_pf.count; i++) {
+        Z_Free(fs_pf.files[i].buf);
+        Z_Free(fs_pf.files[i].name);
+    }
+
+    Z_Free(fs_pf.files);
+    memset(&fs_pf, 0, sizeof(fs_pf));
+}
+
 /*
 ============
 FS_LoadFile
@@ -1880,8 +2565,10 @@ a NULL buffer will just return the file length without loading
 */
 int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
 {
+    prefetch_t *pf;
     file_t *file;
     qhandle_t f;
+    const byte *view;
     byte *buf;
     int64_t len;
     int read;
@@ -1896,17 +2583,38 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
         return Q_ERR(EAGAIN); // not yet initialized
     }
 
+    // prefetched files were looked up in all search paths
+    if (fs_pf.count && (!buffer || tag == TAG_FILESYSTEM) &&
+        !(flags & (FS_PATH_MASK | FS_TYPE_MASK | FS_FLAG_GZIP | FS_FLAG_DEFLATE)) &&
+        (pf = find_prefetched(path)) != NULL && pf->state != PF_SKIP) {
+        if (pf->state == PF_MISSING) {
+            return Q_ERR(ENOENT);
+        }
+        if (buffer) {
+            fs_loadstats.files++;
+            fs_loadstats.prefetched++;
+            fs_loadstats.bytes_copied += pf->len;
+            *buffer = pf->buf;
+            pf->buf = NULL;
+            pf->state = PF_SKIP;
+        }
+        return pf->len;
+    }
+
     // allocate new file handle
     file = alloc_handle(&f);
     if (!file) {
         return Q_ERR(EMFILE);
     }
 
+    PROF_BEGIN("FS_LoadFileEx");
+
     file->mode = (flags & ~FS_MODE_MASK) | FS_MODE_READ | FS_FLAG_LOADFILE;
 
     // look for it in the filesystem or pack files
     len = expand_open_file_read(file, path);
     if (len < 0) {
+        PROF_END();
         return len;
     }
 
@@ -1921,6 +2629,18 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
         goto done;
     }
 
+    fs_loadstats.files++;
+
+    // return stored pack entry in place, pack is kept until FS_FreeFile
+    if ((flags & FS_FLAG_MAPPED) && file->type == FS_PAK &&
+        (view = entry_view(file->pack, file->entry)) != NULL) {
+        pack_get(file->pack);
+        fs_loadstats.mapped++;
+        fs_loadstats.bytes_mapped += len;
+        *buffer = (void *)view;
+        goto done;
+    }
+
     // allocate chunk of memory, +1 for NUL
     buf = Z_TagMalloc(len + 1, tag);
 
@@ -1932,14 +2652,42 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
         goto done;
     }
 
+    fs_loadstats.bytes_copied += len;
+
     *buffer = buf;
     buf[len] = 0;
 
 done:
     FS_CloseFile(f);
+    PROF_END();
     return len;
 }
 
+/*
+============
+FS_FreeFile
+
+Frees buffer returned by FS_LoadFile, which may be a view into mapped pack.
+============
+*/
+void FS_FreeFile(void *buf)
+{
+    pack_t *pack;
+
+    if (!buf) {
+        return;
+    }
+
+    LIST_FOR_EACH(pack_t, pack, &fs_mapped_packs, map_entry) {
+        if ((byte *)buf >= pack->map && (byte *)buf < pack->map + pack->map_size) {
+            pack_put(pack);
+            return;
+        }
+    }
+
+    Z_Free(buf);
+}
+
 static int write_and_close(const void *data, size_t len, qhandle_t f)
 {
     int ret1 = FS_Write(data, len, f);
@@ -1996,8 +2744,6 @@ bool FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
     return true;
 }
 
-#if USE_CLIENT
-
 static int build_absolute_path(char *buffer, const char *path)
 {
     char normalized[MAX_OSPATH];
@@ -2038,8 +2784,6 @@ int FS_RenameFile(const char *from, const char *to)
     return Q_ERR_SUCCESS;
 }
 
-#endif // USE_CLIENT
-
 /*
 ================
 FS_FPrintf
@@ -2062,8 +2806,24 @@ int FS_FPrintf(qhandle_t f, const char *format, ...)
     return FS_Write(string, len, f);
 }
 
+static void pack_unmap(pack_t *pack)
+{
+    if (!pack->map) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(pack->map);
+#else
+    munmap(pack->map, pack->map_size);
+#endif
+    List_Remove(&pack->map_entry);
+    pack->map = NULL;
+}
+
 static void pack_free(pack_t *pack)
 {
+    pack_unmap(pack);
     fclose(pack->fp);
     Z_Free(pack->names);
     Z_Free(pack->file_hash);
@@ -2101,6 +2861,8 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     pack->type = type;
     pack->refcount = 0;
     pack->fp = fp;
+    pack->map = NULL;
+    pack->map_size = 0;
     pack->num_files = num_files;
     pack->files = FS_Malloc(num_files * sizeof(pack->files[0]));
     pack->hash_size = 0;
@@ -2111,6 +2873,56 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     return pack;
 }
 
+// maps the whole pack read-only, so that stored entries can be
+// loaded without copying. Failure is not fatal.
+static void pack_map(pack_t *pack)
+{
+    int64_t size;
+    void *map;
+#ifdef _WIN32
+    HANDLE handle;
+#endif
+
+    if (!fs_mmap->integer) {
+        return;
+    }
+
+    if (os_fseek(pack->fp, 0, SEEK_END)) {
+        return;
+    }
+    size = os_ftell(pack->fp);
+    if (size <= 0 || size > SIZE_MAX) {
+        return;
+    }
+
+    // don't exhaust address space on 32-bit systems
+    if (sizeof(void *) < 8 && size > 0x20000000) {
+        return;
+    }
+
+#ifdef _WIN32
+    handle = CreateFileMappingA((HANDLE)_get_osfhandle(_fileno(pack->fp)),
+                                NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!handle) {
+        return;
+    }
+    map = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(handle);
+    if (!map) {
+        return;
+    }
+#else
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(pack->fp), 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+#endif
+
+    pack->map = map;
+    pack->map_size = size;
+    List_Append(&fs_mapped_packs, &pack->map_entry);
+}
+
 // allocates hash table and inserts all filenames into it
 static void pack_calc_hashes(pack_t *pack)
 {
@@ -2221,6 +3033,7 @@ static pack_t *load_pak_file(const char *packfile)
     }
 
     pack_calc_hashes(pack);
+    pack_map(pack);
 
     FS_DPrintf("%s: %u files, %u hash\n",
                packfile, pack->num_files, pack->hash_size);
@@ -2538,6 +3351,7 @@ static pack_t *load_zip_file(const char *packfile)
     pack->names = Z_Realloc(pack->names, names_len);
 
     pack_calc_hashes(pack);
+    pack_map(pack);
 
     FS_DPrintf("%s: %u files, %u skipped, %u hash%s\n",
                packfile, pack->num_files, (int)(num_files_cd - num_files),
@@ -3617,6 +4431,24 @@ static void FS_Restart_f(void)
     CL_RestartFilesystem(true);
 }
 
+/*
+================
+FS_LoadStats_f
+================
+*/
+static void FS_LoadStats_f(void)
+{
+    Com_Printf("%u files loaded, %u of them mapped, %u prefetched\n",
+               fs_loadstats.files, fs_loadstats.mapped, fs_loadstats.prefetched);
+    Com_Printf("%.1f MB copied, %.1f MB mapped\n",
+               fs_loadstats.bytes_copied / 1e6, fs_loadstats.bytes_mapped / 1e6);
+    Com_Printf("%u reads, %u seeks\n", fs_loadstats.reads, fs_loadstats.seeks);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&fs_loadstats, 0, sizeof(fs_loadstats));
+    }
+}
+
 static const cmdreg_t c_fs[] = {
     { "path", FS_Path_f },
     { "fdir", FS_FDir_f },
@@ -3630,6 +4462,7 @@ static const cmdreg_t c_fs[] = {
     { "softlink", FS_Link_f, FS_Link_c },
     { "softunlink", FS_UnLink_f, FS_Link_c },
     { "fs_restart", FS_Restart_f },
+    { "fs_loadstats", FS_LoadStats_f },
 
     { NULL }
 };
@@ -3657,6 +4490,12 @@ void FS_Shutdown(void)
     }
     fs_num_files = 0;
 
+    // free prefetched files
+    FS_EndPrefetch();
+
+    // stop async writer thread
+    shutdown_async();
+
     // free symbolic links
     free_all_links(&fs_hard_links);
     free_all_links(&fs_soft_links);
@@ -3758,6 +4597,9 @@ void FS_Init(void)
 
 	fs_shareware = Cvar_Get("fs_shareware", "0", CVAR_ROM);
 
+    fs_mmap = Cvar_Get("fs_mmap", "1", 0);
+    fs_prefetch = Cvar_Get("fs_prefetch", "4", 0);
+
     // get the game cvar and start the filesystem
     fs_game = Cvar_Get("game", DEFGAME, CVAR_LATCH | CVAR_SERVERINFO);
     fs_game->changed = fs_game_changed;
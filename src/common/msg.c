@@ -32,10 +32,10 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-sizebuf_t   msg_write;
+q_thread_local sizebuf_t msg_write;
 byte        msg_write_buffer[MAX_MSGLEN];
 
-sizebuf_t   msg_read;
+q_thread_local sizebuf_t msg_read;
 byte        msg_read_buffer[MAX_MSGLEN];
 
 const entity_packed_t   nullEntityState;
@@ -448,6 +448,29 @@ int MSG_WriteDeltaUsercmd_Enhanced(const usercmd_t *from,
 
 #endif // USE_CLIENT
 
+/*
+=============
+MSG_BuildZDictionary
+
+Builds preset deflate dictionary for svc_zpacket from the configstring and
+baseline sections of svc_gamestate, exactly as they were sent. Both server
+and client see the same bytes, so they build identical dictionaries.
+Strings go last, since data near the end of dictionary is cheapest to
+reference. Returns dictionary length, at most ZDICT_SIZE bytes.
+=============
+*/
+size_t MSG_BuildZDictionary(byte *dict, const byte *strings, size_t stringslen,
+                            const byte *bases, size_t baseslen)
+{
+    size_t s = min(stringslen, ZDICT_SIZE);
+    size_t b = min(baseslen, ZDICT_SIZE - s);
+
+    memcpy(dict, bases + baseslen - b, b);
+    memcpy(dict + b, strings + stringslen - s, s);
+
+    return b + s;
+}
+
 void MSG_WriteDir(const vec3_t dir)
 {
     int     best;
@@ -491,6 +514,7 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, bool short_a
     out->frame = in->frame;
     out->sound = in->sound;
     out->event = in->event;
+    VectorClear(out->velocity);
 }
 
 void MSG_WriteDeltaEntity(const entity_packed_t *from,
@@ -745,6 +769,369 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     }
 }
 
+/*
+==============================================================================
+
+            BIT PACKED ENTITY DELTAS
+
+Used by Q2PRO protocol version 1023 and above. Entity numbers, update masks
+and fields are written into a single bit stream terminated by an empty
+number delta. Origins are coded as exp-Golomb residuals against a
+prediction made from the velocity of the entity in the frame delta'ed from,
+so moving entities cost a few bits per axis. Update masks are coded from a
+move-to-front list reset at the start of each packet, most entities in a
+frame share one of a handful of masks. All values are coded losslessly in
+the same quantized units as MSG_WriteDeltaEntity() uses.
+==============================================================================
+*/
+
+// fields of escaped update masks, in transmission order
+static const uint32_t packed_fields[] = {
+    U_ORIGIN1, U_ORIGIN2, U_ORIGIN3, U_ANGLE1, U_ANGLE2, U_ANGLE3, U_ANGLE16,
+    U_FRAME8, U_EVENT, U_OLDORIGIN, U_MODEL, U_MODEL2, U_MODEL3, U_MODEL4,
+    U_SKIN8, U_EFFECTS8, U_RENDERFX8, U_SOUND, U_SOLID, U_REMOVE
+};
+
+static const uint32_t packed_origin_bits[3] = { U_ORIGIN1, U_ORIGIN2, U_ORIGIN3 };
+static const uint32_t packed_angle_bits[3] = { U_ANGLE1, U_ANGLE2, U_ANGLE3 };
+
+#define PACKED_NUMFIELDS    q_countof(packed_fields)
+#define PACKED_NUMMASKS     16
+#define PACKED_ESCAPE       15
+
+// initial move-to-front list of update masks, most common first
+static const uint32_t packed_masks[PACKED_NUMMASKS] = {
+    U_ORIGIN1 | U_ORIGIN2,
+    U_FRAME8,
+    U_ORIGIN1 | U_ORIGIN2 | U_FRAME8,
+    U_ORIGIN1 | U_ORIGIN2 | U_ANGLE2 | U_FRAME8,
+    U_REMOVE,
+    U_ORIGIN1 | U_ORIGIN2 | U_ORIGIN3,
+    U_ORIGIN3,
+    U_ANGLE2,
+    U_EVENT,
+    0,
+    U_ORIGIN1 | U_ORIGIN2 | U_ORIGIN3 | U_ANGLE2 | U_FRAME8,
+    U_ORIGIN1 | U_ORIGIN3,
+    U_ORIGIN2 | U_ORIGIN3,
+    U_ORIGIN1,
+    U_ORIGIN2,
+    U_EFFECTS8
+};
+
+typedef struct {
+    uint32_t    masks[PACKED_NUMMASKS];
+    int         number;
+} packed_coder_t;
+
+static inline uint32_t zigzag(int v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int unzigzag(uint32_t v)
+{
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static void packed_reset(packed_coder_t *c)
+{
+    memcpy(c->masks, packed_masks, sizeof(c->masks));
+    c->number = 0;
+}
+
+static void packed_move_to_front(packed_coder_t *c, int index, uint32_t mask)
+{
+    if (index == PACKED_NUMMASKS)
+        index--;
+    memmove(c->masks + 1, c->masks, index * sizeof(c->masks[0]));
+    c->masks[0] = mask;
+}
+
+// the first frame entity appears in has no velocity to predict with
+static void packed_predict(int16_t *pred, const int16_t *origin, const int16_t *vel, int dt)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+        pred[i] = dt > 0 ? origin[i] + vel[i] * dt : origin[i];
+}
+
+static void packed_velocity(int16_t *vel, const int16_t *from, const int16_t *to, int dt)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+        vel[i] = dt > 0 ? (int16_t)(to[i] - from[i]) / dt : 0;
+}
+
+static q_thread_local packed_coder_t   packed_write;
+
+static void put_bits(uint32_t value, int bits)
+{
+    size_t bitpos = msg_write.bitpos;
+    byte *p;
+    int n;
+
+    if (((bitpos + bits + 7) >> 3) > msg_write.maxsize)
+        Com_Error(ERR_FATAL, "%s: overflow", __func__);
+
+    while (bits > 0) {
+        p = &msg_write.data[bitpos >> 3];
+        if ((bitpos & 7) == 0)
+            *p = 0;
+        n = min(8 - (bitpos & 7), bits);
+        *p |= (value & ((1U << n) - 1)) << (bitpos & 7);
+        value >>= n;
+        bitpos += n;
+        bits -= n;
+    }
+
+    msg_write.bitpos = bitpos;
+    msg_write.cursize = (bitpos + 7) >> 3;
+}
+
+// exp-Golomb code of order k
+static void put_golomb(uint32_t value, int k)
+{
+    uint32_t x = value + (1U << k);
+    int n = k;
+
+    while (x >> (n + 1))
+        n++;
+
+    put_bits(0, n - k);
+    put_bits(1, 1);
+    put_bits(x, n);
+}
+
+static void put_sized(uint32_t value)
+{
+    if (value & 0xffff0000) {
+        put_bits(2, 2);
+        put_bits(value, 32);
+    } else if (value & 0x0000ff00) {
+        put_bits(1, 2);
+        put_bits(value, 16);
+    } else {
+        put_bits(0, 2);
+        put_bits(value, 8);
+    }
+}
+
+static void put_number(int number)
+{
+    int delta = number - packed_write.number;
+
+    if (delta < 1)
+        Com_Error(ERR_DROP, "%s: entities out of order: %d after %d",
+                  __func__, number, packed_write.number);
+
+    if (delta == 1) {
+        put_bits(1, 1);
+    } else {
+        put_bits(0, 1);
+        put_golomb(delta - 1, 0);
+    }
+
+    packed_write.number = number;
+}
+
+static void put_mask(uint32_t mask)
+{
+    int i;
+
+    if (packed_write.masks[0] == mask) {
+        put_bits(1, 1);
+        return;
+    }
+
+    put_bits(0, 1);
+
+    for (i = 1; i < PACKED_NUMMASKS; i++) {
+        if (packed_write.masks[i] == mask) {
+            put_bits(i - 1, 4);
+            packed_move_to_front(&packed_write, i, mask);
+            return;
+        }
+    }
+
+    put_bits(PACKED_ESCAPE, 4);
+    for (i = 0; i < PACKED_NUMFIELDS; i++)
+        put_bits(!!(mask & packed_fields[i]), 1);
+
+    packed_move_to_front(&packed_write, PACKED_NUMMASKS, mask);
+}
+
+void MSG_BeginPackedEntities(void)
+{
+    msg_write.bitpos = msg_write.cursize << 3;
+    packed_reset(&packed_write);
+}
+
+/*
+=============
+MSG_WritePackedEntity
+
+Bit packed counterpart of MSG_WriteDeltaEntity(). Also updates velocity of
+`to', which next frame delta'ed from it uses for prediction. `dt' is the
+number of frames between `from' and `to', or 0 if `from' is a baseline.
+=============
+*/
+void MSG_WritePackedEntity(const entity_packed_t *from,
+                           entity_packed_t       *to,
+                           msgEsFlags_t          flags,
+                           int                   dt)
+{
+    int16_t     pred[3];
+    const int16_t *base;
+    uint32_t    bits;
+    int         i;
+
+    if (!to) {
+        if (!from)
+            Com_Error(ERR_DROP, "%s: NULL", __func__);
+
+        if (from->number < 1 || from->number >= MAX_EDICTS)
+            Com_Error(ERR_DROP, "%s: bad number: %d", __func__, from->number);
+
+        put_number(from->number);
+        put_mask(U_REMOVE);
+        return; // remove entity
+    }
+
+    if (to->number < 1 || to->number >= MAX_EDICTS)
+        Com_Error(ERR_DROP, "%s: bad number: %d", __func__, to->number);
+
+    if (!from)
+        from = &nullEntityState;
+
+    packed_predict(pred, from->origin, from->velocity, dt);
+
+// send an update
+    bits = 0;
+
+    // first person entity origin is held at the old value by the caller,
+    // it costs bits only in the frame its velocity drops to zero
+    if (to->origin[0] != pred[0])
+        bits |= U_ORIGIN1;
+    if (to->origin[1] != pred[1])
+        bits |= U_ORIGIN2;
+    if (to->origin[2] != pred[2])
+        bits |= U_ORIGIN3;
+
+    if (!(flags & MSG_ES_FIRSTPERSON)) {
+        if (to->angles[0] != from->angles[0])
+            bits |= U_ANGLE1;
+        if (to->angles[1] != from->angles[1])
+            bits |= U_ANGLE2;
+        if (to->angles[2] != from->angles[2])
+            bits |= U_ANGLE3;
+        if ((flags & MSG_ES_SHORTANGLES) && (bits & (U_ANGLE1 | U_ANGLE2 | U_ANGLE3)))
+            bits |= U_ANGLE16;
+
+        if ((flags & MSG_ES_NEWENTITY) && !VectorCompare(to->old_origin, from->origin))
+            bits |= U_OLDORIGIN;
+    }
+
+    if (to->skinnum != from->skinnum)
+        bits |= U_SKIN8;
+    if (to->frame != from->frame)
+        bits |= U_FRAME8;
+    if (to->effects != from->effects)
+        bits |= U_EFFECTS8;
+    if (to->renderfx != from->renderfx)
+        bits |= U_RENDERFX8;
+    if (to->solid != from->solid)
+        bits |= U_SOLID;
+
+    // event is not delta compressed, just 0 compressed
+    if (to->event)
+        bits |= U_EVENT;
+
+    if (to->modelindex != from->modelindex)
+        bits |= U_MODEL;
+    if (to->modelindex2 != from->modelindex2)
+        bits |= U_MODEL2;
+    if (to->modelindex3 != from->modelindex3)
+        bits |= U_MODEL3;
+    if (to->modelindex4 != from->modelindex4)
+        bits |= U_MODEL4;
+
+    if (to->sound != from->sound)
+        bits |= U_SOUND;
+
+    if (to->renderfx & RF_FRAMELERP) {
+        bits |= U_OLDORIGIN;
+    } else if (to->renderfx & RF_BEAM) {
+        if (!VectorCompare(to->old_origin, from->old_origin))
+            bits |= U_OLDORIGIN;
+    }
+
+    packed_velocity(to->velocity, from->origin, to->origin, dt);
+
+    //
+    // write the message
+    //
+    if (!bits && !(flags & MSG_ES_FORCE))
+        return;     // nothing to send!
+
+    put_number(to->number);
+    put_mask(bits);
+
+    if (bits & U_MODEL)
+        put_bits(to->modelindex, 8);
+    if (bits & U_MODEL2)
+        put_bits(to->modelindex2, 8);
+    if (bits & U_MODEL3)
+        put_bits(to->modelindex3, 8);
+    if (bits & U_MODEL4)
+        put_bits(to->modelindex4, 8);
+
+    if (bits & U_FRAME8)
+        put_golomb(zigzag((int16_t)(to->frame - from->frame)), 0);
+
+    if (bits & U_SKIN8)
+        put_sized(to->skinnum);
+    if (bits & U_EFFECTS8)
+        put_sized(to->effects);
+    if (bits & U_RENDERFX8)
+        put_sized(to->renderfx);
+
+    for (i = 0; i < 3; i++)
+        if (bits & packed_origin_bits[i])
+            put_golomb(zigzag((int16_t)(to->origin[i] - pred[i])), 2);
+
+    for (i = 0; i < 3; i++) {
+        if (!(bits & packed_angle_bits[i]))
+            continue;
+        if (bits & U_ANGLE16)
+            put_golomb(zigzag((int16_t)(to->angles[i] - from->angles[i])), 4);
+        else
+            put_bits((uint16_t)to->angles[i] >> 8, 8);
+    }
+
+    if (bits & U_OLDORIGIN) {
+        base = (to->renderfx & RF_BEAM) ? to->origin : from->origin;
+        for (i = 0; i < 3; i++)
+            put_golomb(zigzag((int16_t)(to->old_origin[i] - base[i])), 2);
+    }
+
+    if (bits & U_SOUND)
+        put_bits(to->sound, 8);
+    if (bits & U_EVENT)
+        put_bits(to->event, 8);
+    if (bits & U_SOLID)
+        put_bits(to->solid, (flags & MSG_ES_LONGSOLID) ? 32 : 16);
+}
+
+void MSG_EndPackedEntities(void)
+{
+    // empty number delta terminates the list
+    put_bits(0, 1);
+    put_golomb(0, 0);
+}
+
 static inline int OFFSET2CHAR(float x)
 {
     return clamp(x, -32, 127.0f / 4) * 4;
@@ -1931,6 +2318,222 @@ void MSG_ParseDeltaEntity(const entity_state_t *from,
     }
 }
 
+static q_thread_local packed_coder_t   packed_read;
+
+static uint32_t get_bits(int bits)
+{
+    size_t bitpos = msg_read.bitpos;
+    uint32_t value = 0;
+    int i, n;
+
+    if (bitpos + bits > msg_read.cursize << 3)
+        Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+
+    for (i = 0; i < bits; i += n, bitpos += n) {
+        n = min(8 - (bitpos & 7), bits - i);
+        value |= ((msg_read.data[bitpos >> 3] >> (bitpos & 7)) & ((1U << n) - 1)) << i;
+    }
+
+    msg_read.bitpos = bitpos;
+    msg_read.readcount = (bitpos + 7) >> 3;
+    return value;
+}
+
+static uint32_t get_golomb(int k)
+{
+    int n = 0;
+
+    while (!get_bits(1))
+        if (++n > 24)
+            Com_Error(ERR_DROP, "%s: bad code", __func__);
+
+    n += k;
+    return ((1U << n) | get_bits(n)) - (1U << k);
+}
+
+static uint32_t get_sized(void)
+{
+    switch (get_bits(2)) {
+    case 0:
+        return get_bits(8);
+    case 1:
+        return get_bits(16);
+    case 2:
+        return get_bits(32);
+    default:
+        Com_Error(ERR_DROP, "%s: bad size", __func__);
+    }
+}
+
+static uint32_t get_mask(void)
+{
+    uint32_t mask;
+    int i;
+
+    if (get_bits(1))
+        return packed_read.masks[0];
+
+    i = get_bits(4);
+    if (i != PACKED_ESCAPE) {
+        mask = packed_read.masks[i + 1];
+        packed_move_to_front(&packed_read, i + 1, mask);
+        return mask;
+    }
+
+    mask = 0;
+    for (i = 0; i < PACKED_NUMFIELDS; i++)
+        if (get_bits(1))
+            mask |= packed_fields[i];
+
+    packed_move_to_front(&packed_read, PACKED_NUMMASKS, mask);
+    return mask;
+}
+
+void MSG_BeginParsingPackedEntities(void)
+{
+    msg_read.bitpos = msg_read.readcount << 3;
+    packed_reset(&packed_read);
+}
+
+/*
+=================
+MSG_ParsePackedEntityBits
+
+Returns the entity number and the update mask, 0 at the end of the list
+=================
+*/
+int MSG_ParsePackedEntityBits(int *bits)
+{
+    uint32_t delta;
+
+    *bits = 0;
+
+    if (get_bits(1)) {
+        delta = 1;
+    } else {
+        delta = get_golomb(0);
+        if (!delta)
+            return 0;
+        delta++;
+    }
+
+    if (delta >= MAX_EDICTS - packed_read.number)
+        return -1;
+
+    packed_read.number += delta;
+    *bits = get_mask();
+    return packed_read.number;
+}
+
+/*
+==================
+MSG_ParsePackedEntity
+
+Bit packed counterpart of MSG_ParseDeltaEntity(). Unchanged entities must be
+parsed with zero bits as well, so that they follow the prediction.
+`fromvel' is NULL when delta'ing from a baseline.
+==================
+*/
+void MSG_ParsePackedEntity(const entity_state_t *from,
+                           entity_state_t *to,
+                           const int16_t  *fromvel,
+                           int16_t        *tovel,
+                           int            number,
+                           int            bits,
+                           msgEsFlags_t   flags,
+                           int            dt)
+{
+    int16_t origin[3], pred[3], neworigin[3];
+    int     i, angle;
+
+    if (!to) {
+        Com_Error(ERR_DROP, "%s: NULL", __func__);
+    }
+
+    if (number < 1 || number >= MAX_EDICTS) {
+        Com_Error(ERR_DROP, "%s: bad entity number: %d", __func__, number);
+    }
+
+    // set everything to the state we are delta'ing from
+    if (!from) {
+        memset(to, 0, sizeof(*to));
+    } else if (to != from) {
+        memcpy(to, from, sizeof(*to));
+    }
+
+    to->number = number;
+    to->event = 0;
+
+    for (i = 0; i < 3; i++)
+        origin[i] = COORD2SHORT(to->origin[i]);
+
+    if (!fromvel)
+        dt = 0;
+    packed_predict(pred, origin, fromvel, dt);
+
+    if (bits & U_MODEL) {
+        to->modelindex = get_bits(8);
+    }
+    if (bits & U_MODEL2) {
+        to->modelindex2 = get_bits(8);
+    }
+    if (bits & U_MODEL3) {
+        to->modelindex3 = get_bits(8);
+    }
+    if (bits & U_MODEL4) {
+        to->modelindex4 = get_bits(8);
+    }
+
+    if (bits & U_FRAME8)
+        to->frame = (uint16_t)(to->frame + unzigzag(get_golomb(0)));
+
+    if (bits & U_SKIN8)
+        to->skinnum = get_sized();
+    if (bits & U_EFFECTS8)
+        to->effects = get_sized();
+    if (bits & U_RENDERFX8)
+        to->renderfx = get_sized();
+
+    for (i = 0; i < 3; i++) {
+        if (bits & packed_origin_bits[i])
+            neworigin[i] = pred[i] + unzigzag(get_golomb(2));
+        else
+            neworigin[i] = pred[i];
+        to->origin[i] = SHORT2COORD(neworigin[i]);
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (!(bits & packed_angle_bits[i]))
+            continue;
+        if (bits & U_ANGLE16) {
+            angle = ANGLE2SHORT(to->angles[i]) + unzigzag(get_golomb(4));
+            to->angles[i] = SHORT2ANGLE((int16_t)angle);
+        } else {
+            to->angles[i] = BYTE2ANGLE((int8_t)get_bits(8));
+        }
+    }
+
+    if (bits & U_OLDORIGIN) {
+        const int16_t *base = (to->renderfx & RF_BEAM) ? neworigin : origin;
+        for (i = 0; i < 3; i++)
+            to->old_origin[i] = SHORT2COORD((int16_t)(base[i] + unzigzag(get_golomb(2))));
+    }
+
+    if (bits & U_SOUND) {
+        to->sound = get_bits(8);
+    }
+
+    if (bits & U_EVENT) {
+        to->event = get_bits(8);
+    }
+
+    if (bits & U_SOLID) {
+        to->solid = get_bits((flags & MSG_ES_LONGSOLID) ? 32 : 16);
+    }
+
+    packed_velocity(tovel, origin, neworigin, dt);
+}
+
 #endif // USE_CLIENT || USE_MVD_CLIENT
 
 #if USE_CLIENT
@@ -50,6 +50,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #ifdef __linux__
 #include <linux/types.h>
 #if USE_ICMP
@@ -64,6 +67,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents infinite retry loops caused by broken TCP/IP stacks
 #define MAX_ERROR_RETRIES   64
 
+// batch UDP packets into single recvmmsg/sendmmsg calls
+#ifdef __linux__
+#define USE_MMSG    1
+#define MAX_MMSG    32
+#else
+#define USE_MMSG    0
+#endif
+
+// server UDP sockets may be serviced by a separate thread
+#ifndef _WIN32
+#define USE_NET_THREAD  1
+#define NET_RING_SIZE   256     // must be power of two
+#else
+#define USE_NET_THREAD  0
+#endif
+
 #if USE_CLIENT
 
 #define MAX_LOOPBACK    4
@@ -88,6 +107,7 @@ cvar_t          *net_ip6;
 cvar_t          *net_port;
 
 netadr_t        net_from;
+unsigned        net_time;
 
 #if USE_CLIENT
 static cvar_t   *net_clientport;
@@ -106,8 +126,12 @@ static cvar_t   *net_enable_ipv6;
 static cvar_t   *net_ignore_icmp;
 #endif
 
+#if USE_NET_THREAD
+static cvar_t   *net_thread;
+#endif
+
 static netflag_t    net_active;
-static int          net_error;
+static q_thread_local int   net_error;  // network thread has its own
 
 static qsocket_t    udp_sockets[NS_COUNT] = { -1, -1 };
 static qsocket_t    tcp_socket = -1;
@@ -139,6 +163,90 @@ static uint64_t     net_bytes_rcvd;
 static uint64_t     net_bytes_sent;
 static uint64_t     net_packets_rcvd;
 static uint64_t     net_packets_sent;
+static uint64_t     net_calls_rcvd;     // UDP receive syscalls
+static uint64_t     net_calls_sent;     // UDP send syscalls
+
+#if USE_MMSG
+typedef struct {
+    struct mmsghdr          hdrs[MAX_MMSG];
+    struct iovec            iovs[MAX_MMSG];
+    struct sockaddr_storage addrs[MAX_MMSG];
+    netadr_t                to[MAX_MMSG];
+    byte                    data[MAX_MMSG][MAX_PACKETLEN];
+    qsocket_t               sock;
+    int                     count;
+} mmsgbatch_t;
+
+static mmsgbatch_t  net_recv_batch;
+static mmsgbatch_t  net_send_batch;
+static bool         net_mmsg_broken;    // not supported by kernel
+#endif
+
+static bool         net_batching[NS_COUNT];
+
+#if USE_NET_THREAD
+typedef struct {
+    netadr_t    adr;
+    qsocket_t   sock;
+    unsigned    time;       // arrival time
+    int         len;
+    int         error, info;
+    byte        data[MAX_PACKETLEN];
+} netslot_t;
+
+// single producer, single consumer
+typedef struct {
+    netslot_t   *slots;
+    unsigned    size;
+    unsigned    head;   // written by producer
+    unsigned    tail;   // written by consumer
+} netring_t;
+
+static struct {
+    bool        running;
+    pthread_t   thread;
+    qsocket_t   socks[2];
+    int         wake[2];    // wakes up network thread
+    int         notify[2];  // wakes up main thread
+    int         sleeping;
+    int         quit;
+    netring_t   recv;
+    netring_t   send;
+    netring_t   errors;
+    // written by network thread only, read atomically
+    uint64_t    calls_rcvd;
+    uint64_t    calls_sent;
+    uint64_t    recv_errors;
+    uint64_t    send_errors;
+    uint64_t    bytes_sent;
+    uint64_t    packets_sent;
+    // main thread only
+    uint64_t    bytes_counted;
+    uint64_t    packets_counted;
+    uint64_t    send_drops;     // send ring was full
+} net_io;
+
+static q_thread_local bool  net_io_thread;
+
+// network thread must not print
+#define NET_DPrintf(...) \
+    do { if (!net_io_thread) Com_DPrintf(__VA_ARGS__); } while (0)
+
+// adds packets sent by network thread since the last call to statistics
+static void NET_CollectThreadStats(void)
+{
+    uint64_t bytes = q_atomic_load(&net_io.bytes_sent);
+    uint64_t packets = q_atomic_load(&net_io.packets_sent);
+
+    net_rate_sent += bytes - net_io.bytes_counted;
+    net_bytes_sent += bytes - net_io.bytes_counted;
+    net_packets_sent += packets - net_io.packets_counted;
+    net_io.bytes_counted = bytes;
+    net_io.packets_counted = packets;
+}
+#else
+#define NET_DPrintf(...)    Com_DPrintf(__VA_ARGS__)
+#endif
 
 //=============================================================================
 
@@ -495,6 +603,7 @@ static void NET_Stats_f(void)
 {
     time_t diff, now = time(NULL);
     char buffer[MAX_QPATH];
+    uint64_t calls_sent, calls_rcvd, send_errors, recv_errors;
 
     if (com_startTime > now) {
         com_startTime = now;
@@ -504,6 +613,11 @@ static void NET_Stats_f(void)
         diff = 1;
     }
 
+#if USE_NET_THREAD
+    if (net_io.running)
+        NET_CollectThreadStats();
+#endif
+
     Com_FormatTime(buffer, sizeof(buffer), diff);
     Com_Printf("Network uptime: %s\n", buffer);
     Com_Printf("Bytes sent: %"PRIu64" (%"PRIu64" bytes/sec)\n",
@@ -514,12 +628,30 @@ static void NET_Stats_f(void)
                net_packets_sent, net_packets_sent / diff);
     Com_Printf("Packets rcvd: %"PRIu64" (%"PRIu64" packets/sec)\n",
                net_packets_rcvd, net_packets_rcvd / diff);
+    calls_sent = net_calls_sent;
+    calls_rcvd = net_calls_rcvd;
+    send_errors = net_send_errors;
+    recv_errors = net_recv_errors;
+#if USE_NET_THREAD
+    calls_sent += q_atomic_load(&net_io.calls_sent);
+    calls_rcvd += q_atomic_load(&net_io.calls_rcvd);
+    send_errors += q_atomic_load(&net_io.send_errors);
+    recv_errors += q_atomic_load(&net_io.recv_errors);
+#endif
+    Com_Printf("Send calls: %"PRIu64" (%.2f packets/call)\n",
+               calls_sent, (double)net_packets_sent / max(calls_sent, 1));
+    Com_Printf("Recv calls: %"PRIu64" (%.2f packets/call)\n",
+               calls_rcvd, (double)net_packets_rcvd / max(calls_rcvd, 1));
 #if USE_ICMP
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64"/%"PRIu64" (send/recv/icmp)\n",
-               net_send_errors, net_recv_errors, net_icmp_errors);
+               send_errors, recv_errors, net_icmp_errors);
 #else
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64" (send/recv)\n",
-               net_send_errors, net_recv_errors);
+               send_errors, recv_errors);
+#endif
+#if USE_NET_THREAD
+    if (net_io.send_drops)
+        Com_Printf("Network thread send drops: %"PRIu64"\n", net_io.send_drops);
 #endif
     Com_Printf("Current upload rate: %zu bytes/sec\n", net_rate_up);
     Com_Printf("Current download rate: %zu bytes/sec\n", net_rate_dn);
@@ -610,9 +742,22 @@ static bool NET_SendLoopPacket(netsrc_t sock, const void *data,
 
 static const char *os_error_string(int err);
 
+#if USE_NET_THREAD
+static void NET_QueueErrorEvent(qsocket_t sock, netadr_t *from,
+                                int ee_errno, int ee_info);
+#endif
+
 static void NET_ErrorEvent(qsocket_t sock, netadr_t *from,
                            int ee_errno, int ee_info)
 {
+#if USE_NET_THREAD
+    // passed to main thread
+    if (net_io_thread) {
+        NET_QueueErrorEvent(sock, from, ee_errno, ee_info);
+        return;
+    }
+#endif
+
     if (net_ignore_icmp->integer > 0) {
         return;
     }
@@ -840,6 +985,74 @@ int NET_Sleepv(int msec, ...)
 
 //=============================================================================
 
+static void NET_UdpPacketRcvd(const void *data, size_t len, void (*packet_cb)(void))
+{
+#if USE_DEBUG
+    if (net_log_enable->integer)
+        NET_LogPacket(&net_from, "UDP recv", data, len);
+#endif
+
+    net_rate_rcvd += len;
+    net_bytes_rcvd += len;
+    net_packets_rcvd++;
+
+    if (data != msg_read_buffer)
+        memcpy(msg_read_buffer, data, len);
+
+    SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
+    msg_read.cursize = len;
+
+    (*packet_cb)();
+}
+
+#if USE_MMSG
+
+// returns false if single packet receive should be used instead
+static bool NET_GetUdpPacketsBatch(qsocket_t sock, ioentry_t *e, void (*packet_cb)(void))
+{
+    mmsgbatch_t *b = &net_recv_batch;
+    int i, ret;
+
+    while (1) {
+        for (i = 0; i < MAX_MMSG; i++) {
+            b->iovs[i].iov_base = b->data[i];
+            b->iovs[i].iov_len = MAX_PACKETLEN;
+            memset(&b->hdrs[i], 0, sizeof(b->hdrs[i]));
+            b->hdrs[i].msg_hdr.msg_iov = &b->iovs[i];
+            b->hdrs[i].msg_hdr.msg_iovlen = 1;
+            b->hdrs[i].msg_hdr.msg_name = &b->addrs[i];
+            b->hdrs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+        }
+
+        ret = os_udp_recv_many(sock, b->hdrs, MAX_MMSG);
+        net_calls_rcvd++;
+        if (ret == NET_AGAIN) {
+            e->canread = false;
+            return true;
+        }
+
+        if (ret == NET_ERROR) {
+            if (net_error == ENOSYS)
+                net_mmsg_broken = true;
+            // let single packet receive handle the error
+            return false;
+        }
+
+        for (i = 0; i < ret; i++) {
+            NET_SockadrToNetadr(&b->addrs[i], &net_from);
+            NET_UdpPacketRcvd(b->data[i], b->hdrs[i].msg_len, packet_cb);
+        }
+
+        // short batch means socket queue is drained
+        if (ret < MAX_MMSG) {
+            e->canread = false;
+            return true;
+        }
+    }
+}
+
+#endif // USE_MMSG
+
 static void NET_GetUdpPackets(qsocket_t sock, void (*packet_cb)(void))
 {
     ioentry_t *e;
@@ -852,8 +1065,14 @@ static void NET_GetUdpPackets(qsocket_t sock, void (*packet_cb)(void))
     if (!e->canread)
         return;
 
+#if USE_MMSG
+    if (!net_mmsg_broken && NET_GetUdpPacketsBatch(sock, e, packet_cb))
+        return;
+#endif
+
     while (1) {
         ret = os_udp_recv(sock, msg_read_buffer, MAX_PACKETLEN, &net_from);
+        net_calls_rcvd++;
         if (ret == NET_AGAIN) {
             e->canread = false;
             break;
@@ -866,22 +1085,348 @@ static void NET_GetUdpPackets(qsocket_t sock, void (*packet_cb)(void))
             break;
         }
 
+        NET_UdpPacketRcvd(msg_read_buffer, ret, packet_cb);
+    }
+}
+
+static void NET_UdpPacketSent(const netadr_t *to, const void *data, size_t len, int ret)
+{
+    if (ret < len)
+        Com_WPrintf("%s: short send to %s\n", __func__,
+                    NET_AdrToString(to));
+
 #if USE_DEBUG
-        if (net_log_enable->integer)
-            NET_LogPacket(&net_from, "UDP recv", msg_read_buffer, ret);
+    if (net_log_enable->integer)
+        NET_LogPacket(to, "UDP send", data, ret);
 #endif
 
-        net_rate_rcvd += ret;
-        net_bytes_rcvd += ret;
-        net_packets_rcvd++;
+    net_rate_sent += ret;
+    net_bytes_sent += ret;
+    net_packets_sent++;
+}
+
+#if USE_NET_THREAD
 
-        SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
-        msg_read.cursize = ret;
+/*
+===============================================================================
 
-        (*packet_cb)();
+NETWORK THREAD
+
+When net_thread is enabled, server UDP sockets are owned by a separate thread
+that receives packets as soon as they arrive and timestamps them, and sends
+queued packets so that the main thread never blocks in socket calls. Packets
+are passed between threads in single producer, single consumer rings.
+
+===============================================================================
+*/
+
+static netslot_t *NET_RingReserve(netring_t *r)
+{
+    if (r->head - q_atomic_load(&r->tail) == r->size)
+        return NULL;
+    return &r->slots[r->head & (r->size - 1)];
+}
+
+static void NET_RingCommit(netring_t *r)
+{
+    q_atomic_store(&r->head, r->head + 1);
+}
+
+static netslot_t *NET_RingPeek(netring_t *r)
+{
+    if (q_atomic_load(&r->head) == r->tail)
+        return NULL;
+    return &r->slots[r->tail & (r->size - 1)];
+}
+
+static void NET_RingRelease(netring_t *r)
+{
+    q_atomic_store(&r->tail, r->tail + 1);
+}
+
+static void NET_RingInit(netring_t *r, unsigned size)
+{
+    r->slots = Z_Malloc(sizeof(r->slots[0]) * size);
+    r->size = size;
+    r->head = r->tail = 0;
+}
+
+static void NET_RingFree(netring_t *r)
+{
+    Z_Free(r->slots);
+    memset(r, 0, sizeof(*r));
+}
+
+static void NET_DrainPipe(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void NET_WakePipe(int fd)
+{
+    // if the pipe is full, reader is going to wake up anyway
+    if (write(fd, "", 1) < 0)
+        return;
+}
+
+#if USE_ICMP
+static void NET_QueueErrorEvent(qsocket_t sock, netadr_t *from,
+                                int ee_errno, int ee_info)
+{
+    netslot_t *slot = NET_RingReserve(&net_io.errors);
+
+    if (!slot)
+        return;
+
+    slot->adr = *from;
+    slot->sock = sock;
+    slot->error = ee_errno;
+    slot->info = ee_info;
+    NET_RingCommit(&net_io.errors);
+}
+#endif
+
+// returns true if any packets were received
+static bool NET_ThreadRecv(qsocket_t sock)
+{
+    netslot_t *slot;
+    bool received = false;
+    int ret;
+
+    while ((slot = NET_RingReserve(&net_io.recv)) != NULL) {
+        ret = os_udp_recv(sock, slot->data, MAX_PACKETLEN, &slot->adr);
+        q_atomic_add(&net_io.calls_rcvd, 1);
+        if (ret == NET_AGAIN)
+            break;
+
+        if (ret == NET_ERROR) {
+            q_atomic_add(&net_io.recv_errors, 1);
+            break;
+        }
+
+        slot->sock = sock;
+        slot->time = Sys_Milliseconds();
+        slot->len = ret;
+        slot->error = 0;
+        NET_RingCommit(&net_io.recv);
+        received = true;
+    }
+
+    return received;
+}
+
+static void NET_ThreadSend(void)
+{
+    netslot_t *slot;
+    int ret;
+
+    while ((slot = NET_RingPeek(&net_io.send)) != NULL) {
+        ret = os_udp_send(slot->sock, slot->data, slot->len, &slot->adr);
+        q_atomic_add(&net_io.calls_sent, 1);
+        if (ret == NET_ERROR) {
+            q_atomic_add(&net_io.send_errors, 1);
+        } else if (ret >= 0) {
+            q_atomic_add(&net_io.bytes_sent, ret);
+            q_atomic_add(&net_io.packets_sent, 1);
+        }
+        NET_RingRelease(&net_io.send);
+    }
+}
+
+static void *NET_ThreadFunc(void *arg)
+{
+    struct pollfd fds[3];
+    int i, nfds = 0;
+    bool received;
+
+    net_io_thread = true;
+
+    for (i = 0; i < 2; i++) {
+        if (net_io.socks[i] != -1) {
+            fds[nfds].fd = net_io.socks[i];
+            fds[nfds++].events = POLLIN;
+        }
+    }
+    fds[nfds].fd = net_io.wake[0];
+    fds[nfds++].events = POLLIN;
+
+    while (!q_atomic_load(&net_io.quit)) {
+        // main thread writes to wake pipe only while we are sleeping
+        q_atomic_cas(&net_io.sleeping, 0, 1);
+        if (!NET_RingPeek(&net_io.send))
+            poll(fds, nfds, 100);
+        q_atomic_store(&net_io.sleeping, 0);
+        NET_DrainPipe(net_io.wake[0]);
+
+        received = false;
+        for (i = 0; i < 2; i++)
+            if (net_io.socks[i] != -1)
+                received |= NET_ThreadRecv(net_io.socks[i]);
+
+        if (received || NET_RingPeek(&net_io.errors))
+            NET_WakePipe(net_io.notify[1]);
+
+        NET_ThreadSend();
+    }
+
+    // don't lose queued packets
+    NET_ThreadSend();
+    return NULL;
+}
+
+static bool NET_OpenPipe(int fds[2])
+{
+    if (pipe(fds))
+        return false;
+
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+static void NET_ClosePipe(int fds[2])
+{
+    close(fds[0]);
+    close(fds[1]);
+    fds[0] = fds[1] = -1;
+}
+
+static void NET_WakeThread(void)
+{
+    if (q_atomic_cas(&net_io.sleeping, 1, 0))
+        NET_WakePipe(net_io.wake[1]);
+}
+
+static void NET_StartThread(void)
+{
+    ioentry_t *e;
+    int i;
+
+    if (net_io.running || !net_thread->integer)
+        return;
+
+    net_io.socks[0] = udp_sockets[NS_SERVER];
+    net_io.socks[1] = udp6_sockets[NS_SERVER];
+    if (net_io.socks[0] == -1 && net_io.socks[1] == -1)
+        return;
+
+    if (!NET_OpenPipe(net_io.wake))
+        goto fail1;
+    if (!NET_OpenPipe(net_io.notify))
+        goto fail2;
+
+    NET_RingInit(&net_io.recv, NET_RING_SIZE);
+    NET_RingInit(&net_io.send, NET_RING_SIZE);
+    NET_RingInit(&net_io.errors, 16);
+    net_io.sleeping = net_io.quit = 0;
+
+    if (pthread_create(&net_io.thread, NULL, NET_ThreadFunc, NULL)) {
+        NET_RingFree(&net_io.recv);
+        NET_RingFree(&net_io.send);
+        NET_RingFree(&net_io.errors);
+        NET_ClosePipe(net_io.notify);
+fail2:
+        NET_ClosePipe(net_io.wake);
+fail1:
+        Com_EPrintf("Couldn't start network thread\n");
+        return;
     }
+
+    // main thread waits for notifications instead of sockets
+    for (i = 0; i < 2; i++)
+        if (net_io.socks[i] != -1)
+            os_get_io(net_io.socks[i])->wantread = false;
+    e = NET_AddFd(net_io.notify[0]);
+    e->wantread = true;
+
+    net_io.running = true;
+    Com_DPrintf("Network thread started\n");
 }
 
+static void NET_StopThread(void)
+{
+    int i;
+
+    if (!net_io.running)
+        return;
+
+    q_atomic_store(&net_io.quit, 1);
+    NET_WakePipe(net_io.wake[1]);
+    pthread_join(net_io.thread, NULL);
+    NET_CollectThreadStats();
+
+    for (i = 0; i < 2; i++)
+        if (net_io.socks[i] != -1)
+            os_get_io(net_io.socks[i])->wantread = true;
+    NET_RemoveFd(net_io.notify[0]);
+
+    NET_ClosePipe(net_io.wake);
+    NET_ClosePipe(net_io.notify);
+    NET_RingFree(&net_io.recv);
+    NET_RingFree(&net_io.send);
+    NET_RingFree(&net_io.errors);
+
+    net_io.running = false;
+    Com_DPrintf("Network thread stopped\n");
+}
+
+static void NET_GetThreadPackets(void (*packet_cb)(void))
+{
+    netslot_t *slot;
+
+    NET_DrainPipe(net_io.notify[0]);
+    NET_CollectThreadStats();
+
+#if USE_ICMP
+    while ((slot = NET_RingPeek(&net_io.errors)) != NULL) {
+        NET_ErrorEvent(slot->sock, &slot->adr, slot->error, slot->info);
+        NET_RingRelease(&net_io.errors);
+    }
+#endif
+
+    while ((slot = NET_RingPeek(&net_io.recv)) != NULL) {
+        net_from = slot->adr;
+        net_time = slot->time;
+        NET_UdpPacketRcvd(slot->data, slot->len, packet_cb);
+        NET_RingRelease(&net_io.recv);
+    }
+}
+
+static bool NET_QueueThreadPacket(qsocket_t s, const void *data,
+                                  size_t len, const netadr_t *to)
+{
+    netslot_t *slot = NET_RingReserve(&net_io.send);
+
+    // drop it if the ring is full, just as if socket send buffer was
+    if (!slot) {
+        net_io.send_drops++;
+        return false;
+    }
+
+    slot->adr = *to;
+    slot->sock = s;
+    slot->len = len;
+    memcpy(slot->data, data, len);
+    NET_RingCommit(&net_io.send);
+
+#if USE_DEBUG
+    if (net_log_enable->integer)
+        NET_LogPacket(to, "UDP send", data, len);
+#endif
+
+    // counted by NET_CollectThreadStats once actually sent
+
+    if (!net_batching[NS_SERVER])
+        NET_WakeThread();
+
+    return true;
+}
+
+#endif // USE_NET_THREAD
+
 /*
 =============
 NET_GetPackets
@@ -895,11 +1440,22 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
 #if USE_CLIENT
     memset(&net_from, 0, sizeof(net_from));
     net_from.type = NA_LOOPBACK;
+    net_time = com_eventTime;
 
     // process loopback packets
     NET_GetLoopPackets(sock, packet_cb);
 #endif
 
+#if USE_NET_THREAD
+    // process packets received by network thread
+    if (sock == NS_SERVER && net_io.running) {
+        NET_GetThreadPackets(packet_cb);
+        return;
+    }
+#endif
+
+    net_time = com_eventTime;
+
     // process UDP packets
     NET_GetUdpPackets(udp_sockets[sock], packet_cb);
 
@@ -907,6 +1463,114 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
     NET_GetUdpPackets(udp6_sockets[sock], packet_cb);
 }
 
+static bool NET_SendUdpPacket(qsocket_t s, const void *data,
+                              size_t len, const netadr_t *to)
+{
+    int ret;
+
+    ret = os_udp_send(s, data, len, to);
+    net_calls_sent++;
+    if (ret == NET_AGAIN)
+        return false;
+
+    if (ret == NET_ERROR) {
+        Com_DPrintf("%s: %s to %s\n", __func__,
+                    NET_ErrorString(), NET_AdrToString(to));
+        net_send_errors++;
+        return false;
+    }
+
+    NET_UdpPacketSent(to, data, len, ret);
+    return true;
+}
+
+#if USE_MMSG
+
+static void NET_FlushPackets(void)
+{
+    mmsgbatch_t *b = &net_send_batch;
+    int i, j, ret;
+
+    for (i = 0; i < b->count; i += ret) {
+        if (net_mmsg_broken) {
+            NET_SendUdpPacket(b->sock, b->data[i], b->iovs[i].iov_len, &b->to[i]);
+            ret = 1;
+            continue;
+        }
+
+        ret = os_udp_send_many(b->sock, b->hdrs + i, b->count - i);
+        net_calls_sent++;
+        if (ret == NET_AGAIN)
+            break;  // drop the rest, just as separate sends would
+
+        if (ret == NET_ERROR) {
+            if (net_error == ENOSYS)
+                net_mmsg_broken = true;
+            // let single packet send handle the error
+            NET_SendUdpPacket(b->sock, b->data[i], b->iovs[i].iov_len, &b->to[i]);
+            ret = 1;
+            continue;
+        }
+
+        for (j = i; j < i + ret; j++)
+            NET_UdpPacketSent(&b->to[j], b->data[j], b->iovs[j].iov_len, b->hdrs[j].msg_len);
+    }
+
+    b->count = 0;
+}
+
+static void NET_QueuePacket(qsocket_t s, const void *data,
+                            size_t len, const netadr_t *to)
+{
+    mmsgbatch_t *b = &net_send_batch;
+    int i;
+
+    if (b->count && b->sock != s)
+        NET_FlushPackets();
+
+    i = b->count++;
+    b->sock = s;
+    b->to[i] = *to;
+    memcpy(b->data[i], data, len);
+    b->iovs[i].iov_base = b->data[i];
+    b->iovs[i].iov_len = len;
+    memset(&b->hdrs[i], 0, sizeof(b->hdrs[i]));
+    b->hdrs[i].msg_hdr.msg_iov = &b->iovs[i];
+    b->hdrs[i].msg_hdr.msg_iovlen = 1;
+    b->hdrs[i].msg_hdr.msg_name = &b->addrs[i];
+    b->hdrs[i].msg_hdr.msg_namelen = NET_NetadrToSockadr(to, &b->addrs[i]);
+
+    if (b->count == MAX_MMSG)
+        NET_FlushPackets();
+}
+
+#endif // USE_MMSG
+
+/*
+=============
+NET_BatchPackets
+
+While enabled, UDP packets sent on this socket are queued and
+sent together. Disabling flushes the queue.
+=============
+*/
+void NET_BatchPackets(netsrc_t sock, bool enable)
+{
+    net_batching[sock] = enable;
+    if (enable)
+        return;
+
+#if USE_NET_THREAD
+    if (sock == NS_SERVER && net_io.running)
+        NET_WakeThread();
+#endif
+
+#if USE_MMSG
+    if (net_send_batch.count)
+        NET_FlushPackets();
+#endif
+}
+
 /*
 =============
 NET_SendPacket
@@ -916,7 +1580,6 @@ NET_SendPacket
 bool NET_SendPacket(netsrc_t sock, const void *data,
                     size_t len, const netadr_t *to)
 {
-    int ret;
     qsocket_t s;
 
     if (len == 0)
@@ -949,31 +1612,19 @@ bool NET_SendPacket(netsrc_t sock, const void *data,
     if (s == -1)
         return false;
 
-    ret = os_udp_send(s, data, len, to);
-    if (ret == NET_AGAIN)
-        return false;
+#if USE_NET_THREAD
+    if (sock == NS_SERVER && net_io.running)
+        return NET_QueueThreadPacket(s, data, len, to);
+#endif
 
-    if (ret == NET_ERROR) {
-        Com_DPrintf("%s: %s to %s\n", __func__,
-                    NET_ErrorString(), NET_AdrToString(to));
-        net_send_errors++;
-        return false;
+#if USE_MMSG
+    if (net_batching[sock]) {
+        NET_QueuePacket(s, data, len, to);
+        return true;
     }
-
-    if (ret < len)
-        Com_WPrintf("%s: short send to %s\n", __func__,
-                    NET_AdrToString(to));
-
-#if USE_DEBUG
-    if (net_log_enable->integer)
-        NET_LogPacket(to, "UDP send", data, ret);
 #endif
 
-    net_rate_sent += ret;
-    net_bytes_sent += ret;
-    net_packets_sent++;
-
-    return true;
+    return NET_SendUdpPacket(s, data, len, to);
 }
 
 //=============================================================================
@@ -1316,6 +1967,9 @@ void NET_Config(netflag_t flag)
     }
 
     if (flag == NET_NONE) {
+#if USE_NET_THREAD
+        NET_StopThread();
+#endif
         // shut down any existing sockets
         for (sock = 0; sock < NS_COUNT; sock++) {
             if (udp_sockets[sock] != -1) {
@@ -1343,6 +1997,9 @@ void NET_Config(netflag_t flag)
     if (flag & NET_SERVER) {
         NET_OpenServer();
         NET_OpenServer6();
+#if USE_NET_THREAD
+        NET_StartThread();
+#endif
     }
 
     net_active |= flag;
@@ -1961,6 +2618,11 @@ void NET_Init(void)
     net_ignore_icmp = Cvar_Get("net_ignore_icmp", "0", 0);
 #endif
 
+#if USE_NET_THREAD
+    net_thread = Cvar_Get("net_thread", "0", 0);
+    net_thread->changed = net_udp_param_changed;
+#endif
+
 #if USE_DEBUG
     net_log_enable_changed(net_log_enable);
 #endif
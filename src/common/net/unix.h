@@ -49,12 +49,12 @@ static bool process_error_queue(qsocket_t sock, const netadr_t *to)
 
         if (recvmsg(sock, &msg, MSG_ERRQUEUE) == -1) {
             if (errno != EWOULDBLOCK)
-                Com_DPrintf("%s: %s\n", __func__, strerror(errno));
+                NET_DPrintf("%s: %s\n", __func__, strerror(errno));
             break;
         }
 
         if (!(msg.msg_flags & MSG_ERRQUEUE)) {
-            Com_DPrintf("%s: no extended error received\n", __func__);
+            NET_DPrintf("%s: no extended error received\n", __func__);
             break;
         }
 
@@ -78,7 +78,7 @@ static bool process_error_queue(qsocket_t sock, const netadr_t *to)
         }
 
         if (!cmsg) {
-            Com_DPrintf("%s: no ICMP error found\n", __func__);
+            NET_DPrintf("%s: no ICMP error found\n", __func__);
             break;
         }
 
@@ -87,7 +87,7 @@ static bool process_error_queue(qsocket_t sock, const netadr_t *to)
         // check for offender address being current packet destination
         if (to != NULL && NET_IsEqualBaseAdr(&from, to) &&
             (from.port == 0 || from.port == to->port)) {
-            Com_DPrintf("%s: found offending address: %s\n", __func__,
+            NET_DPrintf("%s: found offending address: %s\n", __func__,
                         NET_AdrToString(&from));
             found = true;
         }
@@ -163,6 +163,40 @@ static int os_udp_send(qsocket_t sock, const void *data,
     return NET_ERROR;
 }
 
+#if USE_MMSG
+
+// receives up to `count' packets, returns number of packets received
+static int os_udp_recv_many(qsocket_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret = recvmmsg(sock, msgs, count, 0, NULL);
+
+    if (ret >= 0)
+        return ret;
+
+    net_error = errno;
+    if (net_error == EWOULDBLOCK)
+        return NET_AGAIN;
+
+    return NET_ERROR;
+}
+
+// sends up to `count' packets, returns number of packets sent
+static int os_udp_send_many(qsocket_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret = sendmmsg(sock, msgs, count, 0);
+
+    if (ret >= 0)
+        return ret;
+
+    net_error = errno;
+    if (net_error == EWOULDBLOCK)
+        return NET_AGAIN;
+
+    return NET_ERROR;
+}
+
+#endif // USE_MMSG
+
 static neterr_t os_get_error(void)
 {
     net_error = errno;
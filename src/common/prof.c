@@ -0,0 +1,302 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// prof.c -- CPU profiler zones
+//
+// Each thread that enters a zone while profiling is enabled claims a slot
+// with its own ring buffer, so recording never takes locks. Only the most
+// recent PROF_RING_SIZE zones of each thread are kept. Timestamps are raw
+// TSC ticks where available, converted to microseconds on export using the
+// rate measured over the profiling session. Starting a new session doesn't
+// touch other threads' state, each thread resets its own on next zone.
+//
+
+#include "shared/shared.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/files.h"
+#include "common/prof.h"
+#include "system/system.h"
+
+#if USE_PROFILER
+
+#if (defined __GNUC__) && (defined __i386__ || defined __x86_64__)
+#include <x86intrin.h>
+#define prof_ticks()    __rdtsc()
+#elif (defined _MSC_VER) && (defined _M_IX86 || defined _M_X64)
+#include <intrin.h>
+#define prof_ticks()    __rdtsc()
+#else
+#define prof_ticks()    Sys_Microseconds()
+#endif
+
+#define PROF_DIR            "profiles/"
+#define PROF_MAX_THREADS    40
+#define PROF_MAX_DEPTH      32
+#define PROF_RING_SIZE      (1 << 16)
+
+typedef struct {
+    const char  *name;
+    uint64_t    start;
+    uint64_t    end;
+} profzone_t;
+
+typedef struct {
+    profzone_t  *ring;      // allocated by owning thread
+    unsigned    head;       // total zones recorded since start
+    int         session;    // session state belongs to
+    int         depth;
+    const char  *names[PROF_MAX_DEPTH];
+    uint64_t    starts[PROF_MAX_DEPTH];
+} profthread_t;
+
+int prof_enabled;
+
+static struct {
+    profthread_t    threads[PROF_MAX_THREADS];
+    int             numthreads;
+    int             session;
+    uint64_t        start_ticks, stop_ticks;
+    uint64_t        start_usec, stop_usec;
+} prof;
+
+static q_thread_local profthread_t  *prof_self;
+static q_thread_local bool          prof_failed;
+
+/*
+==============================================================================
+
+RECORDING
+
+==============================================================================
+*/
+
+static profthread_t *claim_thread(void)
+{
+    profthread_t *t;
+    int slot;
+
+    if (prof_failed)
+        return NULL;
+
+    slot = q_atomic_add(&prof.numthreads, 1);
+    if (slot >= PROF_MAX_THREADS) {
+        prof_failed = true;
+        return NULL;
+    }
+
+    // Z_Malloc is not thread safe
+    t = &prof.threads[slot];
+    t->ring = malloc(PROF_RING_SIZE * sizeof(t->ring[0]));
+    if (!t->ring) {
+        prof_failed = true;
+        return NULL;
+    }
+    q_atomic_store(&t->session, q_atomic_load(&prof.session));
+
+    return prof_self = t;
+}
+
+// drops state left from previous session, called by owning thread only
+static bool stale_thread(profthread_t *t)
+{
+    int session = q_atomic_load(&prof.session);
+
+    if (t->session == session)
+        return false;
+
+    q_atomic_store(&t->head, 0);
+    t->depth = 0;
+    q_atomic_store(&t->session, session);
+    return true;
+}
+
+void Prof_Begin(const char *name)
+{
+    profthread_t *t = prof_self;
+
+    if (!t && !(t = claim_thread()))
+        return;
+
+    stale_thread(t);
+
+    if (t->depth < PROF_MAX_DEPTH) {
+        t->names[t->depth] = name;
+        t->starts[t->depth] = prof_ticks();
+    }
+    t->depth++;
+}
+
+void Prof_End(void)
+{
+    profthread_t *t = prof_self;
+    profzone_t *z;
+
+    // zone may have begun before profiling was enabled,
+    // or in previous session
+    if (!t || stale_thread(t) || !t->depth)
+        return;
+
+    // publish zone only after it is filled in, for profdump
+    if (--t->depth < PROF_MAX_DEPTH) {
+        z = &t->ring[t->head & (PROF_RING_SIZE - 1)];
+        z->name = t->names[t->depth];
+        z->start = t->starts[t->depth];
+        z->end = prof_ticks();
+        q_atomic_store(&t->head, t->head + 1);
+    }
+}
+
+/*
+==============================================================================
+
+COMMANDS
+
+==============================================================================
+*/
+
+static int num_threads(void)
+{
+    return min(q_atomic_load(&prof.numthreads), PROF_MAX_THREADS);
+}
+
+// workers may be running zones at any time (async work), so their state
+// is reset by themselves when they notice the new session
+static void Prof_Start_f(void)
+{
+    // make sure main thread gets the first slot
+    if (!prof_self)
+        claim_thread();
+
+    q_atomic_add(&prof.session, 1);
+
+    prof.start_ticks = prof_ticks();
+    prof.start_usec = Sys_Microseconds();
+    prof_enabled = 1;
+
+    Com_Printf("Profiling started.\n");
+}
+
+static void Prof_Stop_f(void)
+{
+    if (!prof_enabled) {
+        Com_Printf("Not profiling.\n");
+        return;
+    }
+
+    prof.stop_ticks = prof_ticks();
+    prof.stop_usec = Sys_Microseconds();
+    prof_enabled = 0;
+
+    Com_Printf("Profiling stopped after %.3f seconds.\n",
+               (prof.stop_usec - prof.start_usec) * 1e-6);
+}
+
+static void Prof_Dump_f(void)
+{
+    char buffer[MAX_OSPATH];
+    uint64_t stop_ticks, stop_usec;
+    double scale, base;
+    unsigned first, total = 0, dropped = 0;
+    const char *sep = "";
+    profthread_t *t;
+    profzone_t *z;
+    unsigned head;
+    qhandle_t f;
+    int i, n;
+
+    if (!prof.start_usec) {
+        Com_Printf("Nothing profiled yet.\n");
+        return;
+    }
+
+    if (Q_concat(buffer, sizeof(buffer), PROF_DIR,
+                 Cmd_Argc() > 1 ? Cmd_Argv(1) : "profile", ".json") >= sizeof(buffer)) {
+        Com_EPrintf("Oversize filename specified.\n");
+        return;
+    }
+
+    FS_OpenFile(buffer, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for writing\n", buffer);
+        return;
+    }
+
+    if (prof_enabled) {
+        stop_ticks = prof_ticks();
+        stop_usec = Sys_Microseconds();
+    } else {
+        stop_ticks = prof.stop_ticks;
+        stop_usec = prof.stop_usec;
+    }
+
+    // convert ticks to microseconds
+    scale = 1.0;
+    if (stop_usec > prof.start_usec && stop_ticks > prof.start_ticks)
+        scale = (double)(stop_usec - prof.start_usec) / (stop_ticks - prof.start_ticks);
+    base = (double)prof.start_ticks;
+
+    FS_FPrintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    n = num_threads();
+    for (i = 0; i < n; i++) {
+        // skip threads that haven't entered a zone this session, or are
+        // still claiming their slot. Session is stored after ring pointer
+        // and head, so those are valid once it matches.
+        t = &prof.threads[i];
+        if (q_atomic_load(&t->session) != prof.session)
+            continue;
+        head = q_atomic_load(&t->head);
+
+        FS_FPrintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s %d\"}}", sep, i, i ? "thread" : "main", i);
+        sep = ",\n";
+
+        first = 0;
+        if (head > PROF_RING_SIZE) {
+            first = head - PROF_RING_SIZE;
+            dropped += first;
+        }
+
+        for (; first < head; first++) {
+            z = &t->ring[first & (PROF_RING_SIZE - 1)];
+            FS_FPrintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f}", z->name, i,
+                       (z->start - base) * scale, (z->end - z->start) * scale);
+            total++;
+        }
+    }
+
+    FS_FPrintf(f, "\n]}\n");
+    FS_CloseFile(f);
+
+    Com_Printf("Wrote %u zones from %d threads to %s", total, n, buffer);
+    if (dropped)
+        Com_Printf(" (%u older zones overwritten)", dropped);
+    Com_Printf(".\n");
+}
+
+void Prof_Init(void)
+{
+    Cmd_AddCommand("profstart", Prof_Start_f);
+    Cmd_AddCommand("profstop", Prof_Stop_f);
+    Cmd_AddCommand("profdump", Prof_Dump_f);
+}
+
+#endif // USE_PROFILER
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
+#include "common/cmodel.h"
 #include "common/common.h"
 #include "common/files.h"
 #include "common/mdfour.h"
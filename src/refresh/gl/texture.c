@@ -36,6 +36,7 @@ static cvar_t *gl_noscrap;
 static cvar_t *gl_round_down;
 static cvar_t *gl_picmip;
 static cvar_t *gl_downsample_skins;
+static cvar_t *gl_linear_mipmaps;
 static cvar_t *gl_gamma_scale_pics;
 static cvar_t *gl_bilerp_chars;
 static cvar_t *gl_bilerp_pics;
@@ -371,6 +372,14 @@ static bool GL_MakePowerOfTwo(int *width, int *height)
     return false;
 }
 
+static void GL_MipMap(byte *data, int width, int height)
+{
+    if (gl_linear_mipmaps->integer)
+        IMG_MipMapSRGB(data, data, width, height);
+    else
+        IMG_MipMap(data, data, width, height);
+}
+
 /*
 ===============
 GL_Upload32
@@ -427,7 +436,7 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
         // optimized case, use faster mipmap operation
         scaled = data;
         while (width > scaled_width || height > scaled_height) {
-            IMG_MipMap(scaled, scaled, width, height);
+            GL_MipMap(scaled, width, height);
             width >>= 1;
             height >>= 1;
         }
@@ -456,13 +465,13 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
     c.texUploads++;
 
     if (type == IT_WALL || type == IT_SKIN) {
-        if (qglGenerateMipmap) {
+        if (qglGenerateMipmap && !gl_linear_mipmaps->integer) {
             qglGenerateMipmap(GL_TEXTURE_2D);
         } else {
             int miplevel = 0;
 
             while (scaled_width > 1 || scaled_height > 1) {
-                IMG_MipMap(scaled, scaled, scaled_width, scaled_height);
+                GL_MipMap(scaled, scaled_width, scaled_height);
                 scaled_width >>= 1;
                 scaled_height >>= 1;
                 if (scaled_width < 1)
@@ -925,6 +934,7 @@ void GL_InitImages(void)
     gl_round_down = Cvar_Get("gl_round_down", "0", CVAR_FILES);
     gl_picmip = Cvar_Get("gl_picmip", "0", CVAR_FILES);
     gl_downsample_skins = Cvar_Get("gl_downsample_skins", "1", CVAR_FILES);
+    gl_linear_mipmaps = Cvar_Get("gl_linear_mipmaps", "0", CVAR_FILES);
     gl_gamma_scale_pics = Cvar_Get("gl_gamma_scale_pics", "0", CVAR_FILES);
     gl_upscale_pcx = Cvar_Get("gl_upscale_pcx", "0", CVAR_FILES);
     gl_saturation = Cvar_Get("gl_saturation", "1", CVAR_FILES);
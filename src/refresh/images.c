@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/files.h"
+#include "common/mdfour.h"
 #include "../client/client.h"
 #include "refresh/images.h"
 #include "system/system.h"
@@ -36,6 +37,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <assert.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_IMG_SSE2    1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define USE_IMG_AVX2    1
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_IMG_NEON    1
+#endif
+
 #define R_COLORMAP_PCX    "pics/colormap.pcx"
 
 #define IMG_LOAD(x) \
@@ -796,8 +809,378 @@ IMAGE PROCESSING
 =========================================================
 */
 
-void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
-                         byte *out, int outwidth, int outheight)
+// SIMD kernels process leading part of each row and return how much of it
+// they have done, the rest is finished by scalar code. Results are bit exact
+// with scalar versions, which `imagebench' command verifies.
+typedef int (*mipmap_row_t)(byte *out, const byte *in, int width);
+typedef int (*resample_row_t)(byte *out, const byte *inrow1, const byte *inrow2,
+                              const unsigned *p1, const unsigned *p2, int count);
+typedef int (*filter_float_t)(float *out, const float *in, int count,
+                              const float *kernel, int size, int stride);
+typedef int (*average_float_t)(float *out, const float *a, const float *b, int count);
+
+static struct {
+    mipmap_row_t    mipmap;
+    resample_row_t  resample;
+    filter_float_t  filter;
+    average_float_t average;
+    const char      *mipmap_name;
+    const char      *resample_name;
+    const char      *float_name;
+} img_simd;
+
+float   img_srgb_to_linear[256];
+float   img_srgb_thresholds[256];
+byte    img_linear_to_srgb[IMG_LINEAR_STEPS];
+
+static int mipmap_scalar(byte *out, const byte *in, int width)
+{
+    return 0;
+}
+
+static int resample_scalar(byte *out, const byte *inrow1, const byte *inrow2,
+                           const unsigned *p1, const unsigned *p2, int count)
+{
+    return 0;
+}
+
+static int filter_float_scalar(float *out, const float *in, int count,
+                               const float *kernel, int size, int stride)
+{
+    return 0;
+}
+
+static int average_float_scalar(float *out, const float *a, const float *b, int count)
+{
+    return 0;
+}
+
+#if USE_IMG_SSE2
+static int mipmap_sse2(byte *out, const byte *in, int width)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i a, b, lo, hi, h0, h1;
+    int j;
+
+    // 8 input pixels per iteration, all loads are done before the store
+    // so that mipmapping in place works
+    for (j = 0; j + 32 <= width; j += 32) {
+        a = _mm_loadu_si128((const __m128i *)(in + j));
+        b = _mm_loadu_si128((const __m128i *)(in + width + j));
+        lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        h0 = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+
+        a = _mm_loadu_si128((const __m128i *)(in + j + 16));
+        b = _mm_loadu_si128((const __m128i *)(in + width + j + 16));
+        lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        h1 = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+
+        h0 = _mm_srli_epi16(h0, 2);
+        h1 = _mm_srli_epi16(h1, 2);
+        _mm_storeu_si128((__m128i *)(out + j / 2), _mm_packus_epi16(h0, h1));
+    }
+
+    return j;
+}
+
+static inline __m128i load_texels_sse2(const byte *row, const unsigned *p)
+{
+    uint32_t t[4];
+
+    memcpy(&t[0], row + p[0], 4);
+    memcpy(&t[1], row + p[1], 4);
+    memcpy(&t[2], row + p[2], 4);
+    memcpy(&t[3], row + p[3], 4);
+
+    return _mm_loadu_si128((const __m128i *)t);
+}
+
+static int resample_sse2(byte *out, const byte *inrow1, const byte *inrow2,
+                         const unsigned *p1, const unsigned *p2, int count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i a, b, c, d, lo, hi;
+    int j;
+
+    for (j = 0; j + 4 <= count; j += 4) {
+        a = load_texels_sse2(inrow1, p1 + j);
+        b = load_texels_sse2(inrow1, p2 + j);
+        c = load_texels_sse2(inrow2, p1 + j);
+        d = load_texels_sse2(inrow2, p2 + j);
+        lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                           _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+        hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                           _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+        lo = _mm_srli_epi16(lo, 2);
+        hi = _mm_srli_epi16(hi, 2);
+        _mm_storeu_si128((__m128i *)(out + j * 4), _mm_packus_epi16(lo, hi));
+    }
+
+    return j;
+}
+
+// multiplies and adds are kept separate and in scalar order, so that
+// results match scalar code exactly
+static int filter_float_sse2(float *out, const float *in, int count,
+                             const float *kernel, int size, int stride)
+{
+    __m128 acc;
+    int i, j;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        acc = _mm_setzero_ps();
+        for (j = 0; j < size; j++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(kernel[j]),
+                                             _mm_loadu_ps(in + i + j * stride)));
+        _mm_storeu_ps(out + i, acc);
+    }
+
+    return i;
+}
+
+static int average_float_sse2(float *out, const float *a, const float *b, int count)
+{
+    __m128 half = _mm_set1_ps(0.5f);
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(a + i),
+                                                     _mm_loadu_ps(b + i)), half));
+
+    return i;
+}
+#endif
+
+#if USE_IMG_AVX2
+__attribute__((target("avx2")))
+static int mipmap_avx2(byte *out, const byte *in, int width)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i a, b, lo, hi, h0, h1;
+    int j;
+
+    for (j = 0; j + 64 <= width; j += 64) {
+        a = _mm256_loadu_si256((const __m256i *)(in + j));
+        b = _mm256_loadu_si256((const __m256i *)(in + width + j));
+        lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        h0 = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+
+        a = _mm256_loadu_si256((const __m256i *)(in + j + 32));
+        b = _mm256_loadu_si256((const __m256i *)(in + width + j + 32));
+        lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+        hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+        h1 = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+
+        // packing works within 128-bit lanes, restore pixel order
+        h0 = _mm256_packus_epi16(_mm256_srli_epi16(h0, 2), _mm256_srli_epi16(h1, 2));
+        _mm256_storeu_si256((__m256i *)(out + j / 2), _mm256_permute4x64_epi64(h0, 0xD8));
+    }
+
+    return j;
+}
+
+__attribute__((target("avx2")))
+static int resample_avx2(byte *out, const byte *inrow1, const byte *inrow2,
+                         const unsigned *p1, const unsigned *p2, int count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i i1, i2, a, b, c, d, lo, hi;
+    int j;
+
+    for (j = 0; j + 8 <= count; j += 8) {
+        i1 = _mm256_loadu_si256((const __m256i *)(p1 + j));
+        i2 = _mm256_loadu_si256((const __m256i *)(p2 + j));
+        a = _mm256_i32gather_epi32((const int *)inrow1, i1, 1);
+        b = _mm256_i32gather_epi32((const int *)inrow1, i2, 1);
+        c = _mm256_i32gather_epi32((const int *)inrow2, i1, 1);
+        d = _mm256_i32gather_epi32((const int *)inrow2, i2, 1);
+        lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)),
+                              _mm256_add_epi16(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero)));
+        hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)),
+                              _mm256_add_epi16(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero)));
+        lo = _mm256_srli_epi16(lo, 2);
+        hi = _mm256_srli_epi16(hi, 2);
+        _mm256_storeu_si256((__m256i *)(out + j * 4), _mm256_packus_epi16(lo, hi));
+    }
+
+    return j;
+}
+
+__attribute__((target("avx2")))
+static int filter_float_avx2(float *out, const float *in, int count,
+                             const float *kernel, int size, int stride)
+{
+    __m256 acc;
+    int i, j;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        acc = _mm256_setzero_ps();
+        for (j = 0; j < size; j++)
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(kernel[j]),
+                                                   _mm256_loadu_ps(in + i + j * stride)));
+        _mm256_storeu_ps(out + i, acc);
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int average_float_avx2(float *out, const float *a, const float *b, int count)
+{
+    __m256 half = _mm256_set1_ps(0.5f);
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(a + i),
+                                                              _mm256_loadu_ps(b + i)), half));
+
+    return i;
+}
+#endif
+
+#if USE_IMG_NEON
+static int mipmap_neon(byte *out, const byte *in, int width)
+{
+    uint8x16x4_t a, b;
+    uint8x8x4_t r;
+    int j, k;
+
+    // 16 input pixels per iteration, deinterleaved into channels
+    for (j = 0; j + 64 <= width; j += 64) {
+        a = vld4q_u8(in + j);
+        b = vld4q_u8(in + width + j);
+        for (k = 0; k < 4; k++)
+            r.val[k] = vshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[k]), b.val[k]), 2);
+        vst4_u8(out + j / 2, r);
+    }
+
+    return j;
+}
+
+static int filter_float_neon(float *out, const float *in, int count,
+                             const float *kernel, int size, int stride)
+{
+    float32x4_t acc;
+    int i, j;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        acc = vdupq_n_f32(0);
+        for (j = 0; j < size; j++)
+            acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(in + i + j * stride), kernel[j]));
+        vst1q_f32(out + i, acc);
+    }
+
+    return i;
+}
+
+static int average_float_neon(float *out, const float *a, const float *b, int count)
+{
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4)
+        vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i)), 0.5f));
+
+    return i;
+}
+#endif
+
+static void select_kernels(void)
+{
+    img_simd.mipmap = mipmap_scalar;
+    img_simd.resample = resample_scalar;
+    img_simd.filter = filter_float_scalar;
+    img_simd.average = average_float_scalar;
+    img_simd.mipmap_name = img_simd.resample_name = img_simd.float_name = "scalar";
+
+#if USE_IMG_SSE2
+    img_simd.mipmap = mipmap_sse2;
+    img_simd.resample = resample_sse2;
+    img_simd.filter = filter_float_sse2;
+    img_simd.average = average_float_sse2;
+    img_simd.mipmap_name = img_simd.resample_name = img_simd.float_name = "SSE2";
+#endif
+
+#if USE_IMG_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        img_simd.mipmap = mipmap_avx2;
+        img_simd.resample = resample_avx2;
+        img_simd.filter = filter_float_avx2;
+        img_simd.average = average_float_avx2;
+        img_simd.mipmap_name = img_simd.resample_name = img_simd.float_name = "AVX2";
+    }
+#endif
+
+#if USE_IMG_NEON
+    img_simd.mipmap = mipmap_neon;
+    img_simd.filter = filter_float_neon;
+    img_simd.average = average_float_neon;
+    img_simd.mipmap_name = img_simd.float_name = "NEON";
+#endif
+}
+
+// reference for encode_srgb() from vkpt/color.h
+static byte encode_srgb_exact(float x)
+{
+    if (x <= 0.0031308f)
+        x *= 12.92f;
+    else
+        x = 1.055f * powf(x, 1.f / 2.4f) - 0.055f;
+
+    x = max(0.f, min(1.f, x));
+
+    return (byte)roundf(x * 255.f);
+}
+
+static void init_srgb_tables(void)
+{
+    uint32_t lo, hi, mid;
+    float x;
+    int i;
+
+    // same math as decode_srgb() from vkpt/color.h
+    for (i = 0; i < 256; i++) {
+        x = (float)i / 255.f;
+        if (x < 0.04045f)
+            img_srgb_to_linear[i] = x / 12.92f;
+        else
+            img_srgb_to_linear[i] = powf((x + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (i = 0; i < IMG_LINEAR_STEPS; i++) {
+        x = (float)i / (IMG_LINEAR_STEPS - 1);
+        if (x <= 0.0031308f)
+            x *= 12.92f;
+        else
+            x = 1.055f * powf(x, 1.f / 2.4f) - 0.055f;
+        x = max(0.f, min(1.f, x));
+        img_linear_to_srgb[i] = (byte)roundf(x * 255.f);
+    }
+
+    // encoding is monotonic, so find the smallest linear value encoded to
+    // each sRGB value by bisecting bit patterns of positive floats, which
+    // are ordered the same way as the floats themselves
+    img_srgb_thresholds[0] = 0;
+    for (i = 1; i < 256; i++) {
+        lo = 0;
+        hi = 0x3f800000;    // 1.0f
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            memcpy(&x, &mid, sizeof(x));
+            if (encode_srgb_exact(x) >= i)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        memcpy(&img_srgb_thresholds[i], &lo, sizeof(float));
+    }
+}
+
+static void resample_texture(const byte *in, int inwidth, int inheight,
+                             byte *out, int outwidth, int outheight,
+                             resample_row_t kernel)
 {
     int i, j;
     const byte  *inrow1, *inrow2;
@@ -828,7 +1211,8 @@ void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
     for (i = 0; i < outheight; i++) {
         inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
         inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
+        j = kernel(out, inrow1, inrow2, p1, p2, outwidth);
+        for (out += j * 4; j < outwidth; j++) {
             pix1 = inrow1 + p1[j];
             pix2 = inrow1 + p2[j];
             pix3 = inrow2 + p1[j];
@@ -842,14 +1226,15 @@ void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
     }
 }
 
-void IMG_MipMap(byte *out, byte *in, int width, int height)
+static void mipmap(byte *out, byte *in, int width, int height, mipmap_row_t kernel)
 {
     int     i, j;
 
     width <<= 2;
     height >>= 1;
     for (i = 0; i < height; i++, in += width) {
-        for (j = 0; j < width; j += 8, out += 4, in += 8) {
+        j = kernel(out, in, width);
+        for (out += j / 2, in += j; j < width; j += 8, out += 4, in += 8) {
             out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
             out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
             out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
@@ -858,6 +1243,232 @@ void IMG_MipMap(byte *out, byte *in, int width, int height)
     }
 }
 
+void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
+                         byte *out, int outwidth, int outheight)
+{
+    resample_texture(in, inwidth, inheight, out, outwidth, outheight, img_simd.resample);
+}
+
+void IMG_MipMap(byte *out, byte *in, int width, int height)
+{
+    mipmap(out, in, width, height, img_simd.mipmap);
+}
+
+static void filter_float(float *out, const float *in, int count,
+                         const float *kernel, int size, int stride,
+                         filter_float_t func)
+{
+    int i, j;
+    float v;
+
+    for (i = func(out, in, count, kernel, size, stride); i < count; i++) {
+        v = 0;
+        for (j = 0; j < size; j++)
+            v += kernel[j] * in[i + j * stride];
+        out[i] = v;
+    }
+}
+
+static void average_float(float *out, const float *a, const float *b, int count,
+                          average_float_t func)
+{
+    int i;
+
+    for (i = func(out, a, b, count); i < count; i++)
+        out[i] = (a[i] + b[i]) * 0.5f;
+}
+
+/*
+================
+IMG_FilterFloat
+
+Convolves `count' floats with `size' tap kernel, taps being `stride' floats
+apart. `in' must hold count + (size - 1) * stride floats.
+================
+*/
+void IMG_FilterFloat(float *out, const float *in, int count,
+                     const float *kernel, int size, int stride)
+{
+    filter_float(out, in, count, kernel, size, stride, img_simd.filter);
+}
+
+void IMG_AverageFloat(float *out, const float *a, const float *b, int count)
+{
+    average_float(out, a, b, count, img_simd.average);
+}
+
+static inline byte average_srgb(const byte *a, const byte *b, const byte *c, const byte *d)
+{
+    float x = img_srgb_to_linear[*a] + img_srgb_to_linear[*b] +
+              img_srgb_to_linear[*c] + img_srgb_to_linear[*d];
+
+    return img_linear_to_srgb[(int)(x * ((IMG_LINEAR_STEPS - 1) * 0.25f) + 0.5f)];
+}
+
+// same as IMG_MipMap, but averages colors in linear space, which keeps
+// minified high contrast textures from getting darker. Alpha is averaged
+// as is.
+void IMG_MipMapSRGB(byte *out, byte *in, int width, int height)
+{
+    int     i, j;
+
+    width <<= 2;
+    height >>= 1;
+    for (i = 0; i < height; i++, in += width) {
+        for (j = 0; j < width; j += 8, out += 4, in += 8) {
+            out[0] = average_srgb(&in[0], &in[4], &in[width + 0], &in[width + 4]);
+            out[1] = average_srgb(&in[1], &in[5], &in[width + 1], &in[width + 5]);
+            out[2] = average_srgb(&in[2], &in[6], &in[width + 2], &in[width + 6]);
+            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+        }
+    }
+}
+
+static void bench_result(const char *what, const char *name, uint64_t scalar,
+                         uint64_t simd, bool match)
+{
+    Com_Printf("%-9s scalar %8.3f ms, %-6s %8.3f ms (%.2fx) %s\n", what,
+               scalar * 1e-3, name, simd * 1e-3,
+               simd ? (double)scalar / simd : 0.0, match ? "ok" : "MISMATCH");
+}
+
+static void IMG_Bench_f(void)
+{
+    int         i, size, count, outsize, total;
+    byte        *src, *ref, *out;
+    uint64_t    start, scalar, simd;
+    bool        match;
+
+    if (Cmd_Argc() > 3) {
+        Com_Printf("Usage: %s [size] [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    size = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 1024;
+    count = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 20;
+    clamp(size, 16, MAX_TEXTURE_SIZE);
+    clamp(count, 1, 1000);
+    size &= ~1;
+    total = size * size * 4;
+
+    src = Z_Malloc(total);
+    ref = Z_Malloc(total);
+    out = Z_Malloc(total);
+    for (i = 0; i < total; i++)
+        src[i] = Q_rand() & 255;
+
+    // mipmap in place, like texture upload code does
+    scalar = simd = 0;
+    match = true;
+    for (i = 0; i < count; i++) {
+        memcpy(ref, src, total);
+        start = Sys_Microseconds();
+        mipmap(ref, ref, size, size, mipmap_scalar);
+        scalar += Sys_Microseconds() - start;
+
+        memcpy(out, src, total);
+        start = Sys_Microseconds();
+        mipmap(out, out, size, size, img_simd.mipmap);
+        simd += Sys_Microseconds() - start;
+
+        match &= !memcmp(ref, out, total / 4);
+    }
+    bench_result("mipmap", img_simd.mipmap_name, scalar, simd, match);
+
+    // resample to non power of two size
+    outsize = size * 3 / 4;
+    scalar = simd = 0;
+    match = true;
+    for (i = 0; i < count; i++) {
+        start = Sys_Microseconds();
+        resample_texture(src, size, size, ref, outsize, outsize, resample_scalar);
+        scalar += Sys_Microseconds() - start;
+
+        start = Sys_Microseconds();
+        resample_texture(src, size, size, out, outsize, outsize, img_simd.resample);
+        simd += Sys_Microseconds() - start;
+
+        match &= !memcmp(ref, out, outsize * outsize * 4);
+    }
+    bench_result("resample", img_simd.resample_name, scalar, simd, match);
+
+    // float filter and average on the same amount of data, 11 tap kernel
+    // on single channel like fake emissive blur does
+    {
+        static const float kernel[] = {
+            0.0093f, 0.028002f, 0.065984f, 0.121703f, 0.175713f, 0.198596f,
+            0.175713f, 0.121703f, 0.065984f, 0.028002f, 0.0093f
+        };
+        int numfloats = total / 4 - 10;
+        float *fsrc = (float *)src, *fref = (float *)ref, *fout = (float *)out;
+
+        for (i = 0; i < total / 4; i++)
+            fsrc[i] = frand();
+
+        scalar = simd = 0;
+        match = true;
+        for (i = 0; i < count; i++) {
+            start = Sys_Microseconds();
+            filter_float(fref, fsrc, numfloats, kernel, 11, 1, filter_float_scalar);
+            scalar += Sys_Microseconds() - start;
+
+            start = Sys_Microseconds();
+            filter_float(fout, fsrc, numfloats, kernel, 11, 1, img_simd.filter);
+            simd += Sys_Microseconds() - start;
+
+            match &= !memcmp(fref, fout, numfloats * sizeof(float));
+        }
+        bench_result("filter", img_simd.float_name, scalar, simd, match);
+
+        numfloats = total / 8;
+        scalar = simd = 0;
+        match = true;
+        for (i = 0; i < count; i++) {
+            start = Sys_Microseconds();
+            average_float(fref, fsrc, fsrc + numfloats, numfloats, average_float_scalar);
+            scalar += Sys_Microseconds() - start;
+
+            start = Sys_Microseconds();
+            average_float(fout, fsrc, fsrc + numfloats, numfloats, img_simd.average);
+            simd += Sys_Microseconds() - start;
+
+            match &= !memcmp(fref, fout, numfloats * sizeof(float));
+        }
+        bench_result("average", img_simd.float_name, scalar, simd, match);
+
+        // table encoding against powf, over and beyond [0, 1] range
+        numfloats = total / 4;
+        for (i = 0; i < numfloats; i++)
+            fsrc[i] = crand() * 0.1f + frand() * 1.1f;
+
+        start = Sys_Microseconds();
+        for (i = 0; i < numfloats; i++)
+            ref[i] = encode_srgb_exact(fsrc[i]);
+        scalar = Sys_Microseconds() - start;
+
+        start = Sys_Microseconds();
+        for (i = 0; i < numfloats; i++)
+            out[i] = IMG_EncodeSRGB(fsrc[i]);
+        simd = Sys_Microseconds() - start;
+
+        match = !memcmp(ref, out, numfloats);
+        bench_result("encode", "table", scalar, simd, match);
+    }
+
+    // linear to sRGB table must round trip all sRGB values
+    match = true;
+    for (i = 0; i < 256; i++) {
+        memset(ref, i, 16);
+        IMG_MipMapSRGB(out, ref, 2, 2);
+        match &= out[0] == i;
+    }
+    Com_Printf("sRGB      round trip %s\n", match ? "ok" : "MISMATCH");
+
+    Z_Free(src);
+    Z_Free(ref);
+    Z_Free(out);
+}
+
 /*
 =========================================================
 
@@ -891,6 +1502,7 @@ static int              img_total;
 
 static cvar_t   *r_override_textures;
 static cvar_t   *r_texture_formats;
+static cvar_t   *r_texture_cache;
 
 /*
 ===============
@@ -1006,6 +1618,342 @@ static image_t *lookup_image(const char *name,
     return NULL;
 }
 
+/*
+=================================================================
+
+DECODED TEXTURE CACHE
+
+Decoded TGA/JPG/PNG images are kept in the write directory, named by
+checksum of source file contents and decoding parameters, so stale
+entries are never found and nothing needs to be invalidated. Once cache
+grows over r_texture_cache_size megabytes, oldest entries are removed at
+the end of each registration that added new ones.
+
+=================================================================
+*/
+
+#define TEXCACHE_DIR        "texcache"
+#define TEXCACHE_IDENT      MakeLittleLong('Q','2','T','C')
+#define TEXCACHE_VERSION    1
+#define TEXCACHE_MAX_SIZE   16384
+
+static cvar_t   *r_texture_cache_size;
+static bool     texcache_written;
+
+typedef struct {
+    uint32_t    ident;
+    uint32_t    version;
+    uint8_t     key[16];
+    uint32_t    width, height;
+    uint32_t    pixel_format;
+    uint32_t    flags;          // IF_OPAQUE
+} texcache_t;
+
+static void texcache_key(const byte *rawdata, size_t rawlen, uint8_t *key)
+{
+    uint32_t params[2];
+    mdfour_t md;
+
+    params[0] = TEXCACHE_VERSION;
+    params[1] = supports_extended_pixel_format();
+
+    mdfour_begin(&md);
+    mdfour_update(&md, (const uint8_t *)params, sizeof(params));
+    mdfour_update(&md, rawdata, rawlen);
+    mdfour_result(&md, key);
+}
+
+static size_t texcache_path(char *buffer, size_t size, const uint8_t *key)
+{
+    char hex[33];
+    int i;
+
+    for (i = 0; i < 16; i++)
+        Q_snprintf(hex + i * 2, 3, "%02x", key[i]);
+
+    return Q_concat(buffer, size, TEXCACHE_DIR "/", hex, ".bin");
+}
+
+static size_t texcache_pixel_size(int pixel_format)
+{
+    return pixel_format == PF_R16_UNORM ? 2 : 4;
+}
+
+static int texcache_load(const uint8_t *key, image_t *image, byte **pic)
+{
+    char buffer[MAX_QPATH];
+    texcache_t header;
+    qhandle_t f;
+    int64_t len;
+    size_t size;
+    byte *data;
+    int ret;
+
+    texcache_path(buffer, sizeof(buffer), key);
+    len = FS_OpenFile(buffer, &f, FS_MODE_READ | FS_TYPE_REAL);
+    if (!f)
+        return len;
+
+    ret = FS_Read(&header, sizeof(header), f);
+    if (ret != sizeof(header)) {
+        ret = ret < 0 ? ret : Q_ERR_UNEXPECTED_EOF;
+        goto fail;
+    }
+
+    if (header.ident != TEXCACHE_IDENT || header.version != TEXCACHE_VERSION ||
+        memcmp(header.key, key, sizeof(header.key)) ||
+        header.width < 1 || header.width > TEXCACHE_MAX_SIZE ||
+        header.height < 1 || header.height > TEXCACHE_MAX_SIZE ||
+        header.pixel_format > PF_R16_UNORM) {
+        ret = Q_ERR_INVALID_FORMAT;
+        goto fail;
+    }
+
+    size = header.width * header.height * texcache_pixel_size(header.pixel_format);
+    if (len != sizeof(header) + size) {
+        ret = Q_ERR_INVALID_FORMAT;
+        goto fail;
+    }
+
+    data = IMG_AllocPixels(size);
+    ret = FS_Read(data, size, f);
+    if (ret != size) {
+        IMG_FreePixels(data);
+        ret = ret < 0 ? ret : Q_ERR_UNEXPECTED_EOF;
+        goto fail;
+    }
+
+    FS_CloseFile(f);
+
+    *pic = data;
+    image->upload_width = image->width = header.width;
+    image->upload_height = image->height = header.height;
+    image->pixel_format = header.pixel_format;
+    image->flags |= header.flags & IF_OPAQUE;
+    return Q_ERR_SUCCESS;
+
+fail:
+    FS_CloseFile(f);
+    Com_DPrintf("Couldn't load %s for %s: %s\n", buffer, image->name, Q_ErrorString(ret));
+    return ret;
+}
+
+static void texcache_save(const uint8_t *key, const image_t *image, const byte *pic)
+{
+    char buffer[MAX_QPATH];
+    texcache_t header;
+    qhandle_t f;
+    size_t size;
+    int ret;
+
+    texcache_path(buffer, sizeof(buffer), key);
+    FS_OpenFile(buffer, &f, FS_MODE_WRITE);
+    if (!f)
+        return;
+
+    header.ident = TEXCACHE_IDENT;
+    header.version = TEXCACHE_VERSION;
+    memcpy(header.key, key, sizeof(header.key));
+    header.width = image->width;
+    header.height = image->height;
+    header.pixel_format = image->pixel_format;
+    header.flags = image->flags & IF_OPAQUE;
+
+    size = image->width * image->height * texcache_pixel_size(image->pixel_format);
+
+    FS_Write(&header, sizeof(header), f);
+    FS_Write(pic, size, f);
+    ret = FS_CloseFile(f);
+
+    // partially written entry will be rejected by size check
+    if (ret < 0)
+        Com_WPrintf("Couldn't write %s: %s\n", buffer, Q_ErrorString(ret));
+
+    texcache_written = true;
+}
+
+static int texcache_cmp(const void *p1, const void *p2)
+{
+    const file_info_t *a = *(const file_info_t **)p1;
+    const file_info_t *b = *(const file_info_t **)p2;
+
+    if (a->mtime != b->mtime)
+        return a->mtime < b->mtime ? -1 : 1;
+    return 0;
+}
+
+// removes oldest entries until cache fits in r_texture_cache_size
+static void texcache_prune(void)
+{
+    char path[MAX_OSPATH];
+    file_info_t **list;
+    int64_t total, limit;
+    int i, count, removed;
+
+    texcache_written = false;
+    if (r_texture_cache_size->integer <= 0)
+        return;
+
+    list = (file_info_t **)FS_ListFiles(TEXCACHE_DIR, ".bin", FS_TYPE_REAL |
+                                        FS_PATH_GAME | FS_SEARCH_EXTRAINFO, &count);
+    if (!list)
+        return;
+
+    total = 0;
+    for (i = 0; i < count; i++)
+        total += list[i]->size;
+
+    limit = (int64_t)r_texture_cache_size->integer << 20;
+    if (total > limit) {
+        qsort(list, count, sizeof(list[0]), texcache_cmp);
+
+        // loading doesn't touch entries, so one still in use may go too;
+        // it is then decoded and written again as the newest one
+        for (i = removed = 0; i < count && total > limit; i++) {
+            if (Q_concat(path, sizeof(path), fs_gamedir, "/" TEXCACHE_DIR "/",
+                         list[i]->name) >= sizeof(path))
+                continue;
+            if (remove(path))
+                continue;
+            total -= list[i]->size;
+            removed++;
+        }
+
+        Com_DPrintf("%s: removed %d entries, %"PRId64" MB left\n",
+                    __func__, removed, total >> 20);
+    }
+
+    FS_FreeList((void **)list);
+}
+
+typedef struct {
+    byte    *data;
+    size_t  len, size;
+} texcache_buf_t;
+
+static void texcache_bench_write(void *context, void *data, int size)
+{
+    texcache_buf_t *buf = context;
+
+    if (buf->len + size > buf->size) {
+        buf->size = max(buf->size * 2, buf->len + size);
+        buf->data = Z_Realloc(buf->data, buf->size);
+    }
+    memcpy(buf->data + buf->len, data, size);
+    buf->len += size;
+}
+
+/*
+================
+IMG_TexCacheBench_f
+
+Compares decoding a PNG with reading the same image back from cache.
+Image is a smooth gradient with some noise, which compresses about as
+well as typical texture.
+================
+*/
+static void IMG_TexCacheBench_f(void)
+{
+    texcache_buf_t buf = { 0 };
+    image_t image = { 0 };
+    uint64_t start, decode, load;
+    int i, x, y, size, count, ret;
+    char name[MAX_QPATH], path[MAX_OSPATH];
+    uint8_t key[16];
+    byte *src, *p, *pic;
+
+    if (Cmd_Argc() > 3) {
+        Com_Printf("Usage: %s [size] [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    size = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 2048;
+    count = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 5;
+    clamp(size, 16, TEXCACHE_MAX_SIZE);
+    clamp(count, 1, 100);
+
+    src = p = Z_Malloc(size * size * 4);
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++, p += 4) {
+            p[0] = (x * 255 / size + (Q_rand() & 7)) & 255;
+            p[1] = (y * 255 / size + (Q_rand() & 7)) & 255;
+            p[2] = ((x + y) * 127 / size + (Q_rand() & 7)) & 255;
+            p[3] = 255;
+        }
+    }
+    ret = stbi_write_png_to_func(texcache_bench_write, &buf, size, size, 4, src, size * 4);
+    Z_Free(src);
+    if (!ret) {
+        Com_EPrintf("Couldn't encode PNG\n");
+        goto done;
+    }
+
+    decode = 0;
+    for (i = 0; i < count; i++) {
+        start = Sys_Microseconds();
+        ret = IMG_LoadSTB(buf.data, buf.len, &image, &pic);
+        decode += Sys_Microseconds() - start;
+        if (ret < 0) {
+            Com_EPrintf("Couldn't decode PNG: %s\n", Q_ErrorString(ret));
+            goto done;
+        }
+        if (i < count - 1)
+            IMG_FreePixels(pic);
+    }
+
+    // cache entry is read back from page cache, like on second level load
+    texcache_key(buf.data, buf.len, key);
+    texcache_save(key, &image, pic);
+    IMG_FreePixels(pic);
+
+    load = 0;
+    for (i = 0; i < count; i++) {
+        start = Sys_Microseconds();
+        ret = texcache_load(key, &image, &pic);
+        load += Sys_Microseconds() - start;
+        if (ret < 0)
+            break;
+        IMG_FreePixels(pic);
+    }
+
+    texcache_path(name, sizeof(name), key);
+    if (Q_concat(path, sizeof(path), fs_gamedir, "/", name) < sizeof(path))
+        remove(path);
+
+    if (ret < 0) {
+        Com_EPrintf("Couldn't load cache entry: %s\n", Q_ErrorString(ret));
+        goto done;
+    }
+
+    Com_Printf("%dx%d: PNG %.1f MB decode %.3f ms, cache %.1f MB read %.3f ms (%.2fx)\n",
+               size, size, buf.len / 1e6, decode / 1e3 / count,
+               image.width * image.height * texcache_pixel_size(image.pixel_format) / 1e6,
+               load / 1e3 / count, (double)decode / max(load, 1));
+
+done:
+    Z_Free(buf.data);
+}
+
+// decodes image, going through cache for formats that are slow to decode
+static int decode_image(imageformat_t fmt, byte *rawdata, size_t rawlen, image_t *image, byte **pic)
+{
+    uint8_t key[16];
+    int ret;
+
+    if (!r_texture_cache->integer || fmt < IM_TGA)
+        return img_loaders[fmt].load(rawdata, rawlen, image, pic);
+
+    texcache_key(rawdata, rawlen, key);
+    if (texcache_load(key, image, pic) == Q_ERR_SUCCESS)
+        return Q_ERR_SUCCESS;
+
+    ret = img_loaders[fmt].load(rawdata, rawlen, image, pic);
+    if (ret >= 0)
+        texcache_save(key, image, *pic);
+
+    return ret;
+}
+
 #define TRY_IMAGE_SRC_GAME      1
 #define TRY_IMAGE_SRC_BASE      0
 
@@ -1016,16 +1964,16 @@ static int _try_image_format(imageformat_t fmt, image_t *image, int try_src, byt
     int         ret;
 
     // load the file
-    int fs_flags = 0;
+    int fs_flags = FS_FLAG_MAPPED;
     if (try_src > 0)
-        fs_flags = try_src == TRY_IMAGE_SRC_GAME ? FS_PATH_GAME : FS_PATH_BASE;
+        fs_flags |= try_src == TRY_IMAGE_SRC_GAME ? FS_PATH_GAME : FS_PATH_BASE;
     len = FS_LoadFileFlags(image->name, (void **)&data, fs_flags);
     if (!data) {
         return len;
     }
 
     // decompress the image
-    ret = img_loaders[fmt].load(data, len, image, pic);
+    ret = decode_image(fmt, data, len, image, pic);
 
     FS_FreeFile(data);
 
@@ -1700,6 +2648,9 @@ void IMG_FreeUnused(void)
     if (count) {
         Com_DPrintf("%s: %i images freed\n", __func__, count);
     }
+
+    if (texcache_written)
+        texcache_prune();
 }
 
 void IMG_FreeAll(void)
@@ -1774,6 +2725,8 @@ static const cmdreg_t img_cmd[] = {
     { "screenshotjpg", IMG_ScreenShotJPG_f },
     { "screenshotpng", IMG_ScreenShotPNG_f },
     { "screenshothdr", IMG_ScreenShotHDR_f },
+    { "imagebench", IMG_Bench_f },
+    { "texcachebench", IMG_TexCacheBench_f },
     { NULL }
 };
 
@@ -1785,6 +2738,8 @@ void IMG_Init(void)
 
     r_override_textures = Cvar_Get("r_override_textures", "1", CVAR_FILES);
     r_texture_formats = Cvar_Get("r_texture_formats", "pjt", 0);
+    r_texture_cache = Cvar_Get("r_texture_cache", "0", 0);
+    r_texture_cache_size = Cvar_Get("r_texture_cache_size", "4096", 0);
     r_texture_formats->changed = r_texture_formats_changed;
     r_texture_formats_changed(r_texture_formats);
 
@@ -1797,6 +2752,9 @@ void IMG_Init(void)
 
     Cmd_Register(img_cmd);
 
+    select_kernels();
+    init_srgb_tables();
+
     for (i = 0; i < RIMAGES_HASH; i++) {
         List_Init(&r_imageHash[i]);
     }
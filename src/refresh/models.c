@@ -350,9 +350,9 @@ qhandle_t R_RegisterModel(const char *name)
          try_location >= TRY_MODEL_SRC_BASE;
          try_location--)
     {
-        int fs_flags = 0;
+        int fs_flags = FS_FLAG_MAPPED;
         if (try_location > 0)
-            fs_flags = try_location == TRY_MODEL_SRC_GAME ? FS_PATH_GAME : FS_PATH_BASE;
+            fs_flags |= try_location == TRY_MODEL_SRC_GAME ? FS_PATH_GAME : FS_PATH_BASE;
 
         char* extension = normalized + namelen - 4;
         bool try_md3 = cls.ref_type == REF_TYPE_VKPT || (cls.ref_type == REF_TYPE_GL && gl_use_hd_assets->integer);
@@ -374,7 +374,7 @@ qhandle_t R_RegisterModel(const char *name)
 
 	if (!rawdata)
 	{
-		filelen = FS_LoadFile(normalized, (void **)&rawdata);
+		filelen = FS_LoadFileFlags(normalized, (void **)&rawdata, FS_FLAG_MAPPED);
 		if (!rawdata) {
 			// don't spam about missing models
 			if (filelen == Q_ERR(ENOENT)) {
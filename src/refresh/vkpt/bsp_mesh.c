@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "material.h"
 #include "cameras.h"
 #include "conversion.h"
+#include "common/prof.h"
 
 #include <assert.h>
 #include <float.h>
@@ -1841,6 +1842,8 @@ bsp_mesh_create_custom_sky_prims(uint32_t* prim_ctr, bsp_mesh_t* wm, const bsp_t
 void
 bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 {
+	PROF_BEGIN("bsp_mesh_create_from_bsp");
+
 	const char* full_game_map_name = map_name;
 	if (strcmp(map_name, "demo1") == 0)
 		full_game_map_name = "base1";
@@ -1984,6 +1987,8 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp, const char* map_name)
 	collect_cluster_lights(wm, bsp);
 
 	compute_sky_visibility(wm, bsp);
+
+	PROF_END();
 }
 
 void
@@ -19,26 +19,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #ifndef COLOR_H_
 #define COLOR_H_
 
+// tables are filled by IMG_Init
 static inline float decode_srgb(byte pix)
 {
-	float x = (float)pix / 255.f;
-	
-	if (x < 0.04045f)
-		return x / 12.92f;
-
-	return powf((x + 0.055f) / 1.055f, 2.4f);
+	return img_srgb_to_linear[pix];
 }
 
 static inline byte encode_srgb(float x)
 {
-    if (x <= 0.0031308f)
-        x *= 12.92f;
-    else
-        x = 1.055f * powf(x, 1.f / 2.4f) - 0.055f;
-     
-    x = max(0.f, min(1.f, x));
-
-    return (byte)roundf(x * 255.f);
+    return IMG_EncodeSRGB(x);
 }
 
 #endif // COLOR_H_
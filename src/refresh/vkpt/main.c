@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/bench.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/common.h"
@@ -2983,7 +2984,9 @@ R_RenderFrame_RTX(refdef_t *fd, int waterLevel)
 	EntityUploadInfo upload_info = { 0 };
 	vkpt_pt_reset_instances();
 	vkpt_shadow_map_reset_instances();
+	BENCH_BEGIN(BENCH_REFRESH);
 	prepare_entities(&upload_info);
+	BENCH_END(BENCH_REFRESH);
 	if (bsp_world_model && render_world)
 	{
 		vkpt_pt_instance_model_blas(&vkpt_refdef.bsp_mesh_world.geom_opaque,      g_identity_transform, VERTEX_BUFFER_WORLD, -1, 0);
@@ -523,6 +523,7 @@ struct filterscratch_s
 	int num_comps;
 	int pad_left, pad_right;
 	float *ptr;
+	float *row;
 };
 
 static void filterscratch_init(struct filterscratch_s* scratch, unsigned kernel_size, int stripe_size, int num_comps)
@@ -532,11 +533,13 @@ static void filterscratch_init(struct filterscratch_s* scratch, unsigned kernel_
 	scratch->pad_right = kernel_size - scratch->pad_left - 1;
 	int num_scratch_pixels = scratch->pad_left + stripe_size + scratch->pad_right;
 	scratch->ptr = Z_Malloc(num_scratch_pixels * num_comps * sizeof(float));
+	scratch->row = Z_Malloc(stripe_size * num_comps * sizeof(float));
 }
 
 static void filterscratch_free(struct filterscratch_s* scratch)
 {
 	Z_Free(scratch->ptr);
+	Z_Free(scratch->row);
 }
 
 static void filterscratch_fill_from_float_image(struct filterscratch_s *scratch, float *current_stripe, int stripe_size, int element_stride)
@@ -591,25 +594,23 @@ static void filter_one_dimension_float(float* pixels, int num_comps,
 	struct filterscratch_s scratch;
 	filterscratch_init(&scratch, kernel_size, stripe_size, num_comps);
 	float *current_stripe = pixels;
-	float* values = alloca(num_comps * sizeof(float));
 	for (int s = 0; s < num_stripes; s++)
 	{
 		// back up image data to scratch buffer
 		filterscratch_fill_from_float_image(&scratch, current_stripe, stripe_size, element_stride);
-		// filter the stripe
-		for (int i = 0; i < stripe_size; i++)
+		// filter the stripe; components of all pixels are filtered as one
+		// array, with kernel taps being one pixel apart
+		if (element_stride == 1)
 		{
-			memset(values, 0, num_comps * sizeof(float));
-			for (int j = 0; j < kernel_size; j++)
+			IMG_FilterFloat(current_stripe, scratch.ptr, stripe_size * num_comps, kernel, kernel_size, num_comps);
+		}
+		else
+		{
+			IMG_FilterFloat(scratch.row, scratch.ptr, stripe_size * num_comps, kernel, kernel_size, num_comps);
+			for (int i = 0; i < stripe_size; i++)
 			{
-				float f = kernel[j];
-				float *src_p = scratch.ptr + (i + j) * num_comps;
-				for (int c = 0; c < num_comps; c++)
-				{
-					values[c] += f * src_p[c];
-				}
+				memcpy(current_stripe + i * element_stride * num_comps, scratch.row + i * num_comps, num_comps * sizeof(float));
 			}
-			memcpy(current_stripe + i * element_stride * num_comps, values, num_comps * sizeof(float));
 		}
 		current_stripe += stripe_stride * num_comps;
 	}
@@ -631,6 +632,7 @@ struct bilerp_s
 	float *current_input_data;
 	float *next_input_data;
 	float *output_data;
+	float *middle_data;
 };
 
 static void bilerp_init(struct bilerp_s* bilerp, int input_w)
@@ -639,6 +641,7 @@ static void bilerp_init(struct bilerp_s* bilerp, int input_w)
 	bilerp->current_input_data = IMG_AllocPixels(input_w * sizeof(float) * 3);
 	bilerp->next_input_data = IMG_AllocPixels(input_w * sizeof(float) * 3);
 	bilerp->output_data = IMG_AllocPixels(input_w * 2 * sizeof(float) * 3);
+	bilerp->middle_data = IMG_AllocPixels(input_w * sizeof(float) * 3);
 }
 
 static void bilerp_free(struct bilerp_s* bilerp)
@@ -646,6 +649,7 @@ static void bilerp_free(struct bilerp_s* bilerp)
 	Z_Free(bilerp->current_input_data);
 	Z_Free(bilerp->next_input_data);
 	Z_Free(bilerp->output_data);
+	Z_Free(bilerp->middle_data);
 }
 
 static inline void _bilerp_get_next_output_line(struct bilerp_s *bilerp, const float** output_line, const float* next_input, int input_w)
@@ -665,40 +669,25 @@ static inline void _bilerp_get_next_output_line(struct bilerp_s *bilerp, const f
 		// Odd output line: interpolate between input lines
 		memcpy(bilerp->next_input_data, next_input, input_w * sizeof(float) * 3);
 
-		float *color_ptr = bilerp->current_input_data;
-		float *next_color_ptr = bilerp->next_input_data;
-		for (int x = 0; x < input_w; x++) {
-			color_ptr[0] = (color_ptr[0] + next_color_ptr[0]) * 0.5f;
-			color_ptr[1] = (color_ptr[1] + next_color_ptr[1]) * 0.5f;
-			color_ptr[2] = (color_ptr[2] + next_color_ptr[2]) * 0.5f;
-			color_ptr += 3;
-			next_color_ptr += 3;
-		}
+		IMG_AverageFloat(bilerp->current_input_data, bilerp->current_input_data, bilerp->next_input_data, input_w * 3);
 	}
 
-	float *out_ptr = bilerp->output_data;
-	float color[3];
+	// Odd output columns: interpolate between neighbouring colors,
+	// last one between last and first pixel
 	const float* color_ptr = bilerp->current_input_data;
-	for (int out_x = 0; out_x < input_w * 2 - 1; out_x++) {
-		if((out_x & 1) == 0) {
-			// Even output row: direct value
-			memcpy(color, color_ptr, 3 * sizeof(float));
-		} else {
-			// Odd output row: interpolate between colors
-			color_ptr += 3;
-			color[0] = (color[0] + color_ptr[0]) * 0.5f;
-			color[1] = (color[1] + color_ptr[1]) * 0.5f;
-			color[2] = (color[2] + color_ptr[2]) * 0.5f;
-		}
-		memcpy(out_ptr, color, 3 * sizeof(float));
-		out_ptr += 3;
-	}
+	float *middle_ptr = bilerp->middle_data;
+	IMG_AverageFloat(middle_ptr, color_ptr, color_ptr + 3, (input_w - 1) * 3);
+	IMG_AverageFloat(middle_ptr + (input_w - 1) * 3, color_ptr + (input_w - 1) * 3, color_ptr, 3);
 
-	// Last row: interpolate between last and first pixel
-	color[0] = (color_ptr[0] + bilerp->current_input_data[0]) * 0.5f;
-	color[1] = (color_ptr[1] + bilerp->current_input_data[1]) * 0.5f;
-	color[2] = (color_ptr[2] + bilerp->current_input_data[2]) * 0.5f;
-	memcpy(out_ptr, color, 3 * sizeof(float));
+	// Even output columns: direct value
+	float *out_ptr = bilerp->output_data;
+	for (int x = 0; x < input_w; x++) {
+		memcpy(out_ptr, color_ptr, 3 * sizeof(float));
+		memcpy(out_ptr + 3, middle_ptr, 3 * sizeof(float));
+		out_ptr += 6;
+		color_ptr += 3;
+		middle_ptr += 3;
+	}
 
 	*output_line = bilerp->output_data;
 
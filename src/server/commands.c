@@ -624,20 +624,34 @@ static void dump_lag(void)
     }
 }
 
+#if USE_ZLIB
+// percentage of bytes saved by compressing messages to this client
+static float zlib_savings(const client_t *cl)
+{
+    if (!cl->zbytes_in)
+        return 0;
+
+    return 100.0f - cl->zbytes_out * 100.0f / cl->zbytes_in;
+}
+#else
+#define zlib_savings(cl)    0.0f
+#endif
+
 static void dump_protocols(void)
 {
     client_t    *cl;
 
     Com_Printf(
-        "num name            major minor msglen zlib chan\n"
-        "--- --------------- ----- ----- ------ ---- ----\n");
+        "num name            major minor msglen zlib chan zsave\n"
+        "--- --------------- ----- ----- ------ ---- ---- -----\n");
 
     FOR_EACH_CLIENT(cl) {
-        Com_Printf("%3i %-15.15s %5d %5d %6zu  %s  %s\n",
+        Com_Printf("%3i %-15.15s %5d %5d %6zu  %s  %s %4.1f%%\n",
                    cl->number, cl->name, cl->protocol, cl->version,
                    cl->netchan->maxpacketlen,
                    cl->has_zlib ? "yes" : "no ",
-                   cl->netchan->type ? "new" : "old");
+                   cl->netchan->type ? "new" : "old",
+                   zlib_savings(cl));
     }
 }
 
@@ -681,6 +695,8 @@ static void SV_Status_f(void)
         Com_Printf("Current map: %s\n\n", sv.name);
     }
 
+    SV_FrameStatus();
+
     if (LIST_EMPTY(&sv_clientlist)) {
         Com_Printf("No UDP clients.\n");
     } else {
@@ -777,6 +793,13 @@ void SV_PrintMiscInfo(void)
                sv_client->protocol, sv_client->version);
     Com_Printf("maxmsglen            %zu\n", sv_client->netchan->maxpacketlen);
     Com_Printf("zlib support         %s\n", sv_client->has_zlib ? "yes" : "no");
+#if USE_ZLIB
+    Com_Printf("zlib dictionary      %s\n", sv_client->zdict ? "yes" : "no");
+    Com_Printf("compressed messages  %u (%u with dictionary)\n",
+               sv_client->zpackets, sv_client->zpackets_dict);
+    Com_Printf("compressed bytes     %"PRIu64" -> %"PRIu64" (%.1f%% saved)\n",
+               sv_client->zbytes_in, sv_client->zbytes_out, zlib_savings(sv_client));
+#endif
     Com_Printf("netchan type         %s\n", sv_client->netchan->type ? "new" : "old");
     Com_Printf("ping                 %d\n", sv_client->ping);
     Com_Printf("movement fps         %d\n", sv_client->moves_per_sec);
@@ -884,10 +907,12 @@ static void SV_StuffAll_f(void)
     MSG_WriteByte(svc_stufftext);
     MSG_WriteString(COM_StripQuotes(Cmd_RawArgs()));
 
+    SV_BeginFanout();
     FOR_EACH_CLIENT(client) {
         if (client->state > cs_zombie)
-            SV_ClientAddMessage(client, MSG_RELIABLE);
+            SV_ClientAddMessage(client, MSG_RELIABLE | MSG_COMPRESS_AUTO);
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
@@ -1748,6 +1773,14 @@ static const cmdreg_t c_server[] = {
     { "demomap", SV_DemoMap_f },
     { "gamemap", SV_GameMap_f, SV_Map_c },
     { "dumpents", SV_DumpEnts_f },
+    { "viscache", SV_VisCache_f },
+    { "framestats", SV_FrameStats_f },
+    { "slowframes", SV_SlowFrames_f },
+    { "tracebench", SV_TraceBench_f },
+    { "areabench", SV_AreaBench_f },
+#if USE_ZLIB && (USE_CLIENT || USE_MVD_CLIENT)
+    { "zbench", SV_ZBench_f },
+#endif
     { "setmaster", SV_SetMaster_f },
     { "listmasters", SV_ListMasters_f },
     { "killserver", SV_KillServer_f },
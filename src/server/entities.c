@@ -19,6 +19,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "server.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_VIS_SSE2    1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define USE_VIS_AVX2    1
+#endif
+#endif
+
 /*
 =============================================================================
 
@@ -31,6 +40,17 @@ Encode a client frame onto the network channel
 #define Q2PRO_OPTIMIZE(c) \
     ((c)->protocol == PROTOCOL_VERSION_Q2PRO && !(c)->settings[CLS_RECORDING])
 
+static void SV_WriteDeltaEntity(const entity_packed_t *from,
+                                entity_packed_t       *to,
+                                msgEsFlags_t          flags,
+                                int                   dt)
+{
+    if (flags & MSG_ES_BITPACKED)
+        MSG_WritePackedEntity(from, to, flags, dt);
+    else
+        MSG_WriteDeltaEntity(from, to, flags);
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -45,13 +65,19 @@ static void SV_EmitPacketEntities(client_t         *client,
 {
     entity_packed_t *newent;
     const entity_packed_t *oldent;
-    int i, oldnum, newnum, oldindex, newindex, from_num_entities;
+    int i, oldnum, newnum, oldindex, newindex, from_num_entities, dt;
     msgEsFlags_t flags;
 
-    if (!from)
+    if (!from) {
         from_num_entities = 0;
-    else
+        dt = 0;
+    } else {
         from_num_entities = from->num_entities;
+        dt = to->number - from->number;
+    }
+
+    if (client->esFlags & MSG_ES_BITPACKED)
+        MSG_BeginPackedEntities();
 
     newindex = 0;
     oldindex = 0;
@@ -91,7 +117,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags, dt);
             oldindex++;
             newindex++;
             continue;
@@ -114,25 +140,29 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags, 0);
             newindex++;
             continue;
         }
 
         if (newnum > oldnum) {
             // the old entity isn't present in the new message
-            MSG_WriteDeltaEntity(oldent, NULL, MSG_ES_FORCE);
+            SV_WriteDeltaEntity(oldent, NULL, client->esFlags | MSG_ES_FORCE, dt);
             oldindex++;
             continue;
         }
     }
 
-    MSG_WriteShort(0);      // end of packetentities
+    if (client->esFlags & MSG_ES_BITPACKED)
+        MSG_EndPackedEntities();
+    else
+        MSG_WriteShort(0);      // end of packetentities
 }
 
 static client_frame_t *get_last_frame(client_t *client)
 {
     client_frame_t *frame;
+    unsigned next_entity;
 
     if (client->lastframe <= 0) {
         // client is asking for a retransmit
@@ -156,7 +186,12 @@ static client_frame_t *get_last_frame(client_t *client)
         return NULL;
     }
 
-    if (svs.next_entity - frame->first_entity > svs.num_entities) {
+    // this is where svs.next_entity was after building the current frame,
+    // which also holds when frames are built in parallel
+    next_entity = client->frames[client->framenum & UPDATE_MASK].first_entity +
+                  client->frames[client->framenum & UPDATE_MASK].num_entities;
+
+    if (next_entity - frame->first_entity > svs.num_entities) {
         // but entities are too old
         Com_DPrintf("%s: delta request from out-of-date entities.\n", client->name);
         return NULL;
@@ -370,17 +405,464 @@ fix_old_origin(client_t *client, entity_packed_t *state, edict_t *ent, int e)
 }
 #endif
 
+/*
+=============================================================================
+
+Visibility cache
+
+Clients standing at the same spot of the map share PVS, PHS and area bits.
+These are computed once per frame for each distinct (clusters, area) key.
+Entity cluster lists are converted into sparse cluster bitsets once per
+frame, so testing entity against client PVS is AND of a few words.
+
+Optionally these tests are done in a single entity-major pass over all
+distinct client positions at once, producing a visibility bit matrix that
+is then consumed by SV_BuildClientFrame. PVS rows are transposed, so that
+each entity word is tested against all positions with wide vector ops.
+
+=============================================================================
+*/
+
+#define VIS_HASH_SIZE   256
+#define VIS_WORD_BITS   (sizeof(size_t) * 8)
+#define VIS_LANES       (32 / sizeof(size_t))   // words in AVX2 register
+
+typedef void (*visandor_t)(size_t *acc, const size_t *row, size_t bits, int count);
+
+typedef struct visinfo_s {
+    struct visinfo_s *next;     // next in hash chain
+    int         index;          // row in visibility matrix
+    int         area;
+    int         cluster;        // -1 when outside the map
+    int         pvscluster;     // last valid cluster used when outside
+    int         numclusters;    // clusters touched by fat PVS box
+    int         clusters[MAX_FAT_CLUSTERS];
+    int         areabytes;
+    byte        areabits[MAX_MAP_AREA_BYTES];
+    size_t      pvs[VIS_MAX_BYTES / sizeof(size_t)];
+    size_t      phs[VIS_MAX_BYTES / sizeof(size_t)];
+} visinfo_t;
+
+typedef struct {
+    unsigned    index;
+    size_t      bits;
+} visword_t;
+
+typedef struct {
+    int         first;
+    int         count;          // -1 if not cached
+} entvis_t;
+
+static struct {
+    cm_t        *cm;            // NULL if not valid
+    int         framenum;       // sv.framenum this was prepared for
+    int         num_edicts;
+
+    visinfo_t   *hash[VIS_HASH_SIZE];
+    visinfo_t   **infos;        // [max_infos], reused between frames
+    int         num_infos;
+    int         max_infos;
+    visinfo_t   **clients;      // [maxclients]
+
+    entvis_t    ents[MAX_EDICTS];
+    visword_t   *words;
+    int         num_words;
+    int         max_words;
+
+    // entity-major pass
+    bool        matrix_valid;
+    int         stride;         // num_infos rounded up to VIS_LANES
+    size_t      *transposed;    // [numwords][stride]
+    int         max_transposed;
+    uint32_t    *matrix;        // [MAX_EDICTS][matrix_words]
+    int         matrix_words;
+    visandor_t  andor;
+    const char  *andor_name;
+
+    // statistics
+    unsigned    frames;
+    unsigned    lookups;
+    unsigned    hits;
+    unsigned    entities;
+    unsigned    headnodes;
+} viscache;
+
+static void find_visinfo(client_t *client, visinfo_t *key, const vec3_t org)
+{
+    mleaf_t *leaf = CM_PointLeaf(client->cm, org);
+
+    key->area = leaf->area;
+    key->cluster = leaf->cluster;
+    if (key->cluster >= 0) {
+        key->pvscluster = -1;
+        key->numclusters = CM_FatClusters(client->cm, org, key->clusters);
+    } else {
+        key->pvscluster = client->last_valid_cluster;
+        key->numclusters = 0;
+    }
+}
+
+static void calc_visinfo(client_t *client, visinfo_t *info)
+{
+    info->areabytes = CM_WriteAreaBits(client->cm, info->areabits, info->area);
+
+    if (info->cluster >= 0)
+        CM_ClustersPVS(client->cm, (byte *)info->pvs, info->clusters, info->numclusters, DVIS_PVS2);
+    else
+        BSP_ClusterVis(client->cm->cache, (byte *)info->pvs, info->pvscluster, DVIS_PVS2);
+
+    BSP_ClusterVis(client->cm->cache, (byte *)info->phs, info->cluster, DVIS_PHS);
+}
+
+static unsigned hash_visinfo(const visinfo_t *key)
+{
+    unsigned hash = key->area * 31 + key->cluster * 7 + key->pvscluster;
+    int i;
+
+    for (i = 0; i < key->numclusters; i++)
+        hash = hash * 31 + key->clusters[i];
+
+    return hash & (VIS_HASH_SIZE - 1);
+}
+
+static bool visinfo_equal(const visinfo_t *a, const visinfo_t *b)
+{
+    return a->area == b->area && a->cluster == b->cluster &&
+        a->pvscluster == b->pvscluster && a->numclusters == b->numclusters &&
+        !memcmp(a->clusters, b->clusters, a->numclusters * sizeof(a->clusters[0]));
+}
+
+static visinfo_t *cache_visinfo(client_t *client)
+{
+    player_state_t *ps = &client->edict->client->ps;
+    visinfo_t *key, *info;
+    vec3_t org;
+    unsigned hash;
+
+    VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
+
+    if (viscache.num_infos == viscache.max_infos)
+        return NULL;
+
+    key = viscache.infos[viscache.num_infos];
+    if (!key)
+        key = viscache.infos[viscache.num_infos] = SV_Malloc(sizeof(*key));
+
+    find_visinfo(client, key, org);
+
+    viscache.lookups++;
+
+    hash = hash_visinfo(key);
+    for (info = viscache.hash[hash]; info; info = info->next) {
+        if (visinfo_equal(info, key)) {
+            viscache.hits++;
+            return info;
+        }
+    }
+
+    calc_visinfo(client, key);
+    key->index = viscache.num_infos;
+    key->next = viscache.hash[hash];
+    viscache.hash[hash] = key;
+    viscache.num_infos++;
+    return key;
+}
+
+static void cache_entity(edict_t *ent, entvis_t *vis, byte *bits)
+{
+    size_t *words = (size_t *)bits;
+    int i, numwords;
+
+    vis->first = viscache.num_words;
+    vis->count = 0;
+
+    if (ent->num_clusters == -1) {
+        // gather all leafs under headnode once instead of walking the
+        // tree for each client
+        numwords = VIS_FAST_LONGS(sv.cm.cache);
+        memset(bits, 0, numwords * sizeof(size_t));
+        CM_HeadnodeClusters(CM_NodeNum(&sv.cm, ent->headnode), bits);
+        viscache.headnodes++;
+    } else {
+        numwords = 0;
+        for (i = 0; i < ent->num_clusters; i++) {
+            int w = ent->clusternums[i] / VIS_WORD_BITS;
+            for (; numwords <= w; numwords++)
+                words[numwords] = 0;
+            Q_SetBit(bits, ent->clusternums[i]);
+        }
+    }
+
+    if (viscache.num_words + numwords > viscache.max_words) {
+        viscache.max_words = ALIGN(viscache.num_words + numwords, 1024);
+        viscache.words = Z_Realloc(viscache.words, viscache.max_words * sizeof(visword_t));
+    }
+
+    for (i = 0; i < numwords; i++) {
+        if (words[i]) {
+            visword_t *w = &viscache.words[viscache.num_words++];
+            w->index = i;
+            w->bits = words[i];
+            vis->count++;
+        }
+    }
+}
+
+static void andor_scalar(size_t *acc, const size_t *row, size_t bits, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        acc[i] |= row[i] & bits;
+}
+
+#if USE_VIS_SSE2
+static void andor_sse2(size_t *acc, const size_t *row, size_t bits, int count)
+{
+    __m128i b = sizeof(bits) == 8 ? _mm_set1_epi64x(bits) : _mm_set1_epi32(bits);
+    int i;
+
+    for (i = 0; i < count; i += 16 / sizeof(size_t)) {
+        __m128i a = _mm_loadu_si128((__m128i *)(acc + i));
+        __m128i r = _mm_loadu_si128((const __m128i *)(row + i));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_or_si128(a, _mm_and_si128(r, b)));
+    }
+}
+#endif
+
+#if USE_VIS_AVX2
+__attribute__((target("avx2")))
+static void andor_avx2(size_t *acc, const size_t *row, size_t bits, int count)
+{
+    __m256i b = sizeof(bits) == 8 ? _mm256_set1_epi64x(bits) : _mm256_set1_epi32(bits);
+    int i;
+
+    for (i = 0; i < count; i += 32 / sizeof(size_t)) {
+        __m256i a = _mm256_loadu_si256((__m256i *)(acc + i));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(row + i));
+        _mm256_storeu_si256((__m256i *)(acc + i), _mm256_or_si256(a, _mm256_and_si256(r, b)));
+    }
+}
+#endif
+
+static void select_andor(void)
+{
+    viscache.andor = andor_scalar;
+    viscache.andor_name = "scalar";
+
+    if (sv_vismatrix->integer < 2)
+        return;
+
+#if USE_VIS_SSE2
+    viscache.andor = andor_sse2;
+    viscache.andor_name = "SSE2";
+#endif
+
+#if USE_VIS_AVX2
+    if (sv_vismatrix->integer > 2 && __builtin_cpu_supports("avx2")) {
+        viscache.andor = andor_avx2;
+        viscache.andor_name = "AVX2";
+    }
+#endif
+}
+
+// tests each cached entity against all distinct client positions
+static void build_vis_matrix(void)
+{
+    size_t      acc[ALIGN(MAX_CLIENTS, VIS_LANES)];
+    int         i, j, e, stride, numwords;
+    size_t      *row;
+    uint32_t    *out;
+    const visword_t *w;
+
+    viscache.matrix_valid = false;
+
+    if (!sv_vismatrix->integer || !viscache.num_infos)
+        return;
+
+    select_andor();
+
+    numwords = VIS_FAST_LONGS(sv.cm.cache);
+    stride = viscache.stride = ALIGN(viscache.num_infos, VIS_LANES);
+
+    if (numwords * stride > viscache.max_transposed) {
+        Z_Free(viscache.transposed);
+        viscache.max_transposed = numwords * stride;
+        viscache.transposed = SV_Malloc(viscache.max_transposed * sizeof(size_t));
+    }
+
+    if (!viscache.matrix) {
+        viscache.matrix_words = (viscache.max_infos + 31) / 32;
+        viscache.matrix = SV_Malloc(MAX_EDICTS * viscache.matrix_words * sizeof(uint32_t));
+    }
+
+    // transpose PVS rows, padding lanes are never visible
+    for (i = 0; i < numwords; i++) {
+        row = viscache.transposed + i * stride;
+        for (j = 0; j < viscache.num_infos; j++)
+            row[j] = viscache.infos[j]->pvs[i];
+        for (; j < stride; j++)
+            row[j] = 0;
+    }
+
+    for (e = 1; e < viscache.num_edicts; e++) {
+        if (viscache.ents[e].count < 0)
+            continue;
+
+        memset(acc, 0, stride * sizeof(acc[0]));
+        w = &viscache.words[viscache.ents[e].first];
+        for (i = 0; i < viscache.ents[e].count; i++, w++)
+            viscache.andor(acc, viscache.transposed + w->index * stride, w->bits, stride);
+
+        out = viscache.matrix + e * viscache.matrix_words;
+        memset(out, 0, viscache.matrix_words * sizeof(out[0]));
+        for (j = 0; j < viscache.num_infos; j++)
+            if (acc[j])
+                Q_SetBit((byte *)out, j);
+    }
+
+    viscache.matrix_valid = true;
+}
+
+/*
+=============
+SV_PrepareVisCache
+
+Called before building client frames each server frame, and each time
+game code had a chance to run in the middle of it.
+=============
+*/
+void SV_PrepareVisCache(void)
+{
+    size_t      bits[VIS_MAX_BYTES / sizeof(size_t)];
+    client_t    *client;
+    edict_t     *ent;
+    int         e;
+
+    viscache.cm = NULL;
+
+    if (!sv_viscache->integer || !ge || !sv.cm.cache || !sv.cm.cache->vis)
+        return;
+
+    if (!viscache.infos) {
+        viscache.max_infos = sv_maxclients->integer;
+        viscache.infos = SV_Mallocz(sizeof(viscache.infos[0]) * viscache.max_infos);
+        viscache.clients = SV_Mallocz(sizeof(viscache.clients[0]) * viscache.max_infos);
+    }
+
+    memset(viscache.hash, 0, sizeof(viscache.hash));
+    viscache.num_infos = 0;
+    viscache.num_words = 0;
+    viscache.num_edicts = min(ge->num_edicts, MAX_EDICTS);
+    viscache.cm = &sv.cm;
+    viscache.framenum = sv.framenum;
+    viscache.frames++;
+
+    FOR_EACH_CLIENT(client) {
+        visinfo_t *info = NULL;
+
+        if (CLIENT_ACTIVE(client) && client->edict->client &&
+            client->cm == &sv.cm && client->pool == (edict_pool_t *)&ge->edicts)
+            info = cache_visinfo(client);
+
+        viscache.clients[client - svs.client_pool] = info;
+    }
+
+    for (e = 1; e < viscache.num_edicts; e++) {
+        ent = EDICT_NUM(e);
+        if (ent->svflags & SVF_NOCLIENT || ent->s.renderfx & RF_BEAM) {
+            viscache.ents[e].count = -1;
+            continue;
+        }
+        cache_entity(ent, &viscache.ents[e], (byte *)bits);
+        viscache.entities++;
+    }
+
+    build_vis_matrix();
+}
+
+void SV_FreeVisCache(void)
+{
+    int i;
+
+    for (i = 0; i < viscache.max_infos; i++)
+        Z_Free(viscache.infos[i]);
+    Z_Free(viscache.words);
+    Z_Free(viscache.transposed);
+    Z_Free(viscache.matrix);
+    Z_Free(viscache.infos);
+    Z_Free(viscache.clients);
+    memset(&viscache, 0, sizeof(viscache));
+}
+
+void SV_VisCache_f(void)
+{
+    if (!viscache.frames) {
+        Com_Printf("No frames built with visibility cache.\n");
+        return;
+    }
+
+    Com_Printf("%u frames, %u lookups, %u hits (%.1f%%)\n", viscache.frames,
+               viscache.lookups, viscache.hits,
+               viscache.lookups ? viscache.hits * 100.0f / viscache.lookups : 0);
+    Com_Printf("%.1f entities/frame, %.1f headnode walks/frame, %d words\n",
+               (float)viscache.entities / viscache.frames,
+               (float)viscache.headnodes / viscache.frames, viscache.max_words);
+    if (viscache.andor_name)
+        Com_Printf("Entity-major pass using %s kernel\n", viscache.andor_name);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        viscache.frames = viscache.lookups = viscache.hits = 0;
+        viscache.entities = viscache.headnodes = 0;
+    }
+}
+
+static bool ent_pvs_visible(client_t *client, const visinfo_t *info, bool cached,
+                            edict_t *ent, int e)
+{
+    const byte *pvs = (const byte *)info->pvs;
+    const visword_t *w;
+    int i;
+
+    if (cached && e < viscache.num_edicts && viscache.ents[e].count >= 0) {
+        // use results of entity-major pass
+        if (viscache.matrix_valid)
+            return Q_IsBitSet((const byte *)(viscache.matrix + e * viscache.matrix_words), info->index);
+
+        w = &viscache.words[viscache.ents[e].first];
+        for (i = 0; i < viscache.ents[e].count; i++, w++)
+            if (info->pvs[w->index] & w->bits)
+                return true;
+        return false;
+    }
+
+    if (ent->num_clusters == -1) {
+        // too many leafs for individual check, go by headnode
+        return CM_HeadnodeVisible(CM_NodeNum(client->cm, ent->headnode), (byte *)pvs);
+    }
+
+    // check individual leafs
+    for (i = 0; i < ent->num_clusters; i++)
+        if (Q_IsBitSet(pvs, ent->clusternums[i]))
+            return true;
+
+    return false;    // not visible
+}
+
 /*
 =============
-SV_BuildClientFrame
+build_frame
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+copies off the playerstat and areabits. Entity states are written
+into states[(start + i) % size]. Returns false if client is not in
+game yet and the frame was left untouched.
 =============
 */
-void SV_BuildClientFrame(client_t *client)
+static bool build_frame(client_t *client, entity_packed_t *states,
+                        unsigned start, unsigned size)
 {
-    int         e, i;
+    int         e;
     vec3_t      org;
     edict_t     *ent;
     edict_t     *clent;
@@ -389,15 +871,15 @@ void SV_BuildClientFrame(client_t *client)
     player_state_t  *ps;
 	entity_state_t  es;
     int         clientarea, clientcluster;
-    mleaf_t     *leaf;
-    byte        clientphs[VIS_MAX_BYTES];
-    byte        clientpvs[VIS_MAX_BYTES];
+    const visinfo_t *info;
+    visinfo_t   local;
+    const byte  *clientphs;
     bool    ent_visible;
-    int cull_nonvisible_entities = Cvar_Get("sv_cull_nonvisible_entities", "1", CVAR_CHEAT)->integer;
+    int cull_nonvisible_entities = sv_cull_nonvisible_entities->integer;
 
     clent = client->edict;
     if (!clent->client)
-        return;        // not in game yet
+        return false;  // not in game yet
 
     // this is the frame we are creating
     frame = &client->frames[client->framenum & UPDATE_MASK];
@@ -411,12 +893,23 @@ void SV_BuildClientFrame(client_t *client)
     ps = &clent->client->ps;
     VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
 
-    leaf = CM_PointLeaf(client->cm, org);
-    clientarea = leaf->area;
-    clientcluster = leaf->cluster;
+    info = NULL;
+    if (viscache.cm && viscache.framenum == sv.framenum)
+        info = viscache.clients[client - svs.client_pool];
+    if (!info) {
+        find_visinfo(client, &local, org);
+        calc_visinfo(client, &local);
+        info = &local;
+    }
+
+    clientarea = info->area;
+    clientcluster = info->cluster;
+    if (clientcluster >= 0)
+        client->last_valid_cluster = clientcluster;
 
     // calculate the visible areas
-    frame->areabytes = CM_WriteAreaBits(client->cm, frame->areabits, clientarea);
+    frame->areabytes = info->areabytes;
+    memcpy(frame->areabits, info->areabits, info->areabytes);
     if (!frame->areabytes && client->protocol != PROTOCOL_VERSION_Q2PRO) {
         frame->areabits[0] = 255;
         frame->areabytes = 1;
@@ -432,21 +925,10 @@ void SV_BuildClientFrame(client_t *client)
         frame->clientNum = client->number;
     }
 
-	if (clientcluster >= 0)
-	{
-		CM_FatPVS(client->cm, clientpvs, org, DVIS_PVS2);
-		client->last_valid_cluster = clientcluster;
-	}
-	else
-	{
-		BSP_ClusterVis(client->cm->cache, clientpvs, client->last_valid_cluster, DVIS_PVS2);
-	}
-
-    BSP_ClusterVis(client->cm->cache, clientphs, clientcluster, DVIS_PHS);
+    clientphs = (const byte *)info->phs;
 
     // build up the list of visible entities
     frame->num_entities = 0;
-    frame->first_entity = svs.next_entity;
 
     for (e = 1; e < client->pool->num_edicts; e++) {
         ent = EDICT_POOL(client, e);
@@ -496,20 +978,9 @@ void SV_BuildClientFrame(client_t *client)
                         ent_visible = false;
                 }
                 else {
-                    if (cull_nonvisible_entities) {
-                        if (ent->num_clusters == -1) {
-                            // too many leafs for individual check, go by headnode
-                            if (!CM_HeadnodeVisible(CM_NodeNum(client->cm, ent->headnode), clientpvs))
-                                ent_visible = false;
-                        } else {
-                            // check individual leafs
-                            for (i = 0; i < ent->num_clusters; i++)
-                                if (Q_IsBitSet(clientpvs, ent->clusternums[i]))
-                                    break;
-                            if (i == ent->num_clusters)
-                                ent_visible = false;       // not visible
-                        }
-                    }
+                    if (cull_nonvisible_entities &&
+                        !ent_pvs_visible(client, info, info != &local, ent, e))
+                        ent_visible = false;       // not visible
 
                     if (!ent->s.modelindex) {
                         // don't send sounds if they will be attenuated away
@@ -542,7 +1013,7 @@ void SV_BuildClientFrame(client_t *client)
 		}
 
         // add it to the circular client_entities array
-        state = &svs.entities[svs.next_entity % svs.num_entities];
+        state = &states[(start + frame->num_entities) % size];
         MSG_PackEntity(state, &es, Q2PRO_SHORTANGLES(client, e));
 
 
@@ -580,11 +1051,48 @@ void SV_BuildClientFrame(client_t *client)
             state->solid = sv.entities[e].solid32;
         }
 
-        svs.next_entity++;
-
         if (++frame->num_entities == MAX_PACKET_ENTITIES) {
             break;
         }
     }
+
+    return true;
+}
+
+void SV_BuildClientFrame(client_t *client)
+{
+    client_frame_t *frame = &client->frames[client->framenum & UPDATE_MASK];
+
+    if (build_frame(client, svs.entities, svs.next_entity, svs.num_entities)) {
+        frame->first_entity = svs.next_entity;
+        svs.next_entity += frame->num_entities;
+    }
+}
+
+/*
+=============
+SV_BuildClientFrameScratch
+
+Same as SV_BuildClientFrame, but entity states are written into the private
+scratch buffer of MAX_PACKET_ENTITIES size, so that multiple clients can be
+built at once. Frame needs to be committed into svs.entities afterwards.
+=============
+*/
+bool SV_BuildClientFrameScratch(client_t *client, entity_packed_t *scratch)
+{
+    return build_frame(client, scratch, 0, MAX_PACKET_ENTITIES);
+}
+
+void SV_CommitClientFrame(client_t *client, const entity_packed_t *scratch,
+                          unsigned first_entity)
+{
+    client_frame_t *frame = &client->frames[client->framenum & UPDATE_MASK];
+    unsigned i = first_entity % svs.num_entities;
+    unsigned n = min(frame->num_entities, svs.num_entities - i);
+
+    memcpy(svs.entities + i, scratch, n * sizeof(*scratch));
+    memcpy(svs.entities, scratch + n, (frame->num_entities - n) * sizeof(*scratch));
+
+    frame->first_entity = first_entity;
 }
 
@@ -169,13 +169,15 @@ static void PF_bprintf(int level, const char *fmt, ...)
         Com_Printf("%s", string);
     }
 
+    SV_BeginFanout();
     FOR_EACH_CLIENT(client) {
         if (client->state != cs_spawned)
             continue;
         if (level >= client->messagelevel) {
-            SV_ClientAddMessage(client, MSG_RELIABLE);
+            SV_ClientAddMessage(client, MSG_RELIABLE | MSG_COMPRESS_AUTO);
         }
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
@@ -401,12 +403,14 @@ static void PF_configstring(int index, const char *val)
     MSG_WriteData(val, len);
     MSG_WriteByte(0);
 
+    SV_BeginFanout();
     FOR_EACH_CLIENT(client) {
         if (client->state < cs_primed) {
             continue;
         }
-        SV_ClientAddMessage(client, MSG_RELIABLE);
+        SV_ClientAddMessage(client, MSG_RELIABLE | MSG_COMPRESS_AUTO);
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
@@ -493,11 +497,11 @@ static void SV_StartSound(const vec3_t origin, edict_t *edict,
                           int channel, int soundindex, float volume,
                           float attenuation, float timeofs)
 {
-    int         i, ent, flags, sendchan;
+    int         i, j, ent, flags, sendchan, count;
     vec3_t      origin_v;
-    client_t    *client;
+    client_t    *client, *clients[MAX_CLIENTS];
     byte        mask[VIS_MAX_BYTES];
-    mleaf_t     *leaf1, *leaf2;
+    mleaf_t     *leaf1;
     message_packet_t    *msg;
     bool        force_pos;
 
@@ -586,24 +590,25 @@ static void SV_StartSound(const vec3_t origin, edict_t *edict,
         BSP_ClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PHS);
     }
 
+    // PHS cull this sound
+    if (leaf1) {
+        count = SV_ClientsInMask(mask, leaf1->area, clients);
+    } else {
+        count = 0;
+        FOR_EACH_CLIENT(client) {
+            clients[count++] = client;
+        }
+    }
+
     // decide per client if origin needs to be sent
-    FOR_EACH_CLIENT(client) {
+    for (j = 0; j < count; j++) {
+        client = clients[j];
+
         // do not send sounds to connecting clients
         if (!CLIENT_ACTIVE(client)) {
             continue;
         }
 
-        // PHS cull this sound
-        if (!(channel & CHAN_NO_PHS_ADD)) {
-            leaf2 = CM_PointLeaf(&sv.cm, client->edict->s.origin);
-            if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
-                continue;
-            if (leaf2->cluster == -1)
-                continue;
-            if (!Q_IsBitSet(mask, leaf2->cluster))
-                continue;
-        }
-
         // reliable sounds will always have position explicitly set,
         // as no one guarantees reliables to be delivered in time
         if (channel & CHAN_RELIABLE) {
@@ -863,6 +868,7 @@ void SV_InitGameProgs(void)
     import.AddCommandString = PF_AddCommandString;
 
     import.DebugGraph = PF_DebugGraph;
+    import.trace_many = SV_TraceMany;
     import.SetAreaPortalState = PF_SetAreaPortalState;
     import.AreasConnected = PF_AreasConnected;
 
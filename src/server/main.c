@@ -92,6 +92,13 @@ cvar_t  *sv_allow_map;
 cvar_t  *sv_recycle;
 #endif
 cvar_t  *sv_enhanced_setplayer;
+cvar_t  *sv_cull_nonvisible_entities;
+cvar_t  *sv_threads;
+cvar_t  *sv_viscache;
+cvar_t  *sv_vismatrix;
+cvar_t  *sv_area_depth;
+cvar_t  *sv_zdict;
+cvar_t  *sv_packed_entities;
 
 cvar_t  *sv_iplimit;
 cvar_t  *sv_status_limit;
@@ -113,6 +120,314 @@ cvar_t  *map_override_path;
 
 static bool     sv_registered;
 
+/*
+==============================================================================
+
+FRAME TELEMETRY
+
+==============================================================================
+*/
+
+typedef enum {
+    FT_PACKETS,     // reading packets, anticheat, async packets
+    FT_GAME,        // game module RunFrame
+    FT_SEND,        // SV_SendClientMessages
+    FT_MVD,         // MVD recording, GTV clients and MVD client channels
+
+    FT_NUM_STAGES
+} ftstage_t;
+
+#define FT_SLOW_FRAMES  32
+#define FT_WINDOW       10000000    // usec
+
+typedef struct {
+    time_t      time;
+    unsigned    framenum;
+    uint32_t    total;
+    uint32_t    stages[FT_NUM_STAGES];
+    int         entities;
+    int         clients;
+} slowframe_t;
+
+static const char *const ft_stage_names[FT_NUM_STAGES] = {
+    "packets", "game", "send", "mvd"
+};
+
+static cvar_t   *sv_slowframe;
+static cvar_t   *sv_slowframe_log;
+static cvar_t   *sv_slowframe_logsize;
+static cvar_t   *sv_status_frametime;
+
+static struct {
+    // current game frame, accumulated over all SV_Frame calls
+    uint64_t    begin[FT_NUM_STAGES];
+    uint32_t    cur[FT_NUM_STAGES];
+    uint32_t    busy;
+
+    // totals since last reset, index FT_NUM_STAGES is whole frame
+    uint64_t    total[FT_NUM_STAGES + 1];
+    uint32_t    last[FT_NUM_STAGES + 1];
+    uint32_t    max[FT_NUM_STAGES + 1];
+    unsigned    frames;
+    unsigned    numslow;
+
+    // whole frame times over last complete window, for status responses
+    uint64_t    window_start;
+    uint64_t    window_total;
+    uint32_t    window_max;
+    unsigned    window_frames;
+    uint32_t    recent_avg;
+    uint32_t    recent_max;
+    unsigned    recent_slow;
+    unsigned    window_slow;
+
+    slowframe_t slow[FT_SLOW_FRAMES];
+    unsigned    slowhead;
+
+    qhandle_t   log;
+} ft;
+
+static inline void ft_begin(ftstage_t stage)
+{
+    ft.begin[stage] = Sys_Microseconds();
+}
+
+static inline void ft_end(ftstage_t stage)
+{
+    ft.cur[stage] += Sys_Microseconds() - ft.begin[stage];
+}
+
+static uint32_t ft_threshold(void)
+{
+    if (sv_slowframe->value > 0)
+        return sv_slowframe->value * 1000;
+    return SV_FRAMETIME * 1000;
+}
+
+static void ft_close_log(void)
+{
+    if (ft.log) {
+        FS_CloseFile(ft.log);
+        ft.log = 0;
+    }
+}
+
+static void sv_slowframe_log_changed(cvar_t *self)
+{
+    ft_close_log();
+}
+
+static bool ft_log_path(char *buffer, size_t size, const char *ext)
+{
+    if (Q_concat(buffer, size, "logs/", sv_slowframe_log->string, ext) >= size) {
+        Com_EPrintf("Oversize slow frame log name\n");
+        Cvar_Set("sv_slowframe_log", "");
+        return false;
+    }
+    return true;
+}
+
+static void ft_open_log(unsigned mode)
+{
+    char buffer[MAX_OSPATH];
+
+    if (!ft_log_path(buffer, sizeof(buffer), ".log"))
+        return;
+
+    FS_OpenFile(buffer, &ft.log, mode | FS_FLAG_TEXT | FS_BUF_LINE);
+    if (!ft.log) {
+        Com_EPrintf("Couldn't open %s for writing\n", buffer);
+        Cvar_Set("sv_slowframe_log", "");
+    }
+}
+
+// once the log grows too large, keep it as .old.log and start a new one
+static void ft_rotate_log(void)
+{
+    char path[MAX_OSPATH], oldpath[MAX_OSPATH];
+    int ret;
+
+    ft_close_log();
+
+    if (!ft_log_path(path, sizeof(path), ".log"))
+        return;
+    if (!ft_log_path(oldpath, sizeof(oldpath), ".old.log"))
+        return;
+
+    ret = FS_RenameFile(path, oldpath);
+    if (ret)
+        Com_WPrintf("Couldn't rename %s to %s: %s\n", path, oldpath, Q_ErrorString(ret));
+
+    ft_open_log(FS_MODE_WRITE);
+}
+
+static void ft_log_frame(const slowframe_t *f)
+{
+    char date[MAX_QPATH];
+    int64_t pos;
+    int i;
+
+    if (!ft.log)
+        ft_open_log(FS_MODE_APPEND);
+    if (!ft.log)
+        return;
+
+    Com_FormatLocalTime(date, sizeof(date), "%Y-%m-%d %H:%M:%S");
+    FS_FPrintf(ft.log, "%s frame %u total %.2f", date, f->framenum, f->total * 1e-3);
+    for (i = 0; i < FT_NUM_STAGES; i++)
+        FS_FPrintf(ft.log, " %s %.2f", ft_stage_names[i], f->stages[i] * 1e-3);
+    FS_FPrintf(ft.log, " entities %d clients %d\n", f->entities, f->clients);
+
+    pos = FS_Tell(ft.log);
+    if (pos > sv_slowframe_logsize->integer * 1024LL && sv_slowframe_logsize->integer > 0)
+        ft_rotate_log();
+}
+
+static void ft_capture_slow(uint32_t total)
+{
+    slowframe_t *f = &ft.slow[ft.slowhead++ % FT_SLOW_FRAMES];
+    client_t *cl;
+
+    f->time = time(NULL);
+    f->framenum = sv.framenum;
+    f->total = total;
+    memcpy(f->stages, ft.cur, sizeof(f->stages));
+    f->entities = ge ? ge->num_edicts : 0;
+    f->clients = 0;
+    FOR_EACH_CLIENT(cl)
+        if (cl->state == cs_spawned)
+            f->clients++;
+
+    ft.numslow++;
+    ft.window_slow++;
+
+    if (sv_slowframe_log->string[0])
+        ft_log_frame(f);
+}
+
+// called once per game frame after all stages have run
+static void ft_end_frame(uint32_t busy)
+{
+    uint64_t now;
+    int i;
+
+    for (i = 0; i < FT_NUM_STAGES; i++) {
+        ft.total[i] += ft.cur[i];
+        ft.last[i] = ft.cur[i];
+        ft.max[i] = max(ft.max[i], ft.cur[i]);
+    }
+    ft.total[i] += busy;
+    ft.last[i] = busy;
+    ft.max[i] = max(ft.max[i], busy);
+    ft.frames++;
+
+    if (busy > ft_threshold())
+        ft_capture_slow(busy);
+
+    now = Sys_Microseconds();
+    if (!ft.window_start)
+        ft.window_start = now;
+    ft.window_total += busy;
+    ft.window_max = max(ft.window_max, busy);
+    ft.window_frames++;
+    if (now - ft.window_start >= FT_WINDOW) {
+        ft.recent_avg = ft.window_total / ft.window_frames;
+        ft.recent_max = ft.window_max;
+        ft.recent_slow = ft.window_slow;
+        ft.window_start = now;
+        ft.window_total = ft.window_max = 0;
+        ft.window_frames = ft.window_slow = 0;
+    }
+}
+
+static void ft_clear_frame(void)
+{
+    memset(ft.cur, 0, sizeof(ft.cur));
+    ft.busy = 0;
+}
+
+/*
+=================
+SV_FrameStats_f
+=================
+*/
+void SV_FrameStats_f(void)
+{
+    uint64_t other;
+    int i;
+
+    if (!ft.frames) {
+        Com_Printf("No frames run yet.\n");
+        return;
+    }
+
+    Com_Printf("%u frames, %u slow (over %.2f ms)\n",
+               ft.frames, ft.numslow, ft_threshold() * 1e-3);
+    Com_Printf("stage     last   avg   max (ms)\n"
+               "------- ----- ----- -----\n");
+    for (i = 0; i <= FT_NUM_STAGES; i++)
+        Com_Printf("%-7s %5.2f %5.2f %5.2f\n",
+                   i < FT_NUM_STAGES ? ft_stage_names[i] : "total",
+                   ft.last[i] * 1e-3, ft.total[i] * 1e-3 / ft.frames, ft.max[i] * 1e-3);
+
+    other = ft.total[FT_NUM_STAGES];
+    for (i = 0; i < FT_NUM_STAGES; i++)
+        other -= min(other, ft.total[i]);
+    Com_Printf("%-7s       %5.2f\n", "other", other * 1e-3 / ft.frames);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(ft.total, 0, sizeof(ft.total));
+        memset(ft.last, 0, sizeof(ft.last));
+        memset(ft.max, 0, sizeof(ft.max));
+        ft.frames = ft.numslow = 0;
+    }
+}
+
+/*
+=================
+SV_SlowFrames_f
+=================
+*/
+void SV_SlowFrames_f(void)
+{
+    const slowframe_t *f;
+    char date[MAX_QPATH];
+    unsigned i, count;
+    struct tm *tm;
+    int j;
+
+    count = min(ft.slowhead, FT_SLOW_FRAMES);
+    if (Cmd_Argc() > 1)
+        count = min(count, (unsigned)max(atoi(Cmd_Argv(1)), 0));
+
+    if (!count) {
+        Com_Printf("No slow frames recorded.\n");
+        return;
+    }
+
+    Com_Printf("time        frame  total packets   game   send    mvd ents cl\n"
+               "-------- -------- ------ ------- ------ ------ ------ ---- --\n");
+    for (i = 0; i < count; i++) {
+        f = &ft.slow[(ft.slowhead - 1 - i) % FT_SLOW_FRAMES];
+        tm = localtime(&f->time);
+        if (!tm || !strftime(date, sizeof(date), "%H:%M:%S", tm))
+            strcpy(date, "??:??:??");
+        Com_Printf("%s %8u %6.2f", date, f->framenum, f->total * 1e-3);
+        for (j = 0; j < FT_NUM_STAGES; j++)
+            Com_Printf(" %*.2f", j ? 6 : 7, f->stages[j] * 1e-3);
+        Com_Printf(" %4d %2d\n", f->entities, f->clients);
+    }
+}
+
+// prints one line summary for status command
+void SV_FrameStatus(void)
+{
+    if (ft.frames)
+        Com_Printf("Frame time: %.2f ms avg, %.2f ms max, %u slow frames\n\n",
+                   ft.total[FT_NUM_STAGES] * 1e-3 / ft.frames,
+                   ft.max[FT_NUM_STAGES] * 1e-3, ft.numslow);
+}
+
 //============================================================================
 
 void SV_RemoveClient(client_t *client)
@@ -171,6 +486,14 @@ void SV_CleanClient(client_t *client)
             client->baselines[i] = NULL;
         }
     }
+
+#if USE_ZLIB
+    if (client->zdict) {
+        Z_Free(client->zdict);
+        client->zdict = NULL;
+        client->zdict_len = 0;
+    }
+#endif
 }
 
 static void print_drop_reason(client_t *client, const char *reason, clstate_t oldstate)
@@ -446,6 +769,16 @@ static size_t SV_StatusString(char *status)
         }
     }
 
+    // add frame times over last window
+    if (sv_status_frametime->integer > 0) {
+        len = Q_snprintf(entry, sizeof(entry), "\\frametime\\%.1f/%.1f/%u",
+                         ft.recent_avg * 1e-3, ft.recent_max * 1e-3, ft.recent_slow);
+        if (total + len < MAX_INFO_STRING) {
+            memcpy(status + total, entry, len);
+            total += len;
+        }
+    }
+
     status[total++] = '\n';
 
     // add player list
@@ -813,6 +1146,10 @@ static bool parse_enhanced_params(conn_params_t *p)
             if (p->version == PROTOCOL_VERSION_Q2PRO_RESERVED) {
                 p->version--; // never use this version
             }
+            if (p->version >= PROTOCOL_VERSION_Q2PRO_PACKED_ENTITIES &&
+                !sv_packed_entities->integer) {
+                p->version = PROTOCOL_VERSION_Q2PRO_PACKED_ENTITIES - 1;
+            }
         } else {
             p->version = PROTOCOL_VERSION_Q2PRO_MINIMUM;
         }
@@ -1021,6 +1358,9 @@ static void init_pmove_and_es_flags(client_t *newcl)
         if (newcl->version >= PROTOCOL_VERSION_Q2PRO_BEAM_ORIGIN) {
             newcl->esFlags |= MSG_ES_BEAMORIGIN;
         }
+        if (newcl->version >= PROTOCOL_VERSION_Q2PRO_PACKED_ENTITIES) {
+            newcl->esFlags |= MSG_ES_BITPACKED;
+        }
         if (newcl->version >= PROTOCOL_VERSION_Q2PRO_WATERJUMP_HACK) {
             force = 1;
         }
@@ -1777,15 +2117,21 @@ SV_RunGameFrame
 */
 static void SV_RunGameFrame(void)
 {
+    PROF_BEGIN("SV_RunGameFrame");
+
     // save the entire world state if recording a serverdemo
+    ft_begin(FT_MVD);
     SV_MvdBeginFrame();
+    ft_end(FT_MVD);
 
 #if USE_CLIENT
     if (host_speeds->integer)
         time_before_game = Sys_Milliseconds();
 #endif
 
+    ft_begin(FT_GAME);
     ge->RunFrame();
+    ft_end(FT_GAME);
 
 #if USE_CLIENT
     if (host_speeds->integer)
@@ -1800,7 +2146,11 @@ static void SV_RunGameFrame(void)
     }
 
     // save the entire world state if recording a serverdemo
+    ft_begin(FT_MVD);
     SV_MvdEndFrame();
+    ft_end(FT_MVD);
+
+    PROF_END();
 }
 
 /*
@@ -1910,6 +2260,10 @@ int SV_GetWaterLevel() {
 }
 unsigned SV_Frame(unsigned msec)
 {
+    uint64_t start = Sys_Microseconds();
+
+    PROF_BEGIN("SV_Frame");
+
 #if USE_CLIENT
     time_before_game = time_after_game = 0;
 #endif
@@ -1924,26 +2278,38 @@ unsigned SV_Frame(unsigned msec)
 
 #if USE_MVD_CLIENT
     // run connections to MVD/GTV servers
+    ft_begin(FT_MVD);
     MVD_Frame();
+    ft_end(FT_MVD);
 #endif
 
     // read packets from UDP clients
+    ft_begin(FT_PACKETS);
     NET_GetPackets(NS_SERVER, SV_PacketEvent);
+    ft_end(FT_PACKETS);
 
     if (svs.initialized) {
         // run connection to the anticheat server
+        ft_begin(FT_PACKETS);
         AC_Run();
+        ft_end(FT_PACKETS);
 
         // run connections from MVD/GTV clients
+        ft_begin(FT_MVD);
         SV_MvdRunClients();
+        ft_end(FT_MVD);
 
         // deliver fragments and reliable messages for connecting clients
+        ft_begin(FT_PACKETS);
         SV_SendAsyncPackets();
+        ft_end(FT_PACKETS);
     }
 
     // move autonomous things around if enough time has passed
     sv.frameresidual += msec;
     if (sv.frameresidual < SV_FRAMETIME) {
+        ft.busy += Sys_Microseconds() - start;
+        PROF_END();
         return SV_FRAMETIME - sv.frameresidual;
     }
 
@@ -1962,7 +2328,9 @@ unsigned SV_Frame(unsigned msec)
                
 
         // send messages back to the UDP clients
+        ft_begin(FT_SEND);
         SV_SendClientMessages();
+        ft_end(FT_SEND);
 
         // send a heartbeat to the master if needed
         SV_MasterHeartbeat();
@@ -1970,10 +2338,14 @@ unsigned SV_Frame(unsigned msec)
         // clear teleport flags, etc for next frame
         SV_PrepWorldFrame();
 
+        ft_end_frame(ft.busy + Sys_Microseconds() - start);
+
         // advance for next frame
         sv.framenum++;
     }
 
+    ft_clear_frame();
+
     if (COM_DEDICATED) {
         // run cmd buffer in dedicated mode
         if (cmd_buffer.waitCount > 0) {
@@ -1984,6 +2356,7 @@ unsigned SV_Frame(unsigned msec)
     // decide how long to sleep next frame
     sv.frameresidual -= SV_FRAMETIME;
     if (sv.frameresidual < SV_FRAMETIME) {
+        PROF_END();
         return SV_FRAMETIME - sv.frameresidual;
     }
 
@@ -1993,6 +2366,7 @@ unsigned SV_Frame(unsigned msec)
         sv.frameresidual = 100;
     }
 
+    PROF_END();
     return 0;
 }
 
@@ -2246,6 +2620,13 @@ void SV_Init(void)
 #endif
 
     sv_enhanced_setplayer = Cvar_Get("sv_enhanced_setplayer", "0", 0);
+    sv_cull_nonvisible_entities = Cvar_Get("sv_cull_nonvisible_entities", "1", CVAR_CHEAT);
+    sv_threads = Cvar_Get("sv_threads", "0", 0);
+    sv_viscache = Cvar_Get("sv_viscache", "1", 0);
+    sv_vismatrix = Cvar_Get("sv_vismatrix", "3", 0);
+    sv_area_depth = Cvar_Get("sv_area_depth", "8", 0);
+    sv_zdict = Cvar_Get("sv_zdict", "1", 0);
+    sv_packed_entities = Cvar_Get("sv_packed_entities", "1", 0);
 
     sv_iplimit = Cvar_Get("sv_iplimit", "3", 0);
 
@@ -2276,6 +2657,12 @@ void SV_Init(void)
 
     map_override_path = Cvar_Get("map_override_path", "", 0);
 
+    sv_slowframe = Cvar_Get("sv_slowframe", "0", 0);
+    sv_slowframe_log = Cvar_Get("sv_slowframe_log", "", 0);
+    sv_slowframe_log->changed = sv_slowframe_log_changed;
+    sv_slowframe_logsize = Cvar_Get("sv_slowframe_logsize", "1024", 0);
+    sv_status_frametime = Cvar_Get("sv_status_frametime", "0", 0);
+
     init_rate_limits();
 
 #if USE_FPS
@@ -2363,6 +2750,8 @@ Should be safe to call even if server is not fully initalized yet.
 */
 void SV_Shutdown(const char *finalmsg, error_type_t type)
 {
+    int i;
+
     if (!sv_registered)
         return;
 
@@ -2375,10 +2764,15 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     type &= ~MVD_SPAWN_MASK;
 #endif
 
+    // flush datagrams queued by a frame aborted with error
+    NET_BatchPackets(NS_SERVER, false);
+
     AC_Disconnect();
 
     SV_MvdShutdown(type);
 
+    ft_close_log();
+
     SV_FinalMessage(finalmsg, type);
     SV_MasterShutdown();
     SV_ShutdownGameProgs();
@@ -2391,6 +2785,13 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     // free server static data
     Z_Free(svs.client_pool);
     Z_Free(svs.entities);
+    Z_Free(svs.frame_jobs);
+    SV_FreeVisCache();
+    SV_FreeClientLeafs();
+    SV_FreeWorld();
+    for (i = 0; i < MAX_WORKER_THREADS; i++) {
+        Z_Free(svs.frame_scratch[i]);
+    }
 #if USE_ZLIB
     deflateEnd(&svs.z);
 #endif
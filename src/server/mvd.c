@@ -49,8 +49,28 @@ typedef struct {
 
     char        name[MAX_CLIENT_NAME];
     char        version[MAX_QPATH];
+
+    // subscription, delta compressor buffers are NULL for GTV_SUB_ALL
+    gtv_subscription_t  subtype;
+    int                 subplayer;
+    vec3_t              suborigin;
+    player_packed_t     *players;   // [maxclients]
+    entity_packed_t     *entities;  // [MAX_EDICTS]
+
+    // bandwidth statistics
+    uint64_t    bytes;
+    uint64_t    ratebytes;
+    unsigned    rate;       // bytes per second
 } gtv_client_t;
 
+// view of subscribed client, used for culling
+typedef struct {
+    int         player;     // always sent, -1 if none
+    int         area;
+    int         cluster;
+    byte        pvs[VIS_MAX_BYTES];
+} gtv_view_t;
+
 typedef struct {
     bool            enabled;
     bool            active;
@@ -76,6 +96,15 @@ typedef struct {
 
     // TCP client pool
     gtv_client_t    *clients; // [sv_mvd_maxclients]
+
+    // frames for subscribed clients are built here
+    byte            *subframe; // [MAX_MSGLEN]
+
+    // aggregate bandwidth statistics
+    uint64_t        bytes;
+    uint64_t        ratebytes;
+    unsigned        rate;
+    unsigned        ratetime;
 } mvd_server_t;
 
 static mvd_server_t     mvd;
@@ -105,11 +134,13 @@ static cvar_t   *sv_mvd_disconnect_time;
 static cvar_t   *sv_mvd_suspend_time;
 static cvar_t   *sv_mvd_allow_stufftext;
 static cvar_t   *sv_mvd_spawn_dummy;
+static cvar_t   *sv_mvd_subscriptions;
 
 static bool     mvd_enable(void);
 static void     mvd_disable(void);
 static void     mvd_error(const char *reason);
 
+static void     drop_client(gtv_client_t *client, const char *error);
 static void     write_stream(gtv_client_t *client, void *data, size_t len);
 static void     write_message(gtv_client_t *client, gtv_serverop_t op);
 #if USE_ZLIB
@@ -179,7 +210,7 @@ static void dummy_record_f(void)
         return;
     }
 
-    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE,
+    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE | FS_FLAG_ASYNC,
                         "demos/", Cmd_Argv(1), ".mvd2");
     if (!f) {
         return;
@@ -592,7 +623,7 @@ static void build_gamestate(void)
 
 // Writes a single giant message with all the startup info,
 // followed by an uncompressed (baseline) frame.
-static void emit_gamestate(void)
+static void emit_gamestate(player_packed_t *players, entity_packed_t *entities)
 {
     char        *string;
     int         i, j;
@@ -650,7 +681,7 @@ static void emit_gamestate(void)
     if (sv_mvd_nogun->integer) {
         flags |= MSG_PS_IGNORE_GUNINDEX | MSG_PS_IGNORE_GUNFRAMES;
     }
-    for (i = 0, ps = mvd.players; i < sv_maxclients->integer; i++, ps++) {
+    for (i = 0, ps = players; i < sv_maxclients->integer; i++, ps++) {
         extra = 0;
         if (!PPS_INUSE(ps)) {
             extra |= MSG_PS_REMOVE;
@@ -660,11 +691,11 @@ static void emit_gamestate(void)
     MSG_WriteByte(CLIENTNUM_NONE);
 
     // send entity states
-    for (i = 1, es = mvd.entities + 1; i < ge->num_edicts; i++, es++) {
+    for (i = 1, es = entities + 1; i < ge->num_edicts; i++, es++) {
         flags = MSG_ES_UMASK;
         if ((j = es->number) != 0) {
             if (i <= sv_maxclients->integer) {
-                ps = &mvd.players[i - 1];
+                ps = &players[i - 1];
                 if (PPS_INUSE(ps) && ps->pmove.pm_type == PM_NORMAL) {
                     flags |= MSG_ES_FIRSTPERSON;
                 }
@@ -699,20 +730,99 @@ static void copy_entity_state(entity_packed_t *dst, const entity_packed_t *src,
     dst->event = 0;
 }
 
+static void calc_view(gtv_client_t *client, gtv_view_t *view)
+{
+    player_state_t *ps;
+    mleaf_t *leaf;
+    edict_t *ent;
+
+    view->player = -1;
+    if (client->subtype == GTV_SUB_PLAYER) {
+        view->player = client->subplayer;
+        ent = EDICT_NUM(client->subplayer + 1);
+        // keep the last known view origin while player is inactive
+        if (player_is_active(ent)) {
+            ps = &ent->client->ps;
+            VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, client->suborigin);
+        }
+    }
+
+    leaf = CM_PointLeaf(&sv.cm, client->suborigin);
+    view->area = leaf->area;
+    view->cluster = leaf->cluster;
+    CM_FatPVS(&sv.cm, view->pvs, client->suborigin, DVIS_PVS2);
+}
+
+static bool entity_is_visible(const gtv_view_t *view, const edict_t *ent)
+{
+    int i;
+
+    if (NUM_FOR_EDICT(ent) == view->player + 1) {
+        return true;
+    }
+
+    // check area
+    if (view->cluster >= 0 && !CM_AreasConnected(&sv.cm, view->area, ent->areanum)) {
+        // doors can legally straddle two areas, so
+        // we may need to check another one
+        if (!CM_AreasConnected(&sv.cm, view->area, ent->areanum2)) {
+            return false;       // blocked by a door
+        }
+    }
+
+    if (ent->num_clusters == -1) {
+        // too many leafs for individual check, go by headnode
+        return CM_HeadnodeVisible(CM_NodeNum(&sv.cm, ent->headnode), (byte *)view->pvs);
+    }
+
+    // check individual leafs
+    for (i = 0; i < ent->num_clusters; i++) {
+        if (Q_IsBitSet(view->pvs, ent->clusternums[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool player_is_visible(const gtv_view_t *view, const edict_t *ent)
+{
+    // always send followed player and dummy MVD client
+    if (NUM_FOR_EDICT(ent) == view->player + 1) {
+        return true;
+    }
+    if (mvd.dummy && ent == mvd.dummy->edict) {
+        return true;
+    }
+
+    return entity_is_visible(view, ent);
+}
+
 /*
 Builds a new delta compressed MVD frame by capturing all entity and player
 states and calculating portalbits. The same frame is used for all MVD clients,
 as well as local recorder.
+
+If subscribed client is given, frame is delta compressed against its own
+state instead, and only includes entities visible from its view point.
 */
-static void emit_frame(void)
+static void emit_frame(gtv_client_t *client)
 {
-    player_packed_t *oldps, newps;
-    entity_packed_t *oldes, newes;
+    player_packed_t *oldps, newps, *players = mvd.players;
+    entity_packed_t *oldes, newes, *entities = mvd.entities;
+    gtv_view_t view, *cull = NULL;
     edict_t *ent;
     int flags, portalbytes;
     byte portalbits[MAX_MAP_PORTAL_BYTES];
     int i;
 
+    if (client) {
+        players = client->players;
+        entities = client->entities;
+        calc_view(client, &view);
+        cull = &view;
+    }
+
     MSG_WriteByte(mvd_frame);
 
     // send portal bits
@@ -730,10 +840,10 @@ static void emit_frame(void)
 
     // send player states
     for (i = 0; i < sv_maxclients->integer; i++) {
-        oldps = &mvd.players[i];
+        oldps = &players[i];
         ent = EDICT_NUM(i + 1);
 
-        if (!player_is_active(ent)) {
+        if (!player_is_active(ent) || (cull && !player_is_visible(cull, ent))) {
             if (PPS_INUSE(oldps)) {
                 // the old player isn't present in the new message
                 MSG_WriteDeltaPlayerstate_Packet(NULL, NULL, i, flags);
@@ -765,10 +875,10 @@ static void emit_frame(void)
 
     // send entity states
     for (i = 1; i < ge->num_edicts; i++) {
-        oldes = &mvd.entities[i];
+        oldes = &entities[i];
         ent = EDICT_NUM(i);
 
-        if (!entity_is_active(ent)) {
+        if (!entity_is_active(ent) || (cull && !entity_is_visible(cull, ent))) {
             if (oldes->number) {
                 // the old entity isn't present in the new message
                 MSG_WriteDeltaEntity(oldes, NULL, MSG_ES_FORCE);
@@ -786,7 +896,7 @@ static void emit_frame(void)
         // calculate flags
         flags = MSG_ES_UMASK;
         if (i <= sv_maxclients->integer) {
-            oldps = &mvd.players[i - 1];
+            oldps = &players[i - 1];
             if (PPS_INUSE(oldps) && oldps->pmove.pm_type == PM_NORMAL) {
                 // do not waste bandwidth on origin/angle updates,
                 // client will recover them from player state
@@ -812,6 +922,64 @@ static void emit_frame(void)
     MSG_WriteShort(0);      // end of packetentities
 }
 
+// Sends gamestate to the client. Shared gamestate is expected in msg_write,
+// subscribed clients get their own one with empty baseline frame instead.
+// Entities are then introduced by following frames as they become visible.
+static void send_gamestate(gtv_client_t *client)
+{
+    sizebuf_t shared;
+
+    if (!client->entities) {
+        write_message(client, GTS_STREAM_DATA);
+        return;
+    }
+
+    memset(client->players, 0, sizeof(player_packed_t) * sv_maxclients->integer);
+    memset(client->entities, 0, sizeof(entity_packed_t) * MAX_EDICTS);
+
+    shared = msg_write;
+    SZ_TagInit(&msg_write, mvd.subframe, MAX_MSGLEN, SZ_MSG_WRITE);
+    emit_gamestate(client->players, client->entities);
+    write_message(client, GTS_STREAM_DATA);
+    msg_write = shared;
+}
+
+// Sends frame delta compressed and culled for subscribed client.
+// Reliable and unreliable data are shared with all clients.
+static void send_subscription_frame(gtv_client_t *client)
+{
+    sizebuf_t shared;
+    size_t total, datagram;
+    byte header[3];
+
+    shared = msg_write;
+    SZ_TagInit(&msg_write, mvd.subframe, MAX_MSGLEN, SZ_MSG_WRITE);
+    emit_frame(client);
+
+    if (mvd.message.cursize + msg_write.cursize >= MAX_MSGLEN) {
+        drop_client(client, "frame overflowed");
+        goto done;
+    }
+
+    datagram = mvd.datagram.cursize;
+    if (mvd.message.cursize + msg_write.cursize + datagram >= MAX_MSGLEN) {
+        datagram = 0;
+    }
+
+    total = mvd.message.cursize + msg_write.cursize + datagram + 1;
+    header[0] = total & 255;
+    header[1] = (total >> 8) & 255;
+    header[2] = GTS_STREAM_DATA;
+
+    write_stream(client, header, sizeof(header));
+    write_stream(client, mvd.message.data, mvd.message.cursize);
+    write_stream(client, msg_write.data, msg_write.cursize);
+    write_stream(client, mvd.datagram.data, datagram);
+
+done:
+    msg_write = shared;
+}
+
 static void suspend_streams(void)
 {
     gtv_client_t *client;
@@ -835,11 +1003,11 @@ static void resume_streams(void)
 
     // build and emit gamestate
     build_gamestate();
-    emit_gamestate();
+    emit_gamestate(mvd.players, mvd.entities);
 
     FOR_EACH_ACTIVE_GTV(client) {
         // send gamestate
-        write_message(client, GTS_STREAM_DATA);
+        send_gamestate(client);
 #if USE_ZLIB
         flush_stream(client, Z_SYNC_FLUSH);
 #endif
@@ -1043,7 +1211,7 @@ void SV_MvdEndFrame(void)
     }
 
     // emit a delta update common to all clients
-    emit_frame();
+    emit_frame(NULL);
 
     // if reliable message and frame update don't fit, kick all clients
     if (mvd.message.cursize + msg_write.cursize >= MAX_MSGLEN) {
@@ -1066,10 +1234,14 @@ void SV_MvdEndFrame(void)
 
     // send frame to clients
     FOR_EACH_ACTIVE_GTV(client) {
-        write_stream(client, header, sizeof(header));
-        write_stream(client, mvd.message.data, mvd.message.cursize);
-        write_stream(client, msg_write.data, msg_write.cursize);
-        write_stream(client, mvd.datagram.data, mvd.datagram.cursize);
+        if (client->entities) {
+            send_subscription_frame(client);
+        } else {
+            write_stream(client, header, sizeof(header));
+            write_stream(client, mvd.message.data, mvd.message.cursize);
+            write_stream(client, msg_write.data, msg_write.cursize);
+            write_stream(client, mvd.datagram.data, mvd.datagram.cursize);
+        }
 #if USE_ZLIB
         if (++client->bufcount > client->maxbuf) {
             flush_stream(client, Z_SYNC_FLUSH);
@@ -1289,6 +1461,15 @@ TCP CLIENTS HANDLING
 */
 
 
+static void free_subscription(gtv_client_t *client)
+{
+    Z_Free(client->players);
+    Z_Free(client->entities);
+    client->players = NULL;
+    client->entities = NULL;
+    client->subtype = GTV_SUB_ALL;
+}
+
 static void remove_client(gtv_client_t *client)
 {
     NET_CloseStream(&client->stream);
@@ -1297,6 +1478,7 @@ static void remove_client(gtv_client_t *client)
         Z_Free(client->data);
         client->data = NULL;
     }
+    free_subscription(client);
     client->state = cs_free;
 }
 
@@ -1335,6 +1517,8 @@ static void flush_stream(gtv_client_t *client, int flush)
         if (len) {
             FIFO_Commit(fifo, len);
             client->bufcount = 0;
+            client->bytes += len;
+            mvd.bytes += len;
         }
     } while (ret == Z_OK);
 }
@@ -1404,6 +1588,8 @@ static void write_stream(gtv_client_t *client, void *data, size_t len)
             if (len) {
                 FIFO_Commit(fifo, len);
                 client->bufcount = 0;
+                client->bytes += len;
+                mvd.bytes += len;
             }
         } while (z->avail_in);
     } else
@@ -1411,6 +1597,9 @@ static void write_stream(gtv_client_t *client, void *data, size_t len)
 
         if (FIFO_Write(fifo, data, len) != len) {
             drop_client(client, "overflowed");
+        } else {
+            client->bytes += len;
+            mvd.bytes += len;
         }
 }
 
@@ -1488,6 +1677,10 @@ static void parse_hello(gtv_client_t *client)
     flags &= ~GTF_DEFLATE;
 #endif
 
+    if (!sv_mvd_subscriptions->integer) {
+        flags &= ~GTF_SUBSCRIBE;
+    }
+
     Cvar_ClampInteger(sv_mvd_bufsize, 1, 4);
 
     // allocate larger send buffer
@@ -1534,6 +1727,45 @@ static void parse_ping(gtv_client_t *client)
 #endif
 }
 
+static bool parse_subscription(gtv_client_t *client)
+{
+    int i;
+
+    free_subscription(client);
+
+    if (!(client->flags & GTF_SUBSCRIBE)) {
+        return true;
+    }
+
+    client->subtype = MSG_ReadByte();
+    switch (client->subtype) {
+    case GTV_SUB_ALL:
+        return true;
+    case GTV_SUB_PLAYER:
+        client->subplayer = MSG_ReadByte();
+        if (client->subplayer < 0 || client->subplayer >= sv_maxclients->integer) {
+            return false;
+        }
+        VectorClear(client->suborigin);
+        break;
+    case GTV_SUB_ORIGIN:
+        for (i = 0; i < 3; i++) {
+            client->suborigin[i] = SHORT2COORD(MSG_ReadShort());
+        }
+        break;
+    default:
+        return false;
+    }
+
+    if (msg_read.readcount > msg_read.cursize) {
+        return false;
+    }
+
+    client->players = SV_Mallocz(sizeof(player_packed_t) * sv_maxclients->integer);
+    client->entities = SV_Mallocz(sizeof(entity_packed_t) * MAX_EDICTS);
+    return true;
+}
+
 static void parse_stream_start(gtv_client_t *client)
 {
     int maxbuf;
@@ -1554,6 +1786,12 @@ static void parse_stream_start(gtv_client_t *client)
         maxbuf = 10;
     }
 
+    if (!parse_subscription(client)) {
+        write_message(client, GTS_BADREQUEST);
+        drop_client(client, "bad subscription");
+        return;
+    }
+
     client->maxbuf = maxbuf;
     client->state = cs_spawned;
 
@@ -1564,8 +1802,10 @@ static void parse_stream_start(gtv_client_t *client)
 
     // send gamestate if active
     if (mvd.active) {
-        emit_gamestate();
-        write_message(client, GTS_STREAM_DATA);
+        if (!client->entities) {
+            emit_gamestate(mvd.players, mvd.entities);
+        }
+        send_gamestate(client);
         SZ_Clear(&msg_write);
     } else {
         // send stream suspend marker
@@ -1588,6 +1828,8 @@ static void parse_stream_stop(gtv_client_t *client)
 
     List_Delete(&client->active);
 
+    free_subscription(client);
+
     // send ack to client
     write_message(client, GTS_STREAM_STOP);
 #if USE_ZLIB
@@ -1790,6 +2032,18 @@ void SV_MvdRunClients(void)
         accept_client(&stream);
     }
 
+    // update bandwidth statistics once per second
+    delta = svs.realtime - mvd.ratetime;
+    if (delta >= 1000) {
+        mvd.rate = (mvd.bytes - mvd.ratebytes) * 1000 / delta;
+        mvd.ratebytes = mvd.bytes;
+        mvd.ratetime = svs.realtime;
+        FOR_EACH_GTV(client) {
+            client->rate = (client->bytes - client->ratebytes) * 1000 / delta;
+            client->ratebytes = client->bytes;
+        }
+    }
+
     // run existing connections
     FOR_EACH_GTV(client) {
         // check timeouts
@@ -1847,8 +2101,8 @@ static void dump_clients(void)
     int count;
 
     Com_Printf(
-        "num name             buf lastmsg address               state\n"
-        "--- ---------------- --- ------- --------------------- -----\n");
+        "num name             buf lastmsg address               state subscr   kB/s\n"
+        "--- ---------------- --- ------- --------------------- ----- ------- -----\n");
     count = 0;
     FOR_EACH_GTV(client) {
         Com_Printf("%3d %-16.16s %3zu %7u %-21s ",
@@ -1873,10 +2127,25 @@ static void dump_clients(void)
             Com_Printf("SEND ");
             break;
         }
-        Com_Printf("\n");
+
+        switch (client->subtype) {
+        case GTV_SUB_PLAYER:
+            Com_Printf("pov %3d ", client->subplayer);
+            break;
+        case GTV_SUB_ORIGIN:
+            Com_Printf("origin  ");
+            break;
+        default:
+            Com_Printf("all     ");
+            break;
+        }
+        Com_Printf("%5.1f\n", client->rate / 1000.0f);
 
         count++;
     }
+
+    Com_Printf("\nTotal %"PRIu64" kB sent, %.1f kB/s.\n",
+               mvd.bytes / 1000, mvd.rate / 1000.0f);
 }
 
 static void dump_versions(void)
@@ -1896,6 +2165,19 @@ static void dump_versions(void)
     }
 }
 
+static void dump_recording(void)
+{
+    fs_asyncstats_t stats;
+
+    Com_Printf("Recording local MVD: %"PRId64" kB", FS_Tell(mvd.recording) / 1000);
+    if (FS_AsyncStats(mvd.recording, &stats)) {
+        Com_Printf(", %"PRId64" kB queued, %u stalls (%u ms), %"PRId64" kB dropped",
+                   stats.queued / 1000, stats.stalls, stats.stall_msec,
+                   stats.dropped / 1000);
+    }
+    Com_Printf("\n");
+}
+
 void SV_MvdStatus_f(void)
 {
     if (LIST_EMPTY(&gtv_client_list)) {
@@ -1907,6 +2189,9 @@ void SV_MvdStatus_f(void)
             dump_clients();
         }
     }
+    if (mvd.recording) {
+        dump_recording();
+    }
     Com_Printf("\n");
 }
 
@@ -2000,11 +2285,11 @@ void SV_MvdMapChanged(void)
     if (mvd.active) {
         // build and emit gamestate
         build_gamestate();
-        emit_gamestate();
+        emit_gamestate(mvd.players, mvd.entities);
 
         // send gamestate to all MVD clients
         FOR_EACH_ACTIVE_GTV(client) {
-            write_message(client, GTS_STREAM_DATA);
+            send_gamestate(client);
             NET_UpdateStream(&client->stream);
         }
     }
@@ -2060,9 +2345,10 @@ void SV_MvdInit(void)
 
     // allocate buffers
     Z_TagReserve(sizeof(player_packed_t) * sv_maxclients->integer +
-                 sizeof(entity_packed_t) * MAX_EDICTS + MAX_MSGLEN * 2, TAG_SERVER);
+                 sizeof(entity_packed_t) * MAX_EDICTS + MAX_MSGLEN * 3, TAG_SERVER);
     SZ_Init(&mvd.message, Z_ReservedAlloc(MAX_MSGLEN), MAX_MSGLEN);
     SZ_Init(&mvd.datagram, Z_ReservedAlloc(MAX_MSGLEN), MAX_MSGLEN);
+    mvd.subframe = Z_ReservedAlloc(MAX_MSGLEN);
     mvd.players = Z_ReservedAlloc(sizeof(player_packed_t) * sv_maxclients->integer);
     mvd.entities = Z_ReservedAlloc(sizeof(entity_packed_t) * MAX_EDICTS);
 
@@ -2203,7 +2489,7 @@ static void rec_start(qhandle_t demofile)
     FS_Write(&magic, 4, demofile);
 
     if (mvd.active) {
-        emit_gamestate();
+        emit_gamestate(mvd.players, mvd.entities);
         rec_write();
         SZ_Clear(&msg_write);
     }
@@ -2221,7 +2507,7 @@ void SV_MvdRecord_f(void)
 {
     char buffer[MAX_OSPATH];
     qhandle_t f;
-    unsigned mode = FS_MODE_WRITE;
+    unsigned mode = FS_MODE_WRITE | FS_FLAG_ASYNC;
     int c;
 
     if (sv.state != ss_game) {
@@ -2388,6 +2674,7 @@ void SV_MvdRegister(void)
     sv_mvd_suspend_time->changed(sv_mvd_suspend_time);
     sv_mvd_allow_stufftext = Cvar_Get("sv_mvd_allow_stufftext", "0", CVAR_LATCH);
     sv_mvd_spawn_dummy = Cvar_Get("sv_mvd_spawn_dummy", "1", 0);
+    sv_mvd_subscriptions = Cvar_Get("sv_mvd_subscriptions", "1", 0);
 
     Cmd_Register(c_svmvd);
 }
@@ -62,6 +62,9 @@ typedef struct gtv_s {
     byte        *data;
     size_t      msglen;
     unsigned    flags;
+    gtv_subscription_t  subtype;
+    int                 subplayer;
+    vec3_t              suborigin;
 #if USE_ZLIB
     bool        z_act; // true when actively inflating
     z_stream    z_str;
@@ -119,6 +122,7 @@ static cvar_t  *mvd_buffer_size;
 static cvar_t  *mvd_username;
 static cvar_t  *mvd_password;
 static cvar_t  *mvd_snaps;
+static cvar_t  *mvd_demoindex;
 
 // ====================================================================
 
@@ -138,12 +142,10 @@ void MVD_StopRecord(mvd_t *mvd)
 
 static void MVD_Free(mvd_t *mvd)
 {
-    mvd_snap_t *snap, *next;
     int i;
 
-    LIST_FOR_EACH_SAFE(mvd_snap_t, snap, next, &mvd->snapshots, entry) {
-        Z_Free(snap);
-    }
+    DemoIndex_Save(&mvd->snapshots);
+    DemoIndex_Clear(&mvd->snapshots);
 
     // stop demo recording
     if (mvd->demorecording) {
@@ -328,7 +330,7 @@ static mvd_t *create_channel(gtv_t *gtv)
     mvd->pool.max_edicts = MAX_EDICTS;
     mvd->pm_type = PM_SPECTATOR;
     mvd->min_packets = mvd_wait_delay->integer;
-    List_Init(&mvd->snapshots);
+    DemoIndex_Init(&mvd->snapshots, TAG_MVD);
     List_Init(&mvd->clients);
     List_Init(&mvd->entry);
 
@@ -548,7 +550,6 @@ static int demo_read_first(qhandle_t f)
 // state, configstrings and layouts at the given server frame.
 static void demo_emit_snapshot(mvd_t *mvd)
 {
-    mvd_snap_t *snap;
     gtv_t *gtv;
     int64_t pos;
     char *from, *to;
@@ -593,12 +594,8 @@ static void demo_emit_snapshot(mvd_t *mvd)
 
     // TODO: write private layouts/configstrings
 
-    snap = MVD_Malloc(sizeof(*snap) + msg_write.cursize - 1);
-    snap->framenum = mvd->framenum;
-    snap->filepos = pos;
-    snap->msglen = msg_write.cursize;
-    memcpy(snap->data, msg_write.data, msg_write.cursize);
-    List_Append(&mvd->snapshots, &snap->entry);
+    DemoIndex_Add(&mvd->snapshots, mvd->framenum, pos,
+                  msg_write.data, msg_write.cursize);
 
     Com_DPrintf("[%d] snaplen %zu\n", mvd->framenum, msg_write.cursize);
 
@@ -607,22 +604,30 @@ static void demo_emit_snapshot(mvd_t *mvd)
     mvd->last_snapshot = mvd->framenum;
 }
 
-static mvd_snap_t *demo_find_snapshot(mvd_t *mvd, int framenum)
+// loads snapshots saved by previous playback of the same demo file from the
+// `<demo>.idx' sidecar. called after the first gamestate of the file has
+// been parsed, later maps in the same file are not persisted.
+static void demo_load_index(gtv_t *gtv)
 {
-    mvd_snap_t *snap, *prev;
+    mvd_t *mvd = gtv->mvd;
+    uint32_t key;
+    int ret;
 
-    if (LIST_EMPTY(&mvd->snapshots))
-        return NULL;
+    if (mvd_snaps->integer <= 0 || !mvd_demoindex->integer)
+        return;
 
-    prev = LIST_FIRST(mvd_snap_t, &mvd->snapshots, entry);
+    if (!gtv->demosize)
+        return;
 
-    LIST_FOR_EACH(mvd_snap_t, snap, &mvd->snapshots, entry) {
-        if (snap->framenum > framenum)
-            break;
-        prev = snap;
+    key = DemoIndex_Key(mvd->baseconfigstrings, MAX_CONFIGSTRINGS,
+                        gtv->demopos, gtv->demosize);
+    ret = DemoIndex_Load(&mvd->snapshots, gtv->demoentry->string, key);
+    if (ret > 0) {
+        mvd->last_snapshot = DemoIndex_LastFrame(&mvd->snapshots);
+    } else if (ret < 0 && ret != Q_ERR(ENOENT)) {
+        Com_WPrintf("[%s] Couldn't load %s: %s\n", mvd->name,
+                    mvd->snapshots.path, Q_ErrorString(ret));
     }
-
-    return prev;
 }
 
 static void demo_update(gtv_t *gtv)
@@ -750,6 +755,7 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
         gtv->demosize = gtv->demopos = 0;
     }
 
+    demo_load_index(gtv);
     demo_emit_snapshot(gtv->mvd);
 }
 
@@ -998,6 +1004,10 @@ static void send_hello(gtv_t *gtv)
     flags |= GTF_DEFLATE;
 #endif
 
+    if (gtv->subtype != GTV_SUB_ALL) {
+        flags |= GTF_SUBSCRIBE;
+    }
+
     MSG_WriteShort(GTV_PROTOCOL_VERSION);
     MSG_WriteLong(flags);
     MSG_WriteLong(0);   // reserved
@@ -1025,6 +1035,19 @@ static void send_stream_start(gtv_t *gtv)
 
     // send stream start request
     MSG_WriteShort(maxbuf);
+
+    // ask server to cull the stream, if it supports that
+    if (gtv->flags & GTF_SUBSCRIBE) {
+        MSG_WriteByte(gtv->subtype);
+        if (gtv->subtype == GTV_SUB_PLAYER) {
+            MSG_WriteByte(gtv->subplayer);
+        } else if (gtv->subtype == GTV_SUB_ORIGIN) {
+            MSG_WriteShort(COORD2SHORT(gtv->suborigin[0]));
+            MSG_WriteShort(COORD2SHORT(gtv->suborigin[1]));
+            MSG_WriteShort(COORD2SHORT(gtv->suborigin[2]));
+        }
+    }
+
     write_message(gtv, GTC_STREAM_START);
     SZ_Clear(&msg_write);
 
@@ -1867,7 +1890,7 @@ void MVD_StreamedRecord_f(void)
     mvd_t *mvd;
     uint32_t magic;
     uint16_t msglen;
-    unsigned mode = FS_MODE_WRITE;
+    unsigned mode = FS_MODE_WRITE | FS_FLAG_ASYNC;
     int ret;
     int c;
 
@@ -1948,6 +1971,8 @@ static const cmd_option_t o_mvdconnect[] = {
     { "n:string", "name", "specify channel name as <string>" },
     { "u:string", "user", "specify username as <string>" },
     { "p:string", "pass", "specify password as <string>" },
+    { "f:number", "follow", "only receive what player <number> can see" },
+    { "o:x,y,z", "origin", "only receive what can be seen from <x,y,z>" },
     { NULL }
 };
 
@@ -1966,6 +1991,9 @@ static void MVD_Connect_f(void)
     netadr_t adr;
     netstream_t stream;
     char *name = NULL, *username = NULL, *password = NULL;
+    gtv_subscription_t subtype = GTV_SUB_ALL;
+    int subplayer = 0;
+    vec3_t suborigin = { 0 };
     gtv_t *gtv;
     int c;
 
@@ -1985,6 +2013,21 @@ static void MVD_Connect_f(void)
         case 'p':
             password = cmd_optarg;
             break;
+        case 'f':
+            if (!COM_IsUint(cmd_optarg) || (subplayer = atoi(cmd_optarg)) > 255) {
+                Com_Printf("Bad player number: %s\n", cmd_optarg);
+                return;
+            }
+            subtype = GTV_SUB_PLAYER;
+            break;
+        case 'o':
+            if (sscanf(cmd_optarg, "%f,%f,%f", &suborigin[0],
+                       &suborigin[1], &suborigin[2]) != 3) {
+                Com_Printf("Bad origin: %s\n", cmd_optarg);
+                return;
+            }
+            subtype = GTV_SUB_ORIGIN;
+            break;
         default:
             return;
         }
@@ -2029,6 +2072,9 @@ static void MVD_Connect_f(void)
     gtv->destroy = gtv_destroy;
     gtv->username = MVD_CopyString(username);
     gtv->password = MVD_CopyString(password);
+    gtv->subtype = subtype;
+    gtv->subplayer = subplayer;
+    VectorCopy(suborigin, gtv->suborigin);
     List_Append(&mvd_gtv_list, &gtv->entry);
 
     // set channel name
@@ -2122,58 +2168,36 @@ static void MVD_Skip_f(void)
     mvd->gtv->demoskip = count;
 }
 
-static void MVD_Seek_f(void)
+static bool demo_can_seek(mvd_t *mvd)
 {
-    mvd_t *mvd;
-    gtv_t *gtv;
-    mvd_snap_t *snap;
-    int i, j, ret, index, frames, dest;
-    char *from, *to;
-    edict_t *ent;
-    bool gamestate;
-
-    if (Cmd_Argc() < 2) {
-        Com_Printf("Usage: %s [+-]<timespec> [chanid]\n", Cmd_Argv(0));
-        return;
-    }
-
-    mvd = MVD_SetChannel(2);
-    if (!mvd) {
-        return;
-    }
+    gtv_t *gtv = mvd->gtv;
 
-    gtv = mvd->gtv;
     if (!gtv || !gtv->demoplayback) {
         Com_Printf("[%s] Seeking is only supported on demo channels.\n", mvd->name);
-        return;
+        return false;
     }
 
     if (mvd->demorecording) {
         // need some sort of nodelta frame support for that :(
         Com_Printf("[%s] Seeking is not yet supported during demo recording, sorry.\n", mvd->name);
-        return;
+        return false;
     }
 
-    to = Cmd_Argv(1);
+    return true;
+}
 
-    if (*to == '-' || *to == '+') {
-        // relative to current frame
-        if (!Com_ParseTimespec(to + 1, &frames)) {
-            Com_Printf("Invalid relative timespec.\n");
-            return;
-        }
-        if (*to == '-')
-            frames = -frames;
-        dest = mvd->framenum + frames;
-    } else {
-        // relative to first frame
-        if (!Com_ParseTimespec(to, &dest)) {
-            Com_Printf("Invalid absolute timespec.\n");
-            return;
-        }
-        frames = dest - mvd->framenum;
-    }
+// seeks to the given frame. if `to_end' is set, stops at the end of demo
+// file instead of advancing to the next file in play list.
+static void demo_seek(mvd_t *mvd, int dest, bool to_end)
+{
+    gtv_t *gtv = mvd->gtv;
+    demosnap_t *snap;
+    int i, j, ret, index, frames;
+    char *from, *to;
+    edict_t *ent;
+    bool gamestate;
 
+    frames = dest - mvd->framenum;
     if (!frames)
         // already there
         return;
@@ -2191,7 +2215,11 @@ static void MVD_Seek_f(void)
 
     // seek to the previous most recent snapshot
     if (frames < 0 || mvd->last_snapshot > mvd->framenum) {
-        snap = demo_find_snapshot(mvd, dest);
+        snap = DemoIndex_Find(&mvd->snapshots, dest);
+
+        // don't go back when seeking forward past the last snapshot
+        if (snap && frames > 0 && snap->framenum <= mvd->framenum)
+            snap = NULL;
 
         if (snap) {
             Com_DPrintf("found snap at %d\n", snap->framenum);
@@ -2233,6 +2261,9 @@ static void MVD_Seek_f(void)
     // skip forward to destination frame
     while (mvd->framenum < dest) {
         ret = demo_read_message(gtv->demoplayback);
+        if (ret == 0 && to_end) {
+            break;
+        }
         if (ret <= 0) {
             demo_finish(gtv, ret);
             return;
@@ -2299,6 +2330,423 @@ done:
     mvd->demoseeking = false;
 }
 
+static void MVD_Seek_f(void)
+{
+    mvd_t *mvd;
+    int frames, dest;
+    char *to;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s [+-]<timespec> [chanid]\n", Cmd_Argv(0));
+        return;
+    }
+
+    mvd = MVD_SetChannel(2);
+    if (!mvd) {
+        return;
+    }
+
+    if (!demo_can_seek(mvd)) {
+        return;
+    }
+
+    to = Cmd_Argv(1);
+
+    if (*to == '-' || *to == '+') {
+        // relative to current frame
+        if (!Com_ParseTimespec(to + 1, &frames)) {
+            Com_Printf("Invalid relative timespec.\n");
+            return;
+        }
+        if (*to == '-')
+            frames = -frames;
+        dest = mvd->framenum + frames;
+    } else {
+        // relative to first frame
+        if (!Com_ParseTimespec(to, &dest)) {
+            Com_Printf("Invalid absolute timespec.\n");
+            return;
+        }
+    }
+
+    demo_seek(mvd, dest, false);
+}
+
+// builds snapshots for the whole demo file by skipping to the end and back,
+// then saves them into the `<demo>.idx' sidecar
+static void MVD_Index_f(void)
+{
+    mvd_t *mvd;
+    demoindex_t *index;
+    int framenum, ret;
+
+    mvd = MVD_SetChannel(1);
+    if (!mvd) {
+        return;
+    }
+
+    if (!demo_can_seek(mvd)) {
+        return;
+    }
+
+    index = &mvd->snapshots;
+    if (!index->key) {
+        Com_Printf("[%s] Demo index is not available, check mvd_snaps and mvd_demoindex.\n", mvd->name);
+        return;
+    }
+
+    framenum = mvd->framenum;
+    demo_seek(mvd, INT_MAX, true);
+
+    if (!index->key) {
+        // next map started, index of the first one has been saved
+        Com_Printf("[%s] Indexed first map of demo file.\n", mvd->name);
+        return;
+    }
+
+    demo_seek(mvd, framenum, false);
+
+    ret = DemoIndex_Save(index);
+    if (ret < 0) {
+        Com_EPrintf("[%s] Couldn't write %s: %s\n", mvd->name, index->path, Q_ErrorString(ret));
+        return;
+    }
+
+    Com_Printf("[%s] Indexed %d snapshots in %s\n", mvd->name, index->numsnaps, index->path);
+}
+
+/*
+==============================================================================
+
+ENTITY ENCODING BENCHMARK
+
+==============================================================================
+*/
+
+typedef struct {
+    entity_packed_t cur[MAX_EDICTS];
+    bool            curvalid[MAX_EDICTS];
+    entity_packed_t old[MAX_EDICTS];
+    bool            oldvalid[MAX_EDICTS];
+    entity_state_t  decoded[MAX_EDICTS];
+    int16_t         velocities[MAX_EDICTS][3];
+    bool            decvalid[MAX_EDICTS];
+    byte            buffer[MAX_MSGLEN];
+    unsigned        frames;
+    unsigned        mismatches;
+    uint64_t        standard, packed;
+} entbench_t;
+
+static entbench_t   *entbench;
+
+// flags a Q2PRO client would get, see SV_EmitPacketEntities
+static msgEsFlags_t entbench_flags(mvd_t *mvd, int num)
+{
+    msgEsFlags_t flags = MSG_ES_UMASK | MSG_ES_LONGSOLID | MSG_ES_BEAMORIGIN;
+
+    if (num <= mvd->maxclients)
+        flags |= MSG_ES_NEWENTITY;
+    if (mvd->edicts[num].solid == SOLID_BSP)
+        flags |= MSG_ES_SHORTANGLES;
+
+    return flags;
+}
+
+static size_t entbench_write(mvd_t *mvd, bool packed)
+{
+    entbench_t *eb = entbench;
+    entity_packed_t *ent;
+    msgEsFlags_t flags;
+    int i;
+
+    SZ_Init(&msg_write, eb->buffer, sizeof(eb->buffer));
+
+    if (packed)
+        MSG_BeginPackedEntities();
+
+    for (i = 1; i < MAX_EDICTS; i++) {
+        if (!eb->curvalid[i] && !eb->oldvalid[i])
+            continue;
+
+        flags = entbench_flags(mvd, i);
+        ent = &eb->cur[i];
+
+        if (packed) {
+            if (!eb->curvalid[i])
+                MSG_WritePackedEntity(&eb->old[i], NULL, MSG_ES_FORCE, 1);
+            else if (!eb->oldvalid[i])
+                MSG_WritePackedEntity(NULL, ent, flags | MSG_ES_FORCE, 0);
+            else
+                MSG_WritePackedEntity(&eb->old[i], ent, flags, 1);
+        } else {
+            if (!eb->curvalid[i])
+                MSG_WriteDeltaEntity(&eb->old[i], NULL, MSG_ES_FORCE);
+            else if (!eb->oldvalid[i])
+                MSG_WriteDeltaEntity(NULL, ent, flags | MSG_ES_FORCE);
+            else
+                MSG_WriteDeltaEntity(&eb->old[i], ent, flags);
+        }
+    }
+
+    if (packed)
+        MSG_EndPackedEntities();
+    else
+        MSG_WriteShort(0);
+
+    return msg_write.cursize;
+}
+
+static void entbench_parse(mvd_t *mvd, int number, int bits, bool delta)
+{
+    entbench_t *eb = entbench;
+    entity_state_t *ent = &eb->decoded[number];
+
+    MSG_ParsePackedEntity(delta ? ent : NULL, ent, delta ? eb->velocities[number] : NULL,
+                          eb->velocities[number], number, bits,
+                          entbench_flags(mvd, number) | MSG_ES_BITPACKED, delta ? 1 : 0);
+    eb->decvalid[number] = true;
+}
+
+// decodes bit packed entities back and checks them against the source
+static void entbench_verify(mvd_t *mvd, size_t len)
+{
+    entbench_t *eb = entbench;
+    entity_packed_t a, b;
+    int i, num, bits, oldnum;
+    bool old[MAX_EDICTS];
+
+    SZ_Init(&msg_read, eb->buffer, sizeof(eb->buffer));
+    msg_read.cursize = len;
+
+    memcpy(old, eb->decvalid, sizeof(old));
+    for (oldnum = 1; oldnum < MAX_EDICTS && !old[oldnum]; oldnum++)
+        ;
+
+    MSG_BeginParsingPackedEntities();
+    while ((num = MSG_ParsePackedEntityBits(&bits)) > 0) {
+        while (oldnum < num) {
+            entbench_parse(mvd, oldnum, 0, true);
+            while (++oldnum < MAX_EDICTS && !old[oldnum])
+                ;
+        }
+
+        if (bits & U_REMOVE) {
+            eb->decvalid[num] = false;
+        } else {
+            entbench_parse(mvd, num, bits, oldnum == num);
+        }
+
+        if (oldnum == num) {
+            while (++oldnum < MAX_EDICTS && !old[oldnum])
+                ;
+        }
+    }
+
+    if (num < 0) {
+        eb->mismatches++;
+        memset(eb->decvalid, 0, sizeof(eb->decvalid));
+        return;
+    }
+
+    while (oldnum < MAX_EDICTS) {
+        entbench_parse(mvd, oldnum, 0, true);
+        while (++oldnum < MAX_EDICTS && !old[oldnum])
+            ;
+    }
+
+    for (i = 1; i < MAX_EDICTS; i++) {
+        if (eb->decvalid[i] != eb->curvalid[i]) {
+            eb->mismatches++;
+            continue;
+        }
+        if (!eb->curvalid[i])
+            continue;
+
+        // old_origin is not delta compressed the same way
+        a = eb->cur[i];
+        MSG_PackEntity(&b, &eb->decoded[i], entbench_flags(mvd, i) & MSG_ES_SHORTANGLES);
+        VectorClear(a.velocity);
+        VectorClear(a.old_origin);
+        VectorClear(b.old_origin);
+        if (memcmp(&a, &b, sizeof(a)))
+            eb->mismatches++;
+    }
+}
+
+// called after each MVD frame is parsed
+static void entbench_frame(mvd_t *mvd)
+{
+    entbench_t *eb = entbench;
+    sizebuf_t oldwrite, oldread;
+    edict_t *ent;
+    size_t len;
+    int i;
+
+    for (i = 1; i < MAX_EDICTS; i++) {
+        ent = &mvd->edicts[i];
+        eb->curvalid[i] = ent->inuse;
+        if (ent->inuse)
+            MSG_PackEntity(&eb->cur[i], &ent->s, ent->solid == SOLID_BSP);
+        eb->cur[i].number = i;
+    }
+
+    oldwrite = msg_write;
+    oldread = msg_read;
+
+    eb->standard += entbench_write(mvd, false);
+    len = entbench_write(mvd, true);
+    eb->packed += len;
+    entbench_verify(mvd, len);
+
+    msg_write = oldwrite;
+    msg_read = oldread;
+
+    memcpy(eb->old, eb->cur, sizeof(eb->old));
+    memcpy(eb->oldvalid, eb->curvalid, sizeof(eb->oldvalid));
+    eb->frames++;
+}
+
+// reads the rest of current map and encodes entities of each frame with
+// both regular and bit packed entity deltas, then seeks back
+static void MVD_EntBench_f(void)
+{
+    gtv_t *gtv;
+    mvd_t *mvd;
+    entbench_t *eb;
+    sizebuf_t oldmsg;
+    unsigned start, msec;
+    int framenum, ret;
+    bool gamestate;
+
+    mvd = MVD_SetChannel(1);
+    if (!mvd) {
+        return;
+    }
+
+    if (!demo_can_seek(mvd)) {
+        return;
+    }
+
+    gtv = mvd->gtv;
+    framenum = mvd->framenum;
+    entbench = eb = MVD_Mallocz(sizeof(*eb));
+
+    // may be called from rcon packet handler
+    oldmsg = msg_read;
+
+    if (setjmp(mvd_jmpbuf)) {
+        // channel is gone
+        msg_read = oldmsg;
+        Z_Free(eb);
+        entbench = NULL;
+        return;
+    }
+
+    mvd->parse_frame = entbench_frame;
+    mvd->demoseeking = true;
+
+    start = Sys_Milliseconds();
+    gamestate = false;
+    while (!gamestate) {
+        ret = demo_read_message(gtv->demoplayback);
+        if (ret <= 0)
+            break;
+        gamestate = MVD_ParseMessage(mvd);
+    }
+    msec = Sys_Milliseconds() - start;
+
+    mvd->demoseeking = false;
+    mvd->parse_frame = NULL;
+    entbench = NULL;
+
+    if (ret < 0) {
+        Com_EPrintf("[%s] Couldn't read %s: %s\n", mvd->name,
+                    gtv->demoentry->string, Q_ErrorString(ret));
+    } else if (eb->frames) {
+        Com_Printf("[%s] %u frames in %u msec\n", mvd->name, eb->frames, msec);
+        Com_Printf("regular: %.1f bytes/frame\n", (double)eb->standard / eb->frames);
+        Com_Printf("packed:  %.1f bytes/frame, %.1f%% saved\n",
+                   (double)eb->packed / eb->frames,
+                   eb->standard ? 100.0 - eb->packed * 100.0 / eb->standard : 0.0);
+        if (eb->mismatches)
+            Com_WPrintf("%u entities decoded differently\n", eb->mismatches);
+    }
+
+    Z_Free(eb);
+
+    // next map has started, nothing to go back to
+    if (!gamestate)
+        demo_seek(mvd, framenum, false);
+
+    msg_read = oldmsg;
+}
+
+// plays the rest of current map as fast as possible, with all the work
+// normally done for connected spectators, then seeks back
+static void MVD_TimeDemo_f(void)
+{
+    gtv_t *gtv;
+    mvd_t *mvd;
+    sizebuf_t oldmsg;
+    int framenum, ret;
+
+    mvd = MVD_SetChannel(1);
+    if (!mvd) {
+        return;
+    }
+
+    if (!demo_can_seek(mvd)) {
+        return;
+    }
+
+    gtv = mvd->gtv;
+    framenum = mvd->framenum;
+
+    // may be called from rcon packet handler
+    oldmsg = msg_read;
+
+    if (setjmp(mvd_jmpbuf)) {
+        // channel is gone
+        msg_read = oldmsg;
+        Bench_Stop();
+        return;
+    }
+
+    Bench_Start(gtv->demoentry->string);
+
+    while (1) {
+        BENCH_BEGIN(BENCH_FRAME);
+        ret = demo_load_message(gtv->demoplayback);
+        if (ret <= 0)
+            break;
+
+        // don't cause spectators to reconnect
+        if ((msg_read_buffer[0] & SVCMD_MASK) == mvd_serverdata)
+            break;
+
+        SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
+        msg_read.cursize = ret;
+
+        BENCH_BEGIN(BENCH_PARSE);
+        MVD_ParseMessage(mvd);
+        BENCH_END(BENCH_PARSE);
+
+        BENCH_END(BENCH_FRAME);
+        Bench_EndFrame();
+    }
+
+    if (ret < 0) {
+        Com_EPrintf("[%s] Couldn't read %s: %s\n", mvd->name,
+                    gtv->demoentry->string, Q_ErrorString(ret));
+    }
+
+    Bench_Stop();
+
+    demo_seek(mvd, framenum, false);
+
+    msg_read = oldmsg;
+}
+
 static void MVD_Control_f(void)
 {
     static const cmd_option_t options[] = {
@@ -2536,6 +2984,9 @@ static const cmdreg_t c_mvd[] = {
     { "mvdpause", MVD_Pause_f },
     { "mvdskip", MVD_Skip_f },
     { "mvdseek", MVD_Seek_f },
+    { "mvdindex", MVD_Index_f },
+    { "mvdentbench", MVD_EntBench_f },
+    { "mvdtimedemo", MVD_TimeDemo_f },
 
     { NULL }
 };
@@ -2569,6 +3020,7 @@ void MVD_Register(void)
     mvd_username = Cvar_Get("mvd_username", "unnamed", 0);
     mvd_password = Cvar_Get("mvd_password", "", CVAR_PRIVATE);
     mvd_snaps = Cvar_Get("mvd_snaps", "10", 0);
+    mvd_demoindex = Cvar_Get("mvd_demoindex", "1", 0);
 
     Cmd_Register(c_mvd);
 }
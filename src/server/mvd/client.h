@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "../server.h"
+#include "common/demoindex.h"
 #include <setjmp.h>
 
 #define MVD_Malloc(size)    Z_TagMalloc(size, TAG_MVD)
@@ -112,14 +113,6 @@ typedef enum {
     MVD_NUM_STATES
 } mvd_state_t;
 
-typedef struct {
-    list_t entry;
-    int framenum;
-    int64_t filepos;
-    size_t msglen;
-    byte data[1];
-} mvd_snap_t;
-
 struct gtv_s;
 
 // FIXME: entire struct is > 500 kB in size!
@@ -133,13 +126,14 @@ typedef struct mvd_s {
     struct gtv_s    *gtv;
     bool            (*read_frame)(struct mvd_s *);
     bool            (*forward_cmd)(mvd_client_t *);
+    void            (*parse_frame)(struct mvd_s *);
 
     // demo related variables
     qhandle_t   demorecording;
     char        *demoname;
     bool        demoseeking;
     int         last_snapshot;
-    list_t      snapshots;
+    demoindex_t snapshots;
 
     // delay buffer
     fifo_t      delay;
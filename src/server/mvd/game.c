@@ -733,6 +733,7 @@ void MVD_BroadcastPrintf(mvd_t *mvd, int level, int mask, const char *fmt, ...)
     MSG_WriteByte(level);
     MSG_WriteData(text, len + 1);
 
+    SV_BeginFanout();
     FOR_EACH_MVDCL(other, mvd) {
         cl = other->cl;
         if (cl->state < cs_spawned) {
@@ -744,8 +745,9 @@ void MVD_BroadcastPrintf(mvd_t *mvd, int level, int mask, const char *fmt, ...)
         if (other->uf & mask) {
             continue;
         }
-        SV_ClientAddMessage(cl, MSG_RELIABLE);
+        SV_ClientAddMessage(cl, MSG_RELIABLE | MSG_COMPRESS_AUTO);
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
@@ -1633,12 +1635,14 @@ void MVD_UpdateConfigstring(mvd_t *mvd, int index)
     MSG_WriteString(s);
 
     // broadcast configstring change
+    SV_BeginFanout();
     FOR_EACH_MVDCL(client, mvd) {
         if (client->cl->state < cs_primed) {
             continue;
         }
-        SV_ClientAddMessage(client->cl, MSG_RELIABLE);
+        SV_ClientAddMessage(client->cl, MSG_RELIABLE | MSG_COMPRESS_AUTO);
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
@@ -204,6 +204,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
         return;
 
     // send the data to all relevent clients
+    SV_BeginFanout();
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
         if (cl->state < cs_primed) {
@@ -226,8 +227,9 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
                 continue;
         }
 
-        cl->AddMessage(cl, data, length, reliable);
+        SV_ClientAddData(cl, data, length, reliable);
     }
+    SV_EndFanout();
 }
 
 static void MVD_UnicastSend(mvd_t *mvd, bool reliable, byte *data, size_t length, mvd_player_t *player)
@@ -237,6 +239,7 @@ static void MVD_UnicastSend(mvd_t *mvd, bool reliable, byte *data, size_t length
     client_t *cl;
 
     // send to all relevant clients
+    SV_BeginFanout();
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
         if (cl->state < cs_spawned) {
@@ -244,9 +247,10 @@ static void MVD_UnicastSend(mvd_t *mvd, bool reliable, byte *data, size_t length
         }
         target = client->target ? client->target : mvd->dummy;
         if (target == player) {
-            cl->AddMessage(cl, data, length, reliable);
+            SV_ClientAddData(cl, data, length, reliable);
         }
     }
+    SV_EndFanout();
 }
 
 static void MVD_UnicastLayout(mvd_t *mvd, mvd_player_t *player)
@@ -347,6 +351,7 @@ static void MVD_UnicastPrint(mvd_t *mvd, bool reliable, mvd_player_t *player)
     length = msg_read.readcount - readcount;
 
     // send to all relevant clients
+    SV_BeginFanout();
     FOR_EACH_MVDCL(client, mvd) {
         cl = client->cl;
         if (cl->state < cs_spawned) {
@@ -362,9 +367,10 @@ static void MVD_UnicastPrint(mvd_t *mvd, bool reliable, mvd_player_t *player)
         target = (mvd->flags & MVF_NOMSGS) ? mvd->dummy :
                  client->target ? client->target : mvd->dummy;
         if (target == player) {
-            cl->AddMessage(cl, data, length, reliable);
+            SV_ClientAddData(cl, data, length, reliable);
         }
     }
+    SV_EndFanout();
 }
 
 static void MVD_UnicastStuff(mvd_t *mvd, bool reliable, mvd_player_t *player)
@@ -828,10 +834,16 @@ static void MVD_ParseFrame(mvd_t *mvd)
     SHOWNET(1, "%3zu:frame:%u\n", msg_read.readcount - 1, mvd->framenum);
     MVD_PlayerToEntityStates(mvd);
 
+    if (mvd->parse_frame) {
+        mvd->parse_frame(mvd);
+    }
+
     // update clients now so that effects datagram that
     // follows can reference current view positions
     if (mvd->state && mvd->framenum && !mvd->demoseeking) {
+        BENCH_BEGIN(BENCH_CLIENTS);
         MVD_UpdateClients(mvd);
+        BENCH_END(BENCH_CLIENTS);
     }
 
     mvd->framenum++;
@@ -840,7 +852,6 @@ static void MVD_ParseFrame(mvd_t *mvd)
 void MVD_ClearState(mvd_t *mvd, bool full)
 {
     mvd_player_t *player;
-    mvd_snap_t *snap, *next;
     int i;
 
     // clear all entities, don't trust num_edicts as it is possible
@@ -860,12 +871,9 @@ void MVD_ClearState(mvd_t *mvd, bool full)
     if (!full)
         return;
 
-    // free all snapshots
-    LIST_FOR_EACH_SAFE(mvd_snap_t, snap, next, &mvd->snapshots, entry) {
-        Z_Free(snap);
-    }
-
-    List_Init(&mvd->snapshots);
+    // free all snapshots, saving them into the index sidecar first
+    DemoIndex_Save(&mvd->snapshots);
+    DemoIndex_Clear(&mvd->snapshots);
 
     // free current map
     CM_FreeMap(&mvd->cm);
@@ -171,13 +171,15 @@ void SV_BroadcastPrintf(int level, const char *fmt, ...)
     MSG_WriteByte(level);
     MSG_WriteData(string, len + 1);
 
+    SV_BeginFanout();
     FOR_EACH_CLIENT(client) {
         if (client->state != cs_spawned)
             continue;
         if (level < client->messagelevel)
             continue;
-        SV_ClientAddMessage(client, MSG_RELIABLE);
+        SV_ClientAddMessage(client, MSG_RELIABLE | MSG_COMPRESS_AUTO);
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
@@ -230,14 +232,166 @@ void SV_BroadcastCommand(const char *fmt, ...)
     MSG_WriteByte(svc_stufftext);
     MSG_WriteData(string, len + 1);
 
+    SV_BeginFanout();
     FOR_EACH_CLIENT(client) {
-        SV_ClientAddMessage(client, MSG_RELIABLE);
+        SV_ClientAddMessage(client, MSG_RELIABLE | MSG_COMPRESS_AUTO);
     }
+    SV_EndFanout();
 
     SZ_Clear(&msg_write);
 }
 
 
+/*
+===============================================================================
+
+CLIENT LEAF INDEX
+
+Leafs of client origins are cached and clients are bucketed by cluster, so
+that multicasts only visit clients standing in clusters set in the mask,
+instead of walking the BSP tree for each client. Cached leaf is updated
+once client origin changes, so results are always the same as if looked
+up directly.
+
+===============================================================================
+*/
+
+typedef struct {
+    list_t      entry;
+    mleaf_t     *leaf;      // NULL if not linked
+    vec3_t      origin;
+} leafclient_t;
+
+static struct {
+    bsp_t       *cache;
+    int         spawncount;
+    int         numclusters;
+    list_t      *buckets;   // [numclusters]
+    size_t      *occupied;  // [numclusters] bits
+    leafclient_t *clients;  // [maxclients]
+} leafindex;
+
+void SV_FreeClientLeafs(void)
+{
+    Z_Free(leafindex.buckets);
+    Z_Free(leafindex.occupied);
+    Z_Free(leafindex.clients);
+    memset(&leafindex, 0, sizeof(leafindex));
+}
+
+static void init_client_leafs(void)
+{
+    bsp_t *cache = sv.cm.cache;
+    int i, numclusters = 0;
+
+    SV_FreeClientLeafs();
+
+    for (i = 0; i < cache->numleafs; i++)
+        numclusters = max(numclusters, cache->leafs[i].cluster + 1);
+
+    leafindex.cache = cache;
+    leafindex.spawncount = sv.spawncount;
+    leafindex.numclusters = numclusters;
+    leafindex.buckets = SV_Malloc(sizeof(list_t) * max(numclusters, 1));
+    leafindex.occupied = SV_Mallocz(ALIGN(numclusters, 64) / 8);
+    leafindex.clients = SV_Mallocz(sizeof(leafclient_t) * sv_maxclients->integer);
+
+    for (i = 0; i < numclusters; i++)
+        List_Init(&leafindex.buckets[i]);
+}
+
+static void unlink_client_leaf(leafclient_t *lc)
+{
+    int cluster = lc->leaf->cluster;
+
+    if (cluster >= 0) {
+        List_Remove(&lc->entry);
+        if (LIST_EMPTY(&leafindex.buckets[cluster]))
+            Q_ClearBit((byte *)leafindex.occupied, cluster);
+    }
+    lc->leaf = NULL;
+}
+
+static void link_client_leaf(leafclient_t *lc, const vec3_t origin)
+{
+    int cluster;
+
+    VectorCopy(origin, lc->origin);
+    lc->leaf = CM_PointLeaf(&sv.cm, origin);
+
+    cluster = lc->leaf->cluster;
+    if (cluster >= 0) {
+        List_Append(&leafindex.buckets[cluster], &lc->entry);
+        Q_SetBit((byte *)leafindex.occupied, cluster);
+    }
+}
+
+static void update_client_leafs(void)
+{
+    client_t *client;
+    leafclient_t *lc;
+
+    if (leafindex.cache != sv.cm.cache || leafindex.spawncount != sv.spawncount)
+        init_client_leafs();
+
+    FOR_EACH_CLIENT(client) {
+        lc = &leafindex.clients[client - svs.client_pool];
+        if (client->state < cs_primed) {
+            if (lc->leaf)
+                unlink_client_leaf(lc);
+            continue;
+        }
+        if (lc->leaf) {
+            if (VectorCompare(lc->origin, client->edict->s.origin))
+                continue;
+            unlink_client_leaf(lc);
+        }
+        link_client_leaf(lc, client->edict->s.origin);
+    }
+}
+
+/*
+=================
+SV_ClientsInMask
+
+Finds clients standing in clusters set in mask and in areas connected to
+the given area. Returned list is sorted in client order.
+=================
+*/
+int SV_ClientsInMask(const byte *mask, int area, client_t **list)
+{
+    const size_t *bits = (const size_t *)mask;
+    int i, j, k, count, numwords;
+    leafclient_t *lc;
+    client_t *client;
+    size_t word;
+
+    update_client_leafs();
+
+    numwords = ALIGN(leafindex.numclusters, 64) / (sizeof(size_t) * 8);
+    count = 0;
+
+    for (i = 0; i < numwords; i++) {
+        word = bits[i] & leafindex.occupied[i];
+        if (!word)
+            continue;
+        for (j = 0; j < sizeof(size_t) * 8; j++) {
+            if (!(word & ((size_t)1 << j)))
+                continue;
+            LIST_FOR_EACH(leafclient_t, lc, &leafindex.buckets[i * sizeof(size_t) * 8 + j], entry) {
+                if (!CM_AreasConnected(&sv.cm, area, lc->leaf->area))
+                    continue;
+                client = svs.client_pool + (lc - leafindex.clients);
+                for (k = count++; k > 0 && list[k - 1] > client; k--)
+                    list[k] = list[k - 1];
+                list[k] = client;
+            }
+        }
+    }
+
+    return count;
+}
+
 /*
 =================
 SV_Multicast
@@ -254,11 +408,12 @@ MULTICAST_PHS    send to clients potentially hearable from org
 */
 void SV_Multicast(const vec3_t origin, multicast_t to)
 {
-    client_t    *client;
+    client_t    *client, *clients[MAX_CLIENTS];
     byte        mask[VIS_MAX_BYTES];
-    mleaf_t     *leaf1 = NULL, *leaf2;
+    mleaf_t     *leaf1 = NULL;
     int         leafnum q_unused = 0;
     int         flags = 0;
+    int         i, count;
 
     if (!sv.cm.cache) {
         Com_Error(ERR_DROP, "%s: no map loaded", __func__);
@@ -291,27 +446,30 @@ void SV_Multicast(const vec3_t origin, multicast_t to)
     }
 
     // send the data to all relevent clients
-    FOR_EACH_CLIENT(client) {
-        if (client->state < cs_primed) {
-            continue;
-        }
-        // do not send unreliables to connecting clients
-        if (!(flags & MSG_RELIABLE) && !CLIENT_ACTIVE(client)) {
-            continue;
-        }
-
-        if (leaf1) {
-            leaf2 = CM_PointLeaf(&sv.cm, client->edict->s.origin);
-            if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
+    flags |= MSG_COMPRESS_AUTO;
+    SV_BeginFanout();
+    if (leaf1) {
+        count = SV_ClientsInMask(mask, leaf1->area, clients);
+        for (i = 0; i < count; i++) {
+            // do not send unreliables to connecting clients
+            if (!(flags & MSG_RELIABLE) && !CLIENT_ACTIVE(clients[i])) {
                 continue;
-            if (leaf2->cluster == -1)
+            }
+            SV_ClientAddMessage(clients[i], flags);
+        }
+    } else {
+        FOR_EACH_CLIENT(client) {
+            if (client->state < cs_primed) {
                 continue;
-            if (!Q_IsBitSet(mask, leaf2->cluster))
+            }
+            // do not send unreliables to connecting clients
+            if (!(flags & MSG_RELIABLE) && !CLIENT_ACTIVE(client)) {
                 continue;
+            }
+            SV_ClientAddMessage(client, flags);
         }
-
-        SV_ClientAddMessage(client, flags);
     }
+    SV_EndFanout();
 
     // add to MVD datagram
     SV_MvdMulticast(leafnum, to);
@@ -320,6 +478,141 @@ void SV_Multicast(const vec3_t origin, multicast_t to)
     SZ_Clear(&msg_write);
 }
 
+/*
+===============================================================================
+
+MESSAGE FANOUT
+
+Messages larger than MSG_TRESHOLD are kept in reference counted blocks.
+Between SV_BeginFanout() and SV_EndFanout() payload added to many clients
+is copied into a block once and compressed at most once per distinct preset
+dictionary, all recipients then queue the very same blocks.
+
+===============================================================================
+*/
+
+#if USE_ZLIB
+typedef struct {
+    bool        dict;
+    byte        sum[16];
+    msgblock_t  *block;     // NULL if it didn't compress good enough
+} zcache_t;
+#endif
+
+static struct {
+    int         depth;
+    const byte  *data;      // payload cached blocks were made from
+    size_t      len;
+    msgblock_t  *raw;
+#if USE_ZLIB
+    zcache_t    zcache[MSG_MAXZCACHE];
+    int         numzcache;
+#endif
+} fanout;
+
+// block that data passed to client->AddMessage() belongs to
+static msgblock_t *msg_block;
+
+static msgblock_t *alloc_block(const byte *data, size_t len)
+{
+    msgblock_t *block = SV_Malloc(sizeof(*block) + len - 1);
+
+    block->refcount = 1;
+    block->cursize = len;
+    memcpy(block->data, data, len);
+
+    return block;
+}
+
+static void release_block(msgblock_t *block)
+{
+    Q_assert(block->refcount > 0);
+    if (!--block->refcount) {
+        Z_Free(block);
+    }
+}
+
+static void flush_fanout(void)
+{
+#if USE_ZLIB
+    int i;
+
+    for (i = 0; i < fanout.numzcache; i++) {
+        if (fanout.zcache[i].block) {
+            release_block(fanout.zcache[i].block);
+        }
+    }
+    fanout.numzcache = 0;
+#endif
+
+    if (fanout.raw) {
+        release_block(fanout.raw);
+        fanout.raw = NULL;
+    }
+
+    fanout.data = NULL;
+    fanout.len = 0;
+}
+
+// returns true if fanout is in progress, cached blocks are made from
+// this payload from now on
+static bool fanout_active(const byte *data, size_t len)
+{
+    if (!fanout.depth) {
+        return false;
+    }
+
+    if (fanout.data != data || fanout.len != len) {
+        flush_fanout();
+        fanout.data = data;
+        fanout.len = len;
+    }
+
+    return true;
+}
+
+void SV_BeginFanout(void)
+{
+    // nested fanout (dropping a client prints to everyone) invalidates
+    // anything outer one has cached, it is rebuilt on demand
+    flush_fanout();
+    fanout.depth++;
+}
+
+void SV_EndFanout(void)
+{
+    Q_assert(fanout.depth > 0);
+    flush_fanout();
+    fanout.depth--;
+}
+
+static void add_block(client_t *client, msgblock_t *block, bool reliable)
+{
+    msg_block = block;
+    client->AddMessage(client, block->data, block->cursize, reliable);
+    msg_block = NULL;
+}
+
+/*
+=======================
+SV_ClientAddData
+
+Adds uncompressed data to client's message list, shares the copy
+with other clients if fanout is in progress.
+=======================
+*/
+void SV_ClientAddData(client_t *client, byte *data, size_t len, bool reliable)
+{
+    if (len > MSG_TRESHOLD && fanout_active(data, len)) {
+        if (!fanout.raw) {
+            fanout.raw = alloc_block(data, len);
+        }
+        add_block(client, fanout.raw, reliable);
+    } else {
+        client->AddMessage(client, data, len, reliable);
+    }
+}
+
 #if USE_ZLIB
 static size_t max_compressed_len(client_t *client)
 {
@@ -349,18 +642,27 @@ static bool can_compress_message(client_t *client)
     return true;
 }
 
-static bool compress_message(client_t *client, int flags)
+// dictionary is used only once client has parsed the gamestate it was
+// built from, which is guaranteed after it has sent `begin'
+static bool use_zdict(client_t *client)
+{
+    return client->zdict && client->state == cs_spawned && sv_zdict->integer;
+}
+
+// returns svc_zpacket with contents of the write buffer,
+// or NULL if it didn't compress good enough
+static msgblock_t *deflate_message(const byte *dict, size_t dictlen)
 {
     byte    buffer[MAX_MSGLEN];
     int     ret, len;
 
-    if (!client->has_zlib)
-        return false;
+    if (dict)
+        deflateSetDictionary(&svs.z, dict, dictlen);
 
     svs.z.next_in = msg_write.data;
     svs.z.avail_in = msg_write.cursize;
     svs.z.next_out = buffer + ZPACKET_HEADER;
-    svs.z.avail_out = max_compressed_len(client);
+    svs.z.avail_out = MAX_MSGLEN - ZPACKET_HEADER;
 
     ret = deflate(&svs.z, Z_FINISH);
     len = svs.z.total_out;
@@ -369,12 +671,12 @@ static bool compress_message(client_t *client, int flags)
     deflateReset(&svs.z);
 
     if (ret != Z_STREAM_END) {
-        Com_WPrintf("Error %d compressing %zu bytes message for %s\n",
-                    ret, msg_write.cursize, client->name);
-        return false;
+        Com_WPrintf("Error %d compressing %zu bytes message\n",
+                    ret, msg_write.cursize);
+        return NULL;
     }
 
-    buffer[0] = svc_zpacket;
+    buffer[0] = svc_zpacket | (dict ? ZPACKET_DICT : 0);
     buffer[1] = len & 255;
     buffer[2] = (len >> 8) & 255;
     buffer[3] = msg_write.cursize & 255;
@@ -382,15 +684,81 @@ static bool compress_message(client_t *client, int flags)
 
     len += ZPACKET_HEADER;
 
-    SV_DPrintf(0, "%s: comp: %zu into %d\n",
-               client->name, msg_write.cursize, len);
-
     // did it compress good enough?
     if (len >= msg_write.cursize)
+        return NULL;
+
+    return alloc_block(buffer, len);
+}
+
+// finds compressed version of fanned out message for this client,
+// compressing it on first use. returns NULL if cache is full.
+static zcache_t *find_zcache(client_t *client, bool dict)
+{
+    zcache_t *z;
+    int i;
+
+    for (i = 0, z = fanout.zcache; i < fanout.numzcache; i++, z++) {
+        if (z->dict != dict)
+            continue;
+        if (dict && memcmp(z->sum, client->zdict_sum, sizeof(z->sum)))
+            continue;
+        return z;
+    }
+
+    if (fanout.numzcache == MSG_MAXZCACHE)
+        return NULL;
+
+    z = &fanout.zcache[fanout.numzcache++];
+    z->dict = dict;
+    if (dict)
+        memcpy(z->sum, client->zdict_sum, sizeof(z->sum));
+    z->block = deflate_message(dict ? client->zdict : NULL, client->zdict_len);
+    return z;
+}
+
+static bool compress_message(client_t *client, int flags)
+{
+    msgblock_t  *block;
+    zcache_t    *z = NULL;
+    bool        dict, ret = false;
+
+    if (!client->has_zlib)
         return false;
 
-    client->AddMessage(client, buffer, len, flags & MSG_RELIABLE);
-    return true;
+    dict = use_zdict(client);
+
+    if (fanout_active(msg_write.data, msg_write.cursize))
+        z = find_zcache(client, dict);
+
+    if (z)
+        block = z->block;
+    else
+        block = deflate_message(dict ? client->zdict : NULL, client->zdict_len);
+
+    if (!block)
+        return false;
+
+    SV_DPrintf(0, "%s: comp: %zu into %u\n",
+               client->name, msg_write.cursize, block->cursize);
+
+    if (block->cursize - ZPACKET_HEADER > max_compressed_len(client)) {
+        Com_WPrintf("Compressed %zu bytes message doesn't fit for %s\n",
+                    msg_write.cursize, client->name);
+    } else {
+        client->zpackets++;
+        client->zpackets_dict += dict;
+        client->zbytes_in += msg_write.cursize;
+        client->zbytes_out += block->cursize;
+
+        add_block(client, block, flags & MSG_RELIABLE);
+        ret = true;
+    }
+
+    if (!z)
+        release_block(block);
+
+    return ret;
 }
 #else
 #define can_compress_message(client)    false
@@ -420,7 +788,7 @@ void SV_ClientAddMessage(client_t *client, int flags)
     }
 
     if (!(flags & MSG_COMPRESS) || !compress_message(client, flags)) {
-        client->AddMessage(client, msg_write.data, msg_write.cursize, flags & MSG_RELIABLE);
+        SV_ClientAddData(client, msg_write.data, msg_write.cursize, flags & MSG_RELIABLE);
     }
 
     if (flags & MSG_CLEAR) {
@@ -436,6 +804,11 @@ FRAME UPDATES - COMMON
 ===============================================================================
 */
 
+// zone allocator and block reference counts are not thread safe, so worker
+// threads building frames in parallel collect dynamic messages here and
+// release them later
+static q_thread_local list_t *msg_garbage;
+
 static inline void free_msg_packet(client_t *client, message_packet_t *msg)
 {
     List_Remove(&msg->entry);
@@ -443,7 +816,12 @@ static inline void free_msg_packet(client_t *client, message_packet_t *msg)
     if (msg->cursize > MSG_TRESHOLD) {
         Q_assert(msg->cursize <= client->msg_dynamic_bytes);
         client->msg_dynamic_bytes -= msg->cursize;
-        Z_Free(msg);
+        if (msg_garbage) {
+            List_Append(msg_garbage, &msg->entry);
+        } else {
+            release_block(msg->block);
+            Z_Free(msg);
+        }
     } else {
         List_Insert(&client->msg_free_list, &msg->entry);
     }
@@ -454,6 +832,11 @@ static inline void free_msg_packet(client_t *client, message_packet_t *msg)
 #define MSG_FIRST(list) \
     LIST_FIRST(message_packet_t, list, entry)
 
+static inline byte *msg_data(message_packet_t *msg)
+{
+    return msg->cursize > MSG_TRESHOLD ? msg->block->data : msg->data;
+}
+
 static void free_all_messages(client_t *client)
 {
     message_packet_t *msg, *next;
@@ -487,7 +870,14 @@ static void add_msg_packet(client_t     *client,
                         __func__, client->name);
             goto overflowed;
         }
-        msg = SV_Malloc(sizeof(*msg) + len - MSG_TRESHOLD);
+        msg = SV_Malloc(sizeof(*msg));
+        if (msg_block) {
+            Q_assert(data == msg_block->data);
+            msg_block->refcount++;
+            msg->block = msg_block;
+        } else {
+            msg->block = alloc_block(data, len);
+        }
         client->msg_dynamic_bytes += len;
     } else {
         if (LIST_EMPTY(&client->msg_free_list)) {
@@ -497,9 +887,9 @@ static void add_msg_packet(client_t     *client,
         }
         msg = MSG_FIRST(&client->msg_free_list);
         List_Remove(&msg->entry);
+        memcpy(msg->data, data, len);
     }
 
-    memcpy(msg->data, data, len);
     msg->cursize = (uint16_t)len;
 
     if (reliable) {
@@ -586,7 +976,7 @@ static inline void write_msg(client_t *client, message_packet_t *msg, size_t max
 {
     // if this msg fits, write it
     if (msg_write.cursize + msg->cursize <= maxsize) {
-        MSG_WriteData(msg->data, msg->cursize);
+        MSG_WriteData(msg_data(msg), msg->cursize);
     }
     free_msg_packet(client, msg);
 }
@@ -654,7 +1044,7 @@ static void write_reliables_old(client_t *client, size_t maxsize)
         SV_DPrintf(1, "%s to %s: writing msg %d: %d bytes\n",
                    __func__, client->name, count, msg->cursize);
 
-        SZ_Write(&client->netchan->message, msg->data, msg->cursize);
+        SZ_Write(&client->netchan->message, msg_data(msg), msg->cursize);
         free_msg_packet(client, msg);
         count++;
     }
@@ -664,6 +1054,7 @@ static void write_reliables_old(client_t *client, size_t maxsize)
 static void repack_unreliables(client_t *client, size_t maxsize)
 {
     message_packet_t *msg, *next;
+    byte *data;
 
     if (msg_write.cursize + 4 > maxsize) {
         return;
@@ -671,13 +1062,14 @@ static void repack_unreliables(client_t *client, size_t maxsize)
 
     // temp entities first
     FOR_EACH_MSG_SAFE(&client->msg_unreliable_list) {
-        if (!msg->cursize || msg->data[0] != svc_temp_entity) {
+        if (!msg->cursize || msg_data(msg)[0] != svc_temp_entity) {
             continue;
         }
         // ignore some low-priority effects, these checks come from r1q2
-        if (msg->data[1] == TE_BLOOD || msg->data[1] == TE_SPLASH ||
-            msg->data[1] == TE_GUNSHOT || msg->data[1] == TE_BULLET_SPARKS ||
-            msg->data[1] == TE_SHOTGUN) {
+        data = msg_data(msg);
+        if (data[1] == TE_BLOOD || data[1] == TE_SPLASH ||
+            data[1] == TE_GUNSHOT || data[1] == TE_BULLET_SPARKS ||
+            data[1] == TE_SHOTGUN) {
             continue;
         }
         write_msg(client, msg, maxsize);
@@ -700,7 +1092,7 @@ static void repack_unreliables(client_t *client, size_t maxsize)
 
     // then positioned sounds
     FOR_EACH_MSG_SAFE(&client->msg_unreliable_list) {
-        if (msg->cursize && msg->data[0] == svc_sound) {
+        if (msg->cursize && msg_data(msg)[0] == svc_sound) {
             write_msg(client, msg, maxsize);
         }
     }
@@ -720,7 +1112,7 @@ static void repack_unreliables(client_t *client, size_t maxsize)
 static void write_datagram_old(client_t *client)
 {
     message_packet_t *msg;
-    size_t maxsize, cursize;
+    size_t maxsize;
 
     // determine how much space is left for unreliable data
     maxsize = client->netchan->maxpacketlen;
@@ -758,18 +1150,6 @@ static void write_datagram_old(client_t *client)
 
     // write at least one reliable message
     write_reliables_old(client, client->netchan->maxpacketlen - msg_write.cursize);
-
-    // send the datagram
-    cursize = client->netchan->Transmit(client->netchan,
-                                        msg_write.cursize,
-                                        msg_write.data,
-                                        client->numpackets);
-
-    // record the size for rate estimation
-    SV_CalcSendTime(client, cursize);
-
-    // clear the write buffer
-    SZ_Clear(&msg_write);
 }
 
 /*
@@ -794,8 +1174,6 @@ static void add_message_new(client_t *client, byte *data,
 
 static void write_datagram_new(client_t *client)
 {
-    size_t cursize;
-
     // send over all the relevant entity_state_t
     // and the player_state_t
     client->WriteFrame(client);
@@ -828,6 +1206,21 @@ static void write_datagram_new(client_t *client)
         }
     }
 #endif
+}
+
+
+/*
+===============================================================================
+
+COMMON STUFF
+
+===============================================================================
+*/
+
+// transmits the datagram written by client->WriteDatagram
+static void send_datagram(client_t *client)
+{
+    size_t cursize;
 
     // send the datagram
     cursize = client->netchan->Transmit(client->netchan,
@@ -842,15 +1235,6 @@ static void write_datagram_new(client_t *client)
     SZ_Clear(&msg_write);
 }
 
-
-/*
-===============================================================================
-
-COMMON STUFF
-
-===============================================================================
-*/
-
 static void finish_frame(client_t *client)
 {
     message_packet_t *msg, *next;
@@ -876,6 +1260,162 @@ static void check_key_sync(client_t *client)
 }
 #endif
 
+/*
+===============================================================================
+
+PARALLEL FRAME UPDATES
+
+Frames are built and written by worker threads, one client per job. Entity
+states are first collected into private scratch buffer, then space in
+svs.entities is reserved right after the previous client, which keeps the
+layout and thus the output identical to serial path. Datagrams are written
+into private buffers in place of shared msg_write and transmitted in the
+original client order.
+
+===============================================================================
+*/
+
+#define JOB_PENDING     0
+#define JOB_RESERVED    1   // svs.entities space reserved
+#define JOB_SENT        2   // datagram transmitted
+
+typedef struct frame_job_s {
+    client_t    *client;
+    unsigned    next_entity;    // valid once JOB_RESERVED
+    int         state;
+    list_t      garbage;
+} frame_job_t;
+
+typedef struct frame_scratch_s {
+    entity_packed_t entities[MAX_PACKET_ENTITIES];
+    byte            buffer[MAX_MSGLEN];
+} frame_scratch_t;
+
+static void wait_for_job(frame_job_t *job, int state)
+{
+    while (q_atomic_load(&job->state) < state)
+        ;
+}
+
+static void build_frame_job(void *arg, int index, int slot)
+{
+    frame_job_t     *job = &svs.frame_jobs[index];
+    frame_scratch_t *scratch = svs.frame_scratch[slot];
+    client_t        *client = job->client;
+    message_packet_t *msg, *next;
+    unsigned        first_entity;
+    bool            built;
+
+    // decide which entities are visible
+    built = SV_BuildClientFrameScratch(client, scratch->entities);
+
+    // reserve space in svs.entities after the previous client
+    if (index) {
+        wait_for_job(job - 1, JOB_RESERVED);
+        first_entity = job[-1].next_entity;
+    } else {
+        first_entity = svs.next_entity;
+    }
+    job->next_entity = first_entity;
+    if (built)
+        job->next_entity += client->frames[client->framenum & UPDATE_MASK].num_entities;
+    q_atomic_store(&job->state, JOB_RESERVED);
+
+    if (built)
+        SV_CommitClientFrame(client, scratch->entities, first_entity);
+
+    // write the datagram into private buffer
+    SZ_TagInit(&msg_write, scratch->buffer, MAX_MSGLEN, SZ_MSG_WRITE);
+    msg_garbage = &job->garbage;
+    client->WriteDatagram(client);
+    msg_garbage = NULL;
+
+    // transmit in the same order serial path would
+    if (index)
+        wait_for_job(job - 1, JOB_SENT);
+
+    send_datagram(client);
+
+    // jobs get here one at a time, in client order
+    FOR_EACH_MSG_SAFE(&job->garbage) {
+        release_block(msg->block);
+        Z_Free(msg);
+    }
+
+    // advance for next frame
+    client->framenum++;
+
+    // clear all unreliable messages still left
+    finish_frame(client);
+
+    q_atomic_store(&job->state, JOB_SENT);
+}
+
+// returns number of threads to build frames with, or 0 if this frame
+// can't be built in parallel with output identical to serial path
+static int parallel_threads(void)
+{
+    client_t        *client;
+    client_frame_t  *frame;
+    unsigned        next_entity;
+    int             count = 0;
+
+    if (sv_threads->integer < 1)
+        return 0;
+
+    FOR_EACH_CLIENT(client) {
+        if (!CLIENT_ACTIVE(client) || !SV_CLIENTSYNC(client))
+            continue;
+        // dropping a client changes the frames of clients following it
+        if (client->netchan->message.overflowed)
+            return 0;
+        count++;
+    }
+
+    if (count < 2)
+        return 0;
+
+    // clients reserve space in svs.entities concurrently with other clients
+    // delta compressing from their old frames, these must not be overwritten
+    next_entity = svs.next_entity + count * MAX_PACKET_ENTITIES;
+    FOR_EACH_CLIENT(client) {
+        if (!CLIENT_ACTIVE(client) || !SV_CLIENTSYNC(client))
+            continue;
+        if (client->lastframe <= 0 || client->framenum - client->lastframe >= UPDATE_BACKUP)
+            continue;
+        frame = &client->frames[client->lastframe & UPDATE_MASK];
+        if (frame->number != client->lastframe)
+            continue;
+        if (svs.next_entity - frame->first_entity > svs.num_entities)
+            continue;
+        if (next_entity - frame->first_entity > svs.num_entities)
+            return 0;
+    }
+
+    return min(sv_threads->integer, MAX_WORKER_THREADS);
+}
+
+static void build_frames_parallel(int threads, int count)
+{
+    int i;
+
+    threads = min(threads, count);
+    for (i = 0; i < threads; i++) {
+        if (!svs.frame_scratch[i]) {
+            svs.frame_scratch[i] = SV_Malloc(sizeof(frame_scratch_t));
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        svs.frame_jobs[i].state = JOB_PENDING;
+        List_Init(&svs.frame_jobs[i].garbage);
+    }
+
+    Sys_ParallelFor(threads, count, build_frame_job, NULL);
+
+    svs.next_entity = svs.frame_jobs[count - 1].next_entity;
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -888,6 +1428,21 @@ void SV_SendClientMessages(void)
 {
     client_t    *client;
     size_t      cursize;
+    int         threads, count;
+
+    PROF_BEGIN("SV_SendClientMessages");
+
+    SV_PrepareVisCache();
+
+    // send all datagrams of this frame together
+    NET_BatchPackets(NS_SERVER, true);
+
+    threads = parallel_threads();
+    if (threads && !svs.frame_jobs) {
+        svs.frame_jobs = SV_Malloc(sizeof(frame_job_t) * sv_maxclients->integer);
+    }
+
+    count = 0;
 
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
@@ -907,6 +1462,7 @@ void SV_SendClientMessages(void)
         if (client->netchan->message.overflowed) {
             SZ_Clear(&client->netchan->message);
             SV_DropClient(client, "reliable message overflowed");
+            SV_PrepareVisCache();   // game code may have moved things
             goto finish;
         }
 
@@ -922,9 +1478,16 @@ void SV_SendClientMessages(void)
             goto advance;
         }
 
+        // leave it to worker threads
+        if (threads) {
+            svs.frame_jobs[count++].client = client;
+            continue;
+        }
+
         // build the new frame and write it
         SV_BuildClientFrame(client);
         client->WriteDatagram(client);
+        send_datagram(client);
 
 advance:
         // advance for next frame
@@ -934,6 +1497,14 @@ finish:
         // clear all unreliable messages still left
         finish_frame(client);
     }
+
+    if (count) {
+        build_frames_parallel(threads, count);
+    }
+
+    NET_BatchPackets(NS_SERVER, false);
+
+    PROF_END();
 }
 
 static void write_pending_download(client_t *client)
@@ -1068,3 +1639,242 @@ void SV_ShutdownClientSend(client_t *client)
     List_Init(&client->msg_free_list);
 }
 
+
+#if USE_ZLIB && (USE_CLIENT || USE_MVD_CLIENT)
+
+/*
+===============================================================================
+
+COMPRESSION BENCHMARK
+
+===============================================================================
+*/
+
+typedef struct {
+    z_stream    z;
+    byte        *buffer;
+    byte        out[MAX_MSGLEN];
+    byte        dict[ZDICT_SIZE];
+    size_t      dict_len;
+    unsigned    count;
+    uint64_t    raw, plain, dict_total;
+} zbench_t;
+
+static int zbench_read(zbench_t *zb, qhandle_t f)
+{
+    uint32_t msglen;
+    int read;
+
+    read = FS_Read(&msglen, 4, f);
+    if (read != 4)
+        return read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
+
+    if (msglen == (uint32_t)-1)
+        return 0;
+
+    msglen = LittleLong(msglen);
+    if (msglen > MAX_MSGLEN)
+        return Q_ERR_INVALID_FORMAT;
+
+    read = FS_Read(zb->buffer, msglen, f);
+    if (read != msglen)
+        return read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
+
+    SZ_Init(&msg_read, zb->buffer, MAX_MSGLEN);
+    msg_read.cursize = msglen;
+    return 1;
+}
+
+// collects configstrings and baselines from client demo startup packets
+// in svc_gamestate layout. returns 1 once `precache' command is seen.
+static int zbench_parse_startup(sizebuf_t *strings, sizebuf_t *bases)
+{
+    char string[MAX_QPATH];
+    entity_state_t es;
+    size_t start;
+    int cmd, num, bits;
+
+    while (msg_read.readcount < msg_read.cursize) {
+        cmd = MSG_ReadByte();
+        start = msg_read.readcount;
+
+        switch (cmd) {
+        case svc_serverdata:
+            if (MSG_ReadLong() != PROTOCOL_VERSION_DEFAULT)
+                return Q_ERR_UNKNOWN_FORMAT;
+            MSG_ReadLong();
+            MSG_ReadByte();
+            MSG_ReadString(NULL, 0);
+            MSG_ReadShort();
+            MSG_ReadString(NULL, 0);
+            break;
+        case svc_configstring:
+            MSG_ReadShort();
+            MSG_ReadString(NULL, 0);
+            SZ_Write(strings, msg_read.data + start, msg_read.readcount - start);
+            break;
+        case svc_spawnbaseline:
+            num = MSG_ParseEntityBits(&bits);
+            if (num < 1 || num >= MAX_EDICTS)
+                return Q_ERR_INVALID_FORMAT;
+            MSG_ParseDeltaEntity(NULL, &es, num, bits, 0);
+            SZ_Write(bases, msg_read.data + start, msg_read.readcount - start);
+            break;
+        case svc_stufftext:
+            MSG_ReadString(string, sizeof(string));
+            if (!strcmp(string, "precache\n"))
+                return 1;
+            break;
+        default:
+            return Q_ERR_INVALID_FORMAT;
+        }
+    }
+
+    if (msg_read.readcount > msg_read.cursize || strings->overflowed || bases->overflowed)
+        return Q_ERR_INVALID_FORMAT;
+
+    return 0;
+}
+
+static size_t zbench_deflate(zbench_t *zb, bool dict)
+{
+    size_t len;
+    int ret;
+
+    if (dict)
+        deflateSetDictionary(&zb->z, zb->dict, zb->dict_len);
+
+    zb->z.next_in = msg_read.data;
+    zb->z.avail_in = msg_read.cursize;
+    zb->z.next_out = zb->out;
+    zb->z.avail_out = sizeof(zb->out);
+
+    ret = deflate(&zb->z, Z_FINISH);
+    len = zb->z.total_out + ZPACKET_HEADER;
+    deflateReset(&zb->z);
+
+    // server would send it uncompressed
+    if (ret != Z_STREAM_END || len >= msg_read.cursize)
+        return msg_read.cursize;
+
+    return len;
+}
+
+static int zbench_run(zbench_t *zb, qhandle_t f, size_t minlen)
+{
+    sizebuf_t strings, bases;
+    int ret;
+
+    SZ_Init(&strings, Z_Malloc(MAX_CONFIGSTRINGS * (MAX_QPATH + 4)),
+            MAX_CONFIGSTRINGS * (MAX_QPATH + 4));
+    SZ_Init(&bases, Z_Malloc(MAX_EDICTS * 64), MAX_EDICTS * 64);
+    strings.allowoverflow = bases.allowoverflow = true;
+
+    // build dictionary from startup packets
+    do {
+        ret = zbench_read(zb, f);
+        if (ret == 0)
+            ret = Q_ERR_UNEXPECTED_EOF;
+        if (ret > 0)
+            ret = zbench_parse_startup(&strings, &bases);
+    } while (ret == 0);
+
+    if (ret > 0) {
+        SZ_WriteShort(&strings, MAX_CONFIGSTRINGS);
+        SZ_WriteShort(&bases, 0);
+        zb->dict_len = MSG_BuildZDictionary(zb->dict, strings.data, strings.cursize,
+                                            bases.data, bases.cursize);
+    }
+
+    Z_Free(strings.data);
+    Z_Free(bases.data);
+
+    if (ret < 0)
+        return ret;
+
+    // compress the rest of demo messages
+    while ((ret = zbench_read(zb, f)) > 0) {
+        zb->raw += msg_read.cursize;
+        zb->count++;
+
+        if (msg_read.cursize < minlen) {
+            zb->plain += msg_read.cursize;
+            zb->dict_total += msg_read.cursize;
+            continue;
+        }
+
+        zb->plain += zbench_deflate(zb, false);
+        zb->dict_total += zbench_deflate(zb, true);
+    }
+
+    return ret;
+}
+
+/*
+==================
+SV_ZBench_f
+
+Compresses messages of a client demo the way svc_zpackets are compressed,
+with and without preset dictionary built from the demo gamestate, and
+reports bandwidth saved.
+==================
+*/
+void SV_ZBench_f(void)
+{
+    char        name[MAX_OSPATH];
+    zbench_t    *zb;
+    sizebuf_t   oldmsg;
+    qhandle_t   f;
+    size_t      minlen;
+    unsigned    start, msec;
+    int         ret;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <demo> [minlen]\n", Cmd_Argv(0));
+        return;
+    }
+
+    minlen = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 0;
+
+    f = FS_EasyOpenFile(name, sizeof(name), FS_MODE_READ | FS_FLAG_GZIP,
+                        "demos/", Cmd_Argv(1), ".dm2");
+    if (!f)
+        return;
+
+    zb = Z_Mallocz(sizeof(*zb));
+    zb->buffer = Z_Malloc(MAX_MSGLEN);
+    zb->z.zalloc = SV_zalloc;
+    zb->z.zfree = SV_zfree;
+    Q_assert(deflateInit2(&zb->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+             -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) == Z_OK);
+
+    // may be called from rcon packet handler
+    oldmsg = msg_read;
+
+    start = Sys_Milliseconds();
+    ret = zbench_run(zb, f, minlen);
+    msec = Sys_Milliseconds() - start;
+
+    msg_read = oldmsg;
+
+    deflateEnd(&zb->z);
+    FS_CloseFile(f);
+
+    if (ret < 0) {
+        Com_Printf("Couldn't read %s: %s\n", name, Q_ErrorString(ret));
+    } else if (!zb->raw) {
+        Com_Printf("No messages in %s\n", name);
+    } else {
+        Com_Printf("%u messages, %"PRIu64" bytes, %zu bytes dictionary, %u msec\n",
+                   zb->count, zb->raw, zb->dict_len, msec);
+        Com_Printf("deflate:    %"PRIu64" bytes (%.1f%% saved)\n", zb->plain,
+                   100.0 - zb->plain * 100.0 / zb->raw);
+        Com_Printf("dictionary: %"PRIu64" bytes (%.1f%% saved)\n", zb->dict_total,
+                   100.0 - zb->dict_total * 100.0 / zb->raw);
+    }
+
+    Z_Free(zb->buffer);
+    Z_Free(zb);
+}
+
+#endif // USE_ZLIB && (USE_CLIENT || USE_MVD_CLIENT)
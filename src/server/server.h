@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/list.h"
 #include "shared/game.h"
 
+#include "common/bench.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
@@ -32,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/net.h"
 #include "common/net/chan.h"
 #include "common/pmove.h"
+#include "common/prof.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/zone.h"
@@ -88,7 +90,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SV_FEATURES (GMF_CLIENTNUM | GMF_PROPERINUSE | GMF_MVDSPEC | \
                      GMF_WANT_ALL_DISCONNECTS | GMF_ENHANCED_SAVEGAMES | \
                      SV_GMF_VARIABLE_FPS | GMF_EXTRA_USERINFO | \
-                     GMF_IPV6_ADDRESS_AWARE)
+                     GMF_IPV6_ADDRESS_AWARE | GMF_TRACE_MANY)
 
 // ugly hack for SV_Shutdown
 #define MVD_SPAWN_DISABLED  0
@@ -208,6 +210,7 @@ typedef enum {
 
 #define MSG_POOLSIZE        1024
 #define MSG_TRESHOLD        (62 - sizeof(list_t))   // keep message_packet_t 64 bytes aligned
+#define MSG_MAXZCACHE       4   // distinct compressed versions kept per fanout
 
 #define MSG_RELIABLE        1
 #define MSG_CLEAR           2
@@ -218,11 +221,20 @@ typedef enum {
 
 #define MAX_SOUND_PACKET   14
 
+// immutable payload of messages larger than MSG_TRESHOLD, shared by
+// all clients the same message was fanned out to
+typedef struct {
+    unsigned            refcount;
+    unsigned            cursize;
+    uint8_t             data[1];
+} msgblock_t;
+
 typedef struct {
     list_t              entry;
     uint16_t            cursize;    // zero means sound packet
     union {
         uint8_t         data[MSG_TRESHOLD];
+        msgblock_t      *block;     // cursize > MSG_TRESHOLD
         struct {
             uint8_t     flags;
             uint8_t     index;
@@ -352,6 +364,17 @@ typedef struct client_s {
     // per-client baseline chunks
     entity_packed_t *baselines[SV_BASELINES_CHUNKS];
 
+#if USE_ZLIB
+    // preset dictionary built from the last gamestate
+    byte            *zdict;
+    size_t          zdict_len;
+    byte            zdict_sum[16];  // identifies dictionary contents
+
+    // compression statistics
+    unsigned        zpackets, zpackets_dict;
+    uint64_t        zbytes_in, zbytes_out;
+#endif
+
     // server state pointers (hack for MVD channels implementation)
     char            *configstrings;
     char            *gamedir, *mapname;
@@ -474,6 +497,9 @@ typedef struct server_static_s {
     unsigned        next_entity;    // next state to use
     entity_packed_t *entities;      // [num_entities]
 
+    struct frame_job_s      *frame_jobs;    // [maxclients]
+    struct frame_scratch_s  *frame_scratch[MAX_WORKER_THREADS];
+
 #if USE_ZLIB
     z_stream        z;  // for compressing messages at once
 #endif
@@ -540,6 +566,13 @@ extern cvar_t       *sv_allow_map;
 extern cvar_t       *sv_recycle;
 #endif
 extern cvar_t       *sv_enhanced_setplayer;
+extern cvar_t       *sv_cull_nonvisible_entities;
+extern cvar_t       *sv_threads;
+extern cvar_t       *sv_viscache;
+extern cvar_t       *sv_vismatrix;
+extern cvar_t       *sv_area_depth;
+extern cvar_t       *sv_zdict;
+extern cvar_t       *sv_packed_entities;
 
 extern cvar_t       *sv_status_limit;
 extern cvar_t       *sv_status_show;
@@ -584,6 +617,10 @@ addrmatch_t *SV_MatchAddress(list_t *list, netadr_t *address);
 
 int SV_CountClients(void);
 
+void SV_FrameStats_f(void);
+void SV_SlowFrames_f(void);
+void SV_FrameStatus(void);
+
 #if USE_ZLIB
 voidpf SV_zalloc(voidpf opaque, uInt items, uInt size);
 void SV_zfree(voidpf opaque, voidpf address);
@@ -619,13 +656,21 @@ void SV_FlushRedirect(int redirected, char *outputbuf, size_t len);
 void SV_SendClientMessages(void);
 void SV_SendAsyncPackets(void);
 
+int SV_ClientsInMask(const byte *mask, int area, client_t **list);
+void SV_FreeClientLeafs(void);
 void SV_Multicast(const vec3_t origin, multicast_t to);
 void SV_ClientPrintf(client_t *cl, int level, const char *fmt, ...) q_printf(3, 4);
 void SV_BroadcastPrintf(int level, const char *fmt, ...) q_printf(2, 3);
 void SV_ClientCommand(client_t *cl, const char *fmt, ...) q_printf(2, 3);
 void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
+void SV_ClientAddData(client_t *client, byte *data, size_t len, bool reliable);
+void SV_BeginFanout(void);
+void SV_EndFanout(void);
 void SV_ShutdownClientSend(client_t *client);
+#if USE_ZLIB && (USE_CLIENT || USE_MVD_CLIENT)
+void SV_ZBench_f(void);
+#endif
 void SV_InitClientSend(client_t *newcl);
 
 //
@@ -744,7 +789,13 @@ void SV_PrintMiscInfo(void);
 #define ES_INUSE(s) \
     ((s)->modelindex || (s)->effects || (s)->sound || (s)->event)
 
+void SV_PrepareVisCache(void);
+void SV_FreeVisCache(void);
+void SV_VisCache_f(void);
 void SV_BuildClientFrame(client_t *client);
+bool SV_BuildClientFrameScratch(client_t *client, entity_packed_t *scratch);
+void SV_CommitClientFrame(client_t *client, const entity_packed_t *scratch,
+                          unsigned first_entity);
 void SV_WriteFrameToClient_Default(client_t *client);
 void SV_WriteFrameToClient_Enhanced(client_t *client);
 
@@ -775,6 +826,8 @@ int SV_NoSaveGames(void);
 //
 
 void SV_ClearWorld(void);
+void SV_FreeWorld(void);
+void SV_AreaBench_f(void);
 // called after the world model has been loaded, before linking any entities
 
 void PF_UnlinkEdict(edict_t *ent);
@@ -819,3 +872,8 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceMany(tracebatch_t *batch, int count);
+// same as SV_Trace for each ray, nearby rays share area queries
+
+void SV_TraceBench_f(void);
+
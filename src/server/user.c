@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // sv_user.c -- server code for moving users
 
 #include "server.h"
+#include "common/mdfour.h"
 
 #define MSG_GAMESTATE   (MSG_RELIABLE | MSG_CLEAR | MSG_COMPRESS)
 
@@ -169,14 +170,43 @@ static void write_baselines(void)
     SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
 }
 
+#if USE_ZLIB
+// builds preset dictionary for compressing further messages to this client
+// from the gamestate about to be sent, client does the same once it is parsed
+static void set_zdict(size_t strings, size_t bases)
+{
+    struct mdfour md;
+
+    if (sv_client->version < PROTOCOL_VERSION_Q2PRO_ZLIB_DICT || !sv_client->has_zlib) {
+        return;
+    }
+
+    if (!sv_client->zdict) {
+        sv_client->zdict = SV_Malloc(ZDICT_SIZE);
+    }
+
+    sv_client->zdict_len = MSG_BuildZDictionary(sv_client->zdict,
+                                                msg_write.data + strings, bases - strings,
+                                                msg_write.data + bases, msg_write.cursize - bases);
+
+    // clients with identical dictionaries share compressed broadcasts
+    mdfour_begin(&md);
+    mdfour_update(&md, sv_client->zdict, sv_client->zdict_len);
+    mdfour_result(&md, sv_client->zdict_sum);
+}
+#else
+#define set_zdict(strings, bases)   (void)0
+#endif
+
 static void write_gamestate(void)
 {
     entity_packed_t  *base;
     int         i, j;
-    size_t      length;
+    size_t      length, strings, bases;
     char        *string;
 
     MSG_WriteByte(svc_gamestate);
+    strings = msg_write.cursize;
 
     // write configstrings
     string = sv_client->configstrings;
@@ -190,6 +220,7 @@ static void write_gamestate(void)
         MSG_WriteByte(0);
     }
     MSG_WriteShort(MAX_CONFIGSTRINGS);   // end of configstrings
+    bases = msg_write.cursize;
 
     // write baselines
     for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
@@ -206,6 +237,8 @@ static void write_gamestate(void)
     }
     MSG_WriteShort(0);   // end of baselines
 
+    set_zdict(strings, bases);
+
     SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
 }
 
@@ -1065,8 +1098,8 @@ static void SV_SetLastFrame(int lastframe)
 
             if (frame->number == lastframe) {
                 // save time for ping calc
-                if (frame->sentTime <= com_eventTime)
-                    frame->latency = com_eventTime - frame->sentTime;
+                if (frame->sentTime <= net_time)
+                    frame->latency = net_time - frame->sentTime;
             }
         }
 
@@ -31,21 +31,79 @@ FIXME: this use of "area" is different from the bsp file use
 typedef struct areanode_s {
     int     axis;       // -1 = leaf node
     float   dist;
+    struct areanode_s   *parent;
     struct areanode_s   *children[2];
+    int     depth;
+    int     count;      // entities linked to this node
+    int     total;      // entities linked to this subtree
+    int     nextsplit;  // don't try to split until count reaches this
     list_t  trigger_edicts;
     list_t  solid_edicts;
 } areanode_t;
 
-#define    AREA_DEPTH    4
-#define    AREA_NODES    32
+typedef struct {
+    areanode_t  *nodes;     // nodes[0] is the root, then pairs of children
+    int         numnodes;
+    int         maxdepth;
+    bool        adaptive;
+    areanode_t  *freepairs; // linked through children[0]
+    areanode_t  **entnodes; // node each entity is linked to
+    edict_t     *edicts;
+    int         edict_size;
+} areatree_t;
+
+#define AREA_DEPTH          4   // depth of the uniform tree
+#define AREA_MAX_DEPTH      12
+#define AREA_SPLIT_COUNT    8   // split leafs holding more entities
+#define AREA_MERGE_COUNT    4   // merge subtrees holding at most this
+
+static areatree_t   sv_areatree;
+
+// per worker lists for SV_TraceMany, too large for worker thread stacks
+typedef struct {
+    edict_t     *arealist[MAX_EDICTS];
+    edict_t     *touchlist[MAX_EDICTS];
+} tracescratch_t;
+
+static tracescratch_t   *sv_tracescratch[MAX_WORKER_THREADS];
+
+typedef struct {
+    const vec_t *mins, *maxs;
+    edict_t     **list;
+    int         count, maxcount;
+    int         type;
+} areaedicts_t;
+
+#define AREA_ENTNUM(tree, ent) \
+    ((int)(((byte *)(ent) - (byte *)(tree)->edicts) / (tree)->edict_size))
+
+static void SV_InitAreaNode(areanode_t *anode, areanode_t *parent)
+{
+    anode->axis = -1;
+    anode->dist = 0;
+    anode->parent = parent;
+    anode->children[0] = anode->children[1] = NULL;
+    anode->depth = parent ? parent->depth + 1 : 0;
+    anode->count = anode->total = 0;
+    anode->nextsplit = 0;
+    List_Init(&anode->trigger_edicts);
+    List_Init(&anode->solid_edicts);
+}
+
+static bool SV_AllocAreaChildren(areatree_t *tree, areanode_t *anode)
+{
+    areanode_t *pair = tree->freepairs;
 
-static areanode_t   sv_areanodes[AREA_NODES];
-static int          sv_numareanodes;
+    if (!pair)
+        return false;
 
-static const vec_t  *area_mins, *area_maxs;
-static edict_t      **area_list;
-static int          area_count, area_maxcount;
-static int          area_type;
+    tree->freepairs = pair->children[0];
+    SV_InitAreaNode(&pair[0], anode);
+    SV_InitAreaNode(&pair[1], anode);
+    anode->children[0] = &pair[0];
+    anode->children[1] = &pair[1];
+    return true;
+}
 
 /*
 ===============
@@ -54,23 +112,14 @@ SV_CreateAreaNode
 Builds a uniformly subdivided tree for the given world size
 ===============
 */
-static areanode_t *SV_CreateAreaNode(int depth, const vec3_t mins, const vec3_t maxs)
+static void SV_CreateAreaNode(areatree_t *tree, areanode_t *anode,
+                              const vec3_t mins, const vec3_t maxs)
 {
-    areanode_t  *anode;
     vec3_t      size;
     vec3_t      mins1, maxs1, mins2, maxs2;
 
-    anode = &sv_areanodes[sv_numareanodes];
-    sv_numareanodes++;
-
-    List_Init(&anode->trigger_edicts);
-    List_Init(&anode->solid_edicts);
-
-    if (depth == AREA_DEPTH) {
-        anode->axis = -1;
-        anode->children[0] = anode->children[1] = NULL;
-        return anode;
-    }
+    if (anode->depth == tree->maxdepth || !SV_AllocAreaChildren(tree, anode))
+        return;
 
     VectorSubtract(maxs, mins, size);
     if (size[0] > size[1])
@@ -86,10 +135,238 @@ static areanode_t *SV_CreateAreaNode(int depth, const vec3_t mins, const vec3_t
 
     maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
 
-    anode->children[0] = SV_CreateAreaNode(depth + 1, mins2, maxs2);
-    anode->children[1] = SV_CreateAreaNode(depth + 1, mins1, maxs1);
+    SV_CreateAreaNode(tree, anode->children[0], mins2, maxs2);
+    SV_CreateAreaNode(tree, anode->children[1], mins1, maxs1);
+}
+
+static void SV_FreeAreaTree(areatree_t *tree)
+{
+    Z_Free(tree->nodes);
+    Z_Free(tree->entnodes);
+    memset(tree, 0, sizeof(*tree));
+}
+
+/*
+===============
+SV_InitAreaTree
+
+Adaptive trees start with a single node and are subdivided as entities get
+linked. Otherwise the legacy uniform tree is built over the world bounds.
+===============
+*/
+static void SV_InitAreaTree(areatree_t *tree, int maxdepth, bool adaptive,
+                            const vec3_t mins, const vec3_t maxs,
+                            edict_t *edicts, int edict_size, int max_edicts)
+{
+    int i;
+
+    SV_FreeAreaTree(tree);
+
+    tree->maxdepth = maxdepth;
+    tree->adaptive = adaptive;
+    tree->numnodes = (2 << maxdepth) - 1;
+    tree->nodes = SV_Malloc(sizeof(tree->nodes[0]) * tree->numnodes);
+    tree->entnodes = SV_Mallocz(sizeof(tree->entnodes[0]) * max_edicts);
+    tree->edicts = edicts;
+    tree->edict_size = edict_size;
+
+    for (i = tree->numnodes - 2; i > 0; i -= 2) {
+        tree->nodes[i].children[0] = tree->freepairs;
+        tree->freepairs = &tree->nodes[i];
+    }
+
+    SV_InitAreaNode(tree->nodes, NULL);
+
+    if (!adaptive)
+        SV_CreateAreaNode(tree, tree->nodes, mins, maxs);
+}
+
+static void SV_AreaMoveEdict(areatree_t *tree, edict_t *ent, areanode_t *node)
+{
+    List_Remove(&ent->area);
+    if (ent->solid == SOLID_TRIGGER)
+        List_Append(&node->trigger_edicts, &ent->area);
+    else
+        List_Append(&node->solid_edicts, &ent->area);
+    tree->entnodes[AREA_ENTNUM(tree, ent)] = node;
+    node->count++;
+    node->total++;
+}
+
+static int SV_AreaSide(const areanode_t *node, const edict_t *ent)
+{
+    if (ent->absmin[node->axis] > node->dist)
+        return 0;
+    if (ent->absmax[node->axis] < node->dist)
+        return 1;
+    return -1;
+}
 
-    return anode;
+static void SV_SplitAreaList(areatree_t *tree, areanode_t *node, list_t *list)
+{
+    edict_t *ent, *next;
+    int side;
+
+    LIST_FOR_EACH_SAFE(edict_t, ent, next, list, area) {
+        side = SV_AreaSide(node, ent);
+        if (side != -1) {
+            SV_AreaMoveEdict(tree, ent, node->children[side]);
+            node->count--;
+        }
+    }
+}
+
+/*
+===============
+SV_SplitAreaNode
+
+Splits crowded leaf at the mean of entity centers, along the axis they are
+spread out the most. Gives up until the leaf gets twice as crowded if too
+few entities would move down to the children.
+===============
+*/
+static void SV_SplitAreaNode(areatree_t *tree, areanode_t *node)
+{
+    vec3_t      mins, maxs, sum, center;
+    edict_t     *ent;
+    list_t      *lists[2];
+    int         i, j, axis, moved;
+    float       dist;
+
+    node->nextsplit = node->count * 2;
+
+    ClearBounds(mins, maxs);
+    VectorClear(sum);
+
+    lists[0] = &node->solid_edicts;
+    lists[1] = &node->trigger_edicts;
+    for (i = 0; i < 2; i++) {
+        LIST_FOR_EACH(edict_t, ent, lists[i], area) {
+            VectorAvg(ent->absmin, ent->absmax, center);
+            AddPointToBounds(center, mins, maxs);
+            VectorAdd(sum, center, sum);
+        }
+    }
+
+    axis = 0;
+    for (j = 1; j < 3; j++)
+        if (maxs[j] - mins[j] > maxs[axis] - mins[axis])
+            axis = j;
+
+    if (maxs[axis] - mins[axis] < 1)
+        return;
+
+    dist = sum[axis] / node->count;
+
+    moved = 0;
+    for (i = 0; i < 2; i++) {
+        LIST_FOR_EACH(edict_t, ent, lists[i], area) {
+            if (ent->absmin[axis] > dist || ent->absmax[axis] < dist)
+                moved++;
+        }
+    }
+
+    if (moved < node->count / 4 || !SV_AllocAreaChildren(tree, node))
+        return;
+
+    node->axis = axis;
+    node->dist = dist;
+    for (i = 0; i < 2; i++)
+        SV_SplitAreaList(tree, node, lists[i]);
+}
+
+static void SV_MergeAreaList(areatree_t *tree, areanode_t *node, list_t *list)
+{
+    edict_t *ent, *next;
+
+    LIST_FOR_EACH_SAFE(edict_t, ent, next, list, area) {
+        SV_AreaMoveEdict(tree, ent, node);
+        node->total--;
+    }
+}
+
+// merges children of nodes that became too sparse, up to the root
+static void SV_MergeAreaNodes(areatree_t *tree, areanode_t *node)
+{
+    areanode_t *pair;
+    int i;
+
+    for (; node; node = node->parent) {
+        if (node->axis == -1)
+            continue;
+        if (node->total > AREA_MERGE_COUNT)
+            break;
+        if (node->children[0]->axis != -1 || node->children[1]->axis != -1)
+            break;
+
+        for (i = 0; i < 2; i++) {
+            SV_MergeAreaList(tree, node, &node->children[i]->solid_edicts);
+            SV_MergeAreaList(tree, node, &node->children[i]->trigger_edicts);
+        }
+
+        pair = node->children[0];
+        pair->children[0] = tree->freepairs;
+        tree->freepairs = pair;
+
+        node->axis = -1;
+        node->children[0] = node->children[1] = NULL;
+        node->nextsplit = 0;
+    }
+}
+
+static void SV_AreaUnlinkEdict(areatree_t *tree, edict_t *ent)
+{
+    areanode_t *node, *anode;
+    int entnum = AREA_ENTNUM(tree, ent);
+
+    List_Remove(&ent->area);
+    ent->area.prev = ent->area.next = NULL;
+
+    node = tree->entnodes[entnum];
+    tree->entnodes[entnum] = NULL;
+    if (!node)
+        return;
+
+    node->count--;
+    for (anode = node; anode; anode = anode->parent)
+        anode->total--;
+
+    if (tree->adaptive)
+        SV_MergeAreaNodes(tree, node->parent);
+}
+
+static void SV_AreaLinkEdict(areatree_t *tree, edict_t *ent)
+{
+    areanode_t *node;
+    int side;
+
+    // tree is not built when no map is loaded
+    if (!tree->nodes)
+        return;
+
+    // find the first node that the ent's box crosses
+    node = tree->nodes;
+    while (1) {
+        node->total++;
+        if (node->axis == -1)
+            break;
+        side = SV_AreaSide(node, ent);
+        if (side == -1)
+            break;        // crosses the node
+        node = node->children[side];
+    }
+
+    // link it in
+    if (ent->solid == SOLID_TRIGGER)
+        List_Append(&node->trigger_edicts, &ent->area);
+    else
+        List_Append(&node->solid_edicts, &ent->area);
+    tree->entnodes[AREA_ENTNUM(tree, ent)] = node;
+    node->count++;
+
+    if (tree->adaptive && node->axis == -1 && node->count > AREA_SPLIT_COUNT
+        && node->count >= node->nextsplit && node->depth < tree->maxdepth)
+        SV_SplitAreaNode(tree, node);
 }
 
 /*
@@ -104,12 +381,12 @@ void SV_ClearWorld(void)
     edict_t *ent;
     int i;
 
-    memset(sv_areanodes, 0, sizeof(sv_areanodes));
-    sv_numareanodes = 0;
-
     if (sv.cm.cache) {
         cm = &sv.cm.cache->models[0];
-        SV_CreateAreaNode(0, cm->mins, cm->maxs);
+        SV_InitAreaTree(&sv_areatree, Cvar_ClampInteger(sv_area_depth, 0, AREA_MAX_DEPTH),
+                        true, cm->mins, cm->maxs, ge->edicts, ge->edict_size, ge->max_edicts);
+    } else {
+        SV_FreeAreaTree(&sv_areatree);
     }
 
     // make sure all entities are unlinked
@@ -119,6 +396,18 @@ void SV_ClearWorld(void)
     }
 }
 
+void SV_FreeWorld(void)
+{
+    int i;
+
+    SV_FreeAreaTree(&sv_areatree);
+
+    for (i = 0; i < MAX_WORKER_THREADS; i++) {
+        Z_Free(sv_tracescratch[i]);
+        sv_tracescratch[i] = NULL;
+    }
+}
+
 /*
 ===============
 SV_LinkEdict
@@ -228,13 +517,11 @@ void PF_UnlinkEdict(edict_t *ent)
 {
     if (!ent->area.prev)
         return;        // not linked in anywhere
-    List_Remove(&ent->area);
-    ent->area.prev = ent->area.next = NULL;
+    SV_AreaUnlinkEdict(&sv_areatree, ent);
 }
 
 void PF_LinkEdict(edict_t *ent)
 {
-    areanode_t *node;
     server_entity_t *sent;
     int entnum;
 #if USE_FPS
@@ -306,24 +593,7 @@ void PF_LinkEdict(edict_t *ent)
     if (ent->solid == SOLID_NOT)
         return;
 
-// find the first node that the ent's box crosses
-    node = sv_areanodes;
-    while (1) {
-        if (node->axis == -1)
-            break;
-        if (ent->absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if (ent->absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break;        // crosses the node
-    }
-
-    // link it in
-    if (ent->solid == SOLID_TRIGGER)
-        List_Append(&node->trigger_edicts, &ent->area);
-    else
-        List_Append(&node->solid_edicts, &ent->area);
+    SV_AreaLinkEdict(&sv_areatree, ent);
 }
 
 
@@ -333,13 +603,13 @@ SV_AreaEdicts_r
 
 ====================
 */
-static void SV_AreaEdicts_r(areanode_t *node)
+static void SV_AreaEdicts_r(areaedicts_t *ae, areanode_t *node)
 {
     list_t      *start;
     edict_t     *check;
 
     // touch linked edicts
-    if (area_type == AREA_SOLID)
+    if (ae->type == AREA_SOLID)
         start = &node->solid_edicts;
     else
         start = &node->trigger_edicts;
@@ -347,31 +617,30 @@ static void SV_AreaEdicts_r(areanode_t *node)
     LIST_FOR_EACH(edict_t, check, start, area) {
         if (check->solid == SOLID_NOT)
             continue;        // deactivated
-        if (check->absmin[0] > area_maxs[0]
-            || check->absmin[1] > area_maxs[1]
-            || check->absmin[2] > area_maxs[2]
-            || check->absmax[0] < area_mins[0]
-            || check->absmax[1] < area_mins[1]
-            || check->absmax[2] < area_mins[2])
+        if (check->absmin[0] > ae->maxs[0]
+            || check->absmin[1] > ae->maxs[1]
+            || check->absmin[2] > ae->maxs[2]
+            || check->absmax[0] < ae->mins[0]
+            || check->absmax[1] < ae->mins[1]
+            || check->absmax[2] < ae->mins[2])
             continue;        // not touching
 
-        if (area_count == area_maxcount) {
+        if (ae->count == ae->maxcount) {
             Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
             return;
         }
 
-        area_list[area_count] = check;
-        area_count++;
+        ae->list[ae->count++] = check;
     }
 
     if (node->axis == -1)
         return;        // terminal node
 
     // recurse down both sides
-    if (area_maxs[node->axis] > node->dist)
-        SV_AreaEdicts_r(node->children[0]);
-    if (area_mins[node->axis] < node->dist)
-        SV_AreaEdicts_r(node->children[1]);
+    if (ae->maxs[node->axis] > node->dist)
+        SV_AreaEdicts_r(ae, node->children[0]);
+    if (ae->mins[node->axis] < node->dist)
+        SV_AreaEdicts_r(ae, node->children[1]);
 }
 
 /*
@@ -379,19 +648,28 @@ static void SV_AreaEdicts_r(areanode_t *node)
 SV_AreaEdicts
 ================
 */
-int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs,
-                  edict_t **list, int maxcount, int areatype)
+static int SV_AreaEdictsTree(const areatree_t *tree, const vec3_t mins, const vec3_t maxs,
+                             edict_t **list, int maxcount, int areatype)
 {
-    area_mins = mins;
-    area_maxs = maxs;
-    area_list = list;
-    area_count = 0;
-    area_maxcount = maxcount;
-    area_type = areatype;
+    areaedicts_t ae;
+
+    ae.mins = mins;
+    ae.maxs = maxs;
+    ae.list = list;
+    ae.count = 0;
+    ae.maxcount = maxcount;
+    ae.type = areatype;
 
-    SV_AreaEdicts_r(sv_areanodes);
+    if (tree->nodes)
+        SV_AreaEdicts_r(&ae, tree->nodes);
+
+    return ae.count;
+}
 
-    return area_count;
+int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs,
+                  edict_t **list, int maxcount, int areatype)
+{
+    return SV_AreaEdictsTree(&sv_areatree, mins, maxs, list, maxcount, areatype);
 }
 
 
@@ -453,22 +731,13 @@ int SV_PointContents(const vec3_t p)
     return contents;
 }
 
-/*
-====================
-SV_ClipMoveToEntities
-
-====================
-*/
-static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
-                                  const vec3_t maxs, const vec3_t end,
-                                  edict_t *passedict, int contentmask, trace_t *tr)
+// calculates the bounding box of the entire move
+static void SV_MoveBounds(const vec3_t start, const vec3_t mins,
+                          const vec3_t maxs, const vec3_t end,
+                          vec3_t boxmins, vec3_t boxmaxs)
 {
-    vec3_t      boxmins, boxmaxs;
-    int         i, num;
-    edict_t     *touchlist[MAX_EDICTS], *touch;
-    trace_t     trace;
+    int i;
 
-    // create the bounding box of the entire move
     for (i = 0; i < 3; i++) {
         if (end[i] > start[i]) {
             boxmins[i] = start[i] + mins[i] - 1;
@@ -478,8 +747,16 @@ static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
             boxmaxs[i] = start[i] + maxs[i] + 1;
         }
     }
+}
 
-    num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+static void SV_ClipMoveToEntityList(edict_t **touchlist, int num,
+                                    const vec3_t start, const vec3_t mins,
+                                    const vec3_t maxs, const vec3_t end,
+                                    edict_t *passedict, int contentmask, trace_t *tr)
+{
+    int         i;
+    edict_t     *touch;
+    trace_t     trace;
 
     // be careful, it is possible to have an entity in this
     // list removed before we get to it (killtriggered)
@@ -511,6 +788,28 @@ static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
     }
 }
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+static void SV_ClipMoveToEntities(const vec3_t start, const vec3_t mins,
+                                  const vec3_t maxs, const vec3_t end,
+                                  edict_t *passedict, int contentmask, trace_t *tr)
+{
+    vec3_t      boxmins, boxmaxs;
+    int         num;
+    edict_t     *touchlist[MAX_EDICTS];
+
+    SV_MoveBounds(start, mins, maxs, end, boxmins, boxmaxs);
+
+    num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+
+    SV_ClipMoveToEntityList(touchlist, num, start, mins, maxs, end,
+                            passedict, contentmask, tr);
+}
+
 /*
 ==================
 SV_Trace
@@ -546,3 +845,389 @@ trace_t q_gameabi SV_Trace(const vec3_t start, const vec3_t mins,
     return trace;
 }
 
+
+/*
+===============================================================================
+
+BATCHED TRACES
+
+Rays close to each other share a single area query for the union of their
+move bounds. The list is then filtered by bounds of each move, which gives
+exactly the same entities in the same order as querying separately, since
+the area tree is walked in the same order and entities in subtrees skipped
+by the smaller query can never touch its bounds.
+
+===============================================================================
+*/
+
+#define TRACE_GROUP_SIZE    2048    // max union extent of a group
+#define TRACE_JOB_SIZE      32      // rays per worker job
+
+typedef struct {
+    tracebatch_t    *batch;
+    int             count;
+} tracejob_t;
+
+static bool SV_BoundsTouch(const edict_t *ent, const vec3_t mins, const vec3_t maxs)
+{
+    return !(ent->absmin[0] > maxs[0]
+             || ent->absmin[1] > maxs[1]
+             || ent->absmin[2] > maxs[2]
+             || ent->absmax[0] < mins[0]
+             || ent->absmax[1] < mins[1]
+             || ent->absmax[2] < mins[2]);
+}
+
+static void SV_TraceGroup(tracebatch_t *batch, int count, tracescratch_t *scratch,
+                          const vec3_t groupmins, const vec3_t groupmaxs)
+{
+    edict_t     **arealist = scratch->arealist;
+    edict_t     **touchlist = scratch->touchlist;
+    vec3_t      boxmins, boxmaxs;
+    int         i, j, numarea, num;
+    tracebatch_t *b;
+
+    numarea = SV_AreaEdicts(groupmins, groupmaxs, arealist, MAX_EDICTS, AREA_SOLID);
+
+    for (i = 0, b = batch; i < count; i++, b++) {
+        // clip to world
+        CM_BoxTrace(&b->trace, b->start, b->end, b->mins, b->maxs,
+                    sv.cm.cache->nodes, b->contentmask);
+        b->trace.ent = ge->edicts;
+        if (b->trace.fraction == 0)
+            continue;   // blocked by the world
+
+        // clip to other solid entities
+        SV_MoveBounds(b->start, b->mins, b->maxs, b->end, boxmins, boxmaxs);
+        for (j = num = 0; j < numarea; j++)
+            if (SV_BoundsTouch(arealist[j], boxmins, boxmaxs))
+                touchlist[num++] = arealist[j];
+
+        SV_ClipMoveToEntityList(touchlist, num, b->start, b->mins, b->maxs,
+                                b->end, b->passent, b->contentmask, &b->trace);
+    }
+}
+
+// traces consecutive rays in groups of nearby rays
+static void SV_TraceBatch(tracebatch_t *batch, int count, tracescratch_t *scratch)
+{
+    vec3_t      groupmins, groupmaxs, boxmins, boxmaxs;
+    int         i, j, first;
+
+    first = 0;
+    for (i = 0; i < count; i++) {
+        SV_MoveBounds(batch[i].start, batch[i].mins, batch[i].maxs,
+                      batch[i].end, boxmins, boxmaxs);
+        if (i > first) {
+            for (j = 0; j < 3; j++) {
+                if (max(groupmaxs[j], boxmaxs[j]) - min(groupmins[j], boxmins[j]) > TRACE_GROUP_SIZE)
+                    break;
+            }
+            if (j == 3) {
+                for (j = 0; j < 3; j++) {
+                    groupmins[j] = min(groupmins[j], boxmins[j]);
+                    groupmaxs[j] = max(groupmaxs[j], boxmaxs[j]);
+                }
+                continue;
+            }
+            SV_TraceGroup(batch + first, i - first, scratch, groupmins, groupmaxs);
+            first = i;
+        }
+        VectorCopy(boxmins, groupmins);
+        VectorCopy(boxmaxs, groupmaxs);
+    }
+
+    if (first < count)
+        SV_TraceGroup(batch + first, count - first, scratch, groupmins, groupmaxs);
+}
+
+static void SV_TraceJob(void *arg, int index, int slot)
+{
+    tracejob_t *job = arg;
+    int first = index * TRACE_JOB_SIZE;
+
+    SV_TraceBatch(job->batch + first, min(job->count - first, TRACE_JOB_SIZE),
+                  sv_tracescratch[slot]);
+}
+
+/*
+==================
+SV_TraceMany
+
+Same as calling SV_Trace for each ray in the batch. Large batches are
+spread over sv_threads worker threads.
+==================
+*/
+void SV_TraceMany(tracebatch_t *batch, int count)
+{
+    tracejob_t  job;
+    int         i, threads, numjobs;
+
+    if (!sv.cm.cache) {
+        Com_Error(ERR_DROP, "%s: no map loaded", __func__);
+    }
+
+    if (count < 1)
+        return;
+
+    threads = 1;
+    numjobs = (count + TRACE_JOB_SIZE - 1) / TRACE_JOB_SIZE;
+    if (sv_threads->integer > 0 && numjobs > 1)
+        threads = min(min(sv_threads->integer, MAX_WORKER_THREADS), numjobs);
+
+    // Z_Malloc is not thread safe
+    for (i = 0; i < threads; i++) {
+        if (!sv_tracescratch[i]) {
+            sv_tracescratch[i] = SV_Malloc(sizeof(tracescratch_t));
+        }
+    }
+
+    if (threads > 1) {
+        job.batch = batch;
+        job.count = count;
+        Sys_ParallelFor(threads, numjobs, SV_TraceJob, &job);
+        return;
+    }
+
+    SV_TraceBatch(batch, count, sv_tracescratch[0]);
+}
+
+/*
+==================
+SV_TraceBench_f
+
+Traces random rays between solid entities, one at a time and batched,
+and checks the results are the same.
+==================
+*/
+void SV_TraceBench_f(void)
+{
+    tracebatch_t *batch;
+    trace_t     *serial;
+    edict_t     *ents[MAX_EDICTS], *a, *b;
+    int         i, count, numents, errors;
+    unsigned    start, time_serial, time_batch;
+    float       rate_serial, rate_batch;
+
+    if (!sv.cm.cache || !ge) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+    clamp(count, 1, 1000000);
+
+    numents = 0;
+    for (i = 1; i < ge->num_edicts; i++) {
+        a = EDICT_NUM(i);
+        if (a->inuse && a->solid != SOLID_NOT && a->area.prev)
+            ents[numents++] = a;
+    }
+    if (numents < 2) {
+        Com_Printf("Not enough solid entities.\n");
+        return;
+    }
+
+    batch = Z_Malloc(sizeof(batch[0]) * count);
+    serial = Z_Malloc(sizeof(serial[0]) * count);
+
+    // lines between centers of random entity pairs, grouped by source
+    Q_srand(1);
+    a = ents[0];
+    for (i = 0; i < count; i++) {
+        if (!(i & 15))
+            a = ents[Q_rand_uniform(numents)];
+        b = ents[Q_rand_uniform(numents)];
+        VectorAvg(a->absmin, a->absmax, batch[i].start);
+        VectorAvg(b->absmin, b->absmax, batch[i].end);
+        VectorClear(batch[i].mins);
+        VectorClear(batch[i].maxs);
+        batch[i].passent = a;
+        batch[i].contentmask = MASK_OPAQUE;
+    }
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i++)
+        serial[i] = SV_Trace(batch[i].start, batch[i].mins, batch[i].maxs,
+                             batch[i].end, batch[i].passent, batch[i].contentmask);
+    time_serial = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i += 64)
+        SV_TraceMany(batch + i, min(count - i, 64));
+    time_batch = Sys_Milliseconds() - start;
+
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        if (serial[i].fraction != batch[i].trace.fraction ||
+            serial[i].ent != batch[i].trace.ent ||
+            !VectorCompare(serial[i].endpos, batch[i].trace.endpos))
+            errors++;
+    }
+
+    rate_serial = count * 1000.0f / max(time_serial, 1);
+    rate_batch = count * 1000.0f / max(time_batch, 1);
+    Com_Printf("%d traces: %.0f/sec single, %.0f/sec batched, %d mismatches\n",
+               count, rate_serial, rate_batch, errors);
+
+    Z_Free(serial);
+    Z_Free(batch);
+}
+
+typedef struct {
+    vec3_t  velocity;
+    vec3_t  home;
+} benchent_t;
+
+static void SV_BenchLink(areatree_t *tree, edict_t *ent)
+{
+    if (ent->area.prev)
+        SV_AreaUnlinkEdict(tree, ent);
+
+    VectorAdd(ent->s.origin, ent->mins, ent->absmin);
+    VectorAdd(ent->s.origin, ent->maxs, ent->absmax);
+    ent->absmin[0] -= 1;
+    ent->absmin[1] -= 1;
+    ent->absmin[2] -= 1;
+    ent->absmax[0] += 1;
+    ent->absmax[1] += 1;
+    ent->absmax[2] += 1;
+
+    SV_AreaLinkEdict(tree, ent);
+}
+
+static void SV_BenchSpawn(edict_t *edicts, benchent_t *bench, int count, const mmodel_t *world)
+{
+    vec3_t  centers[8];
+    edict_t *ent;
+    int     i, j;
+
+    Q_srand(1);
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 3; j++)
+            centers[i][j] = world->mins[j] + Q_rand_uniform(max(world->maxs[j] - world->mins[j], 1));
+
+    memset(edicts, 0, sizeof(edicts[0]) * count);
+    for (i = 0; i < count; i++) {
+        ent = &edicts[i];
+        ent->inuse = true;
+        ent->solid = SOLID_BBOX;
+        if (i & 3) {
+            // monsters
+            VectorSet(ent->mins, -16, -16, -24);
+            VectorSet(ent->maxs, 16, 16, 32);
+        } else {
+            // projectiles
+            VectorSet(ent->mins, -2, -2, -2);
+            VectorSet(ent->maxs, 2, 2, 2);
+        }
+        for (j = 0; j < 3; j++) {
+            bench[i].home[j] = centers[i & 7][j] + (int)Q_rand_uniform(512) - 256;
+            bench[i].velocity[j] = (int)Q_rand_uniform(65) - 32;
+        }
+        VectorCopy(bench[i].home, ent->s.origin);
+    }
+}
+
+static void SV_BenchTree(areatree_t *tree, edict_t *edicts, benchent_t *bench,
+                         int count, int frames, const char *name)
+{
+    edict_t     *touchlist[MAX_EDICTS];
+    vec3_t      end, boxmins, boxmaxs;
+    edict_t     *ent;
+    trace_t     tr;
+    unsigned    start, time_link = 0, time_trace = 0;
+    int         i, j, frame, touched = 0;
+
+    for (i = 0; i < count; i++)
+        SV_BenchLink(tree, &edicts[i]);
+
+    for (frame = 0; frame < frames; frame++) {
+        start = Sys_Milliseconds();
+        for (i = 0; i < count; i++) {
+            ent = &edicts[i];
+            // wander around home position
+            for (j = 0; j < 3; j++) {
+                ent->s.origin[j] += bench[i].velocity[j];
+                if (fabsf(ent->s.origin[j] - bench[i].home[j]) > 512)
+                    bench[i].velocity[j] = -bench[i].velocity[j];
+            }
+            SV_BenchLink(tree, ent);
+        }
+        time_link += Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < count; i++) {
+            ent = &edicts[i];
+            VectorMA(ent->s.origin, 8, bench[i].velocity, end);
+
+            CM_BoxTrace(&tr, ent->s.origin, end, ent->mins, ent->maxs,
+                        sv.cm.cache->nodes, MASK_MONSTERSOLID);
+            if (tr.fraction == 0)
+                continue;
+
+            SV_MoveBounds(ent->s.origin, ent->mins, ent->maxs, end, boxmins, boxmaxs);
+            j = SV_AreaEdictsTree(tree, boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+            SV_ClipMoveToEntityList(touchlist, j, ent->s.origin, ent->mins, ent->maxs,
+                                    end, ent, MASK_MONSTERSOLID, &tr);
+            touched += j;
+        }
+        time_trace += Sys_Milliseconds() - start;
+    }
+
+    for (i = 0; i < count; i++)
+        SV_AreaUnlinkEdict(tree, &edicts[i]);
+
+    Com_Printf("%-8s %5u ms link, %5u ms trace, %8.0f traces/sec, %.1f ents/trace\n",
+               name, time_link, time_trace, count * frames * 1000.0f / max(time_trace, 1),
+               (float)touched / (count * frames));
+}
+
+/*
+==================
+SV_AreaBench_f
+
+Moves synthetic clusters of entities around the current map and traces
+them, using both the legacy uniform area tree and the adaptive one.
+==================
+*/
+void SV_AreaBench_f(void)
+{
+    areatree_t  tree;
+    edict_t     *edicts;
+    benchent_t  *bench;
+    mmodel_t    *world;
+    int         count, frames, depth;
+
+    if (!sv.cm.cache) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 1000;
+    clamp(count, 1, MAX_EDICTS);
+    frames = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 100;
+    clamp(frames, 1, 10000);
+    depth = Cvar_ClampInteger(sv_area_depth, 0, AREA_MAX_DEPTH);
+
+    world = &sv.cm.cache->models[0];
+    edicts = SV_Malloc(sizeof(edicts[0]) * count);
+    bench = SV_Malloc(sizeof(bench[0]) * count);
+    memset(&tree, 0, sizeof(tree));
+
+    Com_Printf("%d entities, %d frames\n", count, frames);
+
+    SV_BenchSpawn(edicts, bench, count, world);
+    SV_InitAreaTree(&tree, AREA_DEPTH, false, world->mins, world->maxs,
+                    edicts, sizeof(edicts[0]), count);
+    SV_BenchTree(&tree, edicts, bench, count, frames, "uniform");
+
+    SV_BenchSpawn(edicts, bench, count, world);
+    SV_InitAreaTree(&tree, depth, true, world->mins, world->maxs,
+                    edicts, sizeof(edicts[0]), count);
+    SV_BenchTree(&tree, edicts, bench, count, frames, "adaptive");
+
+    SV_FreeAreaTree(&tree);
+    Z_Free(bench);
+    Z_Free(edicts);
+}
@@ -0,0 +1,1314 @@
+/*
+Copyright (C) 2026 Quake II RTX (Modified) contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// demotool.c -- headless client demo and MVD analyzer / re-encoder
+//
+// Streams .dm2 and .mvd2 files (optionally gzipped) through the same
+// MSG_Parse* delta decoders the client and MVD parsers use, without any
+// renderer, sound or filesystem. Files are processed one per worker thread.
+//
+
+#include "shared/shared.h"
+#include "common/cmodel.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/protocol.h"
+#include "common/sizebuf.h"
+
+#include <setjmp.h>
+#include <errno.h>
+#include <time.h>
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAX_OPS     32
+
+typedef enum {
+    FMT_UNKNOWN,
+    FMT_DM2,
+    FMT_MVD
+} demofmt_t;
+
+typedef struct {
+    const char  *path;
+
+    // filled in by worker
+    demofmt_t   format;
+    int         protocol;
+    char        mapname[MAX_QPATH];
+    char        error[MAX_STRING_CHARS];
+    int64_t     insize;
+    int64_t     outsize;
+    int         messages;
+    int         frames;
+    int64_t     entities;       // sum over frames, for average
+    int         maxentities;
+    int64_t     opcount[MAX_OPS];
+    int64_t     opbytes[MAX_OPS];
+    int         stripped;
+} job_t;
+
+typedef struct {
+    job_t       *job;
+    gzFile      in;
+    gzFile      out;
+    FILE        *csv;
+
+    // parse state
+    int         clientnum;
+    int         maxclients;
+    int         numentities;
+    int         numplayers;
+    bool        inuse[MAX_EDICTS];
+    bool        playerinuse[MAX_CLIENTS];
+    entity_state_t  baselines[MAX_EDICTS];
+    entity_state_t  entities[MAX_EDICTS];
+    player_state_t  players[MAX_CLIENTS];   // only [0] used for .dm2
+
+    // per-frame accumulators, reset after each CSV row
+    int64_t     framebytes;
+    int64_t     frameops[MAX_OPS];
+
+    byte        inbuf[MAX_MSGLEN];
+    byte        outbuf[MAX_MSGLEN];
+    size_t      outlen;
+} demo_t;
+
+static const char *const svc_names[MAX_OPS] = {
+    "bad", "muzzleflash", "muzzleflash2", "temp_entity", "layout",
+    "inventory", "nop", "disconnect", "reconnect", "sound", "print",
+    "stufftext", "serverdata", "configstring", "spawnbaseline",
+    "centerprint", "download", "playerinfo", "packetentities",
+    "deltapacketentities", "frame", "zpacket", "zdownload", "gamestate",
+    "setting"
+};
+
+static const char *const mvd_names[MAX_OPS] = {
+    "bad", "nop", "disconnect", "reconnect", "serverdata", "configstring",
+    "frame", "frame_nodelta", "unicast", "unicast_r", "multicast_all",
+    "multicast_phs", "multicast_pvs", "multicast_all_r", "multicast_phs_r",
+    "multicast_pvs_r", "sound", "print", "stufftext"
+};
+
+static struct {
+    const char  *outdir;
+    const char  *csvdir;
+    bool        strip_sounds;
+    bool        compress;
+    bool        quiet;
+    int         workers;
+} opt;
+
+static job_t    *jobs;
+static int      numjobs;
+
+/*
+==============================================================================
+
+ERROR HANDLING
+
+msg.c reports malformed input with Com_Error(). Each worker keeps its own
+jump buffer so that a broken file only aborts that file.
+
+==============================================================================
+*/
+
+static q_thread_local jmp_buf  *demo_abort;
+static q_thread_local char     *demo_error;
+
+void Com_Error(error_type_t code, const char *fmt, ...)
+{
+    va_list argptr;
+
+    if (demo_error) {
+        va_start(argptr, fmt);
+        Q_vsnprintf(demo_error, MAX_STRING_CHARS, fmt, argptr);
+        va_end(argptr);
+    }
+
+    if (demo_abort)
+        longjmp(*demo_abort, 1);
+
+    abort();
+}
+
+void Com_LPrintf(print_type_t type, const char *fmt, ...)
+{
+    va_list argptr;
+
+    if (type == PRINT_DEVELOPER)
+        return;
+
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+}
+
+/*
+==============================================================================
+
+OUTPUT
+
+==============================================================================
+*/
+
+// copies raw bytes of a parsed command into the re-encoded message
+static void keep_op(demo_t *d, size_t start)
+{
+    size_t len = msg_read.readcount - start;
+
+    if (!d->out)
+        return;
+
+    memcpy(d->outbuf + d->outlen, msg_read.data + start, len);
+    d->outlen += len;
+}
+
+static void write_out(demo_t *d, const void *data, size_t len)
+{
+    if (gzwrite(d->out, data, len) != (int)len)
+        Com_Error(ERR_FATAL, "couldn't write output");
+    d->job->outsize += len;
+}
+
+static void flush_message(demo_t *d)
+{
+    uint32_t len32;
+    uint16_t len16;
+
+    if (!d->out)
+        return;
+
+    // zero length terminates an MVD, drop messages that became empty
+    if (!d->outlen)
+        return;
+
+    if (d->job->format == FMT_MVD) {
+        len16 = LittleShort(d->outlen);
+        write_out(d, &len16, 2);
+    } else {
+        len32 = LittleLong(d->outlen);
+        write_out(d, &len32, 4);
+    }
+    write_out(d, d->outbuf, d->outlen);
+    d->outlen = 0;
+}
+
+static void write_csv_header(demo_t *d)
+{
+    const char *const *names = d->job->format == FMT_MVD ? mvd_names : svc_names;
+    int i;
+
+    if (!d->csv)
+        return;
+
+    fprintf(d->csv, "frame,bytes,entities,players");
+    for (i = 1; i < MAX_OPS; i++)
+        if (names[i])
+            fprintf(d->csv, ",%s", names[i]);
+    fprintf(d->csv, ",positions\n");
+}
+
+// one row per frame, bytes and per-command sizes include
+// everything received since the previous frame
+static void write_csv_row(demo_t *d)
+{
+    const char *const *names = d->job->format == FMT_MVD ? mvd_names : svc_names;
+    const player_state_t *ps;
+    const char *sep = "";
+    int i;
+
+    if (d->csv) {
+        fprintf(d->csv, "%d,%"PRId64",%d,%d", d->job->frames,
+                d->framebytes, d->numentities, d->numplayers);
+        for (i = 1; i < MAX_OPS; i++)
+            if (names[i])
+                fprintf(d->csv, ",%"PRId64, d->frameops[i]);
+        fprintf(d->csv, ",\"");
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (!d->playerinuse[i])
+                continue;
+            ps = &d->players[i];
+            fprintf(d->csv, "%s%d %.1f %.1f %.1f", sep,
+                    d->job->format == FMT_MVD ? i : d->clientnum,
+                    SHORT2COORD(ps->pmove.origin[0]),
+                    SHORT2COORD(ps->pmove.origin[1]),
+                    SHORT2COORD(ps->pmove.origin[2]));
+            sep = ";";
+        }
+        fprintf(d->csv, "\"\n");
+    }
+
+    d->framebytes = 0;
+    memset(d->frameops, 0, sizeof(d->frameops));
+}
+
+static void end_frame(demo_t *d)
+{
+    job_t *job = d->job;
+
+    job->entities += d->numentities;
+    job->maxentities = max(job->maxentities, d->numentities);
+    write_csv_row(d);
+    job->frames++;
+}
+
+static void account_op(demo_t *d, int cmd, size_t start)
+{
+    size_t len = msg_read.readcount - start;
+
+    d->job->opcount[cmd]++;
+    d->job->opbytes[cmd] += len;
+    d->frameops[cmd] += len;
+}
+
+static void set_mapname(demo_t *d, const char *s)
+{
+    size_t len = strlen(s);
+
+    // skip "maps/" and cut off ".bsp"
+    if (len > 9 && !Q_strncasecmp(s, "maps/", 5))
+        Q_strlcpy(d->job->mapname, s + 5, min(len - 8, sizeof(d->job->mapname)));
+}
+
+static void read_configstring(demo_t *d, int index)
+{
+    char s[MAX_STRING_CHARS];
+
+    if (index < 0 || index >= MAX_CONFIGSTRINGS)
+        Com_Error(ERR_DROP, "bad configstring index: %d", index);
+
+    MSG_ReadString(s, sizeof(s));
+
+    if (index == CS_MODELS + 1)
+        set_mapname(d, s);
+    else if (index == CS_MAXCLIENTS)
+        d->maxclients = atoi(s);
+}
+
+/*
+==============================================================================
+
+CLIENT DEMOS
+
+Mirrors CL_ParseServerMessage for protocols 26 and 34, which is all the
+client ever records. Demo frames are always delta compressed from the
+previous recorded frame, so a single entity array is enough.
+
+==============================================================================
+*/
+
+static void dm2_skip_tent(void)
+{
+    vec3_t v;
+    int i, type = MSG_ReadByte();
+
+    switch (type) {
+    case TE_BLOOD:
+    case TE_GUNSHOT:
+    case TE_SPARKS:
+    case TE_BULLET_SPARKS:
+    case TE_SCREEN_SPARKS:
+    case TE_SHIELD_SPARKS:
+    case TE_SHOTGUN:
+    case TE_BLASTER:
+    case TE_HYPERBLASTER:
+    case TE_GREENBLOOD:
+    case TE_BLASTER2:
+    case TE_FLECHETTE:
+    case TE_HEATBEAM_SPARKS:
+    case TE_HEATBEAM_STEAM:
+    case TE_MOREBLOOD:
+    case TE_ELECTRIC_SPARKS:
+        MSG_ReadPos(v);
+        MSG_ReadDir(v);
+        break;
+
+    case TE_SPLASH:
+    case TE_LASER_SPARKS:
+    case TE_WELDING_SPARKS:
+    case TE_TUNNEL_SPARKS:
+        MSG_ReadByte();
+        MSG_ReadPos(v);
+        MSG_ReadDir(v);
+        MSG_ReadByte();
+        break;
+
+    case TE_BLUEHYPERBLASTER:
+    case TE_RAILTRAIL:
+    case TE_BUBBLETRAIL:
+    case TE_DEBUGTRAIL:
+    case TE_BUBBLETRAIL2:
+    case TE_BFG_LASER:
+        MSG_ReadPos(v);
+        MSG_ReadPos(v);
+        break;
+
+    case TE_GRENADE_EXPLOSION:
+    case TE_GRENADE_EXPLOSION_WATER:
+    case TE_EXPLOSION2:
+    case TE_PLASMA_EXPLOSION:
+    case TE_ROCKET_EXPLOSION:
+    case TE_ROCKET_EXPLOSION_WATER:
+    case TE_EXPLOSION1:
+    case TE_EXPLOSION1_NP:
+    case TE_EXPLOSION1_BIG:
+    case TE_BFG_EXPLOSION:
+    case TE_BFG_BIGEXPLOSION:
+    case TE_BOSSTPORT:
+    case TE_PLAIN_EXPLOSION:
+    case TE_CHAINFIST_SMOKE:
+    case TE_TRACKER_EXPLOSION:
+    case TE_TELEPORT_EFFECT:
+    case TE_DBALL_GOAL:
+    case TE_WIDOWSPLASH:
+    case TE_NUKEBLAST:
+        MSG_ReadPos(v);
+        break;
+
+    case TE_PARASITE_ATTACK:
+    case TE_MEDIC_CABLE_ATTACK:
+    case TE_HEATBEAM:
+    case TE_MONSTER_HEATBEAM:
+        MSG_ReadShort();
+        MSG_ReadPos(v);
+        MSG_ReadPos(v);
+        break;
+
+    case TE_GRAPPLE_CABLE:
+        MSG_ReadShort();
+        MSG_ReadPos(v);
+        MSG_ReadPos(v);
+        MSG_ReadPos(v);
+        break;
+
+    case TE_LIGHTNING:
+        MSG_ReadShort();
+        MSG_ReadShort();
+        MSG_ReadPos(v);
+        MSG_ReadPos(v);
+        break;
+
+    case TE_FLASHLIGHT:
+        MSG_ReadPos(v);
+        MSG_ReadShort();
+        break;
+
+    case TE_FORCEWALL:
+        MSG_ReadPos(v);
+        MSG_ReadPos(v);
+        MSG_ReadByte();
+        break;
+
+    case TE_STEAM:
+        i = MSG_ReadShort();
+        MSG_ReadByte();
+        MSG_ReadPos(v);
+        MSG_ReadDir(v);
+        MSG_ReadByte();
+        MSG_ReadShort();
+        if (i != -1)
+            MSG_ReadLong();
+        break;
+
+    case TE_WIDOWBEAMOUT:
+        MSG_ReadShort();
+        MSG_ReadPos(v);
+        break;
+
+    case TE_FLARE:
+        MSG_ReadShort();
+        MSG_ReadByte();
+        MSG_ReadPos(v);
+        MSG_ReadDir(v);
+        break;
+
+    default:
+        Com_Error(ERR_DROP, "bad temp entity type: %d", type);
+    }
+}
+
+static void dm2_skip_sound(void)
+{
+    vec3_t pos;
+    int flags = MSG_ReadByte();
+
+    if (!(flags & (SND_ENT | SND_POS)))
+        Com_Error(ERR_DROP, "sound with neither SND_ENT nor SND_POS set");
+
+    MSG_ReadByte();
+    if (flags & SND_VOLUME)
+        MSG_ReadByte();
+    if (flags & SND_ATTENUATION)
+        MSG_ReadByte();
+    if (flags & SND_OFFSET)
+        MSG_ReadByte();
+    if (flags & SND_ENT)
+        MSG_ReadShort();
+    if (flags & SND_POS)
+        MSG_ReadPos(pos);
+}
+
+static void dm2_parse_serverdata(demo_t *d)
+{
+    char string[MAX_QPATH];
+
+    d->job->protocol = MSG_ReadLong();
+    if (d->job->protocol != PROTOCOL_VERSION_OLD &&
+        d->job->protocol != PROTOCOL_VERSION_DEFAULT)
+        Com_Error(ERR_DROP, "unsupported protocol %d", d->job->protocol);
+
+    MSG_ReadLong();     // servercount
+    MSG_ReadByte();     // attractloop
+    MSG_ReadString(string, sizeof(string));     // gamedir
+    d->clientnum = MSG_ReadShort();
+    MSG_ReadString(string, sizeof(string));     // levelname
+
+    memset(d->baselines, 0, sizeof(d->baselines));
+    memset(d->inuse, 0, sizeof(d->inuse));
+    memset(d->playerinuse, 0, sizeof(d->playerinuse));
+    d->numentities = d->numplayers = 0;
+}
+
+static void dm2_parse_baseline(demo_t *d)
+{
+    int bits, number;
+
+    number = MSG_ParseEntityBits(&bits);
+    if (number < 1 || number >= MAX_EDICTS)
+        Com_Error(ERR_DROP, "bad baseline number: %d", number);
+
+    MSG_ParseDeltaEntity(NULL, &d->baselines[number], number, bits, 0);
+}
+
+static void dm2_parse_entities(demo_t *d)
+{
+    entity_state_t *ent;
+    int bits, number;
+
+    while (1) {
+        number = MSG_ParseEntityBits(&bits);
+        if (number < 0 || number >= MAX_EDICTS)
+            Com_Error(ERR_DROP, "bad entity number: %d", number);
+        if (msg_read.readcount > msg_read.cursize)
+            Com_Error(ERR_DROP, "read past end of message");
+        if (!number)
+            break;
+
+        ent = &d->entities[number];
+
+        if (bits & U_REMOVE) {
+            if (d->inuse[number]) {
+                d->inuse[number] = false;
+                d->numentities--;
+            }
+            continue;
+        }
+
+        if (!d->inuse[number]) {
+            *ent = d->baselines[number];
+            d->inuse[number] = true;
+            d->numentities++;
+        }
+
+        MSG_ParseDeltaEntity(ent, ent, number, bits, 0);
+    }
+}
+
+static void dm2_parse_frame(demo_t *d)
+{
+    player_state_t *ps = &d->players[0];
+    int bits, length, deltaframe;
+
+    MSG_ReadLong();     // currentframe
+    deltaframe = MSG_ReadLong();
+    if (d->job->protocol != PROTOCOL_VERSION_OLD)
+        MSG_ReadByte(); // suppressed
+
+    if (deltaframe <= 0) {
+        memset(d->inuse, 0, sizeof(d->inuse));
+        d->numentities = 0;
+    }
+
+    // skip areabits
+    length = MSG_ReadByte();
+    if (!MSG_ReadData(length))
+        Com_Error(ERR_DROP, "read past end of message");
+
+    if (MSG_ReadByte() != svc_playerinfo)
+        Com_Error(ERR_DROP, "not playerinfo");
+
+    bits = MSG_ReadWord();
+    MSG_ParseDeltaPlayerstate_Default(deltaframe > 0 ? ps : NULL, ps, bits);
+    d->playerinuse[0] = true;
+    d->numplayers = 1;
+
+    if (MSG_ReadByte() != svc_packetentities)
+        Com_Error(ERR_DROP, "not packetentities");
+
+    dm2_parse_entities(d);
+}
+
+static void dm2_parse_message(demo_t *d)
+{
+    char string[MAX_STRING_CHARS];
+    size_t start;
+    int cmd, i, length;
+    bool frame = false;
+
+    while (msg_read.readcount < msg_read.cursize) {
+        start = msg_read.readcount;
+        cmd = MSG_ReadByte();
+
+        switch (cmd) {
+        case svc_nop:
+            break;
+        case svc_disconnect:
+        case svc_reconnect:
+            msg_read.readcount = msg_read.cursize;
+            break;
+        case svc_print:
+            MSG_ReadByte();
+            // fall through
+        case svc_centerprint:
+        case svc_stufftext:
+        case svc_layout:
+            MSG_ReadString(string, sizeof(string));
+            break;
+        case svc_serverdata:
+            dm2_parse_serverdata(d);
+            break;
+        case svc_configstring:
+            read_configstring(d, MSG_ReadShort());
+            break;
+        case svc_sound:
+            dm2_skip_sound();
+            break;
+        case svc_spawnbaseline:
+            dm2_parse_baseline(d);
+            break;
+        case svc_temp_entity:
+            dm2_skip_tent();
+            break;
+        case svc_muzzleflash:
+        case svc_muzzleflash2:
+            MSG_ReadShort();
+            MSG_ReadByte();
+            break;
+        case svc_download:
+            length = MSG_ReadShort();
+            MSG_ReadByte();
+            if (length > 0 && !MSG_ReadData(length))
+                Com_Error(ERR_DROP, "read past end of message");
+            break;
+        case svc_frame:
+            dm2_parse_frame(d);
+            frame = true;
+            break;
+        case svc_inventory:
+            for (i = 0; i < MAX_ITEMS; i++)
+                MSG_ReadShort();
+            break;
+        default:
+            Com_Error(ERR_DROP, "illegible server message: %d", cmd);
+        }
+
+        if (msg_read.readcount > msg_read.cursize)
+            Com_Error(ERR_DROP, "read past end of message");
+
+        account_op(d, cmd, start);
+
+        if (opt.strip_sounds && cmd == svc_sound)
+            d->job->stripped++;
+        else
+            keep_op(d, start);
+    }
+
+    if (frame)
+        end_frame(d);
+}
+
+/*
+==============================================================================
+
+MULTI VIEW DEMOS
+
+Mirrors MVD_ParseMessage, minus everything related to game state.
+
+==============================================================================
+*/
+
+static void mvd_parse_packet_players(demo_t *d)
+{
+    int bits, number;
+
+    while (1) {
+        if (msg_read.readcount > msg_read.cursize)
+            Com_Error(ERR_DROP, "read past end of message");
+
+        number = MSG_ReadByte();
+        if (number == CLIENTNUM_NONE)
+            break;
+
+        if (number < 0 || number >= d->maxclients)
+            Com_Error(ERR_DROP, "bad player number: %d", number);
+
+        bits = MSG_ReadWord();
+        MSG_ParseDeltaPlayerstate_Packet(&d->players[number], &d->players[number], bits);
+
+        if (bits & PPS_REMOVE) {
+            if (d->playerinuse[number]) {
+                d->playerinuse[number] = false;
+                d->numplayers--;
+            }
+            continue;
+        }
+
+        if (!d->playerinuse[number]) {
+            d->playerinuse[number] = true;
+            d->numplayers++;
+        }
+    }
+}
+
+static void mvd_parse_packet_entities(demo_t *d)
+{
+    int bits, number;
+
+    while (1) {
+        if (msg_read.readcount > msg_read.cursize)
+            Com_Error(ERR_DROP, "read past end of message");
+
+        number = MSG_ParseEntityBits(&bits);
+        if (number < 0 || number >= MAX_EDICTS)
+            Com_Error(ERR_DROP, "bad entity number: %d", number);
+
+        if (!number)
+            break;
+
+        MSG_ParseDeltaEntity(&d->entities[number], &d->entities[number], number, bits, 0);
+
+        if (bits & U_REMOVE) {
+            if (d->inuse[number]) {
+                d->inuse[number] = false;
+                d->numentities--;
+            }
+            continue;
+        }
+
+        if (!d->inuse[number]) {
+            d->inuse[number] = true;
+            d->numentities++;
+        }
+    }
+}
+
+static void mvd_parse_frame(demo_t *d)
+{
+    int length;
+
+    // skip portalbits
+    length = MSG_ReadByte();
+    if (length > MAX_MAP_PORTAL_BYTES)
+        Com_Error(ERR_DROP, "bad portalbits length: %d", length);
+    if (!MSG_ReadData(length))
+        Com_Error(ERR_DROP, "read past end of message");
+
+    mvd_parse_packet_players(d);
+    mvd_parse_packet_entities(d);
+}
+
+static void mvd_parse_serverdata(demo_t *d)
+{
+    char gamedir[MAX_QPATH];
+    int index, minor;
+
+    if (MSG_ReadLong() != PROTOCOL_VERSION_MVD)
+        Com_Error(ERR_DROP, "not an MVD stream");
+
+    minor = MSG_ReadShort();
+    if (!MVD_SUPPORTED(minor))
+        Com_Error(ERR_DROP, "unsupported MVD protocol version %d", minor);
+    d->job->protocol = minor;
+
+    MSG_ReadLong();     // servercount
+    MSG_ReadString(gamedir, sizeof(gamedir));
+    d->clientnum = MSG_ReadShort();
+
+    d->maxclients = 0;
+    while (1) {
+        index = MSG_ReadShort();
+        if (index == MAX_CONFIGSTRINGS)
+            break;
+        read_configstring(d, index);
+        if (msg_read.readcount > msg_read.cursize)
+            Com_Error(ERR_DROP, "read past end of message");
+    }
+
+    if (d->maxclients < 1 || d->maxclients > MAX_CLIENTS)
+        Com_Error(ERR_DROP, "invalid maxclients");
+
+    memset(d->entities, 0, sizeof(d->entities));
+    memset(d->players, 0, sizeof(d->players));
+    memset(d->inuse, 0, sizeof(d->inuse));
+    memset(d->playerinuse, 0, sizeof(d->playerinuse));
+    d->numentities = d->numplayers = 0;
+
+    // baseline frame
+    mvd_parse_frame(d);
+}
+
+// returns true if payload is a single svc_sound to be stripped
+static bool mvd_skip_payload(demo_t *d, int length)
+{
+    byte *data = MSG_ReadData(length);
+
+    if (!data)
+        Com_Error(ERR_DROP, "read past end of message");
+
+    return opt.strip_sounds && length && data[0] == svc_sound;
+}
+
+static void mvd_parse_message(demo_t *d)
+{
+    char string[MAX_STRING_CHARS];
+    size_t start;
+    int cmd, extrabits, length, flags;
+    bool strip, frame = false;
+
+    while (msg_read.readcount < msg_read.cursize) {
+        start = msg_read.readcount;
+        cmd = MSG_ReadByte();
+        extrabits = cmd >> SVCMD_BITS;
+        cmd &= SVCMD_MASK;
+        strip = false;
+
+        switch (cmd) {
+        case mvd_nop:
+            break;
+        case mvd_serverdata:
+            mvd_parse_serverdata(d);
+            break;
+        case mvd_multicast_all:
+        case mvd_multicast_all_r:
+            length = MSG_ReadByte() | (extrabits << 8);
+            strip = mvd_skip_payload(d, length);
+            break;
+        case mvd_multicast_phs:
+        case mvd_multicast_pvs:
+        case mvd_multicast_phs_r:
+        case mvd_multicast_pvs_r:
+            length = MSG_ReadByte() | (extrabits << 8);
+            MSG_ReadWord();     // leafnum
+            strip = mvd_skip_payload(d, length);
+            break;
+        case mvd_unicast:
+        case mvd_unicast_r:
+            length = MSG_ReadByte() | (extrabits << 8);
+            MSG_ReadByte();     // clientnum
+            if (!MSG_ReadData(length))
+                Com_Error(ERR_DROP, "read past end of message");
+            break;
+        case mvd_configstring:
+            read_configstring(d, MSG_ReadShort());
+            break;
+        case mvd_frame:
+            mvd_parse_frame(d);
+            frame = true;
+            break;
+        case mvd_sound:
+            flags = MSG_ReadByte();
+            MSG_ReadByte();
+            if (flags & SND_VOLUME)
+                MSG_ReadByte();
+            if (flags & SND_ATTENUATION)
+                MSG_ReadByte();
+            if (flags & SND_OFFSET)
+                MSG_ReadByte();
+            MSG_ReadShort();
+            strip = opt.strip_sounds;
+            break;
+        case mvd_print:
+            MSG_ReadByte();
+            MSG_ReadString(string, sizeof(string));
+            break;
+        default:
+            Com_Error(ERR_DROP, "illegible command at %zu: %d", start, cmd);
+        }
+
+        if (msg_read.readcount > msg_read.cursize)
+            Com_Error(ERR_DROP, "read past end of message");
+
+        account_op(d, cmd, start);
+
+        if (strip)
+            d->job->stripped++;
+        else
+            keep_op(d, start);
+    }
+
+    if (frame)
+        end_frame(d);
+}
+
+/*
+==============================================================================
+
+FILE PROCESSING
+
+==============================================================================
+*/
+
+static bool read_exact(demo_t *d, void *buf, size_t len)
+{
+    int ret = gzread(d->in, buf, len);
+
+    if (ret < 0)
+        Com_Error(ERR_FATAL, "read error");
+
+    return ret == (int)len;
+}
+
+// returns message length, 0 on end of demo
+static size_t read_message(demo_t *d)
+{
+    uint32_t len32;
+    uint16_t len16;
+    size_t msglen;
+
+    if (d->job->format == FMT_MVD) {
+        if (!read_exact(d, &len16, 2))
+            return 0;
+        msglen = LittleShort(len16);
+    } else {
+        if (!read_exact(d, &len32, 4))
+            return 0;
+        if (len32 == (uint32_t)-1)
+            return 0;
+        msglen = LittleLong(len32);
+    }
+
+    if (!msglen)
+        return 0;
+    if (msglen > MAX_MSGLEN)
+        Com_Error(ERR_DROP, "bad message length: %zu", msglen);
+    if (!read_exact(d, d->inbuf, msglen))
+        Com_Error(ERR_DROP, "unexpected end of file");
+
+    return msglen;
+}
+
+static void open_output(demo_t *d)
+{
+    char name[MAX_OSPATH], path[MAX_OSPATH];
+#ifndef _WIN32
+    struct stat in, out;
+#endif
+    size_t len;
+
+    Q_strlcpy(name, COM_SkipPath(d->job->path), sizeof(name));
+    len = strlen(name);
+    if (len > 3 && !Q_strcasecmp(name + len - 3, ".gz"))
+        name[len - 3] = 0;
+
+    if (Q_concat(path, sizeof(path), opt.outdir, "/", name,
+                 opt.compress ? ".gz" : "") >= sizeof(path))
+        Com_Error(ERR_FATAL, "oversize output path");
+
+#ifndef _WIN32
+    if (!stat(d->job->path, &in) && !stat(path, &out) &&
+        in.st_dev == out.st_dev && in.st_ino == out.st_ino)
+        Com_Error(ERR_FATAL, "output would overwrite input");
+#endif
+
+    d->out = gzopen(path, opt.compress ? "wb9" : "wbT");
+    if (!d->out)
+        Com_Error(ERR_FATAL, "couldn't open %s: %s", path, strerror(errno));
+}
+
+static void open_csv(demo_t *d)
+{
+    char path[MAX_OSPATH];
+
+    if (Q_concat(path, sizeof(path), opt.csvdir, "/",
+                 COM_SkipPath(d->job->path), ".csv") >= sizeof(path))
+        Com_Error(ERR_FATAL, "oversize CSV path");
+
+    d->csv = fopen(path, "w");
+    if (!d->csv)
+        Com_Error(ERR_FATAL, "couldn't open %s: %s", path, strerror(errno));
+}
+
+static void process_demo(demo_t *d)
+{
+    job_t *job = d->job;
+    uint32_t magic;
+    size_t msglen;
+
+    d->in = gzopen(job->path, "rb");
+    if (!d->in)
+        Com_Error(ERR_FATAL, "couldn't open: %s", strerror(errno));
+    gzbuffer(d->in, 0x10000);
+
+    if (!read_exact(d, &magic, 4))
+        Com_Error(ERR_DROP, "file too small");
+
+    if (magic == MVD_MAGIC) {
+        job->format = FMT_MVD;
+    } else {
+        // no magic in client demos, rewind to the first length
+        job->format = FMT_DM2;
+        gzrewind(d->in);
+    }
+
+    if (opt.outdir) {
+        open_output(d);
+        if (job->format == FMT_MVD)
+            write_out(d, &magic, 4);
+    }
+
+    if (opt.csvdir) {
+        open_csv(d);
+        write_csv_header(d);
+    }
+
+    while ((msglen = read_message(d)) > 0) {
+        job->insize += msglen;
+        job->messages++;
+        d->framebytes += msglen;
+
+        SZ_Init(&msg_read, d->inbuf, sizeof(d->inbuf));
+        msg_read.cursize = msglen;
+
+        if (job->format == FMT_MVD)
+            mvd_parse_message(d);
+        else
+            dm2_parse_message(d);
+
+        flush_message(d);
+    }
+
+    // write end of demo marker
+    if (d->out) {
+        if (job->format == FMT_MVD) {
+            uint16_t zero = 0;
+            write_out(d, &zero, 2);
+        } else {
+            uint32_t eof = (uint32_t)-1;
+            write_out(d, &eof, 4);
+        }
+    }
+}
+
+static void run_job(job_t *job)
+{
+    jmp_buf jb;
+    demo_t *d;
+
+    d = calloc(1, sizeof(*d));
+    if (!d) {
+        Q_strlcpy(job->error, "out of memory", sizeof(job->error));
+        return;
+    }
+
+    d->job = job;
+    demo_error = job->error;
+    demo_abort = &jb;
+
+    if (!setjmp(jb))
+        process_demo(d);
+
+    demo_abort = NULL;
+    demo_error = NULL;
+
+    if (d->in)
+        gzclose(d->in);
+    if (d->out && gzclose(d->out) != Z_OK && !job->error[0])
+        Q_strlcpy(job->error, "couldn't close output", sizeof(job->error));
+    if (d->csv)
+        fclose(d->csv);
+    free(d);
+}
+
+static int  job_next;
+
+static void worker_func(void)
+{
+    int i;
+
+    while ((i = q_atomic_add(&job_next, 1)) < numjobs)
+        run_job(&jobs[i]);
+}
+
+#ifdef _WIN32
+
+typedef HANDLE thread_t;
+
+static unsigned __stdcall thread_func(void *arg)
+{
+    worker_func();
+    return 0;
+}
+
+static bool thread_create(thread_t *t)
+{
+    *t = (HANDLE)_beginthreadex(NULL, 0, thread_func, NULL, 0, NULL);
+    return *t != NULL;
+}
+
+static void thread_join(thread_t t)
+{
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+static double get_time(void)
+{
+    LARGE_INTEGER freq, count;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / freq.QuadPart;
+}
+
+static int default_workers(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return max(info.dwNumberOfProcessors, 1);
+}
+
+#else
+
+typedef pthread_t thread_t;
+
+static void *thread_func(void *arg)
+{
+    worker_func();
+    return NULL;
+}
+
+static bool thread_create(thread_t *t)
+{
+    return !pthread_create(t, NULL, thread_func, NULL);
+}
+
+static void thread_join(thread_t t)
+{
+    pthread_join(t, NULL);
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int default_workers(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? n : 1;
+}
+
+#endif
+
+static void run_jobs(void)
+{
+    thread_t *threads;
+    int i, n;
+
+    n = min(opt.workers, numjobs);
+    threads = calloc(n, sizeof(*threads));
+
+    i = 0;
+    if (threads)
+        for (; i < n; i++)
+            if (!thread_create(&threads[i]))
+                break;
+
+    // run on this thread if none could be created
+    if (!i)
+        worker_func();
+
+    while (i--)
+        thread_join(threads[i]);
+
+    free(threads);
+}
+
+/*
+==============================================================================
+
+MAIN
+
+==============================================================================
+*/
+
+static void print_summary(double seconds)
+{
+    const char *const *names;
+    int64_t opcount[2][MAX_OPS] = { { 0 } };
+    int64_t opbytes[2][MAX_OPS] = { { 0 } };
+    int64_t insize = 0, outsize = 0, frames = 0;
+    int i, j, f, failed = 0;
+    job_t *job;
+
+    for (i = 0; i < numjobs; i++) {
+        job = &jobs[i];
+        if (!opt.quiet || job->error[0]) {
+            printf("%s: %s %d %s, %d msgs, %d frames, %"PRId64" bytes",
+                   job->path, job->format == FMT_MVD ? "mvd" : "dm2",
+                   job->protocol, job->mapname[0] ? job->mapname : "?",
+                   job->messages, job->frames, job->insize);
+            if (job->frames)
+                printf(", %.1f/%d ents", (double)job->entities / job->frames,
+                       job->maxentities);
+            if (opt.outdir)
+                printf(", %"PRId64" bytes out, %d stripped", job->outsize, job->stripped);
+            if (job->error[0])
+                printf(", ERROR: %s", job->error);
+            printf("\n");
+        }
+
+        if (job->error[0])
+            failed++;
+
+        f = job->format == FMT_MVD;
+        for (j = 0; j < MAX_OPS; j++) {
+            opcount[f][j] += job->opcount[j];
+            opbytes[f][j] += job->opbytes[j];
+        }
+        insize += job->insize;
+        outsize += job->outsize;
+        frames += job->frames;
+    }
+
+    for (f = 0; f < 2; f++) {
+        names = f ? mvd_names : svc_names;
+        for (j = 0; j < MAX_OPS; j++) {
+            if (!opcount[f][j])
+                continue;
+            printf("%-4s %-20s %10"PRId64" %12"PRId64" %5.1f%%\n",
+                   f ? "mvd" : "dm2", names[j] ? names[j] : "?",
+                   opcount[f][j], opbytes[f][j],
+                   insize ? opbytes[f][j] * 100.0 / insize : 0.0);
+        }
+    }
+
+    printf("%d files (%d failed), %"PRId64" frames, %"PRId64" bytes",
+           numjobs, failed, frames, insize);
+    if (opt.outdir)
+        printf(" -> %"PRId64" bytes", outsize);
+    printf(" in %.3f sec (%.1f MB/s, %.0f frames/s) with %d workers\n",
+           seconds, seconds > 0 ? insize / seconds / (1024 * 1024) : 0.0,
+           seconds > 0 ? frames / seconds : 0.0, min(opt.workers, numjobs));
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <demo> [...]\n"
+            "Parse .dm2 and .mvd2 demos (optionally gzipped) and print statistics.\n"
+            "  -j <count>   number of worker threads (default: number of CPUs)\n"
+            "  -c <dir>     write per-frame statistics to <dir>/<demo>.csv\n"
+            "  -o <dir>     re-encode demos into <dir>\n"
+            "  -S           strip sounds when re-encoding\n"
+            "  -z           gzip re-encoded demos\n"
+            "  -q           only print totals and errors\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    double start;
+    int i;
+
+    opt.workers = default_workers();
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        const char *arg = argv[i];
+
+        if (arg[2])
+            usage(argv[0]);
+
+        switch (arg[1]) {
+        case 'j':
+            if (++i == argc)
+                usage(argv[0]);
+            opt.workers = max(atoi(argv[i]), 1);
+            break;
+        case 'c':
+            if (++i == argc)
+                usage(argv[0]);
+            opt.csvdir = argv[i];
+            break;
+        case 'o':
+            if (++i == argc)
+                usage(argv[0]);
+            opt.outdir = argv[i];
+            break;
+        case 'S':
+            opt.strip_sounds = true;
+            break;
+        case 'z':
+            opt.compress = true;
+            break;
+        case 'q':
+            opt.quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (i == argc)
+        usage(argv[0]);
+
+    numjobs = argc - i;
+    jobs = calloc(numjobs, sizeof(*jobs));
+    if (!jobs) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (i = 0; i < numjobs; i++)
+        jobs[i].path = argv[argc - numjobs + i];
+
+    start = get_time();
+    run_jobs();
+    print_summary(get_time() - start);
+
+    for (i = 0; i < numjobs; i++)
+        if (jobs[i].error[0])
+            return 1;
+
+    return 0;
+}
@@ -37,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <pthread.h>
 
 #if USE_CLIENT
 #include <SDL_video.h>
@@ -44,8 +45,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <SDL.h>
 
 extern SDL_Window *sdl_window;
-
-#include <pthread.h>
 #endif
 
 static char baseDirectory[PATH_MAX];
@@ -60,110 +59,213 @@ static bool flush_logs;
 /*
 ===============================================================================
 
-ASYNC WORK QUEUE
+WORKER POOL
+
+Shared by Sys_ParallelFor batches and async work. Batches take priority
+over async work, and the calling thread helps with its own batch so that
+workers busy with long async jobs don't hold it up. No more than sys_workers
+threads run async work at once.
 
 ===============================================================================
 */
 
-#if USE_CLIENT
+static bool             pool_terminate;
+static pthread_mutex_t  pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   pool_wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   pool_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t        pool_threads[MAX_WORKER_THREADS];
+static int              pool_numthreads;
+static int              pool_wakeups;   // batch slots not yet picked up
+static int              pool_active;    // batch slots not yet finished
+static int              pool_async_busy;    // threads running async work
+static int              pool_async_limit;   // sys_workers
+
+static struct {
+    parallelfunc_t  func;
+    void            *arg;
+    int             count;
+    int             next_index;
+    int             next_slot;
+} pool_batch;
+
+static asyncwork_t      *pend_head, **pend_tail = &pend_head;
+static asyncwork_t      *done_head, **done_tail = &done_head;
+
+static cvar_t           *sys_workers;
+
+static void run_batch(void)
+{
+    int slot = q_atomic_add(&pool_batch.next_slot, 1);
+    int index;
 
-static bool work_initialized;
-static bool work_terminate;
-static pthread_mutex_t work_lock;
-static pthread_cond_t work_cond;
-static pthread_t work_thread;
-static asyncwork_t *pend_head;
-static asyncwork_t *done_head;
+    while ((index = q_atomic_add(&pool_batch.next_index, 1)) < pool_batch.count)
+        pool_batch.func(pool_batch.arg, index, slot);
+}
 
-static void append_work(asyncwork_t **head, asyncwork_t *work)
+// called with pool_lock held
+static void run_work(void)
 {
-    asyncwork_t *c, **p;
-    for (p = head, c = *head; c; p = &c->next, c = c->next);
+    asyncwork_t *work = pend_head;
+
+    if (!(pend_head = work->next))
+        pend_tail = &pend_head;
+
+    pool_async_busy++;
+    pthread_mutex_unlock(&pool_lock);
+    work->work_cb(work->cb_arg);
+    pthread_mutex_lock(&pool_lock);
+    pool_async_busy--;
+
     work->next = NULL;
-    *p = work;
+    *done_tail = work;
+    done_tail = &work->next;
 }
 
-static void complete_work(void)
+// called with pool_lock held
+static bool work_ready(void)
 {
-    asyncwork_t *work, *next;
-
-    if (!work_initialized)
-        return;
-    if (pthread_mutex_trylock(&work_lock))
-        return;
-    if (q_unlikely(done_head)) {
-        for (work = done_head; work; work = next) {
-            next = work->next;
-            if (work->done_cb)
-                work->done_cb(work->cb_arg);
-            Z_Free(work);
-        }
-        done_head = NULL;
-    }
-    pthread_mutex_unlock(&work_lock);
+    return pend_head && pool_async_busy < pool_async_limit;
 }
 
-static void *thread_func(void *arg)
+static void *pool_func(void *arg)
 {
-    pthread_mutex_lock(&work_lock);
+    pthread_mutex_lock(&pool_lock);
     while (1) {
-        while (!pend_head && !work_terminate)
-            pthread_cond_wait(&work_cond, &work_lock);
+        while (!pool_wakeups && !work_ready() && !pool_terminate)
+            pthread_cond_wait(&pool_wake_cond, &pool_lock);
 
-        asyncwork_t *work = pend_head;
-        if (!work)
-            break;
-        pend_head = work->next;
+        if (pool_wakeups) {
+            pool_wakeups--;
 
-        pthread_mutex_unlock(&work_lock);
-        work->work_cb(work->cb_arg);
-        pthread_mutex_lock(&work_lock);
+            pthread_mutex_unlock(&pool_lock);
+            run_batch();
+            pthread_mutex_lock(&pool_lock);
 
-        append_work(&done_head, work);
+            if (!--pool_active)
+                pthread_cond_signal(&pool_done_cond);
+        } else if (work_ready()) {
+            // pending work is finished even when terminating
+            run_work();
+        } else {
+            break;
+        }
     }
-    pthread_mutex_unlock(&work_lock);
+    pthread_mutex_unlock(&pool_lock);
 
     return NULL;
 }
 
-static void shutdown_work(void)
+static bool spawn_threads(int threads)
+{
+    while (pool_numthreads < threads) {
+        if (pthread_create(&pool_threads[pool_numthreads], NULL, pool_func, NULL))
+            break;
+        pool_numthreads++;
+    }
+
+    return pool_numthreads;
+}
+
+// runs done callbacks on main thread
+static void complete_work(void)
+{
+    asyncwork_t *work, *next;
+
+    if (pthread_mutex_trylock(&pool_lock))
+        return;
+    work = done_head;
+    done_head = NULL;
+    done_tail = &done_head;
+    pthread_mutex_unlock(&pool_lock);
+
+    // callbacks may queue more work
+    for (; work; work = next) {
+        next = work->next;
+        if (work->done_cb)
+            work->done_cb(work->cb_arg);
+        Z_Free(work);
+    }
+}
+
+static void shutdown_pool(void)
 {
-    if (!work_initialized)
+    int i;
+
+    if (!pool_numthreads)
         return;
 
-    pthread_mutex_lock(&work_lock);
-    work_terminate = true;
-    pthread_cond_signal(&work_cond);
-    pthread_mutex_unlock(&work_lock);
+    pthread_mutex_lock(&pool_lock);
+    pool_terminate = true;
+    pthread_cond_broadcast(&pool_wake_cond);
+    pthread_mutex_unlock(&pool_lock);
 
-    pthread_join(work_thread, NULL);
-    complete_work();
+    for (i = 0; i < pool_numthreads; i++)
+        pthread_join(pool_threads[i], NULL);
 
-    pthread_mutex_destroy(&work_lock);
-    pthread_cond_destroy(&work_cond);
-    work_initialized = false;
+    pool_numthreads = 0;
+    complete_work();
 }
 
 void Sys_QueueAsyncWork(asyncwork_t *work)
 {
-    if (!work_initialized) {
-        pthread_mutex_init(&work_lock, NULL);
-        pthread_cond_init(&work_cond, NULL);
-        if (pthread_create(&work_thread, NULL, thread_func, NULL))
-            Sys_Error("Couldn't create async work thread");
-        work_initialized = true;
-    }
+    int threads = sys_workers ? sys_workers->integer : 1;
 
-    pthread_mutex_lock(&work_lock);
-    append_work(&pend_head, Z_CopyStruct(work));
-    pthread_cond_signal(&work_cond);
-    pthread_mutex_unlock(&work_lock);
+    clamp(threads, 1, MAX_WORKER_THREADS);
+    if (!spawn_threads(threads))
+        Sys_Error("Couldn't create async work thread");
+
+    pthread_mutex_lock(&pool_lock);
+    pool_async_limit = threads;
+    work = Z_CopyStruct(work);
+    work->next = NULL;
+    *pend_tail = work;
+    pend_tail = &work->next;
+    pthread_cond_signal(&pool_wake_cond);
+    pthread_mutex_unlock(&pool_lock);
 }
 
-#else
-#define shutdown_work() (void)0
-#define complete_work() (void)0
-#endif
+void Sys_ParallelFor(int threads, int count, parallelfunc_t func, void *arg)
+{
+    int i;
+
+    if (count < 1)
+        return;
+
+    clamp(threads, 1, MAX_WORKER_THREADS);
+    if (threads > count)
+        threads = count;
+
+    // run serially if no threads could be created
+    if (threads == 1 || !spawn_threads(threads - 1)) {
+        for (i = 0; i < count; i++)
+            func(arg, i, 0);
+        return;
+    }
+
+    if (threads > pool_numthreads + 1)
+        threads = pool_numthreads + 1;
+
+    pthread_mutex_lock(&pool_lock);
+    pool_batch.func = func;
+    pool_batch.arg = arg;
+    pool_batch.count = count;
+    pool_batch.next_index = 0;
+    pool_batch.next_slot = 0;
+    pool_wakeups = threads - 1;
+    pool_active = threads - 1;
+    pthread_cond_broadcast(&pool_wake_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_batch();
+
+    // all indices are taken now, revoke slots no worker picked up
+    pthread_mutex_lock(&pool_lock);
+    pool_active -= pool_wakeups;
+    pool_wakeups = 0;
+    while (pool_active)
+        pthread_cond_wait(&pool_done_cond, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
 
 /*
 ===============================================================================
@@ -185,6 +287,13 @@ unsigned Sys_Milliseconds(void)
     return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
 /*
 =================
 Sys_Quit
@@ -194,7 +303,7 @@ This function never returns.
 */
 void Sys_Quit(void)
 {
-    shutdown_work();
+    shutdown_pool();
     tty_shutdown_input();
 #if USE_SDL
     SDL_Quit();
@@ -344,6 +453,7 @@ void Sys_Init(void)
     sys_homedir = Cvar_Get("homedir", homegamedir, CVAR_NOSET);
     sys_libdir = Cvar_Get("libdir", baseDirectory, CVAR_NOSET);
     sys_forcegamelib = Cvar_Get("sys_forcegamelib", "", CVAR_NOSET);
+    sys_workers = Cvar_Get("sys_workers", "1", 0);
 
     if (tty_init_input()) {
         signal(SIGHUP, term_handler);
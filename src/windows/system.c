@@ -832,120 +832,229 @@ fail:
 /*
 ===============================================================================
 
-ASYNC WORK QUEUE
+WORKER POOL
+
+Shared by Sys_ParallelFor batches and async work. Batches take priority
+over async work, and the calling thread helps with its own batch so that
+workers busy with long async jobs don't hold it up. No more than sys_workers
+threads run async work at once.
 
 ===============================================================================
 */
 
-#if USE_CLIENT
+static bool             pool_terminate;
+static CRITICAL_SECTION pool_crit;
+static HANDLE           pool_wake_sem;  // released once per batch slot or work
+static HANDLE           pool_done_event;
+static HANDLE           pool_threads[MAX_WORKER_THREADS];
+static int              pool_numthreads;
+static int              pool_wakeups;   // batch slots not yet picked up
+static int              pool_active;    // batch slots not yet finished
+static int              pool_async_busy;    // threads running async work
+static int              pool_async_limit;   // sys_workers
+
+static struct {
+    parallelfunc_t  func;
+    void            *arg;
+    int             count;
+    int             next_index;
+    int             next_slot;
+} pool_batch;
+
+static asyncwork_t      *pend_head, **pend_tail = &pend_head;
+static asyncwork_t      *done_head, **done_tail = &done_head;
+
+static cvar_t           *sys_workers;
+
+static void run_batch(void)
+{
+    int slot = q_atomic_add(&pool_batch.next_slot, 1);
+    int index;
 
-static bool work_initialized;
-static bool work_terminate;
-static CRITICAL_SECTION work_crit;
-static HANDLE work_event;
-static HANDLE work_thread;
-static asyncwork_t *pend_head;
-static asyncwork_t *done_head;
+    while ((index = q_atomic_add(&pool_batch.next_index, 1)) < pool_batch.count)
+        pool_batch.func(pool_batch.arg, index, slot);
+}
 
-static void append_work(asyncwork_t **head, asyncwork_t *work)
+// called with pool_crit held. Wakeups of threads over async work limit are
+// lost, so pending work is drained by threads already running it.
+static void run_work(void)
 {
-    asyncwork_t *c, **p;
-    for (p = head, c = *head; c; p = &c->next, c = c->next);
-    work->next = NULL;
-    *p = work;
+    asyncwork_t *work;
+
+    pool_async_busy++;
+    while ((work = pend_head)) {
+        if (!(pend_head = work->next))
+            pend_tail = &pend_head;
+
+        LeaveCriticalSection(&pool_crit);
+        work->work_cb(work->cb_arg);
+        EnterCriticalSection(&pool_crit);
+
+        work->next = NULL;
+        *done_tail = work;
+        done_tail = &work->next;
+    }
+    pool_async_busy--;
 }
 
-static void complete_work(void)
+// semaphore may be left signaled by revoked batch slots,
+// so wakeups with nothing to do are normal
+static DWORD WINAPI pool_func(LPVOID arg)
 {
-    asyncwork_t *work, *next;
+    while (1) {
+        if (WaitForSingleObject(pool_wake_sem, INFINITE))
+            return 1;
 
-    if (!work_initialized)
-        return;
-    if (!TryEnterCriticalSection(&work_crit))
-        return;
-    if (q_unlikely(done_head)) {
-        for (work = done_head; work; work = next) {
-            next = work->next;
-            if (work->done_cb)
-                work->done_cb(work->cb_arg);
-            Z_Free(work);
+        EnterCriticalSection(&pool_crit);
+        if (pool_wakeups) {
+            pool_wakeups--;
+
+            LeaveCriticalSection(&pool_crit);
+            run_batch();
+            EnterCriticalSection(&pool_crit);
+
+            if (!--pool_active)
+                SetEvent(pool_done_event);
+        } else if (pend_head && pool_async_busy < pool_async_limit) {
+            // pending work is finished even when terminating
+            run_work();
+        } else if (pool_terminate) {
+            LeaveCriticalSection(&pool_crit);
+            break;
         }
-        done_head = NULL;
+        LeaveCriticalSection(&pool_crit);
     }
-    LeaveCriticalSection(&work_crit);
+
+    return 0;
 }
 
-static DWORD WINAPI thread_func(LPVOID arg)
+static bool spawn_threads(int threads)
 {
-    EnterCriticalSection(&work_crit);
-    while (1) {
-        while (!pend_head && !work_terminate) {
-            LeaveCriticalSection(&work_crit);
-            if (WaitForSingleObject(work_event, INFINITE))
-                return 1;
-            EnterCriticalSection(&work_crit);
-        }
+    if (!pool_wake_sem) {
+        InitializeCriticalSection(&pool_crit);
+        pool_wake_sem = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+        pool_done_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (!pool_wake_sem || !pool_done_event)
+            Sys_Error("Couldn't create worker thread pool");
+    }
 
-        asyncwork_t *work = pend_head;
-        if (!work)
+    while (pool_numthreads < threads) {
+        HANDLE thread = CreateThread(NULL, 0, pool_func, NULL, 0, NULL);
+        if (!thread)
             break;
-        pend_head = work->next;
+        pool_threads[pool_numthreads++] = thread;
+    }
 
-        LeaveCriticalSection(&work_crit);
-        work->work_cb(work->cb_arg);
-        EnterCriticalSection(&work_crit);
+    return pool_numthreads;
+}
 
-        append_work(&done_head, work);
-    }
-    LeaveCriticalSection(&work_crit);
+// runs done callbacks on main thread
+static void complete_work(void)
+{
+    asyncwork_t *work, *next;
 
-    return 0;
+    if (!pool_wake_sem)
+        return;
+    if (!TryEnterCriticalSection(&pool_crit))
+        return;
+    work = done_head;
+    done_head = NULL;
+    done_tail = &done_head;
+    LeaveCriticalSection(&pool_crit);
+
+    // callbacks may queue more work
+    for (; work; work = next) {
+        next = work->next;
+        if (work->done_cb)
+            work->done_cb(work->cb_arg);
+        Z_Free(work);
+    }
 }
 
-static void shutdown_work(void)
+static void shutdown_pool(void)
 {
-    if (!work_initialized)
+    if (!pool_numthreads)
         return;
 
-    EnterCriticalSection(&work_crit);
-    work_terminate = true;
-    LeaveCriticalSection(&work_crit);
+    EnterCriticalSection(&pool_crit);
+    pool_terminate = true;
+    LeaveCriticalSection(&pool_crit);
 
-    SetEvent(work_event);
+    ReleaseSemaphore(pool_wake_sem, pool_numthreads, NULL);
+    WaitForMultipleObjects(pool_numthreads, pool_threads, TRUE, INFINITE);
 
-    WaitForSingleObject(work_thread, INFINITE);
-    complete_work();
+    while (pool_numthreads)
+        CloseHandle(pool_threads[--pool_numthreads]);
 
-    DeleteCriticalSection(&work_crit);
-    CloseHandle(work_event);
-    CloseHandle(work_thread);
-    work_initialized = false;
+    complete_work();
 }
 
 void Sys_QueueAsyncWork(asyncwork_t *work)
 {
-    if (!work_initialized) {
-        InitializeCriticalSection(&work_crit);
-        work_event = CreateEvent(NULL, FALSE, FALSE, NULL);
-        if (!work_event)
-            Sys_Error("Couldn't create async work event");
-        work_thread = CreateThread(NULL, 0, thread_func, NULL, 0, NULL);
-        if (!work_thread)
-            Sys_Error("Couldn't create async work thread");
-        work_initialized = true;
-    }
-
-    EnterCriticalSection(&work_crit);
-    append_work(&pend_head, Z_CopyStruct(work));
-    LeaveCriticalSection(&work_crit);
-
-    SetEvent(work_event);
+    int threads = sys_workers ? sys_workers->integer : 1;
+
+    clamp(threads, 1, MAX_WORKER_THREADS);
+    if (!spawn_threads(threads))
+        Sys_Error("Couldn't create async work thread");
+
+    EnterCriticalSection(&pool_crit);
+    pool_async_limit = threads;
+    work = Z_CopyStruct(work);
+    work->next = NULL;
+    *pend_tail = work;
+    pend_tail = &work->next;
+    LeaveCriticalSection(&pool_crit);
+
+    ReleaseSemaphore(pool_wake_sem, 1, NULL);
 }
 
-#else
-#define shutdown_work() (void)0
-#define complete_work() (void)0
-#endif
+void Sys_ParallelFor(int threads, int count, parallelfunc_t func, void *arg)
+{
+    int i;
+
+    if (count < 1)
+        return;
+
+    clamp(threads, 1, MAX_WORKER_THREADS);
+    if (threads > count)
+        threads = count;
+
+    // run serially if no threads could be created
+    if (threads == 1 || !spawn_threads(threads - 1)) {
+        for (i = 0; i < count; i++)
+            func(arg, i, 0);
+        return;
+    }
+
+    if (threads > pool_numthreads + 1)
+        threads = pool_numthreads + 1;
+
+    EnterCriticalSection(&pool_crit);
+    pool_batch.func = func;
+    pool_batch.arg = arg;
+    pool_batch.count = count;
+    pool_batch.next_index = 0;
+    pool_batch.next_slot = 0;
+    pool_wakeups = threads - 1;
+    pool_active = threads - 1;
+    LeaveCriticalSection(&pool_crit);
+
+    ReleaseSemaphore(pool_wake_sem, threads - 1, NULL);
+
+    run_batch();
+
+    // all indices are taken now, revoke slots no worker picked up.
+    // done event is set unless revoking finished the batch.
+    EnterCriticalSection(&pool_crit);
+    i = pool_wakeups;
+    pool_active -= pool_wakeups;
+    pool_wakeups = 0;
+    i = pool_active || !i;
+    LeaveCriticalSection(&pool_crit);
+
+    if (i)
+        WaitForSingleObject(pool_done_event, INFINITE);
+}
 
 /*
 ===============================================================================
@@ -1027,7 +1136,7 @@ This function never returns.
 */
 void Sys_Quit(void)
 {
-    shutdown_work();
+    shutdown_pool();
 
 #if USE_CLIENT
 #if USE_SYSCON
@@ -1057,6 +1166,14 @@ unsigned Sys_Milliseconds(void)
     return tm.QuadPart * 1000ULL / timer_freq.QuadPart;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    LARGE_INTEGER tm;
+    QueryPerformanceCounter(&tm);
+    return tm.QuadPart / timer_freq.QuadPart * 1000000ULL +
+           tm.QuadPart % timer_freq.QuadPart * 1000000ULL / timer_freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }
@@ -1096,6 +1213,7 @@ void Sys_Init(void)
     sys_homedir = Cvar_Get("homedir", "", CVAR_NOSET);
 
     sys_forcegamelib = Cvar_Get("sys_forcegamelib", "", CVAR_NOSET);
+    sys_workers = Cvar_Get("sys_workers", "1", 0);
 
 #if USE_WINSVC
     Cmd_AddCommand("installservice", Sys_InstallService_f);